@@ -30,7 +30,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 // The internal item type. This is used as both the value type and the key
 // type, and can be pretty much anything.
@@ -143,10 +145,11 @@ Visit https://github.com/tidwall/bgen for more information.
 
 // A path hint is a search optimization.
 // It's most useful when bsearching, and is turned on by default when
-// BGEN_BSEARCH is provided.
+// BGEN_BSEARCH is provided, unless BGEN_SIMDKEY or a spatial curve is too.
 // This implementation uses one thread local path hint per each btree namespace.
 // See https://github.com/tidwall/btree/blob/master/PATH_HINT.md
-#if defined(BGEN_BSEARCH) && BGEN_FANOUT < 256
+#if defined(BGEN_BSEARCH) && BGEN_FANOUT < 256 && !defined(BGEN_SIMDKEY) && \
+    !defined(BGEN_HILBERT) && !defined(BGEN_ZORDER)
 #ifndef BGEN_PATHHINT
 #define BGEN_PATHHINT
 #endif
@@ -155,13 +158,147 @@ Visit https://github.com/tidwall/bgen for more information.
 #undef BGEN_PATHHINT
 #endif
 
+// Software prefetching.
+// When BGEN_PREFETCH is defined, each node searched while descending the tree
+// is loaded into cache all at once, and the scans and iterators begin loading
+// the next sibling node while the current one is visited. This helps most on
+// trees that are much larger than the CPU cache.
+// BGEN_CACHELINE is the cache line size used for prefetching.
+#ifndef BGEN_CACHELINE
+#define BGEN_CACHELINE 64
+#endif
+
+// Hot path counters.
+// When BGEN_STATS is defined, the tree functions count their compares, node
+// visits, path hint hits and misses, splits, merges, copy-on-write copies, and
+// nearby queue growths. The counters are thread local, so that counting has
+// no contention, and are shared by all trees in the namespace.
+// Use stats() to read the counters of the calling thread and stats_reset() to
+// zero them.
+
+// Split key layout for keyed collections.
+// When BGEN_SOA is defined along with BGEN_KEYED, each node also stores a copy
+// of its item keys in a separate contiguous array, and the node searches only
+// touch that array. This keeps searches cache friendly when the items are
+// much larger than their keys. The items themselves are unchanged.
+#ifdef BGEN_SOA
+#if !defined(BGEN_KEYED) || defined(BGEN_NOORDER)
+#error \
+BGEN_SOA requires BGEN_KEYED and cannot be used with BGEN_NOORDER. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#endif
+
+// Spatial curve ordering.
+// When BGEN_HILBERT or BGEN_ZORDER is defined along with BGEN_SPATIAL, items
+// are ordered by where the center of their rectangle falls on a Hilbert curve
+// or a Z-order curve, and then by BGEN_COMPARE or BGEN_LESS. Items that are
+// close together in space then share nodes, which keeps the node rectangles
+// small so that intersects and nearby visit far fewer nodes.
+// BGEN_CURVERECT sets the min and max of the space that is mapped onto the
+// curve, such as for longitudes and latitudes:
+//
+//     #define BGEN_CURVERECT {min[0]=-180; min[1]=-90; max[0]=180; max[1]=90;}
+//
+// Rectangles outside of that space are clamped to its edges.
+// The key passed to get, delete, and the like must have the same rectangle as
+// the item it's looking for.
+// Each node keeps the curve index of its items next to them, and a descent
+// computes the index of its key once, so that the node searches compare
+// integers and only call BGEN_COMPARE or BGEN_LESS when two indexes tie.
+// Path hints are not used with a curve.
+#if defined(BGEN_HILBERT) || defined(BGEN_ZORDER)
+#define BGEN_CURVE
+#if defined(BGEN_HILBERT) && defined(BGEN_ZORDER)
+#error \
+BGEN_HILBERT and BGEN_ZORDER cannot be both defined. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#if !defined(BGEN_SPATIAL) || !defined(BGEN_CURVERECT)
+#error \
+BGEN_HILBERT and BGEN_ZORDER require BGEN_SPATIAL and BGEN_CURVERECT. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#if defined(BGEN_NOORDER) || defined(BGEN_SOA) || defined(BGEN_SIMDKEY) || \
+    defined(BGEN_MAYBELESSEQUAL) || defined(BGEN_PATHHINT)
+#error \
+BGEN_HILBERT and BGEN_ZORDER cannot be used with BGEN_NOORDER, BGEN_SOA, \
+BGEN_SIMDKEY, BGEN_MAYBELESSEQUAL, or BGEN_PATHHINT. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#endif
+
+// SIMD key search.
+// For primitive item types the node search can compare the key against many
+// items at once, without calling the compare function.
+// Set BGEN_SIMDKEY to the item type, which must be one of u32, i32, u64, i64,
+// or f64. Such as:
+//
+//     #define BGEN_TYPE    uint64_t
+//     #define BGEN_SIMDKEY u64
+//
+// The compare function is still required, and it must agree with the natural
+// numeric order of the items. NaNs are not supported for f64.
+// For keyed collections using BGEN_SOA, set BGEN_SIMDKEY to the key type.
+// It cannot be combined with BGEN_PATHHINT, which would bypass the vector
+// search.
+#define BGEN_SIMDKEY_u32 1
+#define BGEN_SIMDKEY_i32 2
+#define BGEN_SIMDKEY_u64 3
+#define BGEN_SIMDKEY_i64 4
+#define BGEN_SIMDKEY_f64 5
+#ifdef BGEN_SIMDKEY
+#define BGEN_SKIND BGEN_C(BGEN_SIMDKEY_, BGEN_SIMDKEY)
+#if BGEN_SKIND < 1 || BGEN_SKIND > 5
+#error \
+BGEN_SIMDKEY must be one of u32, i32, u64, i64, or f64. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#if defined(BGEN_NOORDER) || (defined(BGEN_KEYED) && !defined(BGEN_SOA))
+#error \
+BGEN_SIMDKEY cannot be used with BGEN_NOORDER, or BGEN_KEYED without BGEN_SOA. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#ifdef BGEN_PATHHINT
+#error \
+BGEN_SIMDKEY cannot be used with BGEN_PATHHINT. \
+Visit https://github.com/tidwall/bgen for more information.
+#endif
+#endif
+
 // Convenient aliases to common types
 #define BGEN_NODE struct BGEN_NAME
 #define BGEN_ITEM BGEN_TYPE
 #define BGEN_ITER struct BGEN_API(iter)
+#define BGEN_VROOT struct BGEN_API(vroot)
+#define BGEN_TREE struct BGEN_API(tree)
+#define BGEN_CIMAGE struct BGEN_API(cimage)
+#define BGEN_NEIGHBOR struct BGEN_API(neighbor)
+#define BGEN_COUNTERS struct BGEN_API(stats)
 #define BGEN_SNODE struct BGEN_SYM(snode)
 #define BGEN_RECT struct BGEN_SYM(rect)
 
+// Alignment of a type, in both C and C++.
+#ifdef __cplusplus
+#define BGEN_ALIGNOF(type) alignof(type)
+#else
+#define BGEN_ALIGNOF(type) _Alignof(type)
+#endif
+
+// Atomics. These come from <stdatomic.h> in C, and from <atomic> in C++,
+// which has no <stdatomic.h> before C++23. Their names are always spelled
+// with BGEN_STD, so that nothing is added to the global namespace of a C++
+// includer.
+#ifdef __cplusplus
+#define BGEN_STDATOMIC <atomic>
+#define BGEN_STD std::
+#define BGEN_ATOMIC(type) std::atomic<type>
+#else
+#define BGEN_STDATOMIC <stdatomic.h>
+#define BGEN_STD
+#define BGEN_ATOMIC(type) _Atomic(type)
+#endif
+
 // Definitions
 
 // The following status codes are private to this file only.
@@ -178,6 +315,7 @@ Visit https://github.com/tidwall/bgen for more information.
 #define BGEN_COPIED      9  // Tree was copied: `clone`, `copy`
 #define BGEN_NOMEM       10 // Out of memory
 #define BGEN_UNSUPPORTED 11 // Operation not supported
+#define BGEN_IOERROR     12 // File could not be read or written
 
 enum BGEN_API(status) {
     BGEN_C(BGEN_NAME, _INSERTED)    = BGEN_INSERTED,
@@ -191,10 +329,41 @@ enum BGEN_API(status) {
     BGEN_C(BGEN_NAME, _COPIED)      = BGEN_COPIED,
     BGEN_C(BGEN_NAME, _NOMEM)       = BGEN_NOMEM,
     BGEN_C(BGEN_NAME, _UNSUPPORTED) = BGEN_UNSUPPORTED,
+    BGEN_C(BGEN_NAME, _IOERROR)     = BGEN_IOERROR,
 };
 
 BGEN_NODE;
 BGEN_ITER;
+BGEN_VROOT;
+BGEN_CIMAGE;
+
+#ifdef BGEN_ARENA
+// A tree and its arena, for BGEN_ARENA. The functions are called with the
+// address of the root, &tree->root, and a zeroed tree is empty.
+struct BGEN_SYM(arena);
+BGEN_TREE {
+    BGEN_NODE *root;               // first, so the root leads to the arena
+    struct BGEN_SYM(arena) *arena; // created with the first node
+};
+#endif
+
+// A nearby item and its distance, for the k nearest neighbor functions.
+BGEN_NEIGHBOR {
+    BGEN_ITEM item;
+    BGEN_RTYPE dist;
+};
+
+// Counters for BGEN_STATS.
+BGEN_COUNTERS {
+    size_t compares;    // key compares while searching nodes
+    size_t visits;      // nodes visited by searches, scans, and queries
+    size_t hint_hits;   // searches that were resolved by the path hint
+    size_t hint_misses; // searches that needed more than the path hint
+    size_t splits;      // nodes split in two
+    size_t merges;      // nodes merged with a sibling
+    size_t cow_copies;  // shared nodes copied by copy-on-write
+    size_t heap_grows;  // growths of the nearby priority queue
+};
 
 BGEN_EXTERN int BGEN_API(get)(BGEN_NODE **root, BGEN_ITEM key,
     BGEN_ITEM *item_out, void *udata);
@@ -218,6 +387,21 @@ BGEN_EXTERN int BGEN_API(push_front)(BGEN_NODE **root, BGEN_ITEM item,
     void *udata);
 BGEN_EXTERN int BGEN_API(push_back)(BGEN_NODE **root, BGEN_ITEM item,
     void *udata);
+BGEN_EXTERN int BGEN_API(load_sorted)(BGEN_NODE **root,
+    const BGEN_ITEM *items, size_t n, double fill_factor, void *udata);
+BGEN_EXTERN int BGEN_API(load)(BGEN_NODE **root, const BGEN_ITEM *items,
+    size_t n, double fill_factor, void *udata);
+BGEN_EXTERN int BGEN_API(get_many)(BGEN_NODE **root, const BGEN_ITEM *keys,
+    size_t nkeys, BGEN_ITEM *items_out, int *statuses, void *udata);
+BGEN_EXTERN int BGEN_API(insert_many)(BGEN_NODE **root,
+    const BGEN_ITEM *items, size_t nitems, BGEN_ITEM *olditems, int *statuses,
+    void *udata);
+BGEN_EXTERN int BGEN_API(split_at)(BGEN_NODE **root, BGEN_ITEM key,
+    BGEN_NODE **right, void *udata);
+BGEN_EXTERN int BGEN_API(join)(BGEN_NODE **left, BGEN_NODE **right,
+    void *udata);
+BGEN_EXTERN int BGEN_API(delete_range)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, void *udata);
 
 BGEN_EXTERN int BGEN_API(copy)(BGEN_NODE **root, BGEN_NODE **newroot,
     void *udata);
@@ -226,6 +410,40 @@ BGEN_EXTERN int BGEN_API(clone)(BGEN_NODE **root, BGEN_NODE **newroot,
 BGEN_EXTERN int BGEN_API(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata);
 BGEN_EXTERN bool BGEN_API(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata);
 
+// Versioned roots for concurrent readers and a single writer (requires COW)
+BGEN_EXTERN void BGEN_API(vroot_init)(BGEN_VROOT *vroot, BGEN_NODE **root);
+BGEN_EXTERN void BGEN_API(vroot_destroy)(BGEN_VROOT *vroot, void *udata);
+BGEN_EXTERN int BGEN_API(vroot_acquire)(BGEN_VROOT *vroot,
+    BGEN_NODE **snapshot);
+BGEN_EXTERN void BGEN_API(vroot_release)(BGEN_VROOT *vroot,
+    BGEN_NODE **snapshot, void *udata);
+BGEN_EXTERN int BGEN_API(vroot_begin)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata);
+BGEN_EXTERN void BGEN_API(vroot_publish)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata);
+BGEN_EXTERN void BGEN_API(vroot_abort)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata);
+
+// Tree images that are mapped into memory (open requires BGEN_MAPPED)
+BGEN_EXTERN int BGEN_API(save)(BGEN_NODE **root, FILE *file, void *udata);
+BGEN_EXTERN int BGEN_API(open_mapped)(BGEN_NODE **root, const char *path,
+    bool checkleaves);
+BGEN_EXTERN void BGEN_API(close_mapped)(BGEN_NODE **root);
+
+// Tree images with compressed leaves (requires BGEN_LZ4, open also requires
+// BGEN_MAPPED)
+BGEN_EXTERN int BGEN_API(save_compressed)(BGEN_NODE **root, FILE *file,
+    void *udata);
+BGEN_EXTERN int BGEN_API(open_compressed)(BGEN_CIMAGE **image,
+    const char *path, size_t cachesize);
+BGEN_EXTERN void BGEN_API(close_compressed)(BGEN_CIMAGE **image);
+BGEN_EXTERN int BGEN_API(cimage_get)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    BGEN_ITEM *item_out, void *udata);
+BGEN_EXTERN int BGEN_API(cimage_seek)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    bool(*iter)(BGEN_ITEM item, void *udata), void *udata);
+BGEN_EXTERN int BGEN_API(cimage_scan)(BGEN_CIMAGE *image,
+    bool(*iter)(BGEN_ITEM item, void *udata), void *udata);
+
 // Optimized for counted B-trees (works with indexes) (rank=index_of,
 // select=get_at)
 BGEN_EXTERN int BGEN_API(insert_at)(BGEN_NODE **root, size_t index,
@@ -239,6 +457,8 @@ BGEN_EXTERN int BGEN_API(get_at)(BGEN_NODE **root, size_t index,
 BGEN_EXTERN int BGEN_API(index_of)(BGEN_NODE **root, BGEN_ITEM key,
     size_t *index, void *udata);
 BGEN_EXTERN size_t BGEN_API(count)(BGEN_NODE **root, void *udata);
+BGEN_EXTERN size_t BGEN_API(count_range)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, void *udata);
 
 // Cursor Iterators
 BGEN_EXTERN void BGEN_API(iter_init)(BGEN_NODE **root, BGEN_ITER *iter,
@@ -256,6 +476,9 @@ BGEN_EXTERN void BGEN_API(iter_scan)(BGEN_ITER *iter);
 BGEN_EXTERN void BGEN_API(iter_scan_desc)(BGEN_ITER *iter);
 BGEN_EXTERN void BGEN_API(iter_intersects)(BGEN_ITER *iter, BGEN_RTYPE min[],
     BGEN_RTYPE max[]);
+BGEN_EXTERN void BGEN_API(iter_nearby_k)(BGEN_ITER *iter, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf);
 BGEN_EXTERN void BGEN_API(iter_nearby)(BGEN_ITER *iter, void *target,
     BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS], 
     void *target, void *udata));
@@ -274,6 +497,24 @@ BGEN_EXTERN int BGEN_API(seek_desc)(BGEN_NODE **root, BGEN_ITEM key,
 BGEN_EXTERN int BGEN_API(intersects)(BGEN_NODE **root,
     BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
         bool(*iter)(BGEN_ITEM item, void *udata), void *udata);
+BGEN_EXTERN int BGEN_API(scan_parallel)(BGEN_NODE **root, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata);
+BGEN_EXTERN int BGEN_API(seek_parallel)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata);
+BGEN_EXTERN int BGEN_API(count_parallel)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    size_t *count, void *udata);
+BGEN_EXTERN int BGEN_API(intersects_parallel)(BGEN_NODE **root,
+    BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS], int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata);
+BGEN_EXTERN size_t BGEN_API(nearby_k)(BGEN_NODE **root, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf, void *udata);
 BGEN_EXTERN int BGEN_API(nearby)(BGEN_NODE **root, void *target,
     BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS], 
     void *target, void *udata), bool(*iter)(BGEN_ITEM item, void *udata), 
@@ -298,6 +539,8 @@ BGEN_EXTERN bool BGEN_API(feat_pathhint)(void);
 BGEN_EXTERN int BGEN_API(feat_dims)(void);
 
 BGEN_EXTERN size_t BGEN_API(height)(BGEN_NODE **root, void *udata);
+BGEN_EXTERN void BGEN_API(stats)(BGEN_COUNTERS *stats);
+BGEN_EXTERN void BGEN_API(stats_reset)(void);
 BGEN_EXTERN bool BGEN_API(sane)(BGEN_NODE **root, void *udata);
 
 BGEN_EXTERN void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS], 
@@ -340,52 +583,72 @@ BGEN_EXTERN int BGEN_API(seek_at_desc_mut)(BGEN_NODE **root, size_t index,
 
 // IMPLEMENTATION
 
+#ifdef BGEN_STATS
+static __thread BGEN_COUNTERS BGEN_SYM(tstats);
+#define BGEN_STAT(name) (BGEN_SYM(tstats).name++)
+#define BGEN_STATN(name, n) (BGEN_SYM(tstats).name += (n))
+#else
+#define BGEN_STAT(name) (void)0
+#define BGEN_STATN(name, n) (void)0
+#endif
+
 #ifdef BGEN_LESS
 #ifdef BGEN_COMPARE
 #error \
 BGEN_COMPARE and BGEN_LESS cannot be both defined
 #endif
+#endif
+
+// With a spatial curve the items are first ordered by their curve index, and
+// the user compare only breaks the ties.
+#ifdef BGEN_CURVE
+#define BGEN_CMPSYM(name) BGEN_SYM(BGEN_C(name, _ties))
+#else
+#define BGEN_CMPSYM(name) BGEN_SYM(name)
+#endif
+
+#ifdef BGEN_LESS
 #ifdef BGEN_KEYED
 // Using nested compare for keyed collection type
-static bool BGEN_SYM(less)(BGEN_ITEM a2, BGEN_ITEM b2, void *udata) {
+static bool BGEN_CMPSYM(less)(BGEN_ITEM a2, BGEN_ITEM b2, void *udata) {
     BGEN_KEYTYPE a = a2.key, b = b2.key;
     (void)a, (void)b, (void)udata;
     BGEN_LESS
 }
 #else
-static bool BGEN_SYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+static bool BGEN_CMPSYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
     (void)a, (void)b, (void)udata;
     BGEN_LESS
 }
 #endif
-static int BGEN_SYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
-    return BGEN_SYM(less)(a, b, udata) ? -1 :
-           BGEN_SYM(less)(b, a, udata) ? 1 :
+static int BGEN_CMPSYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+    return BGEN_CMPSYM(less)(a, b, udata) ? -1 :
+           BGEN_CMPSYM(less)(b, a, udata) ? 1 :
            0;
 }
 #elif defined(BGEN_COMPARE)
 #ifdef BGEN_KEYED
 // Using nested compare for keyed collection type
-static int BGEN_SYM(compare)(BGEN_ITEM a2, BGEN_ITEM b2, void *udata) {
+static int BGEN_CMPSYM(compare)(BGEN_ITEM a2, BGEN_ITEM b2, void *udata) {
     BGEN_KEYTYPE a = a2.key, b = b2.key;
     (void)a, (void)b, (void)udata;
     BGEN_COMPARE
 }
 #else
-static int BGEN_SYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+static int BGEN_CMPSYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
     (void)a, (void)b, (void)udata;
     BGEN_COMPARE
 }
 #endif
-static bool BGEN_SYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
-    return BGEN_SYM(compare)(a, b, udata) < 0;
+static bool BGEN_CMPSYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+    return BGEN_CMPSYM(compare)(a, b, udata) < 0;
 }
 #else
-static bool BGEN_SYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+static bool BGEN_CMPSYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
     (void)a, (void)b, (void)udata;
     return false;
 }
-static int BGEN_SYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+static int BGEN_CMPSYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
     (void)a, (void)b, (void)udata;
     return -1;
 }
@@ -397,12 +660,60 @@ Visit https://github.com/tidwall/bgen for more information.
 #endif
 #endif
 
+#ifdef BGEN_CURVE
+static int BGEN_SYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata);
+static bool BGEN_SYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata);
+#endif
+
 #if defined(BGEN_NOORDER) && (defined(BGEN_LESS) || defined(BGEN_COMPARE))
 #error \
 Neither BGEN_COMPARE nor BGEN_LESS are allowed when BGEN_NOORDER is defined. \
 Visit https://github.com/tidwall/bgen for more information.
 #endif
 
+// The keys searched in each node are the items themselves, or only the item
+// keys when BGEN_SOA is used.
+#ifdef BGEN_SOA
+#define BGEN_KEY BGEN_KEYTYPE
+#ifdef BGEN_LESS
+BGEN_INLINE
+static bool BGEN_SYM(less_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    (void)a, (void)b, (void)udata;
+    BGEN_STAT(compares);
+    BGEN_LESS
+}
+BGEN_INLINE
+static int BGEN_SYM(compare_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    return BGEN_SYM(less_key)(a, b, udata) ? -1 :
+           BGEN_SYM(less_key)(b, a, udata) ? 1 :
+           0;
+}
+#else
+BGEN_INLINE
+static int BGEN_SYM(compare_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    (void)a, (void)b, (void)udata;
+    BGEN_STAT(compares);
+    BGEN_COMPARE
+}
+BGEN_INLINE
+static bool BGEN_SYM(less_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    return BGEN_SYM(compare_key)(a, b, udata) < 0;
+}
+#endif
+#else
+#define BGEN_KEY BGEN_ITEM
+BGEN_INLINE
+static int BGEN_SYM(compare_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    BGEN_STAT(compares);
+    return BGEN_SYM(compare)(a, b, udata);
+}
+BGEN_INLINE
+static bool BGEN_SYM(less_key)(BGEN_KEY a, BGEN_KEY b, void *udata) {
+    BGEN_STAT(compares);
+    return BGEN_SYM(less)(a, b, udata);
+}
+#endif
+
 #ifdef BGEN_MAYBELESSEQUAL
 static bool BGEN_SYM(maybelessequal)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
     (void)a, (void)b, (void)udata;
@@ -434,6 +745,88 @@ static BGEN_RECT BGEN_SYM(item_rect)(BGEN_ITEM item, void *udata) {
 }
 #endif
 
+#ifdef BGEN_CURVE
+#include <stdint.h>
+
+// Bits of each dimension in a curve index.
+#if BGEN_DIMS > 32
+#error \
+BGEN_HILBERT and BGEN_ZORDER allow up to 32 dimensions. \
+Visit https://github.com/tidwall/bgen for more information.
+#elif BGEN_DIMS == 1
+#define BGEN_CURVEBITS 32
+#else
+#define BGEN_CURVEBITS (64/BGEN_DIMS)
+#endif
+
+// Returns the index of the center of the item rectangle on the curve.
+static uint64_t BGEN_SYM(curve_index)(BGEN_ITEM item, void *udata) {
+    BGEN_RECT rect = BGEN_SYM(item_rect)(item, udata);
+    BGEN_RTYPE min[BGEN_DIMS] = { 0 };
+    BGEN_RTYPE max[BGEN_DIMS] = { 0 };
+    BGEN_CURVERECT
+    const uint64_t top = ((uint64_t)1 << BGEN_CURVEBITS) - 1;
+    uint64_t x[BGEN_DIMS];
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        double c = ((double)rect.min[i] + (double)rect.max[i]) / 2;
+        double t = (c - (double)min[i]) / ((double)max[i] - (double)min[i]);
+        t = t > 0 ? t : 0; // also NaN
+        t = t < 1 ? t : 1;
+        x[i] = (uint64_t)(t * (double)top);
+    }
+#ifdef BGEN_HILBERT
+    // Convert the coordinates into the transposed Hilbert index.
+    // From "Programming the Hilbert curve" by John Skilling (2004).
+    const uint64_t m = (uint64_t)1 << (BGEN_CURVEBITS-1);
+    for (uint64_t q = m; q > 1; q >>= 1) {
+        uint64_t p = q - 1;
+        for (int i = 0; i < BGEN_DIMS; i++) {
+            if (x[i] & q) {
+                x[0] ^= p;
+            } else {
+                uint64_t t = (x[0] ^ x[i]) & p;
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
+    }
+    for (int i = 1; i < BGEN_DIMS; i++) {
+        x[i] ^= x[i-1];
+    }
+    uint64_t t = 0;
+    for (uint64_t q = m; q > 1; q >>= 1) {
+        if (x[BGEN_DIMS-1] & q) {
+            t ^= q - 1;
+        }
+    }
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        x[i] ^= t;
+    }
+#endif
+    // Interleave the bits, most significant first.
+    uint64_t index = 0;
+    for (int j = BGEN_CURVEBITS-1; j >= 0; j--) {
+        for (int i = 0; i < BGEN_DIMS; i++) {
+            index = (index << 1) | ((x[i] >> j) & 1);
+        }
+    }
+    return index;
+}
+
+static int BGEN_SYM(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+    uint64_t ia = BGEN_SYM(curve_index)(a, udata);
+    uint64_t ib = BGEN_SYM(curve_index)(b, udata);
+    if (ia != ib) {
+        return ia < ib ? -1 : 1;
+    }
+    return BGEN_SYM(compare_ties)(a, b, udata);
+}
+
+static bool BGEN_SYM(less)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
+    return BGEN_SYM(compare)(a, b, udata) < 0;
+}
+#endif
+
 static bool BGEN_SYM(item_copy)(BGEN_ITEM item, BGEN_ITEM *copy, void *udata) {
     (void)item, (void)copy, (void)udata;
 #ifdef BGEN_ITEMCOPY
@@ -471,23 +864,29 @@ static int BGEN_SYM(rc_fetch_add)(BGEN_SYM(rc_t) *ptr, int delta) {
 
 #else
 
-#include <stdatomic.h>
+#include BGEN_STDATOMIC
 
-typedef atomic_int BGEN_SYM(rc_t);
+typedef BGEN_STD atomic_int BGEN_SYM(rc_t);
 static int BGEN_SYM(rc_load)(BGEN_SYM(rc_t) *ptr) {
-    return atomic_load(ptr);
+    return BGEN_STD atomic_load(ptr);
 }
 static int BGEN_SYM(rc_fetch_sub)(BGEN_SYM(rc_t) *ptr, int delta) {
-    return atomic_fetch_sub(ptr, delta);
+    return BGEN_STD atomic_fetch_sub(ptr, delta);
 }
 static int BGEN_SYM(rc_fetch_add)(BGEN_SYM(rc_t) *ptr, int delta) {
-    return atomic_fetch_add(ptr, delta);
+    return BGEN_STD atomic_fetch_add(ptr, delta);
 }
 
 #endif
 #endif
 
 BGEN_NODE {
+#ifdef BGEN_SOA
+    BGEN_KEY keys[BGEN_MAXITEMS]; // keys of all items in node
+#endif
+#ifdef BGEN_CURVE
+    uint64_t cindex[BGEN_MAXITEMS]; // curve index of all items in node
+#endif
     BGEN_ITEM items[BGEN_MAXITEMS];  // all items in node, ordered
 #ifdef BGEN_COW
     BGEN_SYM(rc_t) rc; // reference counter
@@ -586,93 +985,492 @@ static int BGEN_SYM(feat_dims)(void) {
 #endif
 }
 
-static BGEN_NODE *BGEN_SYM(alloc_node)(bool isleaf) {
-    void *ptr = isleaf ? BGEN_MALLOC(offsetof(BGEN_NODE, children)) :
-        BGEN_MALLOC(sizeof(BGEN_NODE));
-    if (!ptr) {
-        return 0;
-    }
-    BGEN_NODE *node = (BGEN_NODE*)ptr;
-#ifdef BGEN_COW
-    node->rc = 0;
+#ifdef BGEN_ARENA
+// Arena allocator.
+// Each tree has an arena of its own, in its BGEN_TREE handle. Nodes are carved
+// out of large cache-line aligned blocks, and freed nodes are recycled through
+// fixed-size freelists, one for leaves and one for branches, rather than going
+// back to BGEN_FREE. The arena is created with the first node of the tree, and
+// a 'clear' releases it block by block, without visiting the nodes unless
+// their items need freeing (BGEN_ITEMFREE).
+// Trees that share nodes share an arena: a 'clone' (with BGEN_COW) and the
+// right tree of 'split_at' use the arena of the tree they came from, and all
+// versions of a vroot use one arena. Such an arena is released by the 'clear'
+// of the last tree using it, and until then a 'clear' frees its nodes one by
+// one. A 'join' takes over the arena of the right tree when no other tree
+// uses it, and is UNSUPPORTED otherwise. A 'copy' gets a new arena.
+// The functions find the arena through the root pointer, which must therefore
+// be the root of a BGEN_TREE, with the exception of vroot snapshots, which are
+// only read.
+// The arena is unlocked while one tree uses it. A shared arena is guarded by
+// a spinlock unless BGEN_NOATOMICS is set, because the trees sharing it may be
+// used from different threads.
+#include <stdint.h>
+#ifndef BGEN_NOATOMICS
+#include BGEN_STDATOMIC
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#endif
 #endif
-    node->isleaf = isleaf;
-    node->height = 0;
-    node->len = 0;
-    return node;
-}
 
-// returns the number of items in a node by counting, recursively
-static size_t BGEN_SYM(deepcount)(BGEN_NODE *node) {
-    size_t count = (size_t)node->len;
-    if (!node->isleaf) {
-        for (int i = 0; i < node->len+1; i++) {
-            count += BGEN_SYM(deepcount)(node->children[i]);
-        }
-    }
-    return count;
-}
+// Size of each arena block in bytes. Blocks always fit at least one node.
+#ifndef BGEN_ARENABLOCK
+#define BGEN_ARENABLOCK 65536
+#endif
 
-// returns the height of the node counting the depth, recursively
-static int BGEN_SYM(deepheight)(BGEN_NODE *node) {
-    int height = 0;
-    while (1) {
-        height++;
-        if (node->isleaf) {
-            return height;
-        }
-        node = node->children[0];
-    }
+#define BGEN_ALINE 64 // cache line size
+
+// Slab alignment, which is at least that of the node, and with PREFETCH or
+// SIMDKEY a full cache line, so that no node straddles more lines than it must.
+#if defined(BGEN_PREFETCH) || defined(BGEN_SIMDKEY)
+#define BGEN_AMIN BGEN_ALINE
+#else
+#define BGEN_AMIN 16
+#endif
+#define BGEN_AALIGN \
+    (BGEN_ALIGNOF(BGEN_NODE) > BGEN_AMIN ? BGEN_ALIGNOF(BGEN_NODE) : BGEN_AMIN)
+// Block alignment, and the size of the block header.
+#define BGEN_ABASE (BGEN_AALIGN > BGEN_ALINE ? BGEN_AALIGN : BGEN_ALINE)
+#define BGEN_ASIZE(size) (((size)+BGEN_AALIGN-1)/BGEN_AALIGN*BGEN_AALIGN)
+
+struct BGEN_SYM(ablock) {
+    struct BGEN_SYM(ablock) *next;
+    void *ptr; // the unaligned allocation
+};
+
+struct BGEN_SYM(aslab) {
+    struct BGEN_SYM(aslab) *next;
+};
+
+struct BGEN_SYM(arena) {
+    struct BGEN_SYM(ablock) *blocks;
+    // The following are indexed by isleaf
+    struct BGEN_SYM(aslab) *free[2]; // freelists
+    struct BGEN_SYM(aslab) *last[2]; // last slab of each freelist
+    char *bump[2]; // next unused slab in the most recent block
+    char *end[2];
+#ifndef BGEN_NOATOMICS
+    BGEN_STD atomic_size_t refs; // trees using the arena
+    BGEN_STD atomic_int lock;    // taken only while the arena is shared
+#else
+    size_t refs;
+#endif
+};
+
+// The arena of the tree that the calling thread is working on, which is set
+// by the API functions. Nodes are allocated from it and freed to it.
+static __thread struct BGEN_SYM(arena) **BGEN_SYM(aslot);
+
+// The tree of a root pointer.
+static BGEN_TREE *BGEN_SYM(atree)(BGEN_NODE **root) {
+    return (BGEN_TREE*)(void*)root;
 }
 
-#ifdef BGEN_SPATIAL
+static struct BGEN_SYM(arena) **BGEN_SYM(arena_enter)(
+    struct BGEN_SYM(arena) **slot)
+{
+    struct BGEN_SYM(arena) **prev = BGEN_SYM(aslot);
+    BGEN_SYM(aslot) = slot;
+    return prev;
+}
 
-static bool BGEN_SYM(rect_intersects)(BGEN_RECT a, BGEN_RECT b) {
-    int bits = 0;
-    for (int i = 0; i < BGEN_DIMS; i++) {
-        bits |= b.min[i] > a.max[i];
-        bits |= b.max[i] < a.min[i];
-    }
-    return bits == 0;
+static void BGEN_SYM(arena_leave)(struct BGEN_SYM(arena) **prev) {
+    BGEN_SYM(aslot) = prev;
 }
 
-static BGEN_RECT BGEN_SYM(rect_join)(BGEN_RECT a, BGEN_RECT b) {
-    for (int i = 0; i < BGEN_DIMS; i++) {
-        a.min[i] = a.min[i] < b.min[i] ? a.min[i] : b.min[i];
+static struct BGEN_SYM(arena) *BGEN_SYM(arena_new)(void) {
+    struct BGEN_SYM(arena) *arena =
+        (struct BGEN_SYM(arena)*)BGEN_MALLOC(sizeof(struct BGEN_SYM(arena)));
+    if (!arena) {
+        return 0;
     }
-    for (int i = 0; i < BGEN_DIMS; i++) {
-        a.max[i] = a.max[i] > b.max[i] ? a.max[i] : b.max[i];
+    arena->blocks = 0;
+    for (int i = 0; i < 2; i++) {
+        arena->free[i] = 0;
+        arena->last[i] = 0;
+        arena->bump[i] = 0;
+        arena->end[i] = 0;
     }
-    return a;
+#ifndef BGEN_NOATOMICS
+    BGEN_STD atomic_init(&arena->refs, (size_t)1);
+    BGEN_STD atomic_init(&arena->lock, 0);
+#else
+    arena->refs = 1;
+#endif
+    return arena;
 }
 
-static bool BGEN_SYM(feq)(BGEN_RTYPE a, BGEN_RTYPE b) {
-    return !(a < b || a > b);
+static size_t BGEN_SYM(arena_refs)(struct BGEN_SYM(arena) *arena) {
+#ifndef BGEN_NOATOMICS
+    return BGEN_STD atomic_load_explicit(&arena->refs,
+        BGEN_STD memory_order_acquire);
+#else
+    return arena->refs;
+#endif
 }
 
-static bool BGEN_SYM(recteq)(BGEN_RECT a, BGEN_RECT b) {
-    for (int i = 0; i < BGEN_DIMS; i++) {
-        if (!BGEN_SYM(feq)(a.min[i], b.min[i]) || 
-            !BGEN_SYM(feq)(a.max[i], b.max[i]))
+// Lock the arena if it is shared, and return true if it was locked.
+// Only a tree using the arena can share it, so an arena that is not shared
+// stays that way until the calling thread shares it.
+static bool BGEN_SYM(arena_lock)(struct BGEN_SYM(arena) *arena) {
+#ifndef BGEN_NOATOMICS
+    if (BGEN_SYM(arena_refs)(arena) < 2) {
+        return false;
+    }
+    // Wait on plain loads, longer after each try, so that the waiting threads
+    // leave the lock to the one holding it.
+    int spins = 1;
+    while (BGEN_STD atomic_exchange_explicit(&arena->lock, 1,
+        BGEN_STD memory_order_acquire))
+    {
+        while (BGEN_STD atomic_load_explicit(&arena->lock,
+            BGEN_STD memory_order_relaxed))
         {
-            return false;
+            if (spins < 1024) {
+                for (volatile int i = 0; i < spins; i++) {
+                }
+                spins *= 2;
+            } else {
+#if defined(__unix__) || defined(__APPLE__)
+                sched_yield();
+#endif
+            }
         }
     }
     return true;
+#else
+    (void)arena;
+    return false;
+#endif
 }
 
-static bool BGEN_SYM(rect_onedge)(BGEN_RECT rect, BGEN_RECT other) {
-    for (int i = 0; i < BGEN_DIMS; i++) {
-        if (BGEN_SYM(feq)(rect.min[i], other.min[i]) || 
-            BGEN_SYM(feq)(rect.max[i], other.max[i]))
-        {
-            return true;
+static void BGEN_SYM(arena_unlock)(struct BGEN_SYM(arena) *arena, bool locked) {
+#ifndef BGEN_NOATOMICS
+    if (locked) {
+        BGEN_STD atomic_store_explicit(&arena->lock, 0,
+            BGEN_STD memory_order_release);
+    }
+#else
+    (void)arena, (void)locked;
+#endif
+}
+
+static void BGEN_SYM(arena_push)(struct BGEN_SYM(arena) *arena, bool isleaf,
+    void *ptr)
+{
+    struct BGEN_SYM(aslab) *slab = (struct BGEN_SYM(aslab)*)ptr;
+    slab->next = arena->free[isleaf];
+    if (!slab->next) {
+        arena->last[isleaf] = slab;
+    }
+    arena->free[isleaf] = slab;
+}
+
+static void *BGEN_SYM(arena_alloc)(bool isleaf) {
+    struct BGEN_SYM(arena) **slot = BGEN_SYM(aslot);
+    BGEN_ASSERT(slot);
+    if (!*slot) {
+        *slot = BGEN_SYM(arena_new)();
+        if (!*slot) {
+            return 0;
         }
     }
-    return false;
+    struct BGEN_SYM(arena) *arena = *slot;
+    size_t size = isleaf ? BGEN_ASIZE(offsetof(BGEN_NODE, children)) :
+        BGEN_ASIZE(sizeof(BGEN_NODE));
+    void *ptr = 0;
+    bool locked = BGEN_SYM(arena_lock)(arena);
+    if (arena->free[isleaf]) {
+        struct BGEN_SYM(aslab) *slab = arena->free[isleaf];
+        arena->free[isleaf] = slab->next;
+        if (!slab->next) {
+            arena->last[isleaf] = 0;
+        }
+        ptr = slab;
+    } else {
+        if (!arena->bump[isleaf] || 
+            (size_t)(arena->end[isleaf] - arena->bump[isleaf]) < size)
+        {
+            // Add a new block. The first line holds the block header, and
+            // the slabs that follow are all BGEN_AALIGN aligned.
+            size_t nslabs = (BGEN_ARENABLOCK - BGEN_ABASE) / size;
+            nslabs = nslabs < 1 ? 1 : nslabs;
+            size_t bsize = BGEN_ABASE + nslabs * size;
+            void *mem = BGEN_MALLOC(bsize + BGEN_ABASE - 1);
+            if (!mem) {
+                goto done;
+            }
+            char *base = (char*)(((uintptr_t)mem + BGEN_ABASE - 1) & 
+                ~(uintptr_t)(BGEN_ABASE - 1));
+            struct BGEN_SYM(ablock) *block = (struct BGEN_SYM(ablock)*)base;
+            block->ptr = mem;
+            block->next = arena->blocks;
+            arena->blocks = block;
+            arena->bump[isleaf] = base + BGEN_ABASE;
+            arena->end[isleaf] = base + bsize;
+        }
+        ptr = arena->bump[isleaf];
+        arena->bump[isleaf] += size;
+    }
+done:
+    BGEN_SYM(arena_unlock)(arena, locked);
+    return ptr;
 }
 
-// Returns a rectangle for child+item at index. 
+static void BGEN_SYM(arena_free)(BGEN_NODE *node) {
+    BGEN_ASSERT(BGEN_SYM(aslot) && *BGEN_SYM(aslot));
+    struct BGEN_SYM(arena) *arena = *BGEN_SYM(aslot);
+    bool isleaf = node->isleaf;
+    bool locked = BGEN_SYM(arena_lock)(arena);
+    BGEN_SYM(arena_push)(arena, isleaf, node);
+    BGEN_SYM(arena_unlock)(arena, locked);
+}
+
+// Add a tree to the users of an arena.
+static struct BGEN_SYM(arena) *BGEN_SYM(arena_attach)(
+    struct BGEN_SYM(arena) *arena)
+{
+    if (arena) {
+#ifndef BGEN_NOATOMICS
+        BGEN_STD atomic_fetch_add(&arena->refs, 1);
+#else
+        arena->refs++;
+#endif
+    }
+    return arena;
+}
+
+// Remove a tree from the users of its arena, releasing the arena if it was
+// the last one. Takes O(blocks).
+static void BGEN_SYM(arena_detach)(struct BGEN_SYM(arena) **slot) {
+    struct BGEN_SYM(arena) *arena = *slot;
+    *slot = 0;
+    if (!arena) {
+        return;
+    }
+#ifndef BGEN_NOATOMICS
+    if (BGEN_STD atomic_fetch_sub(&arena->refs, 1) > 1) {
+        return;
+    }
+#else
+    if (--arena->refs > 0) {
+        return;
+    }
+#endif
+    struct BGEN_SYM(ablock) *block = arena->blocks;
+    while (block) {
+        struct BGEN_SYM(ablock) *next = block->next;
+        BGEN_FREE(block->ptr);
+        block = next;
+    }
+    BGEN_FREE(arena);
+}
+
+// Move all blocks and free slabs of the arena src, which no other tree uses,
+// into the arena dst. Takes O(blocks).
+static void BGEN_SYM(arena_absorb)(struct BGEN_SYM(arena) *dst,
+    struct BGEN_SYM(arena) *src)
+{
+    // The unused rest of the most recent blocks of src becomes free slabs.
+    for (int isleaf = 0; isleaf < 2; isleaf++) {
+        size_t size = isleaf ? BGEN_ASIZE(offsetof(BGEN_NODE, children)) :
+            BGEN_ASIZE(sizeof(BGEN_NODE));
+        while (src->bump[isleaf] &&
+            (size_t)(src->end[isleaf] - src->bump[isleaf]) >= size)
+        {
+            BGEN_SYM(arena_push)(src, isleaf, src->bump[isleaf]);
+            src->bump[isleaf] += size;
+        }
+    }
+    struct BGEN_SYM(ablock) *last = src->blocks;
+    while (last && last->next) {
+        last = last->next;
+    }
+    bool locked = BGEN_SYM(arena_lock)(dst);
+    if (last) {
+        last->next = dst->blocks;
+        dst->blocks = src->blocks;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (src->free[i]) {
+            src->last[i]->next = dst->free[i];
+            if (!dst->free[i]) {
+                dst->last[i] = src->last[i];
+            }
+            dst->free[i] = src->free[i];
+        }
+    }
+    BGEN_SYM(arena_unlock)(dst, locked);
+    BGEN_FREE(src);
+}
+
+// Use the arena of the tree, if any, until BGEN_ALEAVE.
+#define BGEN_AENTER(root) \
+    struct BGEN_SYM(arena) **BGEN_SYM(aprev) = BGEN_SYM(arena_enter)( \
+        (root) ? &BGEN_SYM(atree)(root)->arena : 0)
+#define BGEN_ALEAVE() BGEN_SYM(arena_leave)(BGEN_SYM(aprev))
+#else
+#define BGEN_AENTER(root)
+#define BGEN_ALEAVE()
+#endif
+
+static BGEN_NODE *BGEN_SYM(alloc_node)(bool isleaf) {
+#ifdef BGEN_ARENA
+    void *ptr = BGEN_SYM(arena_alloc)(isleaf);
+#else
+    void *ptr = isleaf ? BGEN_MALLOC(offsetof(BGEN_NODE, children)) :
+        BGEN_MALLOC(sizeof(BGEN_NODE));
+#endif
+    if (!ptr) {
+        return 0;
+    }
+    BGEN_NODE *node = (BGEN_NODE*)ptr;
+#ifdef BGEN_COW
+    node->rc = 0;
+#endif
+    node->isleaf = isleaf;
+    node->height = 0;
+    node->len = 0;
+    return node;
+}
+
+// Free a single node, without its items or children.
+static void BGEN_SYM(free_node)(BGEN_NODE *node) {
+#ifdef BGEN_ARENA
+    BGEN_SYM(arena_free)(node);
+#else
+    BGEN_FREE(node);
+#endif
+}
+
+// Store an item in a node, keeping the node keys in sync.
+BGEN_INLINE
+static void BGEN_SYM(set_item)(BGEN_NODE *node, int i, BGEN_ITEM item,
+    void *udata)
+{
+    (void)udata;
+    node->items[i] = item;
+#ifdef BGEN_SOA
+    node->keys[i] = item.key;
+#endif
+#ifdef BGEN_CURVE
+    node->cindex[i] = BGEN_SYM(curve_index)(item, udata);
+#endif
+}
+
+// Move an item from one node slot to another, along with its key.
+BGEN_INLINE
+static void BGEN_SYM(move_item)(BGEN_NODE *dst, int di, BGEN_NODE *src,
+    int si)
+{
+    dst->items[di] = src->items[si];
+#ifdef BGEN_SOA
+    dst->keys[di] = src->keys[si];
+#endif
+#ifdef BGEN_CURVE
+    dst->cindex[di] = src->cindex[si];
+#endif
+}
+
+// Start loading a node into the cache.
+// With BGEN_PREFETCH all cache lines that a search of the node may touch are
+// requested at once, so that they arrive in parallel rather than one miss at
+// a time. Otherwise only the first line is requested.
+BGEN_INLINE
+static void BGEN_SYM(prefetch)(BGEN_NODE *node) {
+#ifdef __GNUC__
+#ifdef BGEN_PREFETCH
+    const char *ptr = (const char*)node;
+#ifdef BGEN_SOA
+    size_t size = sizeof(node->keys);
+#elif defined(BGEN_CURVE)
+    size_t size = sizeof(node->cindex);
+#else
+    size_t size = sizeof(node->items);
+#endif
+    for (size_t i = 0; i < size; i += BGEN_CACHELINE) {
+        __builtin_prefetch(ptr+i);
+    }
+    __builtin_prefetch(&node->isleaf);
+#else
+    __builtin_prefetch(node);
+#endif
+#else
+    (void)node;
+#endif
+}
+
+// returns the number of items in a node by counting, recursively
+static size_t BGEN_SYM(deepcount)(BGEN_NODE *node) {
+    size_t count = (size_t)node->len;
+    if (!node->isleaf) {
+        for (int i = 0; i < node->len+1; i++) {
+            count += BGEN_SYM(deepcount)(node->children[i]);
+        }
+    }
+    return count;
+}
+
+// returns the height of the node counting the depth, recursively
+static int BGEN_SYM(deepheight)(BGEN_NODE *node) {
+    int height = 0;
+    while (1) {
+        height++;
+        if (node->isleaf) {
+            return height;
+        }
+        node = node->children[0];
+    }
+}
+
+#ifdef BGEN_SPATIAL
+
+static bool BGEN_SYM(rect_intersects)(BGEN_RECT a, BGEN_RECT b) {
+    int bits = 0;
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        bits |= b.min[i] > a.max[i];
+        bits |= b.max[i] < a.min[i];
+    }
+    return bits == 0;
+}
+
+static BGEN_RECT BGEN_SYM(rect_join)(BGEN_RECT a, BGEN_RECT b) {
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        a.min[i] = a.min[i] < b.min[i] ? a.min[i] : b.min[i];
+    }
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        a.max[i] = a.max[i] > b.max[i] ? a.max[i] : b.max[i];
+    }
+    return a;
+}
+
+static bool BGEN_SYM(feq)(BGEN_RTYPE a, BGEN_RTYPE b) {
+    return !(a < b || a > b);
+}
+
+static bool BGEN_SYM(recteq)(BGEN_RECT a, BGEN_RECT b) {
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        if (!BGEN_SYM(feq)(a.min[i], b.min[i]) || 
+            !BGEN_SYM(feq)(a.max[i], b.max[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool BGEN_SYM(rect_onedge)(BGEN_RECT rect, BGEN_RECT other) {
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        if (BGEN_SYM(feq)(rect.min[i], other.min[i]) || 
+            BGEN_SYM(feq)(rect.max[i], other.max[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns a rectangle for child+item at index. 
 static BGEN_RECT BGEN_SYM(rect_calc)(BGEN_NODE *node, int i, void *udata) {
     (void)node;
     BGEN_ASSERT(node && !node->isleaf);
@@ -739,6 +1537,24 @@ static bool BGEN_SYM(sane0)(BGEN_NODE *node, void *udata, int depth) {
     if (!node->isleaf && node->height < 2) {
         return false;
     }
+#ifdef BGEN_SOA
+    // check that the keys match the items
+    for (int i = 0; i < node->len; i++) {
+        if (BGEN_SYM(compare_key)(node->keys[i], node->items[i].key,
+            udata) != 0)
+        {
+            return false;
+        }
+    }
+#endif
+#ifdef BGEN_CURVE
+    // check that the curve indexes match the items
+    for (int i = 0; i < node->len; i++) {
+        if (node->cindex[i] != BGEN_SYM(curve_index)(node->items[i], udata)) {
+            return false;
+        }
+    }
+#endif
     // Check the height
     if (node->height != BGEN_SYM(deepheight)(node)) {
         return false;
@@ -834,6 +1650,23 @@ static size_t BGEN_SYM(height)(BGEN_NODE **root, void *udata) {
     return *root ? (size_t)(*root)->height : 0;
 }
 
+// Copies the counters of the calling thread.
+// They are always zero unless BGEN_STATS is defined.
+static void BGEN_SYM(stats)(BGEN_COUNTERS *stats) {
+#ifdef BGEN_STATS
+    *stats = BGEN_SYM(tstats);
+#else
+    memset(stats, 0, sizeof(BGEN_COUNTERS));
+#endif
+}
+
+// Zeroes the counters of the calling thread.
+static void BGEN_SYM(stats_reset)(void) {
+#ifdef BGEN_STATS
+    memset(&BGEN_SYM(tstats), 0, sizeof(BGEN_COUNTERS));
+#endif
+}
+
 // Returns the number of items in child node at index.
 // This will use the 'count' value if available.
 static size_t BGEN_SYM(node_count)(BGEN_NODE *branch, int node_index) {
@@ -858,7 +1691,7 @@ static void BGEN_SYM(free)(BGEN_NODE *node, void *udata) {
     for (int i = 0; i < node->len; i++) {
         BGEN_SYM(item_free)(node->items[i], udata);
     }
-    BGEN_FREE(node);
+    BGEN_SYM(free_node)(node);
 }
 
 /// Free the tree!
@@ -869,17 +1702,61 @@ static void BGEN_SYM(clear)(BGEN_NODE **root, void *udata) {
     }
 }
 
+#ifdef BGEN_ARENA
+#ifdef BGEN_ITEMFREE
+// Free the items of the tree, but not its nodes.
+static void BGEN_SYM(free_items)(BGEN_NODE *node, void *udata) {
+#ifdef BGEN_COW
+    if (BGEN_SYM(rc_load)(&node->rc) > 0) {
+        return; // a node of a mapped image
+    }
+#endif
+    if (!node->isleaf) {
+        for (int i = 0; i < node->len+1; i++) {
+            BGEN_SYM(free_items)(node->children[i], udata);
+        }
+    }
+    for (int i = 0; i < node->len; i++) {
+        BGEN_SYM(item_free)(node->items[i], udata);
+    }
+}
+#endif
+
+// Free the tree and let go of its arena. When no other tree uses the arena,
+// its blocks are released all at once, and the nodes are only visited to
+// free their items.
+static void BGEN_SYM(arena_clear)(BGEN_NODE **root,
+    struct BGEN_SYM(arena) **slot, void *udata)
+{
+    if (*slot && BGEN_SYM(arena_refs)(*slot) == 1) {
+#ifdef BGEN_ITEMFREE
+        if (*root) {
+            BGEN_SYM(free_items)(*root, udata);
+        }
+#else
+        (void)udata;
+#endif
+        *root = 0;
+    } else {
+        struct BGEN_SYM(arena) **prev = BGEN_SYM(arena_enter)(slot);
+        BGEN_SYM(clear)(root, udata);
+        BGEN_SYM(arena_leave)(prev);
+    }
+    BGEN_SYM(arena_detach)(slot);
+}
+#endif
+
 #ifdef BGEN_BSEARCH
 BGEN_INLINE
-static int BGEN_SYM(search_bsearch)(BGEN_ITEM *items, int nitems,
-    BGEN_ITEM key, void *udata, int *found)
+static int BGEN_SYM(search_bsearch)(BGEN_KEY *items, int nitems,
+    BGEN_KEY key, void *udata, int *found)
 {
     // Standard bsearch. Balanced. Relies on branch prediction.
     int i = 0;
     int n = nitems;
     while (i < n) {
         int j = (i + n) / 2;
-        int cmp = BGEN_SYM(compare)(key, items[j], udata);
+        int cmp = BGEN_SYM(compare_key)(key, items[j], udata);
         if (cmp < 0) {
             n = j;
         } else if (cmp > 0) {
@@ -894,12 +1771,12 @@ static int BGEN_SYM(search_bsearch)(BGEN_ITEM *items, int nitems,
 }
 #else
 BGEN_INLINE
-static int BGEN_SYM(search_linear)(BGEN_ITEM *items, int nitems, BGEN_ITEM key,
+static int BGEN_SYM(search_linear)(BGEN_KEY *items, int nitems, BGEN_KEY key,
     void *udata, int *found)
 {
     int i = 0;
     *found = 0;
-#ifdef BGEN_MAYBELESSEQUAL
+#if defined(BGEN_MAYBELESSEQUAL) && !defined(BGEN_SOA)
     for (; i < nitems; i++) {
         if (BGEN_SYM(maybelessequal)(key, items[i], udata)) {
             goto compare;
@@ -908,13 +1785,13 @@ static int BGEN_SYM(search_linear)(BGEN_ITEM *items, int nitems, BGEN_ITEM key,
 #endif
 #ifdef BGEN_LESS
     for (; i < nitems; i++) {
-#ifdef BGEN_MAYBELESSEQUAL
+#if defined(BGEN_MAYBELESSEQUAL) && !defined(BGEN_SOA)
     compare:
 #endif
-        if (BGEN_SYM(less)(key, items[i], udata)) {
+        if (BGEN_SYM(less_key)(key, items[i], udata)) {
             break;
         }
-        if (!BGEN_SYM(less)(items[i], key, udata)) {
+        if (!BGEN_SYM(less_key)(items[i], key, udata)) {
             *found = 1;
             break;
         }
@@ -922,10 +1799,10 @@ static int BGEN_SYM(search_linear)(BGEN_ITEM *items, int nitems, BGEN_ITEM key,
 #else
     int cmp;
     for (; i < nitems; i++) {
-#ifdef BGEN_MAYBELESSEQUAL
+#if defined(BGEN_MAYBELESSEQUAL) && !defined(BGEN_SOA)
     compare:
 #endif
-        cmp = BGEN_SYM(compare)(key, items[i], udata);
+        cmp = BGEN_SYM(compare_key)(key, items[i], udata);
         if (cmp <= 0) {
             *found = cmp == 0;
             break;
@@ -936,58 +1813,362 @@ static int BGEN_SYM(search_linear)(BGEN_ITEM *items, int nitems, BGEN_ITEM key,
 }
 #endif
 
+#ifdef BGEN_SIMDKEY
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-static int BGEN_SYM(search)(BGEN_NODE *node, BGEN_ITEM key, void *udata,
-    int *found, int depth)
+#if BGEN_SKIND == 1
+typedef uint32_t BGEN_SYM(skey_t);
+#elif BGEN_SKIND == 2
+typedef int32_t BGEN_SYM(skey_t);
+#elif BGEN_SKIND == 3
+typedef uint64_t BGEN_SYM(skey_t);
+#elif BGEN_SKIND == 4
+typedef int64_t BGEN_SYM(skey_t);
+#else
+typedef double BGEN_SYM(skey_t);
+#endif
+
+// The key type must be the same size as the SIMD key type.
+typedef char BGEN_SYM(skey_check)[
+    sizeof(BGEN_KEY) == sizeof(BGEN_SYM(skey_t)) ? 1 : -1];
+
+// Nodes larger than this are first narrowed with a branchless bsearch.
+#define BGEN_SWINDOW 32
+
+// Returns the number of keys that are less than key.
+BGEN_INLINE
+static int BGEN_SYM(simd_count)(const BGEN_SYM(skey_t) *keys, int n,
+    BGEN_SYM(skey_t) key)
 {
-#ifndef BGEN_PATHHINT
-    (void)depth; // not used
-#ifdef BGEN_BSEARCH
-    return BGEN_SYM(search_bsearch)(node->items, node->len, key, udata, found);
-#else // BGEN_LINEAR
-    return BGEN_SYM(search_linear)(node->items, node->len, key, udata, found);
+    // The vector loops stop at the first chunk that has a key that is not
+    // less than the target key.
+    int i = 0;
+#if defined(__AVX512F__)
+    // Masked loads and compares cover the tail too.
+#if BGEN_SKIND <= 2
+    __m512i vkey = _mm512_set1_epi32((int32_t)key);
+    for (; i < n; i += 16) {
+        __mmask16 m = n-i >= 16 ? 0xFFFF : (__mmask16)((1u<<(n-i))-1);
+        __m512i v = _mm512_maskz_loadu_epi32(m, keys+i);
+#if BGEN_SKIND == 1
+        __mmask16 lt = _mm512_mask_cmplt_epu32_mask(m, v, vkey);
+#else
+        __mmask16 lt = _mm512_mask_cmplt_epi32_mask(m, v, vkey);
 #endif
+        if (lt != m) {
+            return i + __builtin_popcount(lt);
+        }
+    }
+#elif BGEN_SKIND <= 4
+    __m512i vkey = _mm512_set1_epi64((int64_t)key);
+    for (; i < n; i += 8) {
+        __mmask8 m = n-i >= 8 ? 0xFF : (__mmask8)((1u<<(n-i))-1);
+        __m512i v = _mm512_maskz_loadu_epi64(m, keys+i);
+#if BGEN_SKIND == 3
+        __mmask8 lt = _mm512_mask_cmplt_epu64_mask(m, v, vkey);
 #else
-    // path hints are activated
-    BGEN_ITEM *items = node->items;
-    int nitems = node->len;
-    int i = 0;
-    static __thread uint8_t BGEN_SYM(ghint)[BGEN_MAXHEIGHT] = { 0 };
-    int j = BGEN_SYM(ghint)[depth];
-    if (j >= node->len)  {
-        j = node->len-1;
+        __mmask8 lt = _mm512_mask_cmplt_epi64_mask(m, v, vkey);
+#endif
+        if (lt != m) {
+            return i + __builtin_popcount(lt);
+        }
     }
-    int cmp = BGEN_SYM(compare)(key, items[j], udata);
-    if (cmp == 0) {
-        *found = 1;
-        return j;
-    } else if (cmp < 0) {
-        if (j == 0) {
-            *found = 0;
-            return 0;
+#else
+    __m512d vkey = _mm512_set1_pd(key);
+    for (; i < n; i += 8) {
+        __mmask8 m = n-i >= 8 ? 0xFF : (__mmask8)((1u<<(n-i))-1);
+        __m512d v = _mm512_maskz_loadu_pd(m, keys+i);
+        __mmask8 lt = _mm512_mask_cmp_pd_mask(m, v, vkey, _CMP_LT_OQ);
+        if (lt != m) {
+            return i + __builtin_popcount(lt);
         }
-        int cmp = BGEN_SYM(compare)(items[j-1], key, udata);
-        if (cmp == 0) {
-            *found = 1;
-            return j-1;
-        } else if (cmp < 0) {
-            *found = 0;
-            return j;
-        } else {
-            nitems = j;
+    }
+#endif
+    return n; // all keys are less
+#elif defined(__AVX2__)
+#if BGEN_SKIND <= 2
+    __m256i vkey = _mm256_set1_epi32((int32_t)key);
+#if BGEN_SKIND == 1
+    // Flip the sign bits for an unsigned compare.
+    __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    vkey = _mm256_xor_si256(vkey, sign);
+#endif
+    for (; i+8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(keys+i));
+#if BGEN_SKIND == 1
+        v = _mm256_xor_si256(v, sign);
+#endif
+        int lt = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(vkey, v)));
+        if (lt != 0xFF) {
+            return i + __builtin_popcount(lt);
         }
-    } else if (cmp > 0) {
-        if (j == node->len-1) {
-            *found = 0;
-            i = node->len;
-            goto okhint;
+    }
+#elif BGEN_SKIND <= 4
+    __m256i vkey = _mm256_set1_epi64x((int64_t)key);
+#if BGEN_SKIND == 3
+    __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    vkey = _mm256_xor_si256(vkey, sign);
+#endif
+    for (; i+4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(keys+i));
+#if BGEN_SKIND == 3
+        v = _mm256_xor_si256(v, sign);
+#endif
+        int lt = _mm256_movemask_pd(_mm256_castsi256_pd(
+            _mm256_cmpgt_epi64(vkey, v)));
+        if (lt != 0xF) {
+            return i + __builtin_popcount(lt);
         }
-        int cmp = BGEN_SYM(compare)(key, items[j+1], udata);
-        if (cmp == 0) {
+    }
+#else
+    __m256d vkey = _mm256_set1_pd(key);
+    for (; i+4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(keys+i);
+        int lt = _mm256_movemask_pd(_mm256_cmp_pd(v, vkey, _CMP_LT_OQ));
+        if (lt != 0xF) {
+            return i + __builtin_popcount(lt);
+        }
+    }
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    // Each true lane is all ones. Shift them down to ones and add across.
+#if BGEN_SKIND == 1
+    uint32x4_t vkey = vdupq_n_u32(key);
+    for (; i+4 <= n; i += 4) {
+        uint32x4_t lt = vcltq_u32(vld1q_u32(keys+i), vkey);
+        int c = (int)vaddvq_u32(vshrq_n_u32(lt, 31));
+        if (c != 4) {
+            return i + c;
+        }
+    }
+#elif BGEN_SKIND == 2
+    int32x4_t vkey = vdupq_n_s32(key);
+    for (; i+4 <= n; i += 4) {
+        uint32x4_t lt = vcltq_s32(vld1q_s32(keys+i), vkey);
+        int c = (int)vaddvq_u32(vshrq_n_u32(lt, 31));
+        if (c != 4) {
+            return i + c;
+        }
+    }
+#elif BGEN_SKIND == 3
+    uint64x2_t vkey = vdupq_n_u64(key);
+    for (; i+2 <= n; i += 2) {
+        uint64x2_t lt = vcltq_u64(vld1q_u64(keys+i), vkey);
+        int c = (int)vaddvq_u64(vshrq_n_u64(lt, 63));
+        if (c != 2) {
+            return i + c;
+        }
+    }
+#elif BGEN_SKIND == 4
+    int64x2_t vkey = vdupq_n_s64(key);
+    for (; i+2 <= n; i += 2) {
+        uint64x2_t lt = vcltq_s64(vld1q_s64(keys+i), vkey);
+        int c = (int)vaddvq_u64(vshrq_n_u64(lt, 63));
+        if (c != 2) {
+            return i + c;
+        }
+    }
+#else
+    float64x2_t vkey = vdupq_n_f64(key);
+    for (; i+2 <= n; i += 2) {
+        uint64x2_t lt = vcltq_f64(vld1q_f64(keys+i), vkey);
+        int c = (int)vaddvq_u64(vshrq_n_u64(lt, 63));
+        if (c != 2) {
+            return i + c;
+        }
+    }
+#endif
+#endif
+    // Branchless scalar fallback, and the tail of the vector loops.
+    int count = i;
+    for (; i < n; i++) {
+        BGEN_SYM(skey_t) k;
+        memcpy(&k, keys+i, sizeof(k));
+        count += k < key;
+    }
+    return count;
+}
+
+BGEN_INLINE
+static int BGEN_SYM(search_simd)(const BGEN_KEY *items, int nitems,
+    BGEN_KEY key, int *found)
+{
+    const BGEN_SYM(skey_t) *keys = (const BGEN_SYM(skey_t)*)(const void*)items;
+    BGEN_SYM(skey_t) k;
+    memcpy(&k, &key, sizeof(k));
+    int i = 0;
+    int n = nitems;
+    while (n > BGEN_SWINDOW) {
+        int half = n / 2;
+        BGEN_SYM(skey_t) probe;
+        memcpy(&probe, keys+i+half-1, sizeof(probe));
+        i = probe < k ? i+half : i;
+        n -= half;
+        BGEN_STAT(compares);
+    }
+    int c = BGEN_SYM(simd_count)(keys+i, n, k);
+    // Counted like the linear search, which stops at the first key that is
+    // not less than the target.
+    BGEN_STATN(compares, c < n ? c+1 : n);
+    i += c;
+    *found = 0;
+    if (i < nitems) {
+        BGEN_SYM(skey_t) probe;
+        memcpy(&probe, keys+i, sizeof(probe));
+        *found = probe == k;
+    }
+    return i;
+}
+#endif
+
+#ifdef BGEN_CURVE
+// Compares the key, whose curve index is cindex, to the item at index i of
+// node.
+BGEN_INLINE
+static int BGEN_SYM(compare_curve)(BGEN_ITEM key, uint64_t cindex,
+    BGEN_NODE *node, int i, void *udata)
+{
+    BGEN_STAT(compares);
+    if (cindex != node->cindex[i]) {
+        return cindex < node->cindex[i] ? -1 : 1;
+    }
+    return BGEN_SYM(compare_ties)(key, node->items[i], udata);
+}
+
+BGEN_INLINE
+static int BGEN_SYM(search_curve)(BGEN_NODE *node, BGEN_ITEM key,
+    uint64_t cindex, void *udata, int *found)
+{
+    int cmp;
+#ifdef BGEN_BSEARCH
+    int i = 0;
+    int n = node->len;
+    while (i < n) {
+        int j = (i + n) >> 1;
+        cmp = BGEN_SYM(compare_curve)(key, cindex, node, j, udata);
+        if (cmp == 0) {
+            *found = 1;
+            return j;
+        } else if (cmp < 0) {
+            n = j;
+        } else {
+            i = j+1;
+        }
+    }
+    *found = 0;
+    return i;
+#else
+    int i = 0;
+    for (; i < node->len; i++) {
+        cmp = BGEN_SYM(compare_curve)(key, cindex, node, i, udata);
+        if (cmp <= 0) {
+            *found = cmp == 0;
+            return i;
+        }
+    }
+    *found = 0;
+    return i;
+#endif
+}
+#endif
+
+// Returns the curve index of a search key, which is zero without BGEN_CURVE.
+BGEN_INLINE
+static uint64_t BGEN_SYM(key_index)(BGEN_ITEM key, void *udata) {
+#ifdef BGEN_CURVE
+    return BGEN_SYM(curve_index)(key, udata);
+#else
+    (void)key, (void)udata;
+    return 0;
+#endif
+}
+
+// Searches the node for the item. The cindex is the 'key_index' of the item,
+// which a descent computes once for all of its nodes.
+static int BGEN_SYM(search_key)(BGEN_NODE *node, BGEN_ITEM item,
+    uint64_t cindex, void *udata, int *found, int depth)
+{
+    BGEN_STAT(visits);
+#ifdef BGEN_PREFETCH
+    // Load the node lines in parallel, before the search starts probing.
+    BGEN_SYM(prefetch)(node);
+#endif
+#ifdef BGEN_CURVE
+    (void)depth;
+    return BGEN_SYM(search_curve)(node, item, cindex, udata, found);
+#else
+    (void)cindex;
+#ifdef BGEN_SOA
+    BGEN_KEY *items = node->keys;
+    BGEN_KEY key = item.key;
+#else
+    BGEN_KEY *items = node->items;
+    BGEN_KEY key = item;
+#endif
+#ifndef BGEN_PATHHINT
+    (void)depth; // not used
+#ifdef BGEN_SIMDKEY
+    (void)udata;
+    return BGEN_SYM(search_simd)(items, node->len, key, found);
+#elif defined(BGEN_BSEARCH)
+    return BGEN_SYM(search_bsearch)(items, node->len, key, udata, found);
+#else // BGEN_LINEAR
+    return BGEN_SYM(search_linear)(items, node->len, key, udata, found);
+#endif
+#else
+    // path hints are activated
+    int nitems = node->len;
+    int i = 0;
+    static __thread uint8_t BGEN_SYM(ghint)[BGEN_MAXHEIGHT] = { 0 };
+    int j = BGEN_SYM(ghint)[depth];
+    if (j >= node->len)  {
+        j = node->len-1;
+    }
+    int cmp = BGEN_SYM(compare_key)(key, items[j], udata);
+    if (cmp == 0) {
+        BGEN_STAT(hint_hits);
+        *found = 1;
+        return j;
+    } else if (cmp < 0) {
+        if (j == 0) {
+            BGEN_STAT(hint_hits);
+            *found = 0;
+            return 0;
+        }
+        int cmp = BGEN_SYM(compare_key)(items[j-1], key, udata);
+        if (cmp == 0) {
+            BGEN_STAT(hint_hits);
+            *found = 1;
+            return j-1;
+        } else if (cmp < 0) {
+            BGEN_STAT(hint_hits);
+            *found = 0;
+            return j;
+        } else {
+            nitems = j;
+        }
+    } else if (cmp > 0) {
+        if (j == node->len-1) {
+            BGEN_STAT(hint_hits);
+            *found = 0;
+            i = node->len;
+            goto okhint;
+        }
+        int cmp = BGEN_SYM(compare_key)(key, items[j+1], udata);
+        if (cmp == 0) {
+            BGEN_STAT(hint_hits);
             *found = 1;
             i = j+1;
             goto okhint;
         } else if (cmp < 0) {
+            BGEN_STAT(hint_hits);
             *found = 0;
             i = j+1;
             goto okhint;
@@ -996,6 +2177,7 @@ static int BGEN_SYM(search)(BGEN_NODE *node, BGEN_ITEM key, void *udata,
             i = j;
         }
     }
+    BGEN_STAT(hint_misses);
 #ifdef BGEN_BSEARCH
     i += BGEN_SYM(search_bsearch)(items+i, nitems, key, udata, found);
 #else // BGEN_LINEAR
@@ -1005,6 +2187,15 @@ okhint:
     BGEN_SYM(ghint)[depth] = (uint8_t)i;
     return i;
 #endif
+#endif
+}
+
+BGEN_INLINE
+static int BGEN_SYM(search)(BGEN_NODE *node, BGEN_ITEM item, void *udata,
+    int *found, int depth)
+{
+    return BGEN_SYM(search_key)(node, item, BGEN_SYM(key_index)(item, udata),
+        udata, found, depth);
 }
 
 static void BGEN_SYM(print_spaces)(FILE *file, int depth) {
@@ -1021,7 +2212,7 @@ static void BGEN_SYM(node_print)(BGEN_NODE *node, FILE *file,
     BGEN_SYM(print_spaces)(file, depth);
     fprintf(file, ".isleaf=%d ", node->isleaf);
 #ifdef BGEN_COW
-    fprintf(file, ".rc=%d ", node->rc);
+    fprintf(file, ".rc=%d ", BGEN_SYM(rc_load)(&node->rc));
 #endif
     fprintf(file, ".height=%d .len=%d ", node->height, node->len);
     fprintf(file, ".items=[ ");
@@ -1117,6 +2308,12 @@ static BGEN_NODE *BGEN_SYM(node_copy)(BGEN_NODE *node, bool deep, void *udata) {
         if (!BGEN_SYM(item_copy)(node->items[i], &node2->items[i], udata)) {
             goto fail;
         }
+#ifdef BGEN_SOA
+        node2->keys[i] = node2->items[i].key;
+#endif
+#ifdef BGEN_CURVE
+        node2->cindex[i] = node->cindex[i];
+#endif
         icopied++;
     }
     if (!node->isleaf) {
@@ -1161,7 +2358,7 @@ fail:
             BGEN_SYM(free)(node2->children[i], udata);
         }
     }
-    BGEN_FREE(node2);
+    BGEN_SYM(free_node)(node2);
     return 0;
 }
 
@@ -1186,6 +2383,7 @@ static bool BGEN_SYM(cow)(BGEN_NODE **node, void *udata) {
         if (!node2) {
             return false;
         }
+        BGEN_STAT(cow_copies);
         BGEN_SYM(free)(*node, udata);
         *node = node2;
     }
@@ -1196,6 +2394,7 @@ static bool BGEN_SYM(cow)(BGEN_NODE **node, void *udata) {
 static bool BGEN_SYM(node_scan)(BGEN_NODE *node, bool(*iter)(BGEN_ITEM item, 
     void *udata), void *udata)
 {
+    BGEN_STAT(visits);
     if (node->isleaf) {
         for (int i = 0; i < node->len; i++) {
             if (!iter(node->items[i], udata)) {
@@ -1205,6 +2404,9 @@ static bool BGEN_SYM(node_scan)(BGEN_NODE *node, bool(*iter)(BGEN_ITEM item,
         return true;
     }
     for (int i = 0; i < node->len; i++) {
+#ifdef BGEN_PREFETCH
+        BGEN_SYM(prefetch)(node->children[i+1]);
+#endif
         if (!BGEN_SYM(node_scan)(node->children[i], iter, udata)) {
             return false;
         }
@@ -1230,6 +2432,7 @@ static int BGEN_SYM(scan)(BGEN_NODE **root, bool(*iter)(BGEN_ITEM item,
 static bool BGEN_SYM(node_scan_mut)(BGEN_NODE *node, bool(*iter)(BGEN_ITEM item, 
     void *udata), void *udata, int *status)
 {
+    BGEN_STAT(visits);
     if (node->isleaf) {
         for (int i = 0; i < node->len; i++) {
             if (!iter(node->items[i], udata)) {
@@ -1278,6 +2481,7 @@ static int BGEN_SYM(scan_mut)(BGEN_NODE **root, bool(*iter)(BGEN_ITEM item,
 static bool BGEN_SYM(node_scan_desc)(BGEN_NODE *node, bool(*iter)(
     BGEN_ITEM item, void *udata), void *udata)
 {
+    BGEN_STAT(visits);
     if (node->isleaf) {
         for (int i = node->len-1; i >= 0; i--) {
             if (!iter(node->items[i], udata)) {
@@ -1286,10 +2490,18 @@ static bool BGEN_SYM(node_scan_desc)(BGEN_NODE *node, bool(*iter)(
         }
         return true;
     }
+#ifdef BGEN_PREFETCH
+    BGEN_SYM(prefetch)(node->children[node->len-1]);
+#endif
     if (!BGEN_SYM(node_scan_desc)(node->children[node->len], iter, udata)) {
         return false;
     }
     for (int i = node->len-1; i >= 0; i--) {
+#ifdef BGEN_PREFETCH
+        if (i > 0) {
+            BGEN_SYM(prefetch)(node->children[i-1]);
+        }
+#endif
         if (!iter(node->items[i], udata)) {
             return false;
         }
@@ -1315,6 +2527,7 @@ static int BGEN_SYM(scan_desc)(BGEN_NODE **root, bool(*iter)(BGEN_ITEM item,
 static bool BGEN_SYM(node_scan_desc_mut)(BGEN_NODE *node, bool(*iter)(
     BGEN_ITEM item, void *udata), void *udata, int *status)
 {
+    BGEN_STAT(visits);
     if (node->isleaf) {
         for (int i = node->len-1; i >= 0; i--) {
             if (!iter(node->items[i], udata)) {
@@ -1385,6 +2598,11 @@ static bool BGEN_SYM(node_seek)(BGEN_NODE *node, BGEN_ITEM key,
             return false;
         }
         if (!node->isleaf) {
+#ifdef BGEN_PREFETCH
+            if (i+2 <= node->len) {
+                BGEN_SYM(prefetch)(node->children[i+2]);
+            }
+#endif
             if (!BGEN_SYM(node_scan)(node->children[i+1], iter, udata)) {
                 return false;
             }
@@ -1821,7 +3039,7 @@ static void BGEN_SYM(shift_right)(BGEN_NODE *node, int i, int n) {
     BGEN_ASSERT(!BGEN_SYM(shared)(node));
     n--;
     for (int j = node->len; j > i; j--) {
-        node->items[j+n] = node->items[j-1];
+        BGEN_SYM(move_item)(node, j+n, node, j-1);
     }
     node->len++;
     if (!node->isleaf) {
@@ -1850,9 +3068,10 @@ static int BGEN_SYM(index_of)(BGEN_NODE **root, BGEN_ITEM key,
     int depth = 0;
     size_t index = 0;
     BGEN_NODE *node = *root;
+    uint64_t cindex = BGEN_SYM(key_index)(key, udata);
     while (1) {
         int i, found;
-        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        i = BGEN_SYM(search_key)(node, key, cindex, udata, &found, depth);
         index += (size_t)i;
         if (!node->isleaf) {
             for (int j = 0; j < i; j++) {
@@ -1876,6 +3095,60 @@ static int BGEN_SYM(index_of)(BGEN_NODE **root, BGEN_ITEM key,
 #endif
 }
 
+#ifndef BGEN_NOORDER
+// Returns the number of items in the subtree that are in the range [lo, hi).
+// Only the children that an end of the range falls into are descended, and
+// the children in between are counted with 'node_count'.
+static size_t BGEN_SYM(count_range0)(BGEN_NODE *node, BGEN_ITEM lo,
+    BGEN_ITEM hi, void *udata, int depth)
+{
+    int flo, fhi;
+    int i = BGEN_SYM(search)(node, lo, udata, &flo, depth);
+    int j = BGEN_SYM(search)(node, hi, udata, &fhi, depth);
+    if (j <= i) {
+        // Both ends are in child i, or the range is empty.
+        return j < i || flo || node->isleaf ? 0 :
+            BGEN_SYM(count_range0)(node->children[i], lo, hi, udata, depth+1);
+    }
+    // The items i to j-1 are in the range.
+    size_t count = (size_t)(j-i);
+    if (!node->isleaf) {
+        if (!flo) {
+            count += BGEN_SYM(count_range0)(node->children[i], lo, hi, udata,
+                depth+1);
+        }
+        for (int k = i+1; k < j; k++) {
+            count += BGEN_SYM(node_count)(node, k);
+        }
+        if (fhi) {
+            count += BGEN_SYM(node_count)(node, j);
+        } else {
+            count += BGEN_SYM(count_range0)(node->children[j], lo, hi, udata,
+                depth+1);
+        }
+    }
+    return count;
+}
+#endif
+
+// Returns the number of items that are greater than or equal to lo and less
+// than hi. With BGEN_COUNTED this takes O(log n) time, otherwise the subtrees
+// within the range are walked.
+// Returns zero when the tree has no order.
+static size_t BGEN_SYM(count_range)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)lo, (void)hi, (void)udata;
+    return 0;
+#else
+    if (!*root || !BGEN_SYM(less)(lo, hi, udata)) {
+        return 0;
+    }
+    return BGEN_SYM(count_range0)(*root, lo, hi, udata, 0);
+#endif
+}
+
 // returns FOUND or NOTFOUND
 static int BGEN_SYM(get)(BGEN_NODE **root, BGEN_ITEM key, BGEN_ITEM *item_out,
     void *udata)
@@ -1889,9 +3162,10 @@ static int BGEN_SYM(get)(BGEN_NODE **root, BGEN_ITEM key, BGEN_ITEM *item_out,
     }
     BGEN_NODE *node = *root;
     int depth = 0;
+    uint64_t cindex = BGEN_SYM(key_index)(key, udata);
     while (1) {
         int i, found;
-        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        i = BGEN_SYM(search_key)(node, key, cindex, udata, &found, depth);
         if (found) {
             if (item_out) {
                 *item_out = node->items[i];
@@ -1923,10 +3197,11 @@ static int BGEN_SYM(get_mut)(BGEN_NODE **root, BGEN_ITEM key,
     }
     int depth = 0;
     BGEN_NODE *node = *root;
+    uint64_t cindex = BGEN_SYM(key_index)(key, udata);
     while (1) {
         BGEN_ASSERT(!BGEN_SYM(shared)(node));
         int i, found;
-        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        i = BGEN_SYM(search_key)(node, key, cindex, udata, &found, depth);
         if (found) {
             if (item_out) {
                 *item_out = node->items[i];
@@ -1949,21 +3224,20 @@ static bool BGEN_SYM(contains)(BGEN_NODE **root, BGEN_ITEM key, void *udata) {
     return BGEN_SYM(get)(root, key, 0, udata) == BGEN_FOUND;
 }
 
-static BGEN_NODE *BGEN_SYM(split)(BGEN_NODE *left, BGEN_ITEM *mitem, 
-    void *udata)
+// Moves the upper half of the left node into the empty right node, and the
+// middle item into mitem.
+static void BGEN_SYM(split_into)(BGEN_NODE *left, BGEN_NODE *right,
+    BGEN_ITEM *mitem, void *udata)
 {
     (void)udata;
-    BGEN_NODE *right = BGEN_SYM(alloc_node)(left->isleaf);
-    if (!right) {
-        return 0;
-    }
+    BGEN_STAT(splits);
     int mid = BGEN_MAXITEMS / 2;
     *mitem = left->items[mid];
     right->height = left->height;
     right->len = left->len-mid-1;
     left->len = mid;
     for (int i = 0; i < right->len; i++) {
-        right->items[i] = left->items[mid+1+i];
+        BGEN_SYM(move_item)(right, i, left, mid+1+i);
     }
     if (!left->isleaf) {
         for (int i = 0; i <= right->len; i++) {
@@ -1981,6 +3255,16 @@ static BGEN_NODE *BGEN_SYM(split)(BGEN_NODE *left, BGEN_ITEM *mitem,
         left->rects[left->len] = BGEN_SYM(rect_calc)(left, left->len, udata);
 #endif
     }
+}
+
+static BGEN_NODE *BGEN_SYM(split)(BGEN_NODE *left, BGEN_ITEM *mitem, 
+    void *udata)
+{
+    BGEN_NODE *right = BGEN_SYM(alloc_node)(left->isleaf);
+    if (!right) {
+        return 0;
+    }
+    BGEN_SYM(split_into)(left, right, mitem, udata);
     return right;
 }
 
@@ -1996,9 +3280,15 @@ static bool BGEN_SYM(split_root)(BGEN_NODE **root, void *udata) {
     newroot->children[0] = *root;
     newroot->children[1] = BGEN_SYM(split)(*root, &newroot->items[0], udata);
     if (!newroot->children[1]) {
-        BGEN_FREE(newroot);
+        BGEN_SYM(free_node)(newroot);
         return false;
     }
+#ifdef BGEN_SOA
+    newroot->keys[0] = newroot->items[0].key;
+#endif
+#ifdef BGEN_CURVE
+    newroot->cindex[0] = BGEN_SYM(curve_index)(newroot->items[0], udata);
+#endif
 #ifdef BGEN_COUNTED
     newroot->counts[0] = BGEN_SYM(count0)(newroot->children[0]);
     newroot->counts[1] = BGEN_SYM(count0)(newroot->children[1]);
@@ -2021,7 +3311,7 @@ static bool BGEN_SYM(split_child_at)(BGEN_NODE *node, int i, void *udata) {
         return false;
     }
     BGEN_SYM(shift_right)(node, i, 1);
-    node->items[i] = mitem;
+    BGEN_SYM(set_item)(node, i, mitem, udata);
     node->children[i+1] = right;
 #ifdef BGEN_COUNTED
     node->counts[i] = BGEN_SYM(count0)(node->children[i]);
@@ -2049,16 +3339,16 @@ static void BGEN_SYM(give_left)(BGEN_NODE *node, int index, bool balance) {
     BGEN_ASSERT(!BGEN_SYM(shared)(right));
     
     int n = balance ? (right->len-left->len)/2 : right->len-left->len;    
-    left->items[left->len++] = node->items[index-1];
+    BGEN_SYM(move_item)(left, left->len++, node, index-1);
     int i = 0;
     for (; i < n-1; i++) {
-        left->items[left->len++] = right->items[i];
-        right->items[i] = right->items[n+i];
+        BGEN_SYM(move_item)(left, left->len++, right, i);
+        BGEN_SYM(move_item)(right, i, right, n+i);
     }
-    node->items[index-1] = right->items[i];
+    BGEN_SYM(move_item)(node, index-1, right, i);
     right->len -= n;
     for (; i < right->len; i++) {
-        right->items[i] = right->items[n+i];
+        BGEN_SYM(move_item)(right, i, right, n+i);
     }
 #ifdef BGEN_COUNTED
     node->counts[index-1] = left->len;
@@ -2083,13 +3373,13 @@ static void BGEN_SYM(give_right)(BGEN_NODE *node, int index, bool balance) {
     int n = balance ? (left->len-right->len)/2 : left->len-right->len;
     int i = right->len+n-1;
     for (int j = right->len-1; j >= 0; j--) {
-        right->items[i--] = right->items[j];
+        BGEN_SYM(move_item)(right, i--, right, j);
     }
-    right->items[i--] = node->items[index];
+    BGEN_SYM(move_item)(right, i--, node, index);
     for (int j = left->len-1; j > left->len-n; j--) {
-        right->items[i--] = left->items[j];
+        BGEN_SYM(move_item)(right, i--, left, j);
     }
-    node->items[index] = left->items[left->len-n];
+    BGEN_SYM(move_item)(node, index, left, left->len-n);
     left->len -= n;
     right->len += n;
 
@@ -2107,7 +3397,8 @@ static void BGEN_SYM(give_right)(BGEN_NODE *node, int index, bool balance) {
 #define BGEN_PUSHBACK     4
 
 static int BGEN_SYM(insert1)(BGEN_NODE *node, int act, size_t index, 
-    BGEN_ITEM item, BGEN_ITEM *olditem, void *udata, int depth)
+    BGEN_ITEM item, uint64_t cindex, BGEN_ITEM *olditem, void *udata,
+    int depth)
 {
     BGEN_ASSERT(!BGEN_SYM(shared)(node));
     size_t oindex;
@@ -2115,7 +3406,7 @@ static int BGEN_SYM(insert1)(BGEN_NODE *node, int act, size_t index,
 retry:
     switch (act) {
     case BGEN_INSITEM:
-        i = BGEN_SYM(search)(node, item, udata, &found, depth);
+        i = BGEN_SYM(search_key)(node, item, cindex, udata, &found, depth);
         break;
     case BGEN_INSAT: 
     case BGEN_REPAT:
@@ -2218,7 +3509,7 @@ retry:
             if (olditem) {
                 *olditem = node->items[i];
             }
-            node->items[i] = item;
+            BGEN_SYM(set_item)(node, i, item, udata);
 #ifdef BGEN_SPATIAL
             if (!node->isleaf) {
                 // Must also update the owning rectangle
@@ -2233,7 +3524,7 @@ retry:
                 return BGEN_MUSTSPLIT;
             }
             BGEN_SYM(shift_right)(node, i, 1);
-            node->items[i] = item;
+            BGEN_SYM(set_item)(node, i, item, udata);
             return BGEN_INSERTED;
         }
     isbranch:
@@ -2241,7 +3532,7 @@ retry:
             return BGEN_NOMEM;
         }
         int ret = BGEN_SYM(insert1)(node->children[i], act, index, item,
-            olditem, udata, depth+1);
+            cindex, olditem, udata, depth+1);
         if (ret != BGEN_MUSTSPLIT || node->len == BGEN_MAXITEMS) {
             if (ret == BGEN_INSERTED) {
 #ifdef BGEN_COUNTED
@@ -2289,7 +3580,7 @@ static int BGEN_SYM(insert0)(BGEN_NODE **root, int act, size_t index,
         if (!*root) {
             return BGEN_NOMEM;
         }
-        (*root)->items[0] = item;
+        BGEN_SYM(set_item)((*root), 0, item, udata);
         (*root)->len = 1;
         (*root)->height = 1;
         return BGEN_INSERTED;
@@ -2297,8 +3588,11 @@ static int BGEN_SYM(insert0)(BGEN_NODE **root, int act, size_t index,
     if (!BGEN_SYM(cow)(root, udata)) {
         return BGEN_NOMEM;
     }
+    uint64_t cindex =
+        act == BGEN_INSITEM ? BGEN_SYM(key_index)(item, udata) : 0;
     while (1) {
-        int ret = BGEN_SYM(insert1)(*root, act, index, item, olditem, udata, 0);
+        int ret = BGEN_SYM(insert1)(*root, act, index, item, cindex, olditem,
+            udata, 0);
         if (ret != BGEN_MUSTSPLIT) {
             return ret;
         }
@@ -2330,15 +3624,16 @@ static int BGEN_SYM(insert_fastpath)(BGEN_NODE **root, BGEN_ITEM item,
     BGEN_RECT irect = BGEN_SYM(item_rect)(item, udata);
     BGEN_RECT rects[BGEN_MAXHEIGHT];
 #endif
+    uint64_t cindex = BGEN_SYM(key_index)(item, udata);
     while (1) {
         BGEN_ASSERT(!BGEN_SYM(shared)(node));
         int found;
-        int i = BGEN_SYM(search)(node, item, udata, &found, depth);
+        int i = BGEN_SYM(search_key)(node, item, cindex, udata, &found, depth);
         if (found) {
             if (olditem) {
                 *olditem = node->items[i];
             }
-            node->items[i] = item;
+            BGEN_SYM(set_item)(node, i, item, udata);
             ret = BGEN_REPLACED;
             break;
         }
@@ -2381,7 +3676,7 @@ static int BGEN_SYM(insert_fastpath)(BGEN_NODE **root, BGEN_ITEM item,
                 i += cmp > 0;
             } else {
                 BGEN_SYM(shift_right)(node, i, 1);
-                node->items[i] = item;
+                BGEN_SYM(set_item)(node, i, item, udata);
                 return BGEN_INSERTED;
             }
         }
@@ -2441,7 +3736,7 @@ static void BGEN_SYM(shift_left)(BGEN_NODE *node, int i, int n, bool for_merge){
     BGEN_ASSERT(!BGEN_SYM(shared)(node));
     n--;
     for (int j = i; j < node->len-1; j++) {
-        node->items[j+n] = node->items[j+1];
+        BGEN_SYM(move_item)(node, j+n, node, j+1);
     }
     if (!node->isleaf) {
         if (for_merge) {
@@ -2465,11 +3760,12 @@ static void BGEN_SYM(shift_left)(BGEN_NODE *node, int i, int n, bool for_merge){
 }
 
 static void BGEN_SYM(join)(BGEN_NODE *left, BGEN_NODE *right, void *udata) {
+    BGEN_STAT(merges);
     (void)udata;
     BGEN_ASSERT(!BGEN_SYM(shared)(left));
     BGEN_ASSERT(!BGEN_SYM(shared)(right));
     for (int i = 0; i < right->len; i++) {
-        left->items[left->len+i] = right->items[i];
+        BGEN_SYM(move_item)(left, left->len+i, right, i);
     }
     if (!left->isleaf) {
         for (int i = 0; i <= right->len; i++) {
@@ -2511,13 +3807,13 @@ static void BGEN_SYM(rebalance)(BGEN_NODE *node, int i, void *udata) {
         // that includes (left,item,right), and places the contents into the
         // existing left node. Delete the right node altogether and move the
         // following items and child nodes to the left by one slot.
-        left->items[left->len] = node->items[i];
+        BGEN_SYM(move_item)(left, left->len, node, i);
         left->len++;
         BGEN_SYM(join)(left, right, udata);
 #ifdef BGEN_COUNTED
         size_t count = node->counts[i] + 1 + node->counts[i+1];
 #endif
-        BGEN_FREE(right);
+        BGEN_SYM(free_node)(right);
         BGEN_SYM(shift_left)(node, i, 1, true);
 #ifdef BGEN_COUNTED
         node->counts[i] = count;
@@ -2541,13 +3837,13 @@ static void BGEN_SYM(rebalance)(BGEN_NODE *node, int i, void *udata) {
         // Shift items and children over by one.
         if (left->len < right->len) {
             // move right to left
-            left->items[left->len] = node->items[i];
+            BGEN_SYM(move_item)(left, left->len, node, i);
             left->children[left->len+1] = right->children[0];
     #ifdef BGEN_COUNTED
             left->counts[left->len+1] = right->counts[0];
     #endif
             left->len++;
-            node->items[i] = right->items[0];
+            BGEN_SYM(move_item)(node, i, right, 0);
             BGEN_SYM(shift_left)(right, 0, 1, false);
     #ifdef BGEN_SPATIAL
             left->rects[left->len-1] = BGEN_SYM(rect_calc)(left, left->len-1, 
@@ -2558,12 +3854,12 @@ static void BGEN_SYM(rebalance)(BGEN_NODE *node, int i, void *udata) {
         } else {
             // move left to right
             BGEN_SYM(shift_right)(right, 0, 1);
-            right->items[0] = node->items[i];
+            BGEN_SYM(move_item)(right, 0, node, i);
             right->children[0] = left->children[left->len];
     #ifdef BGEN_COUNTED
             right->counts[0] = left->counts[left->len];
     #endif
-            node->items[i] = left->items[left->len-1];
+            BGEN_SYM(move_item)(node, i, left, left->len-1);
             left->len--;
     #ifdef BGEN_SPATIAL
             right->rects[0] = BGEN_SYM(rect_calc)(right, 0, udata);
@@ -2591,14 +3887,14 @@ static void BGEN_SYM(rebalance)(BGEN_NODE *node, int i, void *udata) {
 #define BGEN_DELAT    4
 
 static int BGEN_SYM(delete1)(BGEN_NODE *node, int act, BGEN_ITEM key,
-    size_t index, void *udata, int depth, BGEN_ITEM *prev)
+    uint64_t cindex, size_t index, void *udata, int depth, BGEN_ITEM *prev)
 {
     BGEN_ASSERT(!BGEN_SYM(shared)(node));
     int i = 0;
     int found = 0;
     switch (act) {
     case BGEN_DELKEY:
-        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        i = BGEN_SYM(search_key)(node, key, cindex, udata, &found, depth);
         break;
     case BGEN_POPMAX:
         i = node->isleaf ? node->len-1 : node->len;
@@ -2673,11 +3969,22 @@ static int BGEN_SYM(delete1)(BGEN_NODE *node, int act, BGEN_ITEM key,
             act = BGEN_POPMAX;
         }
     }
-    int ret = BGEN_SYM(delete1)(node->children[i], act, key, index, udata,
-        depth+1, prev);
+    int ret = BGEN_SYM(delete1)(node->children[i], act, key, cindex, index,
+        udata, depth+1, prev);
     if (ret != BGEN_DELETED) {
         return ret;
     }
+#ifdef BGEN_SOA
+    if (prev == &node->items[i]) {
+        // The max item of the child was popped into this node.
+        node->keys[i] = node->items[i].key;
+    }
+#endif
+#ifdef BGEN_CURVE
+    if (prev == &node->items[i]) {
+        node->cindex[i] = BGEN_SYM(curve_index)(node->items[i], udata);
+    }
+#endif
 #ifdef BGEN_COUNTED
     node->counts[i]--;
 #endif
@@ -2702,14 +4009,16 @@ static int BGEN_SYM(delete0)(BGEN_NODE **root, int act, BGEN_ITEM key,
     if (!BGEN_SYM(cow)(root, udata)) {
         return BGEN_NOMEM;
     }
-    int ret = BGEN_SYM(delete1)(*root, act, key, index, udata, 0, olditem);
+    uint64_t cindex = act == BGEN_DELKEY ? BGEN_SYM(key_index)(key, udata) : 0;
+    int ret = BGEN_SYM(delete1)(*root, act, key, cindex, index, udata, 0,
+        olditem);
     if (ret != BGEN_DELETED) {
         return ret;
     }
     if ((*root)->len == 0) {
         BGEN_NODE *old_root = *root;
         *root = (*root)->isleaf ? 0 : (*root)->children[0];
-        BGEN_FREE(old_root);
+        BGEN_SYM(free_node)(old_root);
     }
     return BGEN_DELETED;
 }
@@ -2818,13 +4127,13 @@ static int BGEN_SYM(delete_fastpath)(BGEN_NODE **root, BGEN_ITEM key,
                     }
                     BGEN_NODE *left = parent->children[i];
                     BGEN_NODE *right = parent->children[i+1];
-                    left->items[left->len] = parent->items[i];
+                    BGEN_SYM(move_item)(left, left->len, parent, i);
                     left->len++;
                     BGEN_SYM(join)(left, right, udata);
             #ifdef BGEN_COUNTED
                     size_t count = parent->counts[i] + 1 + parent->counts[i+1];
             #endif
-                    BGEN_FREE(right);
+                    BGEN_SYM(free_node)(right);
                     BGEN_SYM(shift_left)(parent, i, 1, true);
             #ifdef BGEN_COUNTED
                     parent->counts[i] = count;
@@ -2845,7 +4154,7 @@ static int BGEN_SYM(delete_fastpath)(BGEN_NODE **root, BGEN_ITEM key,
                     if (olditem) {
                         *olditem = node->items[i];
                     }
-                    node->items[i] = child->items[child->len-1];
+                    BGEN_SYM(move_item)(node, i, child, child->len-1);
                     child->len--;
             #ifdef BGEN_COUNTED
                     node->counts[i]--;
@@ -2859,10 +4168,10 @@ static int BGEN_SYM(delete_fastpath)(BGEN_NODE **root, BGEN_ITEM key,
                     if (olditem) {
                         *olditem = node->items[i];
                     }
-                    node->items[i] = child->items[0];
+                    BGEN_SYM(move_item)(node, i, child, 0);
                     child->len--;
                     for (int j = 0; j < child->len; j++) {
-                        child->items[j] = child->items[j+1];
+                        BGEN_SYM(move_item)(child, j, child, j+1);
                     }
             #ifdef BGEN_COUNTED
                     node->counts[i+1]--;
@@ -3149,7 +4458,7 @@ static int BGEN_SYM(pop_front_fastpath)(BGEN_NODE **root, BGEN_ITEM *olditem,
                 *olditem = node->items[0];
             }
             for (int i = 1; i < node->len; i++) {
-                node->items[i-1] = node->items[i];
+                BGEN_SYM(move_item)(node, i-1, node, i);
             }
             node->len--;
             return BGEN_DELETED;
@@ -3332,7 +4641,7 @@ static int BGEN_SYM(push_front_fastpath)(BGEN_NODE **root, BGEN_ITEM item,
             }
 #endif
             BGEN_SYM(shift_right)(node, 0, 1);
-            node->items[0] = item;
+            BGEN_SYM(set_item)(node, 0, item, udata);
             return BGEN_INSERTED;
         }
 #ifdef BGEN_COUNTED
@@ -3420,7 +4729,7 @@ static int BGEN_SYM(push_back_fastpath)(BGEN_NODE **root, BGEN_ITEM item,
                 break;
             }
 #endif
-            node->items[node->len++] = item;
+            BGEN_SYM(set_item)(node, node->len++, item, udata);
             return BGEN_INSERTED;
         }
 #ifdef BGEN_COUNTED
@@ -3466,80 +4775,2729 @@ static int BGEN_SYM(insert_at)(BGEN_NODE **root, size_t index, BGEN_ITEM item,
     return BGEN_SYM(insert0)(root, BGEN_INSAT, index, item, 0, udata);
 }
 
-static int BGEN_SYM(copy)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
-    if (!*root) {
-        if (newroot) {
-            *newroot = 0;
+// Split and join.
+// A tree is split by cutting every node along the path to the key in two,
+// which leaves both trees valid except along the cut edges, where nodes may
+// be short of items or empty. The edges are then repaired from the top down
+// by borrowing from, or merging with, the neighboring nodes. Joining appends
+// the shorter tree to the spine of the taller one, at the level where the
+// heights match.
+
+// A reserve of nodes that is allocated up front, so that splitting and
+// joining cannot run out of memory after the tree has been changed.
+// A split needs a new node per level, and a join needs one node for each full
+// branch that it passes plus one more for a new root.
+struct BGEN_SYM(pool) {
+    BGEN_NODE *branches[3*BGEN_MAXHEIGHT+1];
+    BGEN_NODE *leaves[3];
+    int nbranches;
+    int nleaves;
+};
+
+static void BGEN_SYM(pool_init)(struct BGEN_SYM(pool) *pool) {
+    pool->nbranches = 0;
+    pool->nleaves = 0;
+}
+
+static bool BGEN_SYM(pool_reserve)(struct BGEN_SYM(pool) *pool,
+    int nbranches, int nleaves)
+{
+    BGEN_ASSERT(nbranches <= 3*BGEN_MAXHEIGHT+1 && nleaves <= 3);
+    while (pool->nbranches < nbranches) {
+        BGEN_NODE *node = BGEN_SYM(alloc_node)(0);
+        if (!node) {
+            return false;
         }
-        return BGEN_COPIED;
+        pool->branches[pool->nbranches++] = node;
     }
-    BGEN_NODE *node2 = BGEN_SYM(node_copy)(*root, true, udata);
-    if (!node2) {
-        return BGEN_NOMEM;
+    while (pool->nleaves < nleaves) {
+        BGEN_NODE *node = BGEN_SYM(alloc_node)(1);
+        if (!node) {
+            return false;
+        }
+        pool->leaves[pool->nleaves++] = node;
     }
-    if (newroot) {
-        *newroot = node2;
+    return true;
+}
+
+static BGEN_NODE *BGEN_SYM(pool_take)(struct BGEN_SYM(pool) *pool,
+    bool isleaf)
+{
+    if (isleaf) {
+        BGEN_ASSERT(pool->nleaves > 0);
+        return pool->leaves[--pool->nleaves];
     }
-    return BGEN_COPIED;
+    BGEN_ASSERT(pool->nbranches > 0);
+    return pool->branches[--pool->nbranches];
 }
 
-static int BGEN_SYM(clone)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
-#ifndef BGEN_COW
-    return BGEN_SYM(copy)(root, newroot, udata);
-#else
-    (void)udata;
-    if (newroot) {
-        *newroot = *root;
+static void BGEN_SYM(pool_release)(struct BGEN_SYM(pool) *pool) {
+    while (pool->nbranches > 0) {
+        BGEN_SYM(free_node)(pool->branches[--pool->nbranches]);
     }
-    if (*root) {
-        BGEN_SYM(rc_fetch_add)(&(*root)->rc, 1);
+    while (pool->nleaves > 0) {
+        BGEN_SYM(free_node)(pool->leaves[--pool->nleaves]);
     }
-#endif
-    return BGEN_COPIED;
 }
 
+// Updates the count and rect of the child at index i.
+// The rect of an empty leaf, which only exists while a split is repairing
+// the tree, is left for later.
+static void BGEN_SYM(refresh_child)(BGEN_NODE *node, int i, void *udata) {
+    (void)node, (void)i, (void)udata;
+#ifdef BGEN_COUNTED
+    node->counts[i] = BGEN_SYM(count0)(node->children[i]);
+#endif
 #ifdef BGEN_SPATIAL
-
-// The nearby scanner is a kNN operation that uses a heap-based priority queue.
-
-#define BGEN_PQUEUE struct BGEN_SYM(pqueue)
-#define BGEN_PITEM struct BGEN_SYM(pitem)
-#define BGEN_DSIZE 8
-
-BGEN_PITEM {
-    BGEN_RTYPE dist;
-    uint64_t index;    // 1+ = node, item = UINT64_MAX
-    union {
-        BGEN_ITEM item;
-        BGEN_NODE *node;
-    };
-};
-
-BGEN_PQUEUE {
-    BGEN_PITEM *items;
-    size_t len;
-    size_t cap;
-    uint64_t index; // index counter, this increments with every added node.
-};
-
-static void BGEN_SYM(pqueue_init)(BGEN_PQUEUE *queue) {
-    queue->items = 0;
-    queue->len = 0;
-    queue->cap = 0;
-    queue->index = 0;
+    if (!node->children[i]->isleaf || node->children[i]->len > 0) {
+        node->rects[i] = BGEN_SYM(rect_calc)(node, i, udata);
+    }
+#endif
 }
 
-static int BGEN_SYM(pcompare)(BGEN_PQUEUE *queue, size_t i, size_t j, 
-    void *udata)
-{
-    int cmp;
-    // Compare distances
-    cmp = queue->items[i].dist < queue->items[j].dist ? -1 : 
-          queue->items[i].dist > queue->items[j].dist;
-    if (cmp != 0) {
-        return cmp;
-    }
-    // Distances are equal, compare the indexes
+// Moves items between the children at i and i+1 by rotating them through the
+// item that separates the two. A positive n moves the first n items of the
+// right child to the back of the left child, and a negative n moves the last
+// -n items of the left child to the front of the right child.
+static void BGEN_SYM(shift_items)(BGEN_NODE *node, int i, int n, void *udata) {
+    BGEN_NODE *left = node->children[i];
+    BGEN_NODE *right = node->children[i+1];
+    BGEN_ASSERT(!BGEN_SYM(shared)(node));
+    BGEN_ASSERT(!BGEN_SYM(shared)(left));
+    BGEN_ASSERT(!BGEN_SYM(shared)(right));
+    if (n > 0) {
+        int k = left->len;
+        BGEN_SYM(move_item)(left, k, node, i);
+        for (int j = 0; j < n-1; j++) {
+            BGEN_SYM(move_item)(left, k+1+j, right, j);
+        }
+        BGEN_SYM(move_item)(node, i, right, n-1);
+        for (int j = n; j < right->len; j++) {
+            BGEN_SYM(move_item)(right, j-n, right, j);
+        }
+        if (!left->isleaf) {
+            for (int j = 0; j < n; j++) {
+                left->children[k+1+j] = right->children[j];
+#ifdef BGEN_COUNTED
+                left->counts[k+1+j] = right->counts[j];
+#endif
+#ifdef BGEN_SPATIAL
+                left->rects[k+1+j] = right->rects[j];
+#endif
+            }
+            for (int j = n; j <= right->len; j++) {
+                right->children[j-n] = right->children[j];
+#ifdef BGEN_COUNTED
+                right->counts[j-n] = right->counts[j];
+#endif
+#ifdef BGEN_SPATIAL
+                right->rects[j-n] = right->rects[j];
+#endif
+            }
+        }
+        left->len += n;
+        right->len -= n;
+        if (!left->isleaf) {
+            // The old last child now has the separator to its right, and the
+            // new last child lost the item that was to its right.
+            BGEN_SYM(refresh_child)(left, k, udata);
+            BGEN_SYM(refresh_child)(left, left->len, udata);
+        }
+    } else {
+        n = -n;
+        int k = left->len-n;
+        for (int j = right->len-1; j >= 0; j--) {
+            BGEN_SYM(move_item)(right, j+n, right, j);
+        }
+        BGEN_SYM(move_item)(right, n-1, node, i);
+        for (int j = 0; j < n-1; j++) {
+            BGEN_SYM(move_item)(right, j, left, k+1+j);
+        }
+        BGEN_SYM(move_item)(node, i, left, k);
+        if (!left->isleaf) {
+            for (int j = right->len; j >= 0; j--) {
+                right->children[j+n] = right->children[j];
+#ifdef BGEN_COUNTED
+                right->counts[j+n] = right->counts[j];
+#endif
+#ifdef BGEN_SPATIAL
+                right->rects[j+n] = right->rects[j];
+#endif
+            }
+            for (int j = 0; j < n; j++) {
+                right->children[j] = left->children[k+1+j];
+#ifdef BGEN_COUNTED
+                right->counts[j] = left->counts[k+1+j];
+#endif
+#ifdef BGEN_SPATIAL
+                right->rects[j] = left->rects[k+1+j];
+#endif
+            }
+        }
+        left->len -= n;
+        right->len += n;
+        if (!left->isleaf) {
+            BGEN_SYM(refresh_child)(left, left->len, udata);
+            BGEN_SYM(refresh_child)(right, n-1, udata);
+        }
+    }
+    BGEN_SYM(refresh_child)(node, i, udata);
+    BGEN_SYM(refresh_child)(node, i+1, udata);
+}
+
+// Merges the child at i+1 into the child at i, along with the item that
+// separates the two.
+static void BGEN_SYM(merge_at)(BGEN_NODE *node, int i, void *udata) {
+    BGEN_STAT(merges);
+    BGEN_NODE *left = node->children[i];
+    BGEN_NODE *right = node->children[i+1];
+    BGEN_ASSERT(!BGEN_SYM(shared)(node));
+    BGEN_ASSERT(!BGEN_SYM(shared)(left));
+    BGEN_ASSERT(!BGEN_SYM(shared)(right));
+    int k = left->len;
+    BGEN_SYM(move_item)(left, k, node, i);
+    for (int j = 0; j < right->len; j++) {
+        BGEN_SYM(move_item)(left, k+1+j, right, j);
+    }
+    if (!left->isleaf) {
+        for (int j = 0; j <= right->len; j++) {
+            left->children[k+1+j] = right->children[j];
+#ifdef BGEN_COUNTED
+            left->counts[k+1+j] = right->counts[j];
+#endif
+#ifdef BGEN_SPATIAL
+            left->rects[k+1+j] = right->rects[j];
+#endif
+        }
+    }
+    left->len += right->len+1;
+    if (!left->isleaf) {
+        BGEN_SYM(refresh_child)(left, k, udata);
+    }
+    BGEN_SYM(free_node)(right);
+    BGEN_SYM(shift_left)(node, i, 1, true);
+    BGEN_SYM(refresh_child)(node, i, udata);
+}
+
+// Gives the child at index i more than the minimum number of items, either
+// by merging it with its sibling or by moving items over from the sibling.
+// The sibling itself must have at least the minimum.
+static void BGEN_SYM(repair)(BGEN_NODE *node, int i, void *udata) {
+    int j = i == node->len ? i-1 : i+1;
+    BGEN_NODE *child = node->children[i];
+    BGEN_NODE *sibling = node->children[j];
+    if (child->len + sibling->len < BGEN_MAXITEMS) {
+        BGEN_SYM(merge_at)(node, i < j ? i : j, udata);
+    } else {
+        int n = (child->len + sibling->len + 1) / 2 - child->len;
+        BGEN_SYM(shift_items)(node, i < j ? i : j, i < j ? n : -n, udata);
+    }
+}
+
+// Removes empty roots, lowering the height of the tree.
+static void BGEN_SYM(fix_top)(BGEN_NODE **root) {
+    while (*root && (*root)->len == 0) {
+        BGEN_NODE *old_root = *root;
+        *root = old_root->isleaf ? 0 : old_root->children[0];
+        BGEN_SYM(free_node)(old_root);
+    }
+}
+
+// Repairs the right edge of a tree after a split. Nodes along the edge may
+// have any number of items, including none, and are given more than the
+// minimum from top to bottom, so that merges below never leave them short.
+static void BGEN_SYM(fix_back0)(BGEN_NODE *node, void *udata) {
+    if (node->isleaf) {
+        return;
+    }
+    if (node->children[node->len]->len <= BGEN_MINITEMS) {
+        BGEN_SYM(repair)(node, node->len, udata);
+    }
+    BGEN_SYM(fix_back0)(node->children[node->len], udata);
+    BGEN_SYM(refresh_child)(node, node->len, udata);
+}
+
+// Repairs the left edge of a tree after a split.
+static void BGEN_SYM(fix_front0)(BGEN_NODE *node, void *udata) {
+    if (node->isleaf) {
+        return;
+    }
+    if (node->children[0]->len <= BGEN_MINITEMS) {
+        BGEN_SYM(repair)(node, 0, udata);
+    }
+    BGEN_SYM(fix_front0)(node->children[0], udata);
+    BGEN_SYM(refresh_child)(node, 0, udata);
+}
+
+static void BGEN_SYM(fix_edge)(BGEN_NODE **root, bool back, void *udata) {
+    BGEN_SYM(fix_top)(root);
+    if (*root) {
+        if (back) {
+            BGEN_SYM(fix_back0)(*root, udata);
+        } else {
+            BGEN_SYM(fix_front0)(*root, udata);
+        }
+        BGEN_SYM(fix_top)(root);
+    }
+}
+
+// Copies the shared nodes along the right or left spine of a subtree.
+static bool BGEN_SYM(own_spine)(BGEN_NODE **node, bool back, void *udata) {
+#ifndef BGEN_COW
+    (void)node, (void)back, (void)udata;
+#else
+    while (1) {
+        if (!BGEN_SYM(cow)(node, udata)) {
+            return false;
+        }
+        if ((*node)->isleaf) {
+            break;
+        }
+        node = &(*node)->children[back ? (*node)->len : 0];
+    }
+#endif
+    return true;
+}
+
+#ifndef BGEN_NOORDER
+// Copies the shared nodes that a split at key changes. These are the nodes on
+// the path to the key and the spines of their neighbors, which the repairs
+// borrow from.
+static bool BGEN_SYM(own_split)(BGEN_NODE **root, BGEN_ITEM key, void *udata) {
+#ifndef BGEN_COW
+    (void)root, (void)key, (void)udata;
+#else
+    BGEN_NODE **node = root;
+    int found = 0;
+    int depth = 0;
+    while (1) {
+        if (!BGEN_SYM(cow)(node, udata)) {
+            return false;
+        }
+        BGEN_NODE *n = *node;
+        if (n->isleaf) {
+            break;
+        }
+        int i = n->len;
+        if (!found) {
+            i = BGEN_SYM(search)(n, key, udata, &found, depth);
+        }
+        if (i > 0 && !BGEN_SYM(own_spine)(&n->children[i-1], true, udata)) {
+            return false;
+        }
+        if (i < n->len && 
+            !BGEN_SYM(own_spine)(&n->children[i+1], false, udata))
+        {
+            return false;
+        }
+        node = &n->children[i];
+        depth++;
+    }
+#endif
+    return true;
+}
+
+// Cuts the tree along the path to key, moving everything that is greater
+// than or equal to key into a new right tree with nodes from the pool, and
+// then repairs the edges of both trees.
+static int BGEN_SYM(split0)(BGEN_NODE **root, BGEN_ITEM key,
+    BGEN_NODE **right, struct BGEN_SYM(pool) *pool, void *udata)
+{
+    BGEN_NODE *node = *root;
+    BGEN_NODE *rnode = BGEN_SYM(pool_take)(pool, node->isleaf);
+    *right = rnode;
+    int found = 0;
+    int depth = 0;
+    while (1) {
+        BGEN_ASSERT(!BGEN_SYM(shared)(node));
+        // Once the key is found in a branch, everything below it belongs to
+        // the left tree.
+        int i = node->len;
+        if (!found) {
+            i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        }
+        rnode->height = node->height;
+        rnode->len = node->len-i;
+        for (int j = 0; j < rnode->len; j++) {
+            BGEN_SYM(move_item)(rnode, j, node, i+j);
+        }
+        node->len = i;
+        if (node->isleaf) {
+            break;
+        }
+        BGEN_NODE *next = BGEN_SYM(pool_take)(pool, 
+            node->children[i]->isleaf);
+        rnode->children[0] = next;
+        // The first child is repaired later, but start with known values.
+#ifdef BGEN_COUNTED
+        rnode->counts[0] = 0;
+#endif
+#ifdef BGEN_SPATIAL
+        rnode->rects[0] = node->rects[i];
+#endif
+        for (int j = 1; j <= rnode->len; j++) {
+            rnode->children[j] = node->children[i+j];
+#ifdef BGEN_COUNTED
+            rnode->counts[j] = node->counts[i+j];
+#endif
+#ifdef BGEN_SPATIAL
+            rnode->rects[j] = node->rects[i+j];
+#endif
+        }
+        node = node->children[i];
+        rnode = next;
+        depth++;
+    }
+    BGEN_SYM(fix_edge)(root, true, udata);
+    BGEN_SYM(fix_edge)(right, false, udata);
+    return found ? BGEN_FOUND : BGEN_NOTFOUND;
+}
+#endif
+
+// Moves all items that are greater than or equal to key from the tree into
+// the right tree, which must be empty. The items less than key stay put.
+// This takes O(log n) time, no matter how many items move.
+// Returns FOUND: The key was in the tree, and is now the first right item.
+// Returns NOTFOUND: The key was not in the tree.
+// Returns NOMEM: System is out of memory. The tree is unchanged.
+// Returns UNSUPPORTED: The right tree is not empty, or the tree has no order.
+static int BGEN_SYM(split_at)(BGEN_NODE **root, BGEN_ITEM key,
+    BGEN_NODE **right, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)key, (void)right, (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    if (*right) {
+        return BGEN_UNSUPPORTED;
+    }
+    if (!*root) {
+        return BGEN_NOTFOUND;
+    }
+    struct BGEN_SYM(pool) pool;
+    BGEN_SYM(pool_init)(&pool);
+    int ret = BGEN_NOMEM;
+    if (BGEN_SYM(own_split)(root, key, udata) &&
+        BGEN_SYM(pool_reserve)(&pool, (*root)->height-1, 1))
+    {
+        ret = BGEN_SYM(split0)(root, key, right, &pool, udata);
+    }
+    BGEN_SYM(pool_release)(&pool);
+    return ret;
+#endif
+}
+
+// Appends the item and the tree to the back of the node. The tree goes
+// into the node on the right spine that is one level taller than it, or the
+// item alone goes into the last leaf when the tree is empty.
+// Full nodes are split with nodes from the pool. When the node itself splits,
+// the new right sibling is returned and the item holds its separator.
+static BGEN_NODE *BGEN_SYM(join_back)(BGEN_NODE *node, BGEN_ITEM *item,
+    BGEN_NODE *tree, struct BGEN_SYM(pool) *pool, void *udata)
+{
+    BGEN_ASSERT(!BGEN_SYM(shared)(node));
+    int height = tree ? tree->height : 0;
+    BGEN_NODE *child = tree;
+    if (node->height > height+1) {
+        child = BGEN_SYM(join_back)(node->children[node->len], item, tree,
+            pool, udata);
+        BGEN_SYM(refresh_child)(node, node->len, udata);
+        if (!child) {
+            return 0;
+        }
+    }
+    BGEN_NODE *right = 0;
+    BGEN_ITEM mitem;
+    BGEN_NODE *dst = node;
+    if (node->len == BGEN_MAXITEMS) {
+        right = BGEN_SYM(pool_take)(pool, node->isleaf);
+        BGEN_SYM(split_into)(node, right, &mitem, udata);
+        dst = right;
+    }
+    BGEN_SYM(set_item)(dst, dst->len, *item, udata);
+    dst->len++;
+    if (!dst->isleaf) {
+        dst->children[dst->len] = child;
+        if (child->len < BGEN_MINITEMS) {
+            BGEN_SYM(repair)(dst, dst->len, udata);
+        }
+        if (dst->len > 0) {
+            BGEN_SYM(refresh_child)(dst, dst->len-1, udata);
+        }
+        BGEN_SYM(refresh_child)(dst, dst->len, udata);
+    }
+    if (right) {
+        *item = mitem;
+    }
+    return right;
+}
+
+// Prepends the tree and the item to the front of the node, the mirror of
+// join_back. A new sibling from a split goes to the right of the node.
+static BGEN_NODE *BGEN_SYM(join_front)(BGEN_NODE *node, BGEN_ITEM *item,
+    BGEN_NODE *tree, struct BGEN_SYM(pool) *pool, void *udata)
+{
+    BGEN_ASSERT(!BGEN_SYM(shared)(node));
+    int height = tree ? tree->height : 0;
+    BGEN_NODE *child = tree;
+    bool front = true;
+    if (node->height > height+1) {
+        child = BGEN_SYM(join_front)(node->children[0], item, tree, pool,
+            udata);
+        BGEN_SYM(refresh_child)(node, 0, udata);
+        if (!child) {
+            return 0;
+        }
+        // The sibling goes after the first child.
+        front = false;
+    }
+    BGEN_NODE *right = 0;
+    BGEN_ITEM mitem;
+    if (node->len == BGEN_MAXITEMS) {
+        right = BGEN_SYM(pool_take)(pool, node->isleaf);
+        BGEN_SYM(split_into)(node, right, &mitem, udata);
+    }
+    BGEN_SYM(shift_right)(node, 0, 1);
+    BGEN_SYM(set_item)(node, 0, *item, udata);
+    if (!node->isleaf) {
+        node->children[front ? 0 : 1] = child;
+        if (front && child->len < BGEN_MINITEMS) {
+            BGEN_SYM(repair)(node, 0, udata);
+        }
+        BGEN_SYM(refresh_child)(node, 0, udata);
+        if (node->len > 0) {
+            BGEN_SYM(refresh_child)(node, 1, udata);
+        }
+    }
+    if (right) {
+        *item = mitem;
+    }
+    return right;
+}
+
+// Joins the left tree, the item, and the right tree into the left tree.
+// The item must be greater than the left items and less than the right items,
+// and either tree may be empty. The roots and the spine of the taller tree
+// must not be shared, and the pool must hold enough branches.
+static void BGEN_SYM(join3)(BGEN_NODE **left, BGEN_ITEM item,
+    BGEN_NODE *right, struct BGEN_SYM(pool) *pool, void *udata)
+{
+    int lheight = *left ? (*left)->height : 0;
+    int rheight = right ? right->height : 0;
+    BGEN_NODE *root = lheight >= rheight ? *left : right;
+    BGEN_NODE *sibling;
+    if (lheight == rheight) {
+        // Both trees become the children of a new root.
+        BGEN_NODE *node = BGEN_SYM(pool_take)(pool, false);
+        node->height = lheight+1;
+        node->len = 1;
+        BGEN_SYM(set_item)(node, 0, item, udata);
+        node->children[0] = *left;
+        node->children[1] = right;
+        if ((*left)->len < BGEN_MINITEMS) {
+            BGEN_SYM(repair)(node, 0, udata);
+        } else if (right->len < BGEN_MINITEMS) {
+            BGEN_SYM(repair)(node, 1, udata);
+        }
+        for (int i = 0; i <= node->len; i++) {
+            BGEN_SYM(refresh_child)(node, i, udata);
+        }
+        *left = node;
+        BGEN_SYM(fix_top)(left);
+        return;
+    }
+    if (lheight > rheight) {
+        sibling = BGEN_SYM(join_back)(root, &item, right, pool, udata);
+    } else {
+        sibling = BGEN_SYM(join_front)(root, &item, *left, pool, udata);
+    }
+    if (sibling) {
+        BGEN_NODE *node = BGEN_SYM(pool_take)(pool, false);
+        node->height = root->height+1;
+        node->len = 1;
+        BGEN_SYM(set_item)(node, 0, item, udata);
+        node->children[0] = root;
+        node->children[1] = sibling;
+        BGEN_SYM(refresh_child)(node, 0, udata);
+        BGEN_SYM(refresh_child)(node, 1, udata);
+        root = node;
+    }
+    *left = root;
+}
+
+// Joins two non-empty trees, taking the separator from the shorter one.
+// Nodes come from the pool, which is topped up first, so the trees are left
+// unchanged when memory runs out.
+static int BGEN_SYM(join0)(BGEN_NODE **left, BGEN_NODE **right,
+    struct BGEN_SYM(pool) *pool, void *udata)
+{
+    bool back = (*left)->height >= (*right)->height;
+    BGEN_NODE **taller = back ? left : right;
+    if (!BGEN_SYM(own_spine)(taller, back, udata)) {
+        return BGEN_NOMEM;
+    }
+    int nfull = 0;
+    BGEN_NODE *node = *taller;
+    while (!node->isleaf) {
+        nfull += node->len == BGEN_MAXITEMS;
+        node = node->children[back ? node->len : 0];
+    }
+    if (!BGEN_SYM(pool_reserve)(pool, nfull+1, 1)) {
+        return BGEN_NOMEM;
+    }
+    BGEN_ITEM item;
+    int ret = back ? BGEN_SYM(pop_front)(right, &item, udata) :
+        BGEN_SYM(pop_back)(left, &item, udata);
+    if (ret != BGEN_DELETED) {
+        return ret;
+    }
+    BGEN_SYM(join3)(left, item, *right, pool, udata);
+    *right = 0;
+    return BGEN_INSERTED;
+}
+
+// Moves all items from the right tree to the back of the left tree, leaving
+// the right tree empty. Every right item must be greater than every left item.
+// This takes O(log n) time, no matter how many items move.
+// Returns INSERTED: The trees were joined.
+// Returns OUTOFORDER: The trees overlap. Both are unchanged.
+// Returns NOMEM: System is out of memory. Both trees are unchanged.
+// Returns UNSUPPORTED: With BGEN_ARENA, the arena of the right tree is also
+// used by some tree other than the left one. Both trees are unchanged.
+static int BGEN_SYM(tree_join)(BGEN_NODE **left, BGEN_NODE **right,
+    void *udata)
+{
+    if (!*right) {
+        return BGEN_INSERTED;
+    }
+    if (!*left) {
+        *left = *right;
+        *right = 0;
+        return BGEN_INSERTED;
+    }
+#ifndef BGEN_NOORDER
+    BGEN_NODE *lnode = *left;
+    while (!lnode->isleaf) {
+        lnode = lnode->children[lnode->len];
+    }
+    BGEN_NODE *rnode = *right;
+    while (!rnode->isleaf) {
+        rnode = rnode->children[0];
+    }
+    if (!BGEN_SYM(less)(lnode->items[lnode->len-1], rnode->items[0], udata)) {
+        return BGEN_OUTOFORDER;
+    }
+#endif
+    struct BGEN_SYM(pool) pool;
+    BGEN_SYM(pool_init)(&pool);
+    int ret = BGEN_SYM(join0)(left, right, &pool, udata);
+    BGEN_SYM(pool_release)(&pool);
+    return ret;
+}
+
+#ifndef BGEN_NOORDER
+// Returns true if the tree has an item in the range [lo, hi).
+static bool BGEN_SYM(has_range)(BGEN_NODE *node, BGEN_ITEM lo, BGEN_ITEM hi,
+    void *udata)
+{
+    bool has = false;
+    BGEN_ITEM next = lo;
+    int depth = 0;
+    while (1) {
+        int found;
+        int i = BGEN_SYM(search)(node, lo, udata, &found, depth);
+        if (found) {
+            return true;
+        }
+        if (i < node->len) {
+            next = node->items[i];
+            has = true;
+        }
+        if (node->isleaf) {
+            break;
+        }
+        node = node->children[i];
+        depth++;
+    }
+    return has && BGEN_SYM(less)(next, hi, udata);
+}
+#endif
+
+// Deletes all items that are greater than or equal to lo and less than hi.
+// The tree is split in two places and joined again, so this takes
+// O(log n) time plus the time to free the deleted nodes.
+// Returns DELETED: Items were deleted.
+// Returns NOTFOUND: No items were in the range.
+// Returns NOMEM: System is out of memory. The tree is unchanged.
+// Returns UNSUPPORTED: The tree has no order.
+static int BGEN_SYM(delete_range)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)lo, (void)hi, (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    if (!*root || !BGEN_SYM(less)(lo, hi, udata) ||
+        !BGEN_SYM(has_range)(*root, lo, hi, udata))
+    {
+        return BGEN_NOTFOUND;
+    }
+    // Reserve for both splits and the final join, so that only the copying
+    // of shared nodes can fail, and only before the tree is cut.
+    struct BGEN_SYM(pool) pool;
+    BGEN_SYM(pool_init)(&pool);
+    int height = (*root)->height;
+    int ret = BGEN_NOMEM;
+    BGEN_NODE *right = 0;
+    if (!BGEN_SYM(pool_reserve)(&pool, 3*height-1, 3) ||
+        !BGEN_SYM(own_split)(root, hi, udata))
+    {
+        goto done;
+    }
+    // The edges that the split repairs are not shared, so joining the tree
+    // back together never needs to copy.
+    BGEN_SYM(split0)(root, hi, &right, &pool, udata);
+    if (BGEN_SYM(own_split)(root, lo, udata)) {
+        BGEN_NODE *mid = 0;
+        BGEN_SYM(split0)(root, lo, &mid, &pool, udata);
+        if (mid) {
+            BGEN_SYM(free)(mid, udata);
+        }
+        ret = BGEN_DELETED;
+    }
+    if (!*root) {
+        *root = right;
+    } else if (right) {
+        BGEN_SYM(join0)(root, &right, &pool, udata);
+    }
+done:
+    BGEN_SYM(pool_release)(&pool);
+    return ret;
+#endif
+}
+
+static int BGEN_SYM(copy)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
+    if (!*root) {
+        if (newroot) {
+            *newroot = 0;
+        }
+        return BGEN_COPIED;
+    }
+    BGEN_NODE *node2 = BGEN_SYM(node_copy)(*root, true, udata);
+    if (!node2) {
+        return BGEN_NOMEM;
+    }
+    if (newroot) {
+        *newroot = node2;
+    }
+    return BGEN_COPIED;
+}
+
+static int BGEN_SYM(clone)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
+#ifndef BGEN_COW
+    return BGEN_SYM(copy)(root, newroot, udata);
+#else
+    (void)udata;
+    if (newroot) {
+        *newroot = *root;
+    }
+    if (*root) {
+        BGEN_SYM(rc_fetch_add)(&(*root)->rc, 1);
+    }
+#endif
+    return BGEN_COPIED;
+}
+
+// Versioned roots.
+// A vroot holds the most recently published version of a tree, and lets any
+// number of threads read it while one writer at a time prepares and publishes
+// the next version.
+// Readers call vroot_acquire to get their own snapshot of the current
+// version, which is an ordinary tree that may be used with all of the read
+// functions, and vroot_release when they are done with it. Acquiring never
+// blocks and never waits on the writer.
+// The writer calls vroot_begin to get a private clone of the current version,
+// mutates it with the usual functions, and then calls vroot_publish to make
+// it the current version with a single atomic swap, or vroot_abort to throw
+// it away. An older version is freed once the last snapshot referencing it
+// is released, so item frees may happen on any reader thread.
+// Requires BGEN_COW, and not BGEN_NOATOMICS.
+BGEN_VROOT {
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    BGEN_ATOMIC(BGEN_NODE*) root;      // current version
+    BGEN_STD atomic_uint epoch;         // bumped by each publish
+    BGEN_STD atomic_size_t readers[2];  // readers of the root, per epoch parity
+    BGEN_STD atomic_flag wlock;         // held by the writer until publish
+#else
+    BGEN_NODE *root;
+#endif
+#ifdef BGEN_ARENA
+    struct BGEN_SYM(arena) *arena;      // shared by all versions
+#endif
+};
+
+// Initialize a vroot. The vroot takes ownership of the tree.
+static void BGEN_SYM(vroot_init)(BGEN_VROOT *vroot, BGEN_NODE **root) {
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    BGEN_STD atomic_init(&vroot->root, *root);
+    BGEN_STD atomic_init(&vroot->epoch, 0);
+    BGEN_STD atomic_init(&vroot->readers[0], 0);
+    BGEN_STD atomic_init(&vroot->readers[1], 0);
+    BGEN_STD atomic_flag_clear(&vroot->wlock);
+#else
+    vroot->root = *root;
+#endif
+#ifdef BGEN_ARENA
+    // The vroot uses the arena twice: for the current version, and for the
+    // snapshots, which readers release on their own threads.
+    BGEN_TREE *tree = BGEN_SYM(atree)(root);
+    vroot->arena = BGEN_SYM(arena_attach)(tree->arena);
+    tree->arena = 0;
+#endif
+    *root = 0;
+}
+
+// Free the vroot and its current version.
+// REQUIRED: no readers or writer are using the vroot.
+static void BGEN_SYM(vroot_destroy)(BGEN_VROOT *vroot, void *udata) {
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    BGEN_NODE *root = BGEN_STD atomic_load(&vroot->root);
+    BGEN_STD atomic_store(&vroot->root, 0);
+#else
+    BGEN_NODE *root = vroot->root;
+    vroot->root = 0;
+#endif
+#ifdef BGEN_ARENA
+    struct BGEN_SYM(arena) *snapshots = vroot->arena;
+    BGEN_SYM(arena_detach)(&snapshots);
+    BGEN_SYM(arena_clear)(&root, &vroot->arena, udata);
+#else
+    BGEN_SYM(clear)(&root, udata);
+#endif
+}
+
+// Get a snapshot of the current version. Lock-free.
+// Returns COPIED, or UNSUPPORTED.
+static int BGEN_SYM(vroot_acquire)(BGEN_VROOT *vroot, BGEN_NODE **snapshot) {
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    // Register as a reader of the current epoch, so that a publishing writer
+    // will not free the root between loading it and taking the reference.
+    unsigned epoch;
+    while (1) {
+        epoch = BGEN_STD atomic_load(&vroot->epoch);
+        BGEN_STD atomic_fetch_add(&vroot->readers[epoch&1], 1);
+        if (BGEN_STD atomic_load(&vroot->epoch) == epoch) {
+            break;
+        }
+        BGEN_STD atomic_fetch_sub(&vroot->readers[epoch&1], 1);
+    }
+    BGEN_NODE *root = BGEN_STD atomic_load(&vroot->root);
+    if (root) {
+        BGEN_SYM(rc_fetch_add)(&root->rc, 1);
+    }
+    BGEN_STD atomic_fetch_sub(&vroot->readers[epoch&1], 1);
+    *snapshot = root;
+    return BGEN_COPIED;
+#else
+    (void)vroot;
+    *snapshot = 0;
+    return BGEN_UNSUPPORTED;
+#endif
+}
+
+// Release a snapshot from vroot_acquire.
+static void BGEN_SYM(vroot_release)(BGEN_VROOT *vroot, BGEN_NODE **snapshot,
+    void *udata)
+{
+#ifdef BGEN_ARENA
+    struct BGEN_SYM(arena) **prev = BGEN_SYM(arena_enter)(&vroot->arena);
+    BGEN_SYM(clear)(snapshot, udata);
+    BGEN_SYM(arena_leave)(prev);
+#else
+    (void)vroot;
+    BGEN_SYM(clear)(snapshot, udata);
+#endif
+}
+
+// Begin a new version. Waits for any other writer to publish or abort.
+// The root receives a private clone of the current version.
+// Returns COPIED, or UNSUPPORTED.
+static int BGEN_SYM(vroot_begin)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata)
+{
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    while (BGEN_STD atomic_flag_test_and_set_explicit(&vroot->wlock,
+        BGEN_STD memory_order_acquire))
+    {
+    }
+    // Only the writer changes the root, so it can be read directly.
+    BGEN_NODE *current = BGEN_STD atomic_load(&vroot->root);
+#ifdef BGEN_ARENA
+    BGEN_TREE *tree = BGEN_SYM(atree)(root);
+    BGEN_SYM(arena_detach)(&tree->arena);
+    tree->arena = BGEN_SYM(arena_attach)(vroot->arena);
+#endif
+    return BGEN_SYM(clone)(&current, root, udata);
+#else
+    (void)vroot, (void)udata;
+    *root = 0;
+    return BGEN_UNSUPPORTED;
+#endif
+}
+
+// Publish the root as the current version, ending the write. The vroot takes
+// ownership of the root. The previous version is released after all readers
+// that may be loading it have taken their reference.
+// REQUIRED: vroot_begin returned COPIED
+static void BGEN_SYM(vroot_publish)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata)
+{
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+#ifdef BGEN_ARENA
+    BGEN_TREE *tree = BGEN_SYM(atree)(root);
+    if (!vroot->arena) {
+        // The first nodes of the vroot, which takes over the writer's arena.
+        vroot->arena = BGEN_SYM(arena_attach)(tree->arena);
+        tree->arena = 0;
+    } else {
+        BGEN_SYM(arena_detach)(&tree->arena);
+    }
+#endif
+    BGEN_NODE *old = BGEN_STD atomic_exchange(&vroot->root, *root);
+    *root = 0;
+    // New readers now register with the other parity and see the new root.
+    // Wait for the readers of the previous epoch to finish loading.
+    unsigned epoch = BGEN_STD atomic_fetch_add(&vroot->epoch, 1);
+    while (BGEN_STD atomic_load(&vroot->readers[epoch&1]) > 0) {
+    }
+#ifdef BGEN_ARENA
+    struct BGEN_SYM(arena) **prev = BGEN_SYM(arena_enter)(&vroot->arena);
+    BGEN_SYM(clear)(&old, udata);
+    BGEN_SYM(arena_leave)(prev);
+#else
+    BGEN_SYM(clear)(&old, udata);
+#endif
+    BGEN_STD atomic_flag_clear_explicit(&vroot->wlock,
+        BGEN_STD memory_order_release);
+#else
+    (void)vroot, (void)root, (void)udata;
+#endif
+}
+
+// Abort the write, freeing the root and keeping the current version.
+// REQUIRED: vroot_begin returned COPIED
+static void BGEN_SYM(vroot_abort)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata)
+{
+#ifdef BGEN_ARENA
+    BGEN_SYM(arena_clear)(root, &BGEN_SYM(atree)(root)->arena, udata);
+#else
+    BGEN_SYM(clear)(root, udata);
+#endif
+#if defined(BGEN_COW) && !defined(BGEN_NOATOMICS)
+    BGEN_STD atomic_flag_clear_explicit(&vroot->wlock,
+        BGEN_STD memory_order_release);
+#else
+    (void)vroot;
+#endif
+}
+
+#ifdef BGEN_ARENA
+// The functions that move nodes from one tree to another, and so may move
+// them from one arena to another. Nodes stay in the arena they came from.
+
+static int BGEN_SYM(arena_split_at)(BGEN_NODE **root, BGEN_ITEM key,
+    BGEN_NODE **right, void *udata)
+{
+    if (*right) {
+        return BGEN_UNSUPPORTED;
+    }
+    // The right tree gets nodes of the tree, and so uses the same arena.
+    struct BGEN_SYM(arena) **slot = &BGEN_SYM(atree)(root)->arena;
+    BGEN_TREE *rtree = BGEN_SYM(atree)(right);
+    if (!*slot && !(*slot = BGEN_SYM(arena_new)())) {
+        return BGEN_NOMEM;
+    }
+    if (rtree->arena != *slot) {
+        BGEN_SYM(arena_detach)(&rtree->arena);
+        rtree->arena = BGEN_SYM(arena_attach)(*slot);
+    }
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(split_at)(root, key, right, udata);
+    BGEN_ALEAVE();
+    if (!*right) {
+        BGEN_SYM(arena_detach)(&rtree->arena);
+    }
+    return ret;
+}
+
+static int BGEN_SYM(arena_join)(BGEN_NODE **left, BGEN_NODE **right,
+    void *udata)
+{
+    BGEN_TREE *ltree = BGEN_SYM(atree)(left);
+    BGEN_TREE *rtree = BGEN_SYM(atree)(right);
+    if (*right && rtree->arena && rtree->arena != ltree->arena) {
+        // The left tree gets the nodes of the right tree, and so its arena.
+        if (!ltree->arena) {
+            ltree->arena = BGEN_SYM(arena_attach)(rtree->arena);
+        } else if (BGEN_SYM(arena_refs)(rtree->arena) == 1) {
+            BGEN_SYM(arena_absorb)(ltree->arena, rtree->arena);
+            rtree->arena = BGEN_SYM(arena_attach)(ltree->arena);
+        } else {
+            return BGEN_UNSUPPORTED;
+        }
+    }
+    BGEN_AENTER(left);
+    int ret = BGEN_SYM(tree_join)(left, right, udata);
+    BGEN_ALEAVE();
+    if (!*right && rtree->arena == ltree->arena) {
+        BGEN_SYM(arena_detach)(&rtree->arena);
+    }
+    return ret;
+}
+
+static int BGEN_SYM(arena_copy)(BGEN_NODE **root, BGEN_NODE **newroot,
+    void *udata)
+{
+    // The new tree gets an arena of its own.
+    if (newroot) {
+        BGEN_SYM(arena_detach)(&BGEN_SYM(atree)(newroot)->arena);
+    }
+    BGEN_AENTER(newroot ? newroot : root);
+    int ret = BGEN_SYM(copy)(root, newroot, udata);
+    BGEN_ALEAVE();
+    return ret;
+}
+
+static int BGEN_SYM(arena_clone)(BGEN_NODE **root, BGEN_NODE **newroot,
+    void *udata)
+{
+#ifdef BGEN_COW
+    // The new tree shares the nodes of the tree, and so its arena.
+    if (newroot) {
+        BGEN_TREE *ntree = BGEN_SYM(atree)(newroot);
+        struct BGEN_SYM(arena) *arena = BGEN_SYM(atree)(root)->arena;
+        if (ntree->arena != arena) {
+            BGEN_SYM(arena_detach)(&ntree->arena);
+            ntree->arena = BGEN_SYM(arena_attach)(arena);
+        }
+    }
+    return BGEN_SYM(clone)(root, newroot, udata);
+#else
+    return BGEN_SYM(arena_copy)(root, newroot, udata);
+#endif
+}
+#endif
+
+// Tree images.
+// 'save' writes the tree to a file as an image that 'open_mapped' maps back
+// into memory, where it can be queried in place without loading the items.
+// The nodes are written in breadth-first order, with the branches before the
+// leaves and the child pointers stored as offsets into the image. Opening
+// maps the file privately and resolves the child offsets of the branches,
+// which are a small prefix of the image, while the leaves are used directly
+// from the page cache and may be shared by many processes.
+// The items are written as raw bytes, so they must not hold pointers. An
+// image can only be opened by a program using the same item type and btree
+// options on a machine with the same byte order.
+// The mapped tree may be used with all of the read functions. With BGEN_COW
+// it may also be cloned, and the clones modified like any other tree, while
+// the image itself stays unchanged. It must be released with 'close_mapped'
+// rather than 'clear'.
+// Opening requires BGEN_MAPPED, which uses mmap.
+#include <stdint.h>
+#include <string.h>
+#ifdef BGEN_MAPPED
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define BGEN_IMAGEVERSION 1
+
+struct BGEN_SYM(image) {
+    char magic[8];       // "bgenimg"
+    uint32_t byteorder;  // 0x01020304
+    uint32_t version;    // BGEN_IMAGEVERSION
+    uint64_t size;       // size of the image in bytes
+    uint32_t nodesize;   // size of a branch node
+    uint32_t leafsize;   // size of a leaf node
+    uint32_t itemsize;   // size of an item
+    uint32_t maxitems;
+    uint32_t feats;      // counted, spatial, keys, curve
+    uint32_t dims;
+    uint64_t nbranches;
+    uint64_t nleaves;
+    uint64_t root;       // offset of the root, zero for an empty tree
+};
+
+// Sizes and offsets of the nodes in an image.
+#define BGEN_IALIGN(size) \
+    (((size)+BGEN_ALIGNOF(BGEN_NODE)-1)/BGEN_ALIGNOF(BGEN_NODE)* \
+        BGEN_ALIGNOF(BGEN_NODE))
+#define BGEN_ISTART (((sizeof(struct BGEN_SYM(image))+63)/64)*64)
+#define BGEN_IBRANCH BGEN_IALIGN(sizeof(BGEN_NODE))
+#define BGEN_ILEAF BGEN_IALIGN(offsetof(BGEN_NODE, children))
+
+static uint32_t BGEN_SYM(image_feats)(void) {
+    uint32_t feats = 0;
+#ifdef BGEN_COUNTED
+    feats |= 1;
+#endif
+#ifdef BGEN_SPATIAL
+    feats |= 2;
+#endif
+#ifdef BGEN_SOA
+    feats |= 4;
+#endif
+#ifdef BGEN_HILBERT
+    feats |= 16;
+#endif
+#ifdef BGEN_ZORDER
+    feats |= 32;
+#endif
+    return feats;
+}
+
+// Returns the offset of the node with the breadth-first index.
+static uint64_t BGEN_SYM(image_offset)(size_t index, size_t nbranches) {
+    if (index < nbranches) {
+        return BGEN_ISTART + index*BGEN_IBRANCH;
+    }
+    return BGEN_ISTART + nbranches*BGEN_IBRANCH + (index-nbranches)*BGEN_ILEAF;
+}
+
+static void BGEN_SYM(image_count)(BGEN_NODE *node, size_t *nbranches,
+    size_t *nleaves)
+{
+    if (node->isleaf) {
+        (*nleaves)++;
+        return;
+    }
+    (*nbranches)++;
+    for (int i = 0; i <= node->len; i++) {
+        BGEN_SYM(image_count)(node->children[i], nbranches, nleaves);
+    }
+}
+
+// Copies the used fields of a node into the zeroed image node dst of size
+// bytes, so that no padding or unused slot reaches the image. The children
+// of a branch are left for the caller.
+static void BGEN_SYM(image_node)(BGEN_NODE *dst, BGEN_NODE *node, size_t size)
+{
+    memset((void*)dst, 0, size);
+#ifdef BGEN_SOA
+    memcpy(dst->keys, node->keys, sizeof(BGEN_KEY)*node->len);
+#endif
+#ifdef BGEN_CURVE
+    memcpy(dst->cindex, node->cindex, sizeof(uint64_t)*node->len);
+#endif
+    memcpy(dst->items, node->items, sizeof(BGEN_ITEM)*node->len);
+#ifdef BGEN_COW
+    // Image nodes are never freed or modified in place.
+    dst->rc = 1<<30;
+#endif
+    dst->len = node->len;
+    dst->height = node->height;
+    dst->isleaf = node->isleaf;
+    if (!node->isleaf) {
+#ifdef BGEN_COUNTED
+        memcpy(dst->counts, node->counts, sizeof(size_t)*(node->len+1));
+#endif
+#ifdef BGEN_SPATIAL
+        memcpy(dst->rects, node->rects, sizeof(BGEN_RECT)*(node->len+1));
+#endif
+    }
+}
+
+// Write the tree image to a file.
+// Returns COPIED, NOMEM, or IOERROR.
+static int BGEN_SYM(save)(BGEN_NODE **root, FILE *file, void *udata) {
+    (void)udata;
+    size_t nbranches = 0;
+    size_t nleaves = 0;
+    if (*root) {
+        BGEN_SYM(image_count)(*root, &nbranches, &nleaves);
+    }
+    size_t nnodes = nbranches + nleaves;
+    struct BGEN_SYM(image) head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "bgenimg", 8);
+    head.byteorder = 0x01020304;
+    head.version = BGEN_IMAGEVERSION;
+    head.size = BGEN_SYM(image_offset)(nnodes, nbranches);
+    head.nodesize = sizeof(BGEN_NODE);
+    head.leafsize = offsetof(BGEN_NODE, children);
+    head.itemsize = sizeof(BGEN_ITEM);
+    head.maxitems = BGEN_MAXITEMS;
+    head.feats = BGEN_SYM(image_feats)();
+    head.dims = BGEN_DIMS;
+    head.nbranches = nbranches;
+    head.nleaves = nleaves;
+    head.root = nnodes > 0 ? BGEN_ISTART : 0;
+    BGEN_NODE **queue = 0;
+    BGEN_NODE *node2 = (BGEN_NODE*)BGEN_MALLOC(BGEN_IBRANCH);
+    if (!node2 || (nbranches > 0 &&
+        !(queue = (BGEN_NODE**)BGEN_MALLOC(sizeof(BGEN_NODE*)*nbranches))))
+    {
+        if (node2) {
+            BGEN_FREE(node2);
+        }
+        return BGEN_NOMEM;
+    }
+    static const char zeros[64] = { 0 };
+    int status = BGEN_COPIED;
+    size_t nqueued = 0;
+    size_t next = 1;
+    if (fwrite(&head, sizeof(head), 1, file) != 1 ||
+        fwrite(zeros, BGEN_ISTART-sizeof(head), 1, file) != 1)
+    {
+        status = BGEN_IOERROR;
+        goto done;
+    }
+    // Write the branches in breadth-first order, which is also the order
+    // that they are queued in. The children of each branch get the indexes
+    // that follow, in order.
+    if (nbranches > 0) {
+        queue[nqueued++] = *root;
+    }
+    for (size_t i = 0; i < nbranches; i++) {
+        BGEN_NODE *node = queue[i];
+        BGEN_SYM(image_node)(node2, node, BGEN_IBRANCH);
+        for (int j = 0; j <= node->len; j++) {
+            node2->children[j] = (BGEN_NODE*)(uintptr_t)
+                BGEN_SYM(image_offset)(next++, nbranches);
+            if (!node->children[j]->isleaf) {
+                queue[nqueued++] = node->children[j];
+            }
+        }
+        if (fwrite(node2, BGEN_IBRANCH, 1, file) != 1) {
+            status = BGEN_IOERROR;
+            goto done;
+        }
+    }
+    // Then the leaves, which are the children of the lowest branches, or
+    // the root itself.
+    for (size_t i = 0; i < nbranches || (i == 0 && nleaves > 0); i++) {
+        BGEN_NODE *parent = nbranches > 0 ? queue[i] : 0;
+        if (parent && !parent->children[0]->isleaf) {
+            continue;
+        }
+        int n = parent ? parent->len+1 : 1;
+        for (int j = 0; j < n; j++) {
+            BGEN_NODE *node = parent ? parent->children[j] : *root;
+            BGEN_SYM(image_node)(node2, node, BGEN_ILEAF);
+            if (fwrite(node2, BGEN_ILEAF, 1, file) != 1) {
+                status = BGEN_IOERROR;
+                goto done;
+            }
+        }
+    }
+    if (fflush(file) != 0) {
+        status = BGEN_IOERROR;
+    }
+done:
+    BGEN_FREE(node2);
+    if (queue) {
+        BGEN_FREE(queue);
+    }
+    return status;
+}
+
+// Map a tree image that was written by 'save'. The header and the branches
+// are checked, so that a damaged image is rejected instead of being walked.
+// The leaves, which are most of the file, are only checked if 'checkleaves'
+// is true, because checking them reads every page of the file. Without it,
+// opening touches only the branches, and an image must come from a trusted
+// source.
+// Returns FOUND, NOTFOUND if the file does not exist, IOERROR if the file
+// cannot be mapped or is not a valid image for this btree, or UNSUPPORTED.
+static int BGEN_SYM(open_mapped)(BGEN_NODE **root, const char *path,
+    bool checkleaves)
+{
+    *root = 0;
+#ifndef BGEN_MAPPED
+    (void)path, (void)checkleaves;
+    return BGEN_UNSUPPORTED;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? BGEN_NOTFOUND : BGEN_IOERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        (uint64_t)st.st_size < sizeof(struct BGEN_SYM(image)))
+    {
+        close(fd);
+        return BGEN_IOERROR;
+    }
+    size_t size = (size_t)st.st_size;
+    // Private, so that resolving the branches and reference counting by
+    // clones never reach the file.
+    char *base = (char*)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return BGEN_IOERROR;
+    }
+    struct BGEN_SYM(image) *head = (struct BGEN_SYM(image)*)base;
+    size_t nbranches = head->nbranches;
+    size_t nnodes = head->nbranches + head->nleaves;
+    size_t nchecked = checkleaves || nbranches == 0 ? nnodes : nbranches;
+    size_t next = 1;
+    if (memcmp(head->magic, "bgenimg", 8) != 0 ||
+        head->byteorder != 0x01020304 ||
+        head->version != BGEN_IMAGEVERSION ||
+        head->size != size ||
+        head->nodesize != sizeof(BGEN_NODE) ||
+        head->leafsize != offsetof(BGEN_NODE, children) ||
+        head->itemsize != sizeof(BGEN_ITEM) ||
+        head->maxitems != BGEN_MAXITEMS ||
+        head->feats != BGEN_SYM(image_feats)() ||
+        head->dims != BGEN_DIMS ||
+        head->nleaves > size / BGEN_ILEAF ||
+        head->nbranches > size / BGEN_IBRANCH ||
+        BGEN_SYM(image_offset)(nnodes, nbranches) != size ||
+        head->root != (nnodes > 0 ? BGEN_ISTART : 0))
+    {
+        goto invalid;
+    }
+    // Check the nodes and resolve the child offsets of the branches. The
+    // children of each branch must be the nodes that follow in breadth-first
+    // order, one level lower, so that every node is reached exactly once and
+    // all leaves are at the same depth. The children of the lowest branches
+    // are the leaves, which is known from the offsets alone. The flag is read
+    // as a byte because any other value than 0 or 1 is not a valid bool.
+    // A root leaf is always checked.
+    for (size_t i = 0; i < nchecked; i++) {
+        BGEN_NODE *node =
+            (BGEN_NODE*)(base+BGEN_SYM(image_offset)(i, nbranches));
+        uint8_t isleaf;
+        memcpy(&isleaf, &node->isleaf, sizeof(isleaf));
+        if (isleaf != (i >= nbranches) ||
+            node->len < 1 || node->len > BGEN_MAXITEMS ||
+            node->height < 1 || node->height > BGEN_MAXHEIGHT ||
+            (node->height == 1) != isleaf)
+        {
+            goto invalid;
+        }
+#ifdef BGEN_COW
+        if (BGEN_SYM(rc_load)(&node->rc) != 1<<30) {
+            goto invalid;
+        }
+#endif
+        if (isleaf) {
+            continue;
+        }
+        for (int j = 0; j <= node->len; j++) {
+            uint64_t offset = (uint64_t)(uintptr_t)node->children[j];
+            if (next >= nnodes ||
+                offset != BGEN_SYM(image_offset)(next, nbranches))
+            {
+                goto invalid;
+            }
+            BGEN_NODE *child = (BGEN_NODE*)(base+offset);
+            if ((next >= nbranches) != (node->height == 2) ||
+                (node->height > 2 && child->height != node->height-1))
+            {
+                goto invalid;
+            }
+            node->children[j] = child;
+            next++;
+        }
+    }
+    if (nnodes > 0 && next != nnodes) {
+        goto invalid;
+    }
+#ifdef BGEN_COUNTED
+    // The counts are checked from the last branch back, so that the counts
+    // of the children are known to be right when their parent is checked.
+    // The count of an unchecked leaf can only be checked to be in range.
+    for (size_t i = nbranches; i-- > 0; ) {
+        BGEN_NODE *node =
+            (BGEN_NODE*)(base+BGEN_SYM(image_offset)(i, nbranches));
+        for (int j = 0; j <= node->len; j++) {
+            BGEN_NODE *child = node->children[j];
+            if (node->height == 2 && !checkleaves) {
+                if (node->counts[j] < 1 || node->counts[j] > BGEN_MAXITEMS) {
+                    goto invalid;
+                }
+                continue;
+            }
+            size_t count = (size_t)child->len;
+            if (!child->isleaf) {
+                for (int k = 0; k <= child->len; k++) {
+                    count += child->counts[k];
+                }
+            }
+            if (node->counts[j] != count) {
+                goto invalid;
+            }
+        }
+    }
+#endif
+#ifndef BGEN_COW
+    // Without copy-on-write the tree must only be read.
+    mprotect(base, size, PROT_READ);
+#endif
+    if (nnodes == 0) {
+        munmap(base, size);
+        return BGEN_FOUND;
+    }
+    *root = (BGEN_NODE*)(base+head->root);
+    return BGEN_FOUND;
+invalid:
+    munmap(base, size);
+    return BGEN_IOERROR;
+#endif
+}
+
+// Unmap a tree image from 'open_mapped'. Clones of the mapped tree must be
+// cleared first.
+static void BGEN_SYM(close_mapped)(BGEN_NODE **root) {
+#ifdef BGEN_MAPPED
+    if (*root) {
+        char *base = (char*)*root - BGEN_ISTART;
+        struct BGEN_SYM(image) *head = (struct BGEN_SYM(image)*)base;
+        munmap(base, head->size);
+    }
+#endif
+    *root = 0;
+}
+
+// Compressed tree images.
+// 'save_compressed' writes an image like 'save' but with every leaf
+// compressed by LZ4, and 'open_compressed' maps it back into memory. The
+// branches are written and resolved as before, so that descending the tree
+// touches no compressed data, while the children of the lowest branches are
+// leaf numbers. A table of leaf offsets follows the branches, and then the
+// compressed leaves. A leaf is decompressed with LZ4_decompress_safe when a
+// read reaches it, into a buffer of the calling thread, and a copy is kept in
+// a cache of recently used leaves that is shared by all threads. The cache
+// size is given in bytes when opening, and zero disables it.
+// As leaves are not nodes in memory, a compressed image is read through its
+// own handle, with 'cimage_get', 'cimage_seek', and 'cimage_scan', and it is
+// released with 'close_compressed'. The callbacks receive copies of the
+// items, so they may call into the same image.
+// Saving requires BGEN_LZ4, which uses lz4.h and lz4.c, and opening requires
+// both BGEN_LZ4 and BGEN_MAPPED. The same item type and btree options must be
+// used as for 'save'.
+#ifdef BGEN_LZ4
+#include "lz4.h"
+#endif
+#ifndef BGEN_NOATOMICS
+#include BGEN_STDATOMIC
+#endif
+
+#define BGEN_IMAGELZ4 8 // feature flag for compressed leaves
+#define BGEN_CNONE UINT32_MAX
+
+struct BGEN_SYM(cslot) {
+    uint64_t leaf;  // leaf number
+    uint32_t prev;  // more recently used
+    uint32_t next;  // less recently used
+    uint32_t hnext; // next slot in the same bucket
+};
+
+BGEN_CIMAGE {
+    char *base;
+    size_t size;
+    BGEN_NODE *root;         // root branch, or zero for a single leaf
+    uint64_t nleaves;
+    const uint64_t *leaves;  // offsets of the leaves, and the end
+    // Cache of decompressed leaves, most recently used first.
+#ifndef BGEN_NOATOMICS
+    BGEN_STD atomic_flag lock;
+#endif
+    uint32_t nslots;
+    uint32_t nused;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t nbuckets;       // a power of two
+    uint32_t *buckets;
+    struct BGEN_SYM(cslot) *slots;
+    char *pages;
+};
+
+// Write the tree image with compressed leaves to a file, which must be
+// seekable.
+// Returns COPIED, NOMEM, IOERROR, or UNSUPPORTED.
+static int BGEN_SYM(save_compressed)(BGEN_NODE **root, FILE *file,
+    void *udata)
+{
+    (void)udata;
+#ifndef BGEN_LZ4
+    (void)root, (void)file;
+    return BGEN_UNSUPPORTED;
+#else
+    size_t nbranches = 0;
+    size_t nleaves = 0;
+    if (*root) {
+        BGEN_SYM(image_count)(*root, &nbranches, &nleaves);
+    }
+    struct BGEN_SYM(image) head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "bgenimg", 8);
+    head.byteorder = 0x01020304;
+    head.version = BGEN_IMAGEVERSION;
+    head.nodesize = sizeof(BGEN_NODE);
+    head.leafsize = offsetof(BGEN_NODE, children);
+    head.itemsize = sizeof(BGEN_ITEM);
+    head.maxitems = BGEN_MAXITEMS;
+    head.feats = BGEN_SYM(image_feats)() | BGEN_IMAGELZ4;
+    head.dims = BGEN_DIMS;
+    head.nbranches = nbranches;
+    head.nleaves = nleaves;
+    head.root = nbranches+nleaves > 0 ? BGEN_ISTART : 0;
+    uint64_t start = BGEN_ISTART + nbranches*BGEN_IBRANCH;
+    uint64_t offset = start + (nleaves+1)*sizeof(uint64_t);
+    int bound = LZ4_compressBound(BGEN_ILEAF);
+    BGEN_NODE **queue = 0;
+    uint64_t *leaves = (uint64_t*)BGEN_MALLOC(sizeof(uint64_t)*(nleaves+1));
+    BGEN_NODE *node2 = (BGEN_NODE*)BGEN_MALLOC(BGEN_IBRANCH);
+    char *dst = (char*)BGEN_MALLOC(bound);
+    int status = BGEN_COPIED;
+    size_t nqueued = 0;
+    size_t next = 1;
+    size_t leaf = 0;
+    long pos = -1;
+    if (!leaves || !node2 || !dst || (nbranches > 0 &&
+        !(queue = (BGEN_NODE**)BGEN_MALLOC(sizeof(BGEN_NODE*)*nbranches))))
+    {
+        status = BGEN_NOMEM;
+        goto done;
+    }
+    static const char zeros[64] = { 0 };
+    pos = ftell(file);
+    if (pos == -1 || fwrite(&head, sizeof(head), 1, file) != 1 ||
+        fwrite(zeros, BGEN_ISTART-sizeof(head), 1, file) != 1)
+    {
+        status = BGEN_IOERROR;
+        goto done;
+    }
+    // The branches, as in 'save', except that the children of the lowest
+    // branches are the numbers of the leaves.
+    if (nbranches > 0) {
+        queue[nqueued++] = *root;
+    }
+    for (size_t i = 0; i < nbranches; i++) {
+        BGEN_NODE *node = queue[i];
+        BGEN_SYM(image_node)(node2, node, BGEN_IBRANCH);
+        for (int j = 0; j <= node->len; j++) {
+            if (node->children[j]->isleaf) {
+                node2->children[j] = (BGEN_NODE*)(uintptr_t)(next-nbranches);
+            } else {
+                node2->children[j] = (BGEN_NODE*)(uintptr_t)
+                    BGEN_SYM(image_offset)(next, nbranches);
+                queue[nqueued++] = node->children[j];
+            }
+            next++;
+        }
+        if (fwrite(node2, BGEN_IBRANCH, 1, file) != 1) {
+            status = BGEN_IOERROR;
+            goto done;
+        }
+    }
+    // Room for the leaf table, which is known once the leaves are written.
+    memset(leaves, 0, sizeof(uint64_t)*(nleaves+1));
+    if (fwrite(leaves, sizeof(uint64_t), nleaves+1, file) != nleaves+1) {
+        status = BGEN_IOERROR;
+        goto done;
+    }
+    for (size_t i = 0; i < nbranches || (i == 0 && nleaves > 0); i++) {
+        BGEN_NODE *parent = nbranches > 0 ? queue[i] : 0;
+        if (parent && !parent->children[0]->isleaf) {
+            continue;
+        }
+        int n = parent ? parent->len+1 : 1;
+        for (int j = 0; j < n; j++) {
+            BGEN_NODE *node = parent ? parent->children[j] : *root;
+            // Unused item slots are zeroed, which costs next to nothing once
+            // compressed.
+            BGEN_SYM(image_node)(node2, node, BGEN_ILEAF);
+            int size = LZ4_compress_default((char*)node2, dst, BGEN_ILEAF,
+                bound);
+            if (size <= 0 || fwrite(dst, (size_t)size, 1, file) != 1) {
+                status = BGEN_IOERROR;
+                goto done;
+            }
+            leaves[leaf++] = offset;
+            offset += (uint64_t)size;
+        }
+    }
+    leaves[leaf] = offset;
+    head.size = offset;
+    if (fseek(file, pos, SEEK_SET) != 0 ||
+        fwrite(&head, sizeof(head), 1, file) != 1 ||
+        fseek(file, pos+(long)start, SEEK_SET) != 0 ||
+        fwrite(leaves, sizeof(uint64_t), nleaves+1, file) != nleaves+1 ||
+        fseek(file, pos+(long)offset, SEEK_SET) != 0 ||
+        fflush(file) != 0)
+    {
+        status = BGEN_IOERROR;
+    }
+done:
+    if (leaves) {
+        BGEN_FREE(leaves);
+    }
+    if (node2) {
+        BGEN_FREE(node2);
+    }
+    if (dst) {
+        BGEN_FREE(dst);
+    }
+    if (queue) {
+        BGEN_FREE(queue);
+    }
+    return status;
+#endif
+}
+
+// Free the image handle and its cache.
+static void BGEN_SYM(cimage_free)(BGEN_CIMAGE *image) {
+#ifdef BGEN_MAPPED
+    if (image->base) {
+        munmap(image->base, image->size);
+    }
+#endif
+    if (image->buckets) {
+        BGEN_FREE(image->buckets);
+    }
+    if (image->slots) {
+        BGEN_FREE(image->slots);
+    }
+    if (image->pages) {
+        BGEN_FREE(image->pages);
+    }
+    BGEN_FREE(image);
+}
+
+// Map a tree image that was written by 'save_compressed', with a leaf cache
+// of about 'cachesize' bytes.
+// Returns FOUND, NOTFOUND if the file does not exist, IOERROR if the file
+// cannot be mapped or is not a valid image for this btree, NOMEM, or
+// UNSUPPORTED.
+static int BGEN_SYM(open_compressed)(BGEN_CIMAGE **image, const char *path,
+    size_t cachesize)
+{
+    *image = 0;
+#if !defined(BGEN_LZ4) || !defined(BGEN_MAPPED)
+    (void)path, (void)cachesize;
+    return BGEN_UNSUPPORTED;
+#else
+    BGEN_CIMAGE *img = (BGEN_CIMAGE*)BGEN_MALLOC(sizeof(BGEN_CIMAGE));
+    if (!img) {
+        return BGEN_NOMEM;
+    }
+    memset((void*)img, 0, sizeof(BGEN_CIMAGE));
+#ifndef BGEN_NOATOMICS
+    BGEN_STD atomic_flag_clear(&img->lock);
+#endif
+    size_t nslots = cachesize / BGEN_ILEAF;
+    if (nslots >= BGEN_CNONE) {
+        nslots = BGEN_CNONE-1;
+    }
+    img->nslots = (uint32_t)nslots;
+    img->head = BGEN_CNONE;
+    img->tail = BGEN_CNONE;
+    if (nslots > 0) {
+        uint32_t nbuckets = 1;
+        while (nbuckets < nslots && nbuckets < (1u<<31)) {
+            nbuckets *= 2;
+        }
+        img->nbuckets = nbuckets;
+        img->buckets = (uint32_t*)BGEN_MALLOC(sizeof(uint32_t)*nbuckets);
+        img->slots = (struct BGEN_SYM(cslot)*)
+            BGEN_MALLOC(sizeof(struct BGEN_SYM(cslot))*nslots);
+        img->pages = (char*)BGEN_MALLOC(BGEN_ILEAF*nslots);
+        if (!img->buckets || !img->slots || !img->pages) {
+            BGEN_SYM(cimage_free)(img);
+            return BGEN_NOMEM;
+        }
+        memset(img->buckets, 0xFF, sizeof(uint32_t)*nbuckets);
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        BGEN_SYM(cimage_free)(img);
+        return errno == ENOENT ? BGEN_NOTFOUND : BGEN_IOERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        (uint64_t)st.st_size < sizeof(struct BGEN_SYM(image)))
+    {
+        close(fd);
+        BGEN_SYM(cimage_free)(img);
+        return BGEN_IOERROR;
+    }
+    size_t size = (size_t)st.st_size;
+    char *base = (char*)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        BGEN_SYM(cimage_free)(img);
+        return BGEN_IOERROR;
+    }
+    img->base = base;
+    img->size = size;
+    struct BGEN_SYM(image) *head = (struct BGEN_SYM(image)*)base;
+    size_t nbranches = head->nbranches;
+    size_t nleaves = head->nleaves;
+    uint64_t start = BGEN_ISTART + (uint64_t)nbranches*BGEN_IBRANCH;
+    const uint64_t *leaves;
+    if (memcmp(head->magic, "bgenimg", 8) != 0 ||
+        head->byteorder != 0x01020304 ||
+        head->version != BGEN_IMAGEVERSION ||
+        head->size != size ||
+        head->nodesize != sizeof(BGEN_NODE) ||
+        head->leafsize != offsetof(BGEN_NODE, children) ||
+        head->itemsize != sizeof(BGEN_ITEM) ||
+        head->maxitems != BGEN_MAXITEMS ||
+        head->feats != (BGEN_SYM(image_feats)() | BGEN_IMAGELZ4) ||
+        head->dims != BGEN_DIMS ||
+        head->nbranches > size / BGEN_IBRANCH ||
+        head->nleaves > size / sizeof(uint64_t) ||
+        (nbranches == 0 && nleaves > 1) ||
+        (nbranches > 0 && nleaves <= nbranches) ||
+        start + (nleaves+1)*sizeof(uint64_t) > size ||
+        head->root != (nleaves > 0 ? BGEN_ISTART : 0))
+    {
+        goto invalid;
+    }
+    leaves = (const uint64_t*)(base+start);
+    for (size_t i = 0; i < nleaves; i++) {
+        if (leaves[i] < start + (nleaves+1)*sizeof(uint64_t) ||
+            leaves[i] > leaves[i+1])
+        {
+            goto invalid;
+        }
+    }
+    if (leaves[nleaves] != size) {
+        goto invalid;
+    }
+    // Resolve the child offsets of the branches, leaving the leaf numbers.
+    // The flag is read as a byte, as in 'open_mapped'.
+    for (size_t i = 0; i < nbranches; i++) {
+        BGEN_NODE *node =
+            (BGEN_NODE*)(base+BGEN_SYM(image_offset)(i, nbranches));
+        uint8_t isleaf;
+        memcpy(&isleaf, &node->isleaf, sizeof(isleaf));
+        if (isleaf != 0 || node->len < 1 || node->len > BGEN_MAXITEMS ||
+            node->height < 2 || node->height > BGEN_MAXHEIGHT)
+        {
+            goto invalid;
+        }
+        for (int j = 0; j <= node->len; j++) {
+            uint64_t offset = (uint64_t)(uintptr_t)node->children[j];
+            if (node->height == 2) {
+                if (offset >= nleaves) {
+                    goto invalid;
+                }
+                continue;
+            }
+            // The branches that follow this one in breadth-first order.
+            if (offset <= BGEN_SYM(image_offset)(i, nbranches) ||
+                offset >= start ||
+                (offset-BGEN_ISTART) % BGEN_IBRANCH != 0)
+            {
+                goto invalid;
+            }
+            BGEN_NODE *child = (BGEN_NODE*)(base+offset);
+            if (child->height != node->height-1) {
+                goto invalid;
+            }
+            node->children[j] = child;
+        }
+    }
+    mprotect(base, size, PROT_READ);
+    img->nleaves = nleaves;
+    img->leaves = leaves;
+    img->root = nbranches > 0 ? (BGEN_NODE*)(base+BGEN_ISTART) : 0;
+    *image = img;
+    return BGEN_FOUND;
+invalid:
+    BGEN_SYM(cimage_free)(img);
+    return BGEN_IOERROR;
+#endif
+}
+
+// Unmap a compressed tree image from 'open_compressed' and free its cache.
+// REQUIRED: no other threads are reading the image.
+static void BGEN_SYM(close_compressed)(BGEN_CIMAGE **image) {
+    if (*image) {
+        BGEN_SYM(cimage_free)(*image);
+    }
+    *image = 0;
+}
+
+#ifdef BGEN_LZ4
+
+static void BGEN_SYM(cimage_lock)(BGEN_CIMAGE *image) {
+#ifndef BGEN_NOATOMICS
+    while (BGEN_STD atomic_flag_test_and_set_explicit(&image->lock,
+        BGEN_STD memory_order_acquire))
+    {
+    }
+#else
+    (void)image;
+#endif
+}
+
+static void BGEN_SYM(cimage_unlock)(BGEN_CIMAGE *image) {
+#ifndef BGEN_NOATOMICS
+    BGEN_STD atomic_flag_clear_explicit(&image->lock,
+        BGEN_STD memory_order_release);
+#else
+    (void)image;
+#endif
+}
+
+static uint32_t BGEN_SYM(cimage_bucket)(BGEN_CIMAGE *image, uint64_t leaf) {
+    return (uint32_t)((leaf * UINT64_C(0x9E3779B97F4A7C15)) >> 32) &
+        (image->nbuckets-1);
+}
+
+// Remove the slot from the recently used list.
+static void BGEN_SYM(cimage_unlink)(BGEN_CIMAGE *image, uint32_t slot) {
+    struct BGEN_SYM(cslot) *s = &image->slots[slot];
+    if (s->prev != BGEN_CNONE) {
+        image->slots[s->prev].next = s->next;
+    } else {
+        image->head = s->next;
+    }
+    if (s->next != BGEN_CNONE) {
+        image->slots[s->next].prev = s->prev;
+    } else {
+        image->tail = s->prev;
+    }
+}
+
+// Make the slot the most recently used.
+static void BGEN_SYM(cimage_push)(BGEN_CIMAGE *image, uint32_t slot) {
+    struct BGEN_SYM(cslot) *s = &image->slots[slot];
+    s->prev = BGEN_CNONE;
+    s->next = image->head;
+    if (image->head != BGEN_CNONE) {
+        image->slots[image->head].prev = slot;
+    } else {
+        image->tail = slot;
+    }
+    image->head = slot;
+}
+
+// Returns the slot holding the leaf, or CNONE.
+static uint32_t BGEN_SYM(cimage_find)(BGEN_CIMAGE *image, uint64_t leaf) {
+    uint32_t slot = image->buckets[BGEN_SYM(cimage_bucket)(image, leaf)];
+    while (slot != BGEN_CNONE && image->slots[slot].leaf != leaf) {
+        slot = image->slots[slot].hnext;
+    }
+    return slot;
+}
+
+// Returns an unused slot, evicting the least recently used leaf if the cache
+// is full.
+static uint32_t BGEN_SYM(cimage_evict)(BGEN_CIMAGE *image) {
+    if (image->nused < image->nslots) {
+        return image->nused++;
+    }
+    uint32_t slot = image->tail;
+    BGEN_SYM(cimage_unlink)(image, slot);
+    uint32_t *ref = &image->buckets[BGEN_SYM(cimage_bucket)(image,
+        image->slots[slot].leaf)];
+    while (*ref != slot) {
+        ref = &image->slots[*ref].hnext;
+    }
+    *ref = image->slots[slot].hnext;
+    return slot;
+}
+
+// Copy the leaf into 'buf', from the cache or by decompressing it.
+// Returns false if the leaf is corrupt.
+static bool BGEN_SYM(cimage_leaf)(BGEN_CIMAGE *image, uint64_t leaf,
+    BGEN_NODE *buf)
+{
+    uint32_t slot;
+    if (image->nslots > 0) {
+        BGEN_SYM(cimage_lock)(image);
+        slot = BGEN_SYM(cimage_find)(image, leaf);
+        if (slot != BGEN_CNONE) {
+            BGEN_SYM(cimage_unlink)(image, slot);
+            BGEN_SYM(cimage_push)(image, slot);
+            memcpy((void*)buf, image->pages+(size_t)slot*BGEN_ILEAF,
+                BGEN_ILEAF);
+            BGEN_SYM(cimage_unlock)(image);
+            return true;
+        }
+        BGEN_SYM(cimage_unlock)(image);
+    }
+    // Decompress without holding the lock, so that other threads may keep
+    // using the cache.
+    uint64_t offset = image->leaves[leaf];
+    uint64_t size = image->leaves[leaf+1] - offset;
+    if (size > INT32_MAX || LZ4_decompress_safe(image->base+offset,
+        (char*)buf, (int)size, BGEN_ILEAF) != BGEN_ILEAF)
+    {
+        return false;
+    }
+    // The flag is read as a byte, as in 'open_mapped'.
+    uint8_t isleaf;
+    memcpy(&isleaf, &buf->isleaf, sizeof(isleaf));
+    if (isleaf != 1 || buf->len < 1 || buf->len > BGEN_MAXITEMS) {
+        return false;
+    }
+    if (image->nslots > 0) {
+        BGEN_SYM(cimage_lock)(image);
+        // Another thread may have added the leaf in the meantime.
+        if (BGEN_SYM(cimage_find)(image, leaf) == BGEN_CNONE) {
+            slot = BGEN_SYM(cimage_evict)(image);
+            uint32_t bucket = BGEN_SYM(cimage_bucket)(image, leaf);
+            image->slots[slot].leaf = leaf;
+            image->slots[slot].hnext = image->buckets[bucket];
+            image->buckets[bucket] = slot;
+            BGEN_SYM(cimage_push)(image, slot);
+            memcpy(image->pages+(size_t)slot*BGEN_ILEAF, buf, BGEN_ILEAF);
+        }
+        BGEN_SYM(cimage_unlock)(image);
+    }
+    return true;
+}
+
+// Decompression buffer for cimage_get.
+static __thread BGEN_NODE BGEN_SYM(cbuf);
+
+#endif
+
+// Get an item from a compressed image.
+// Returns FOUND, NOTFOUND, IOERROR if a leaf is corrupt, or UNSUPPORTED.
+static int BGEN_SYM(cimage_get)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    BGEN_ITEM *item_out, void *udata)
+{
+#if defined(BGEN_NOORDER) || !defined(BGEN_LZ4)
+    (void)image, (void)key, (void)item_out, (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    if (image->nleaves == 0) {
+        return BGEN_NOTFOUND;
+    }
+    uint64_t leaf = 0;
+    BGEN_NODE *node = image->root;
+    int depth = 0;
+    int i, found;
+    while (node) {
+        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+        if (found) {
+            if (item_out) {
+                *item_out = node->items[i];
+            }
+            return BGEN_FOUND;
+        }
+        if (node->height == 2) {
+            leaf = (uint64_t)(uintptr_t)node->children[i];
+            node = 0;
+        } else {
+            node = node->children[i];
+        }
+        depth++;
+    }
+    BGEN_NODE *buf = &BGEN_SYM(cbuf);
+    if (!BGEN_SYM(cimage_leaf)(image, leaf, buf)) {
+        return BGEN_IOERROR;
+    }
+    i = BGEN_SYM(search)(buf, key, udata, &found, depth);
+    if (!found) {
+        return BGEN_NOTFOUND;
+    }
+    if (item_out) {
+        *item_out = buf->items[i];
+    }
+    return BGEN_FOUND;
+#endif
+}
+
+#ifdef BGEN_LZ4
+
+// Scan the subtree, starting from the first item at or after the key when
+// 'seek' is true. Returns false to stop, with the status set.
+static bool BGEN_SYM(cimage_node_scan)(BGEN_CIMAGE *image, BGEN_NODE *node,
+    uint64_t leaf, bool seek, BGEN_ITEM key, bool(*iter)(BGEN_ITEM item,
+    void *udata), void *udata, BGEN_NODE *buf, int depth, int *status)
+{
+    int i = 0;
+    int found = 0;
+    BGEN_STAT(visits);
+    if (!node) {
+        if (!BGEN_SYM(cimage_leaf)(image, leaf, buf)) {
+            *status = BGEN_IOERROR;
+            return false;
+        }
+#ifndef BGEN_NOORDER
+        if (seek) {
+            i = BGEN_SYM(search)(buf, key, udata, &found, depth);
+        }
+#endif
+        for (; i < buf->len; i++) {
+            if (!iter(buf->items[i], udata)) {
+                *status = BGEN_STOPPED;
+                return false;
+            }
+        }
+        return true;
+    }
+#ifndef BGEN_NOORDER
+    if (seek) {
+        i = BGEN_SYM(search)(node, key, udata, &found, depth);
+    }
+#endif
+    for (; i <= node->len; i++) {
+        // Everything in the child before a found item is less than the key.
+        if (!found) {
+            BGEN_NODE *child = 0;
+            uint64_t cleaf = 0;
+            if (node->height == 2) {
+                cleaf = (uint64_t)(uintptr_t)node->children[i];
+            } else {
+                child = node->children[i];
+            }
+            if (!BGEN_SYM(cimage_node_scan)(image, child, cleaf, seek, key,
+                iter, udata, buf, depth+1, status))
+            {
+                return false;
+            }
+        }
+        seek = false;
+        found = 0;
+        if (i < node->len && !iter(node->items[i], udata)) {
+            *status = BGEN_STOPPED;
+            return false;
+        }
+    }
+    return true;
+}
+
+static int BGEN_SYM(cimage_scan0)(BGEN_CIMAGE *image, bool seek,
+    BGEN_ITEM key, bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
+{
+    if (image->nleaves == 0) {
+        return BGEN_FINISHED;
+    }
+    // A buffer of its own, since the callback may call cimage_get.
+    BGEN_NODE *buf = (BGEN_NODE*)BGEN_MALLOC(BGEN_ILEAF);
+    if (!buf) {
+        return BGEN_NOMEM;
+    }
+    int status = BGEN_FINISHED;
+    BGEN_SYM(cimage_node_scan)(image, image->root, 0, seek, key, iter, udata,
+        buf, 0, &status);
+    BGEN_FREE(buf);
+    return status;
+}
+
+#endif
+
+// Iterate over all items in a compressed image, in order.
+// Returns FINISHED, STOPPED, NOMEM, IOERROR if a leaf is corrupt, or
+// UNSUPPORTED.
+static int BGEN_SYM(cimage_scan)(BGEN_CIMAGE *image, bool(*iter)(BGEN_ITEM item,
+    void *udata), void *udata)
+{
+#ifndef BGEN_LZ4
+    (void)image, (void)iter, (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    BGEN_ITEM key;
+    memset(&key, 0, sizeof(key));
+    return BGEN_SYM(cimage_scan0)(image, false, key, iter, udata);
+#endif
+}
+
+// Iterate over the items in a compressed image, in order, starting with the
+// first item that is equal to or greater than the key.
+// Returns FINISHED, STOPPED, NOMEM, IOERROR if a leaf is corrupt, or
+// UNSUPPORTED.
+static int BGEN_SYM(cimage_seek)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
+{
+#if defined(BGEN_NOORDER) || !defined(BGEN_LZ4)
+    (void)image, (void)key, (void)iter, (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    return BGEN_SYM(cimage_scan0)(image, true, key, iter, udata);
+#endif
+}
+
+// Bulk loading.
+// The tree is built bottom-up from sorted items in a single pass. Every level
+// is planned up front such that its nodes are spread as evenly as possible,
+// holding close to 'fill' items each while never going below MINITEMS.
+
+// Returns the number of nodes needed for a level that holds 'n' items.
+static size_t BGEN_SYM(load_nodes)(size_t n, int fill) {
+    size_t nodes = (n + 1 + (size_t)fill) / ((size_t)fill + 1);
+    size_t most = (n + 1) / (BGEN_MINITEMS + 1);
+    if (nodes > most) {
+        nodes = most;
+    }
+    return nodes > 0 ? nodes : 1;
+}
+
+// Frees the first 'nchildren' subtrees and the node, but not the items.
+static void BGEN_SYM(load_free)(BGEN_NODE *node, int nchildren) {
+    if (!node->isleaf) {
+        for (int i = 0; i < nchildren; i++) {
+            BGEN_NODE *child = node->children[i];
+            BGEN_SYM(load_free)(child, child->len+1);
+        }
+    }
+    BGEN_SYM(free_node)(node);
+}
+
+static int BGEN_SYM(load_sorted0)(BGEN_NODE **root, const BGEN_ITEM *items,
+    size_t n, int fill, void *udata)
+{
+    (void)udata;
+    size_t lbase[BGEN_MAXHEIGHT];  // number of items per node
+    size_t lextra[BGEN_MAXHEIGHT]; // nodes that get one additional item
+    size_t lnext[BGEN_MAXHEIGHT];  // index of the node being filled
+    BGEN_NODE *lnode[BGEN_MAXHEIGHT]; // node being filled
+    int height = 0;
+    size_t m = n;
+    while (1) {
+        BGEN_ASSERT(height < BGEN_MAXHEIGHT);
+        size_t nodes = BGEN_SYM(load_nodes)(m, fill);
+        // A level of 'nodes' nodes passes 'nodes-1' separators upward.
+        lbase[height] = (m - (nodes - 1)) / nodes;
+        lextra[height] = (m - (nodes - 1)) % nodes;
+        lnext[height] = 0;
+        lnode[height] = 0;
+        height++;
+        if (nodes == 1) {
+            break;
+        }
+        m = nodes - 1;
+    }
+    BGEN_NODE *child = 0;
+    for (size_t i = 0; i < n; i++) {
+        BGEN_NODE *leaf = lnode[0];
+        if (!leaf) {
+            leaf = BGEN_SYM(alloc_node)(1);
+            if (!leaf) {
+                goto nomem;
+            }
+            leaf->height = 1;
+            lnode[0] = leaf;
+        }
+        BGEN_SYM(set_item)(leaf, leaf->len++, items[i], udata);
+        if ((size_t)leaf->len < lbase[0] + (lnext[0] < lextra[0])) {
+            continue;
+        }
+        // The leaf is complete. Climb up, attaching each complete node as
+        // the next child of its parent, until a parent has room for the next
+        // item as its separator.
+        lnode[0] = 0;
+        lnext[0]++;
+        child = leaf;
+        for (int l = 1; l < height; l++) {
+            BGEN_NODE *node = lnode[l];
+            if (!node) {
+                node = BGEN_SYM(alloc_node)(0);
+                if (!node) {
+                    goto nomem;
+                }
+                node->height = l+1;
+                lnode[l] = node;
+            }
+            int j = node->len;
+            node->children[j] = child;
+#ifdef BGEN_COUNTED
+            node->counts[j] = BGEN_SYM(count0)(child);
+#endif
+            child = 0;
+            if ((size_t)j < lbase[l] + (lnext[l] < lextra[l])) {
+                BGEN_ASSERT(i+1 < n);
+                BGEN_SYM(set_item)(node, node->len++, items[++i], udata);
+#ifdef BGEN_SPATIAL
+                node->rects[j] = BGEN_SYM(rect_calc)(node, j, udata);
+#endif
+                break;
+            }
+            // That was the last child for this branch.
+#ifdef BGEN_SPATIAL
+            node->rects[j] = BGEN_SYM(rect_calc)(node, j, udata);
+#endif
+            lnode[l] = 0;
+            lnext[l]++;
+            child = node;
+        }
+    }
+    // The last item always completes the root.
+    BGEN_ASSERT(child && child->height == height);
+    *root = child;
+    return BGEN_INSERTED;
+nomem:
+    if (child) {
+        BGEN_SYM(load_free)(child, child->len+1);
+    }
+    for (int l = 0; l < height; l++) {
+        if (lnode[l]) {
+            BGEN_SYM(load_free)(lnode[l], lnode[l]->len);
+        }
+    }
+    return BGEN_NOMEM;
+}
+
+// Loads an array of items that are already in order into the tree.
+// The 'fill_factor' is the fraction of MAXITEMS that each node should hold,
+// such as 1.0 for fully packed nodes, or 0.7 to leave room for future inserts.
+// It's clamped so that nodes never hold fewer than MINITEMS.
+// For an empty tree the nodes are built directly, bottom-up, which is much
+// faster than inserting the items one at a time. Otherwise the items are
+// appended with push_back.
+// Returns INSERTED, OUTOFORDER, or NOMEM.
+// On OUTOFORDER and NOMEM the empty tree remains empty and the caller still
+// owns the items.
+static int BGEN_SYM(load_sorted)(BGEN_NODE **root, const BGEN_ITEM *items,
+    size_t n, double fill_factor, void *udata)
+{
+#ifndef BGEN_NOORDER
+    for (size_t i = 1; i < n; i++) {
+        if (!BGEN_SYM(less)(items[i-1], items[i], udata)) {
+            return BGEN_OUTOFORDER;
+        }
+    }
+#endif
+    if (n == 0) {
+        return BGEN_INSERTED;
+    }
+    if (*root) {
+        for (size_t i = 0; i < n; i++) {
+            int ret = BGEN_SYM(push_back)(root, items[i], udata);
+            if (ret != BGEN_INSERTED) {
+                return ret;
+            }
+        }
+        return BGEN_INSERTED;
+    }
+    int fill = BGEN_MAXITEMS;
+    if (fill_factor > 0 && fill_factor < 1) {
+        fill = (int)(fill_factor * BGEN_MAXITEMS + 0.5);
+        fill = fill < BGEN_MINITEMS ? BGEN_MINITEMS : fill;
+    }
+    return BGEN_SYM(load_sorted0)(root, items, n, fill, udata);
+}
+
+#ifndef BGEN_NOORDER
+// Compares the key to the item at index i of node, using the node keys
+// when available.
+BGEN_INLINE
+static int BGEN_SYM(compare_at)(BGEN_ITEM key, BGEN_NODE *node, int i,
+    void *udata)
+{
+#ifdef BGEN_SOA
+    return BGEN_SYM(compare_key)(key.key, node->keys[i], udata);
+#else
+    return BGEN_SYM(compare)(key, node->items[i], udata);
+#endif
+}
+
+// Search the node and start loading the chosen child into cache.
+BGEN_INLINE
+static int BGEN_SYM(search_prefetch)(BGEN_NODE *node, BGEN_ITEM key,
+    void *udata, int *found, int depth)
+{
+    int i = BGEN_SYM(search)(node, key, udata, found, depth);
+    if (!*found && !node->isleaf) {
+        BGEN_SYM(prefetch)(node->children[i]);
+    }
+    return i;
+}
+
+// Compares the keys at two indexes, using the tree order.
+// With BGEN_CURVE the curve holds the precomputed curve index of each key.
+BGEN_INLINE
+static bool BGEN_SYM(index_less)(const BGEN_ITEM *keys, const void *curve,
+    size_t x, size_t y, void *udata)
+{
+#ifdef BGEN_CURVE
+    const uint64_t *cindex = (const uint64_t*)curve;
+    if (cindex[x] != cindex[y]) {
+        return cindex[x] < cindex[y];
+    }
+    return BGEN_SYM(less_ties)(keys[x], keys[y], udata);
+#else
+    (void)curve;
+    return BGEN_SYM(less)(keys[x], keys[y], udata);
+#endif
+}
+
+// Stable sort of the indexes of the keys, using the tree order.
+// Returns the array holding the sorted indexes, which is either idx or tmp.
+static size_t *BGEN_SYM(sort_index)(const BGEN_ITEM *keys, const void *curve,
+    size_t *idx, size_t *tmp, size_t n, void *udata)
+{
+    // Insertion sort small runs, then merge them bottom-up.
+    const size_t run = 16;
+    for (size_t lo = 0; lo < n; lo += run) {
+        size_t hi = lo+run < n ? lo+run : n;
+        for (size_t i = lo+1; i < hi; i++) {
+            size_t x = idx[i];
+            size_t j = i;
+            while (j > lo &&
+                BGEN_SYM(index_less)(keys, curve, x, idx[j-1], udata))
+            {
+                idx[j] = idx[j-1];
+                j--;
+            }
+            idx[j] = x;
+        }
+    }
+    for (size_t w = run; w < n; w *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2*w) {
+            size_t mid = lo+w < n ? lo+w : n;
+            size_t hi = mid+w < n ? mid+w : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                if (BGEN_SYM(index_less)(keys, curve, idx[j], idx[i], udata)) {
+                    tmp[k++] = idx[j++];
+                } else {
+                    tmp[k++] = idx[i++];
+                }
+            }
+            while (i < mid) {
+                tmp[k++] = idx[i++];
+            }
+            while (j < hi) {
+                tmp[k++] = idx[j++];
+            }
+        }
+        size_t *swap = idx;
+        idx = tmp;
+        tmp = swap;
+    }
+    return idx;
+}
+
+// Orders the keys for a batch operation.
+// Returns 0 when the keys are already in order and no index is needed,
+// 1 when the sorted index was allocated into mem and ord, or -1 on NOMEM.
+static int BGEN_SYM(batch_order)(const BGEN_ITEM *keys, size_t n,
+    size_t **mem, size_t **ord, void *udata)
+{
+    *mem = 0;
+    *ord = 0;
+    size_t i = 1;
+    while (i < n && !BGEN_SYM(less)(keys[i], keys[i-1], udata)) {
+        i++;
+    }
+    if (i >= n) {
+        return 0;
+    }
+#ifdef BGEN_CURVE
+    // The curve index of each key is computed once, after the two index
+    // arrays.
+    size_t size = sizeof(size_t)*2 + sizeof(uint64_t);
+#else
+    size_t size = sizeof(size_t)*2;
+#endif
+    if (n > (size_t)-1 / size) {
+        return -1;
+    }
+    *mem = (size_t*)BGEN_MALLOC(size*n);
+    if (!*mem) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        (*mem)[i] = i;
+    }
+    void *curve = 0;
+#ifdef BGEN_CURVE
+    uint64_t *cindex = (uint64_t*)(*mem+n*2);
+    for (i = 0; i < n; i++) {
+        cindex[i] = BGEN_SYM(curve_index)(keys[i], udata);
+    }
+    curve = cindex;
+#endif
+    *ord = BGEN_SYM(sort_index)(keys, curve, *mem, *mem+n, n, udata);
+    return 1;
+}
+
+// Looks up the sorted keys [lo,hi) in node. The keys descending into the same
+// child are searched together, and the child of the group that follows is
+// prefetched before descending.
+static void BGEN_SYM(get_many1)(BGEN_NODE *node, const BGEN_ITEM *keys,
+    const size_t *ord, size_t lo, size_t hi, BGEN_ITEM *items_out,
+    int *statuses, size_t *nfound, void *udata, int depth)
+{
+    size_t j = lo;
+    size_t k = ord ? ord[j] : j;
+    int found;
+    int i = BGEN_SYM(search_prefetch)(node, keys[k], udata, &found, depth);
+    while (1) {
+        size_t e = j+1;
+        if (found || node->isleaf) {
+            if (found) {
+                if (items_out) {
+                    items_out[k] = node->items[i];
+                }
+                (*nfound)++;
+            }
+            if (statuses) {
+                statuses[k] = found ? BGEN_FOUND : BGEN_NOTFOUND;
+            }
+        } else {
+            while (e < hi && (i == node->len ||
+                BGEN_SYM(compare_at)(keys[ord ? ord[e] : e], node, i,
+                    udata) < 0))
+            {
+                e++;
+            }
+        }
+        if (e == hi) {
+            if (!found && !node->isleaf) {
+                BGEN_SYM(get_many1)(node->children[i], keys, ord, j, e,
+                    items_out, statuses, nfound, udata, depth+1);
+            }
+            return;
+        }
+        size_t k2 = ord ? ord[e] : e;
+        int found2;
+        int i2 = BGEN_SYM(search_prefetch)(node, keys[k2], udata, &found2,
+            depth);
+        if (!found && !node->isleaf) {
+            BGEN_SYM(get_many1)(node->children[i], keys, ord, j, e,
+                items_out, statuses, nfound, udata, depth+1);
+        }
+        j = e;
+        k = k2;
+        i = i2;
+        found = found2;
+    }
+}
+#endif
+
+// Gets many items at once.
+// The keys are sorted, when not already in order, and looked up in a single
+// walk of the tree.
+// items_out and statuses are optional. When provided they must have room for
+// nkeys entries and each entry corresponds to the key at the same position.
+// Each status is FOUND or NOTFOUND.
+// Returns FOUND if all keys were found, otherwise NOTFOUND.
+static int BGEN_SYM(get_many)(BGEN_NODE **root, const BGEN_ITEM *keys,
+    size_t nkeys, BGEN_ITEM *items_out, int *statuses, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)keys, (void)nkeys, (void)items_out, (void)statuses;
+    (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    if (nkeys == 0) {
+        return BGEN_FOUND;
+    }
+    size_t nfound = 0;
+    if (!*root) {
+        for (size_t i = 0; statuses && i < nkeys; i++) {
+            statuses[i] = BGEN_NOTFOUND;
+        }
+        return BGEN_NOTFOUND;
+    }
+    size_t *mem, *ord;
+    if (BGEN_SYM(batch_order)(keys, nkeys, &mem, &ord, udata) < 0) {
+        // Not enough memory to sort the keys. Look them up one at a time.
+        for (size_t i = 0; i < nkeys; i++) {
+            int ret = BGEN_SYM(get)(root, keys[i],
+                items_out ? &items_out[i] : 0, udata);
+            if (statuses) {
+                statuses[i] = ret;
+            }
+            nfound += ret == BGEN_FOUND;
+        }
+    } else {
+        BGEN_SYM(get_many1)(*root, keys, ord, 0, nkeys, items_out, statuses,
+            &nfound, udata, 0);
+        if (mem) {
+            BGEN_FREE(mem);
+        }
+    }
+    return nfound == nkeys ? BGEN_FOUND : BGEN_NOTFOUND;
+#endif
+}
+
+#ifndef BGEN_NOORDER
+// The path to the leaf of the last batch insert and the separator items that
+// bound the leaf.
+struct BGEN_SYM(bcursor) {
+    BGEN_NODE *nodes[BGEN_MAXHEIGHT];
+    int path[BGEN_MAXHEIGHT];
+    int depth;          // depth of the leaf
+    BGEN_NODE *lonode;  // lower bound, if any
+    int loi;
+    BGEN_NODE *hinode;  // upper bound, if any
+    int hii;
+};
+
+// Copy-on-write the path to the leaf where the item belongs.
+// Returns 1 when the cursor is at a leaf, 0 if the item is in a branch or the
+// tree is empty, or -1 on NOMEM.
+static int BGEN_SYM(bcursor_seek)(BGEN_NODE **root, BGEN_ITEM item,
+    struct BGEN_SYM(bcursor) *cur, void *udata)
+{
+    if (!*root) {
+        return 0;
+    }
+    if (!BGEN_SYM(cow)(root, udata)) {
+        return -1;
+    }
+    cur->lonode = 0;
+    cur->hinode = 0;
+    BGEN_NODE *node = *root;
+    int depth = 0;
+    while (1) {
+        cur->nodes[depth] = node;
+        if (node->isleaf) {
+            cur->depth = depth;
+            return 1;
+        }
+        int found;
+        int i = BGEN_SYM(search)(node, item, udata, &found, depth);
+        if (found) {
+            return 0;
+        }
+        if (i > 0) {
+            cur->lonode = node;
+            cur->loi = i-1;
+        }
+        if (i < node->len) {
+            cur->hinode = node;
+            cur->hii = i;
+        }
+        if (!BGEN_SYM(cow)(&node->children[i], udata)) {
+            return -1;
+        }
+        cur->path[depth] = i;
+        node = node->children[i];
+        depth++;
+    }
+}
+
+// Returns true if the item belongs in the leaf of the cursor.
+BGEN_INLINE
+static bool BGEN_SYM(bcursor_owns)(struct BGEN_SYM(bcursor) *cur,
+    BGEN_ITEM item, void *udata)
+{
+    return (!cur->hinode ||
+            BGEN_SYM(compare_at)(item, cur->hinode, cur->hii, udata) < 0) &&
+           (!cur->lonode ||
+            BGEN_SYM(compare_at)(item, cur->lonode, cur->loi, udata) > 0);
+}
+
+// Insert the item into the leaf of the cursor.
+// Returns INSERTED or REPLACED, or 0 if the leaf is full.
+static int BGEN_SYM(bcursor_insert)(struct BGEN_SYM(bcursor) *cur,
+    BGEN_ITEM item, BGEN_ITEM *olditem, void *udata)
+{
+    BGEN_NODE *leaf = cur->nodes[cur->depth];
+    int found;
+    int i = BGEN_SYM(search)(leaf, item, udata, &found, cur->depth);
+    if (found) {
+        if (olditem) {
+            *olditem = leaf->items[i];
+        }
+        BGEN_SYM(set_item)(leaf, i, item, udata);
+#ifdef BGEN_SPATIAL
+        for (int d = cur->depth-1; d >= 0; d--) {
+            BGEN_NODE *node = cur->nodes[d];
+            node->rects[cur->path[d]] = BGEN_SYM(rect_calc)(node,
+                cur->path[d], udata);
+        }
+#endif
+        return BGEN_REPLACED;
+    }
+    if (leaf->len == BGEN_MAXITEMS) {
+        return 0;
+    }
+    BGEN_SYM(shift_right)(leaf, i, 1);
+    BGEN_SYM(set_item)(leaf, i, item, udata);
+#if defined(BGEN_COUNTED) || defined(BGEN_SPATIAL)
+#ifdef BGEN_SPATIAL
+    BGEN_RECT irect = BGEN_SYM(item_rect)(item, udata);
+#endif
+    for (int d = 0; d < cur->depth; d++) {
+        BGEN_NODE *node = cur->nodes[d];
+        int j = cur->path[d];
+#ifdef BGEN_COUNTED
+        node->counts[j]++;
+#endif
+#ifdef BGEN_SPATIAL
+        node->rects[j] = BGEN_SYM(rect_join)(node->rects[j], irect);
+#endif
+    }
+#endif
+    return BGEN_INSERTED;
+}
+#endif
+
+// Inserts many items at once.
+// The items are sorted, when not already in order, and inserted in that
+// order. Consecutive items that belong in the same leaf are inserted without
+// walking the tree again. Items with equal keys are inserted in the order
+// they were provided, so the last one wins, just as with insert.
+// olditems and statuses are optional. When provided they must have room for
+// nitems entries and each entry corresponds to the item at the same position.
+// Each status is INSERTED, REPLACED, or NOMEM.
+// Returns INSERTED, or NOMEM if any item could not be inserted. In that case
+// the items with the NOMEM status were not inserted.
+static int BGEN_SYM(insert_many)(BGEN_NODE **root, const BGEN_ITEM *items,
+    size_t nitems, BGEN_ITEM *olditems, int *statuses, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)items, (void)nitems, (void)olditems, (void)statuses;
+    (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    size_t *mem, *ord;
+    int ordret = BGEN_SYM(batch_order)(items, nitems, &mem, &ord, udata);
+    struct BGEN_SYM(bcursor) cur;
+    bool valid = false;
+    int ret = BGEN_INSERTED;
+    for (size_t j = 0; j < nitems; j++) {
+        size_t k = ord ? ord[j] : j;
+        BGEN_ITEM *olditem = olditems ? &olditems[k] : 0;
+        int status = 0;
+        if (ordret >= 0) {
+            // When there wasn't enough memory to sort the items, they are
+            // simply inserted one at a time.
+            if (valid && !BGEN_SYM(bcursor_owns)(&cur, items[k], udata)) {
+                valid = false;
+            }
+            if (!valid) {
+                int seek = BGEN_SYM(bcursor_seek)(root, items[k], &cur, udata);
+                status = seek < 0 ? BGEN_NOMEM : 0;
+                valid = seek > 0;
+            }
+            if (valid) {
+                status = BGEN_SYM(bcursor_insert)(&cur, items[k], olditem,
+                    udata);
+            }
+        }
+        if (!status) {
+            status = BGEN_SYM(insert)(root, items[k], olditem, udata);
+            valid = false;
+        }
+        if (statuses) {
+            statuses[k] = status;
+        }
+        if (status == BGEN_NOMEM) {
+            for (j++; statuses && j < nitems; j++) {
+                statuses[ord ? ord[j] : j] = BGEN_NOMEM;
+            }
+            ret = BGEN_NOMEM;
+            break;
+        }
+    }
+    if (mem) {
+        BGEN_FREE(mem);
+    }
+    return ret;
+#endif
+}
+
+// Loads an array of items, in any order, into the tree.
+// The items are sorted and then, for an empty tree, built into nodes
+// bottom-up just like load_sorted, using the same 'fill_factor'. Otherwise
+// they are added with insert_many.
+// With BGEN_HILBERT or BGEN_ZORDER, the items that are close together in space
+// are packed into the same nodes.
+// When items compare equal only the last one is loaded, just as with insert,
+// and the others are still owned by the caller.
+// Returns INSERTED or NOMEM. On NOMEM the empty tree remains empty and the
+// caller still owns the items.
+static int BGEN_SYM(load)(BGEN_NODE **root, const BGEN_ITEM *items, size_t n,
+    double fill_factor, void *udata)
+{
+#ifdef BGEN_NOORDER
+    return BGEN_SYM(load_sorted)(root, items, n, fill_factor, udata);
+#else
+    if (*root) {
+        return BGEN_SYM(insert_many)(root, items, n, 0, 0, udata);
+    }
+    size_t *mem, *ord;
+    int ordret = BGEN_SYM(batch_order)(items, n, &mem, &ord, udata);
+    if (ordret < 0) {
+        return BGEN_NOMEM;
+    }
+    if (ordret == 0) {
+        // Already in order, and when there are no equal items they can be
+        // loaded as they are.
+        int ret = BGEN_SYM(load_sorted)(root, items, n, fill_factor, udata);
+        if (ret != BGEN_OUTOFORDER) {
+            return ret;
+        }
+    }
+    int ret = BGEN_NOMEM;
+    BGEN_ITEM *sorted = 0;
+    if (n <= (size_t)-1 / sizeof(BGEN_ITEM)) {
+        sorted = (BGEN_ITEM*)BGEN_MALLOC(sizeof(BGEN_ITEM)*n);
+    }
+    if (sorted) {
+        size_t m = 0;
+        for (size_t j = 0; j < n; j++) {
+            BGEN_ITEM item = items[ord ? ord[j] : j];
+            if (m > 0 && !BGEN_SYM(less)(sorted[m-1], item, udata)) {
+                sorted[m-1] = item;
+            } else {
+                sorted[m++] = item;
+            }
+        }
+        ret = BGEN_SYM(load_sorted)(root, sorted, m, fill_factor, udata);
+        BGEN_FREE(sorted);
+    }
+    if (mem) {
+        BGEN_FREE(mem);
+    }
+    return ret;
+#endif
+}
+
+#ifdef BGEN_SPATIAL
+
+// The nearby scanner is a kNN operation that uses a heap-based priority queue.
+
+#define BGEN_PQUEUE struct BGEN_SYM(pqueue)
+#define BGEN_PITEM struct BGEN_SYM(pitem)
+#define BGEN_DSIZE 8
+
+BGEN_PITEM {
+    BGEN_RTYPE dist;
+    uint64_t index;    // 1+ = node, item = UINT64_MAX
+    union {
+        BGEN_ITEM item;
+        BGEN_NODE *node;
+    };
+};
+
+BGEN_PQUEUE {
+    BGEN_PITEM *items;
+    size_t len;
+    size_t cap;
+    uint64_t index; // index counter, this increments with every added node.
+};
+
+static void BGEN_SYM(pqueue_init)(BGEN_PQUEUE *queue) {
+    queue->items = 0;
+    queue->len = 0;
+    queue->cap = 0;
+    queue->index = 0;
+}
+
+static int BGEN_SYM(pcompare)(BGEN_PQUEUE *queue, size_t i, size_t j, 
+    void *udata)
+{
+    int cmp;
+    // Compare distances
+    cmp = queue->items[i].dist < queue->items[j].dist ? -1 : 
+          queue->items[i].dist > queue->items[j].dist;
+    if (cmp != 0) {
+        return cmp;
+    }
+    // Distances are equal, compare the indexes
     cmp = queue->items[i].index < queue->items[j].index ? -1 : 
           queue->items[i].index > queue->items[j].index;
     if (cmp != 0) {
@@ -3575,8 +7533,10 @@ static BGEN_PITEM BGEN_SYM(pswap_remove)(BGEN_PQUEUE *queue, size_t i) {
 
 static int BGEN_SYM(ppush0)(BGEN_PQUEUE *queue, BGEN_PITEM item, void *udata) {
     if (queue->len == queue->cap) {
+        BGEN_STAT(heap_grows);
         queue->cap = queue->cap == 0 ? 8 : queue->cap*2;
-        BGEN_PITEM *items2 = BGEN_MALLOC(sizeof(BGEN_PITEM)*queue->cap);
+        BGEN_PITEM *items2 =
+            (BGEN_PITEM*)BGEN_MALLOC(sizeof(BGEN_PITEM)*queue->cap);
         if (!items2) {
             return BGEN_NOMEM;
         }
@@ -3659,6 +7619,7 @@ BGEN_SNODE {
 #define BGEN_SCANDESC   1
 #define BGEN_INTERSECTS 2
 #define BGEN_NEARBY     3
+#define BGEN_NEARBYK    4
 
 BGEN_ITER {
     BGEN_NODE **root;         // root node
@@ -3677,6 +7638,12 @@ BGEN_ITER {
             BGEN_PQUEUE queue; // priority queue
             BGEN_ITEM nitem; // current nearby item
         };
+        struct {
+            // k nearest neighbors
+            BGEN_NEIGHBOR *kbuf;
+            size_t klen;
+            size_t kpos;
+        };
 #endif
         struct  {
 #ifdef BGEN_SPATIAL
@@ -3804,6 +7771,13 @@ static void BGEN_SYM(iter_next_asc)(BGEN_ITER *iter) {
             iter->valid = false;
             return;
         }
+#ifdef BGEN_PREFETCH
+        // Start loading the next sibling while this child is iterated.
+        if (snode->index < snode->node->len) {
+            BGEN_SYM(prefetch)(snode->node->children[snode->index+1]);
+        }
+#endif
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ 
             snode->node->children[snode->index], -1 };
     }
@@ -3843,7 +7817,14 @@ static void BGEN_SYM(iter_next_desc)(BGEN_ITER *iter) {
             iter->valid = false;
             return;
         }
+#ifdef BGEN_PREFETCH
+        // Start loading the previous sibling while this child is iterated.
+        if (snode->index > 0) {
+            BGEN_SYM(prefetch)(snode->node->children[snode->index-1]);
+        }
+#endif
         BGEN_NODE *node = snode->node->children[snode->index];
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ node, node->len };
         snode = &iter->stack[iter->nstack-1];
     }
@@ -3857,6 +7838,7 @@ static int BGEN_SYM(nearby_addnodecontents)(BGEN_PQUEUE *queue,
     void *target, void *udata), void *udata, bool mut)
 {
     BGEN_ASSERT(!mut || !BGEN_SYM(shared)(node));
+    BGEN_STAT(visits);
     for (int i = 0; i < node->len; i++) {
         BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
         BGEN_RTYPE d = dist(rect.min, rect.max, target, udata);
@@ -3906,6 +7888,124 @@ static void BGEN_SYM(iter_next_nearby)(BGEN_ITER *iter) {
     iter->valid = false;
 }
 
+// k-nearest neighbors, without allocating.
+// A depth-first branch-and-bound search that keeps the k best items found so
+// far in a max-heap in the caller's buffer. The children of each branch are
+// visited nearest first, and a child is skipped when it is no nearer than
+// the current k-th best item.
+
+struct BGEN_SYM(knn) {
+    BGEN_NEIGHBOR *heap;
+    size_t len;
+    size_t k;
+    void *target;
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+        void *target, void *udata);
+    void *udata;
+};
+
+static void BGEN_SYM(knn_siftdown)(BGEN_NEIGHBOR *heap, size_t len,
+    size_t i)
+{
+    while (1) {
+        size_t l = i*2+1;
+        size_t r = l+1;
+        size_t m = i;
+        if (l < len && heap[l].dist > heap[m].dist) {
+            m = l;
+        }
+        if (r < len && heap[r].dist > heap[m].dist) {
+            m = r;
+        }
+        if (m == i) {
+            return;
+        }
+        BGEN_NEIGHBOR tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+// Returns true if a candidate at the distance can still make the k best.
+BGEN_INLINE
+static bool BGEN_SYM(knn_wants)(struct BGEN_SYM(knn) *knn, BGEN_RTYPE dist) {
+    return knn->len < knn->k || dist < knn->heap[0].dist;
+}
+
+static void BGEN_SYM(knn_add)(struct BGEN_SYM(knn) *knn, BGEN_ITEM item) {
+    BGEN_RECT rect = BGEN_SYM(item_rect)(item, knn->udata);
+    BGEN_RTYPE dist = knn->dist(rect.min, rect.max, knn->target, knn->udata);
+    if (!BGEN_SYM(knn_wants)(knn, dist)) {
+        return;
+    }
+    BGEN_NEIGHBOR *heap = knn->heap;
+    if (knn->len < knn->k) {
+        // sift up
+        size_t i = knn->len++;
+        while (i > 0 && heap[(i-1)/2].dist < dist) {
+            heap[i] = heap[(i-1)/2];
+            i = (i-1)/2;
+        }
+        heap[i] = (BGEN_NEIGHBOR){ .item = item, .dist = dist };
+    } else {
+        heap[0] = (BGEN_NEIGHBOR){ .item = item, .dist = dist };
+        BGEN_SYM(knn_siftdown)(heap, knn->len, 0);
+    }
+}
+
+static void BGEN_SYM(knn_node)(struct BGEN_SYM(knn) *knn, BGEN_NODE *node) {
+    BGEN_STAT(visits);
+    for (int i = 0; i < node->len; i++) {
+        BGEN_SYM(knn_add)(knn, node->items[i]);
+    }
+    if (node->isleaf) {
+        return;
+    }
+    // Order the children by distance, nearest first.
+    BGEN_RTYPE dists[BGEN_MAXITEMS+1];
+    short order[BGEN_MAXITEMS+1];
+    for (int i = 0; i <= node->len; i++) {
+        BGEN_RTYPE dist = knn->dist(node->rects[i].min, node->rects[i].max,
+            knn->target, knn->udata);
+        int j = i;
+        while (j > 0 && dists[j-1] > dist) {
+            dists[j] = dists[j-1];
+            order[j] = order[j-1];
+            j--;
+        }
+        dists[j] = dist;
+        order[j] = (short)i;
+    }
+    for (int i = 0; i <= node->len; i++) {
+        if (!BGEN_SYM(knn_wants)(knn, dists[i])) {
+            // All that follow are further away.
+            break;
+        }
+        BGEN_SYM(knn_node)(knn, node->children[order[i]]);
+    }
+}
+
+// Fill the buffer with the k nearest items, ordered nearest first.
+// Returns the number of items.
+static size_t BGEN_SYM(knn_search)(BGEN_NODE *root, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf, void *udata)
+{
+    struct BGEN_SYM(knn) knn = { buf, 0, k, target, dist, udata };
+    if (root && k > 0) {
+        BGEN_SYM(knn_node)(&knn, root);
+    }
+    // Heap sort to nearest first.
+    for (size_t n = knn.len; n > 1; n--) {
+        BGEN_NEIGHBOR tmp = buf[0];
+        buf[0] = buf[n-1];
+        buf[n-1] = tmp;
+        BGEN_SYM(knn_siftdown)(buf, n-1, 0);
+    }
+    return knn.len;
+}
+
 #endif
 
 // Move iterator cursor to the next item.
@@ -3918,6 +8018,9 @@ static void BGEN_SYM(iter_next)(BGEN_ITER *iter) {
         BGEN_SYM(iter_next_asc)(iter);
     } else if (iter->kind == BGEN_NEARBY) {
         BGEN_SYM(iter_next_nearby)(iter);
+    } else if (iter->kind == BGEN_NEARBYK) {
+        iter->kpos++;
+        iter->valid = iter->kpos < iter->klen;
     } else
 #endif
     if (iter->kind == BGEN_SCAN) {
@@ -3948,10 +8051,14 @@ static void BGEN_SYM(iter_scan)(BGEN_ITER *iter) {
     }
     BGEN_NODE *node = *iter->root;
     while (1) {
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ node, 0 };
         if (node->isleaf) {
             return;
         }
+#ifdef BGEN_PREFETCH
+        BGEN_SYM(prefetch)(node->children[1]);
+#endif
         if (iter->mut && !BGEN_SYM(cow)(&node->children[0], iter->udata)) {
             iter->status = BGEN_NOMEM;
             iter->valid = false;
@@ -3975,11 +8082,15 @@ static void BGEN_SYM(iter_scan_desc)(BGEN_ITER *iter) {
     }
     BGEN_NODE *node = *iter->root;
     while (1) {
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ node, node->len };
         if (node->isleaf) {
             iter->stack[iter->nstack-1].index--;
             return;
         }
+#ifdef BGEN_PREFETCH
+        BGEN_SYM(prefetch)(node->children[node->len-1]);
+#endif
         if (iter->mut && !BGEN_SYM(cow)(&node->children[node->len],
             iter->udata))
         {
@@ -3995,6 +8106,7 @@ static void BGEN_SYM(iter_scan_desc)(BGEN_ITER *iter) {
 // Finds the first intersecting item and fills the stack along the way.
 static bool BGEN_SYM(iter_intersects_first)(BGEN_ITER *iter, BGEN_NODE *node) {
     int depth = iter->nstack;
+    BGEN_STAT(visits);
     iter->stack[iter->nstack++] = (BGEN_SNODE){ node, 0 };
     if (node->isleaf) {
         for (int i = 0; i < node->len; i++) {
@@ -4062,6 +8174,11 @@ static void BGEN_SYM(iter_seek)(BGEN_ITER *iter, BGEN_ITEM key) {
             iter->valid = false;
             return;
         }
+#ifdef BGEN_PREFETCH
+        if (i < node->len) {
+            BGEN_SYM(prefetch)(node->children[i+1]);
+        }
+#endif
         node = node->children[i];
         depth++;
     }
@@ -4082,6 +8199,7 @@ static void BGEN_SYM(iter_seek_at)(BGEN_ITER *iter, size_t index) {
     }
     BGEN_NODE *node = *iter->root;
     while (1) {
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ node, 0 };
         if (node->isleaf) {
             if (index >= (size_t)node->len) {
@@ -4129,6 +8247,7 @@ static void BGEN_SYM(iter_seek_at_desc)(BGEN_ITER *iter, size_t index) {
     }
     BGEN_NODE *node = *iter->root;
     while (1) {
+        BGEN_STAT(visits);
         iter->stack[iter->nstack++] = (BGEN_SNODE){ node, 0 };
         if (node->isleaf) {
             if (index >= (size_t)node->len) {
@@ -4222,6 +8341,31 @@ static void BGEN_SYM(iter_nearby)(BGEN_ITER *iter, void *target,
 #endif
 }
 
+// Iterate over the k nearest items, nearest first, without allocating.
+// The buffer must have room for k neighbors, and must stay valid while
+// iterating. Mutable iterators are not supported by this kind.
+static void BGEN_SYM(iter_nearby_k)(BGEN_ITER *iter, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf)
+{
+    BGEN_SYM(iter_reset)(iter, BGEN_NEARBYK);
+#ifndef BGEN_SPATIAL
+    (void)target, (void)dist, (void)k, (void)buf;
+    iter->valid = false;
+#else
+    if (iter->mut) {
+        iter->status = BGEN_UNSUPPORTED;
+        iter->valid = false;
+        return;
+    }
+    iter->kbuf = buf;
+    iter->klen = BGEN_SYM(knn_search)(*iter->root, target, dist, k, buf,
+        iter->udata);
+    iter->kpos = 0;
+    iter->valid = iter->klen > 0;
+#endif
+}
+
 // Get the current iterator item.
 // REQUIRES: iter_valid() and item != NULL
 static void BGEN_SYM(iter_item)(BGEN_ITER *iter, BGEN_ITEM *item) {
@@ -4230,6 +8374,10 @@ static void BGEN_SYM(iter_item)(BGEN_ITER *iter, BGEN_ITEM *item) {
         *item = iter->nitem;
         return;
     }
+    if (iter->kind == BGEN_NEARBYK) {
+        *item = iter->kbuf[iter->kpos].item;
+        return;
+    }
 #endif
     BGEN_SNODE *snode = &iter->stack[iter->nstack-1];
     *item = snode->node->items[snode->index];
@@ -4262,6 +8410,7 @@ static bool BGEN_SYM(node_intersects)(BGEN_NODE *node, BGEN_RECT target,
     bool(*iter)(BGEN_ITEM item, void *udata),
     void *udata)
 {
+    BGEN_STAT(visits);
     if (node->isleaf) {
         for (int i = 0; i < node->len; i++) {
             BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
@@ -4316,85 +8465,588 @@ static int BGEN_SYM(intersects)(BGEN_NODE **root, BGEN_RTYPE min[],
         }
     }
 #endif
-    return status;
+    return status;
+}
+
+#ifdef BGEN_SPATIAL
+static bool BGEN_SYM(node_intersects_mut)(BGEN_NODE *node, BGEN_RECT target,
+    bool(*iter)(BGEN_ITEM item, void *udata),
+    void *udata, int *status)
+{
+    BGEN_STAT(visits);
+    if (node->isleaf) {
+        for (int i = 0; i < node->len; i++) {
+            BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
+            if (BGEN_SYM(rect_intersects)(target, rect)) {
+                if (!iter(node->items[i], udata)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    for (int i = 0; i < node->len; i++) {
+        if (BGEN_SYM(rect_intersects)(target, node->rects[i])) {
+            if (!BGEN_SYM(cow)(&node->children[i], udata)) {
+                *status = BGEN_NOMEM;
+                return false;
+            }
+            BGEN_NODE *child = node->children[i];
+            if (!BGEN_SYM(node_intersects_mut)(child, target, iter, udata, 
+                status))
+            {
+                return false;
+            }
+            BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
+            if (BGEN_SYM(rect_intersects)(target, rect)) {
+                if (!iter(node->items[i], udata)) {
+                    return false;
+                }
+            }
+        }
+    }
+    if (!BGEN_SYM(cow)(&node->children[node->len], udata)) {
+        *status = BGEN_NOMEM;
+        return false;
+    }
+    if (BGEN_SYM(rect_intersects)(target, node->rects[node->len])) {
+        BGEN_NODE *child = node->children[node->len];
+        if (!BGEN_SYM(node_intersects_mut)(child, target, iter, udata, status)){
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static int BGEN_SYM(intersects_mut)(BGEN_NODE **root, 
+    BGEN_RTYPE min[], BGEN_RTYPE max[], 
+    bool(*iter)(BGEN_ITEM item, void *udata),
+    void *udata)
+{  
+    (void)root, (void)min, (void)max, (void)iter, (void)udata; 
+    int status = BGEN_FINISHED;
+#ifdef BGEN_SPATIAL
+    if (*root) {
+        BGEN_RECT target;
+        for (int i = 0; i < BGEN_DIMS; i++) {
+            target.min[i] = min[i];
+        }
+        for (int i = 0; i < BGEN_DIMS; i++) {
+            target.max[i] = max[i];
+        }
+        if (!BGEN_SYM(cow)(root, udata)) {
+            return BGEN_NOMEM;
+        }
+        if (!BGEN_SYM(node_intersects_mut)(*root, target, iter, udata, &status))
+        {
+            if (status == BGEN_FINISHED) {
+                status = BGEN_STOPPED;
+            }
+        }
+    }
+#endif
+    return status;
+}
+
+// Parallel scanning.
+// The top levels of the tree are split into parts, in order, each holding
+// whole subtrees and the items between them. Only the subtrees that overlap
+// the range, or the rectangle, are split further. With BGEN_COUNTED the parts
+// are balanced by their item counts. The parts are handed out to the jobs one
+// at a time, until all have been visited.
+// The jobs are run by the exec callback, when one is given. It must call
+// run(arg) njobs times and return once all of the calls have returned. The
+// calls may be made from any threads, such as those of a pool, and at the
+// same time, unless BGEN_NOATOMICS is defined without BGEN_PARALLEL. Any of
+// them may visit all parts, so running them one after another is fine too.
+// Without exec, when BGEN_PARALLEL is defined, nthreads threads (including
+// the calling thread) are used, with pthreads started for the call.
+// Otherwise the parts are visited in order on the calling thread.
+// The iter callback receives the part number of each item, starting at zero
+// and less than nthreads*4. Items of the same part arrive in order, and the
+// parts follow the tree order, so results collected per part can be joined
+// in order afterwards. When the jobs run at the same time the callback may
+// be called from any of them at once, and returning false stops them all.
+#ifdef BGEN_PARALLEL
+#include <pthread.h>
+#endif
+#if defined(BGEN_PARALLEL) || !defined(BGEN_NOATOMICS)
+#define BGEN_PATOMIC
+#include BGEN_STDATOMIC
+#endif
+
+#define BGEN_PTASKS 4 // parts per thread
+
+// A subtree when index is -1, otherwise the item at index of node.
+struct BGEN_SYM(pentry) {
+    BGEN_NODE *node;
+    int index;
+};
+
+struct BGEN_SYM(pjob) {
+    bool(*iter)(BGEN_ITEM item, int part, void *udata);
+    void *udata;
+#ifndef BGEN_NOORDER
+    bool bounded; // only the items in [lo, hi)
+    BGEN_ITEM lo;
+    BGEN_ITEM hi;
+#endif
+#ifdef BGEN_SPATIAL
+    bool intersects;
+    BGEN_RECT target;
+#endif
+    bool counting; // count the items rather than visit them
+    struct BGEN_SYM(pentry) *entries;
+    size_t *starts; // the entries of part i are starts[i] to starts[i+1]
+    int nparts;
+#ifdef BGEN_PATOMIC
+    BGEN_STD atomic_int next;
+    BGEN_STD atomic_bool stop;
+    BGEN_STD atomic_size_t count;
+#else
+    int next;
+    bool stop;
+    size_t count;
+#endif
+};
+
+// The remaining fields are set by 'parallel'.
+static void BGEN_SYM(pjob_init)(struct BGEN_SYM(pjob) *job,
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    job->iter = iter;
+    job->udata = udata;
+#ifndef BGEN_NOORDER
+    job->bounded = false;
+#endif
+#ifdef BGEN_SPATIAL
+    job->intersects = false;
+#endif
+    job->counting = false;
+}
+
+static bool BGEN_SYM(pstopped)(struct BGEN_SYM(pjob) *job) {
+#ifdef BGEN_PATOMIC
+    return BGEN_STD atomic_load_explicit(&job->stop,
+        BGEN_STD memory_order_relaxed);
+#else
+    return job->stop;
+#endif
+}
+
+static bool BGEN_SYM(pskip)(struct BGEN_SYM(pjob) *job, BGEN_ITEM item) {
+    (void)job, (void)item;
+#ifdef BGEN_SPATIAL
+    if (job->intersects) {
+        BGEN_RECT rect = BGEN_SYM(item_rect)(item, job->udata);
+        return !BGEN_SYM(rect_intersects)(job->target, rect);
+    }
+#endif
+    return false;
+}
+
+// Returns true if the item is in the range of the job, if it has one.
+static bool BGEN_SYM(pinrange)(struct BGEN_SYM(pjob) *job, BGEN_ITEM item) {
+    (void)job, (void)item;
+#ifndef BGEN_NOORDER
+    if (job->bounded) {
+        return !BGEN_SYM(less)(item, job->lo, job->udata) &&
+            BGEN_SYM(less)(item, job->hi, job->udata);
+    }
+#endif
+    return true;
+}
+
+// Returns true if child i of the node may hold items of the job.
+static bool BGEN_SYM(pchild)(struct BGEN_SYM(pjob) *job, BGEN_NODE *node,
+    int i)
+{
+    (void)job, (void)node, (void)i;
+#ifndef BGEN_NOORDER
+    if (job->bounded) {
+        if (i < node->len &&
+            !BGEN_SYM(less)(job->lo, node->items[i], job->udata))
+        {
+            return false;
+        }
+        if (i > 0 && !BGEN_SYM(less)(node->items[i-1], job->hi, job->udata)) {
+            return false;
+        }
+    }
+#endif
+#ifdef BGEN_SPATIAL
+    if (job->intersects &&
+        !BGEN_SYM(rect_intersects)(job->target, node->rects[i]))
+    {
+        return false;
+    }
+#endif
+    return true;
+}
+
+// Returns the number of items of the job in the subtree.
+static size_t BGEN_SYM(pcount)(struct BGEN_SYM(pjob) *job, BGEN_NODE *node) {
+#ifndef BGEN_NOORDER
+    if (job->bounded) {
+        return BGEN_SYM(count_range0)(node, job->lo, job->hi, job->udata, 0);
+    }
+#endif
+    (void)job;
+    return BGEN_SYM(count0)(node);
+}
+
+static bool BGEN_SYM(pvisit)(struct BGEN_SYM(pjob) *job, BGEN_ITEM item,
+    int part)
+{
+    if (BGEN_SYM(pskip)(job, item)) {
+        return true;
+    }
+    return !BGEN_SYM(pstopped)(job) && job->iter(item, part, job->udata);
+}
+
+// Visits the items of the subtree. When seek is set the subtree may hold
+// items less than lo, and the scan starts with a search for lo, as in
+// 'seek'. A bounded scan ends at the first item that is not less than hi.
+static bool BGEN_SYM(pscan_node)(struct BGEN_SYM(pjob) *job, BGEN_NODE *node,
+    int part, bool seek, int depth)
+{
+    int i = 0;
+    bool skip = false; // child i is before lo
+#ifndef BGEN_NOORDER
+    if (seek) {
+        int found;
+        i = BGEN_SYM(search)(node, job->lo, job->udata, &found, depth);
+        skip = found;
+    }
+#endif
+    for (; i <= node->len; i++) {
+        if (!node->isleaf && !skip) {
+#ifdef BGEN_SPATIAL
+            if (!job->intersects ||
+                BGEN_SYM(rect_intersects)(job->target, node->rects[i]))
+#endif
+            {
+                if (!BGEN_SYM(pscan_node)(job, node->children[i], part, seek,
+                    depth+1))
+                {
+                    return false;
+                }
+            }
+        }
+        seek = false;
+        skip = false;
+        if (i < node->len) {
+#ifndef BGEN_NOORDER
+            if (job->bounded &&
+                !BGEN_SYM(less)(node->items[i], job->hi, job->udata))
+            {
+                break;
+            }
+#endif
+            if (!BGEN_SYM(pvisit)(job, node->items[i], part)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void BGEN_SYM(pwork)(struct BGEN_SYM(pjob) *job) {
+    bool seek = false;
+#ifndef BGEN_NOORDER
+    seek = job->bounded;
+#endif
+    while (!BGEN_SYM(pstopped)(job)) {
+#ifdef BGEN_PATOMIC
+        int part = BGEN_STD atomic_fetch_add(&job->next, 1);
+#else
+        int part = job->next++;
+#endif
+        if (part >= job->nparts) {
+            break;
+        }
+        if (job->counting) {
+            size_t count = 0;
+            for (size_t i = job->starts[part]; i < job->starts[part+1]; i++) {
+                struct BGEN_SYM(pentry) *entry = &job->entries[i];
+                count += entry->index < 0 ?
+                    BGEN_SYM(pcount)(job, entry->node) : 1;
+            }
+#ifdef BGEN_PATOMIC
+            BGEN_STD atomic_fetch_add(&job->count, count);
+#else
+            job->count += count;
+#endif
+            continue;
+        }
+        for (size_t i = job->starts[part]; i < job->starts[part+1]; i++) {
+            struct BGEN_SYM(pentry) *entry = &job->entries[i];
+            bool ok = entry->index < 0 ?
+                BGEN_SYM(pscan_node)(job, entry->node, part, seek, 0) :
+                BGEN_SYM(pvisit)(job, entry->node->items[entry->index], part);
+            if (!ok) {
+#ifdef BGEN_PATOMIC
+                BGEN_STD atomic_store(&job->stop, true);
+#else
+                job->stop = true;
+#endif
+                break;
+            }
+        }
+    }
+}
+
+static void BGEN_SYM(prun)(void *arg) {
+    BGEN_SYM(pwork)((struct BGEN_SYM(pjob)*)arg);
+}
+
+#ifdef BGEN_PARALLEL
+static void *BGEN_SYM(pthread)(void *arg) {
+    BGEN_SYM(pwork)((struct BGEN_SYM(pjob)*)arg);
+    return 0;
+}
+#endif
+
+// Split the top of the tree into entries, a level at a time, until there are
+// enough subtrees to go around. What is outside the range or the rectangle
+// of the job is left out.
+// Returns the number of entries, or -1 on NOMEM.
+static ptrdiff_t BGEN_SYM(psplit)(struct BGEN_SYM(pjob) *job, BGEN_NODE *root,
+    size_t want)
+{
+    size_t n = 1;
+    struct BGEN_SYM(pentry) *entries =
+        (struct BGEN_SYM(pentry)*)BGEN_MALLOC(sizeof(*entries));
+    if (!entries) {
+        return -1;
+    }
+    entries[0] = (struct BGEN_SYM(pentry)){ root, -1 };
+    size_t nsubs = 1;
+    int height = root->height;
+    while (nsubs > 0 && nsubs < want && height > 1) {
+        // Each subtree at this level becomes its children and items.
+        size_t cap = n + nsubs*(BGEN_MAXITEMS*2);
+        struct BGEN_SYM(pentry) *entries2 =
+            (struct BGEN_SYM(pentry)*)BGEN_MALLOC(sizeof(*entries)*cap);
+        if (!entries2) {
+            BGEN_FREE(entries);
+            return -1;
+        }
+        size_t n2 = 0;
+        nsubs = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (entries[i].index >= 0) {
+                entries2[n2++] = entries[i];
+                continue;
+            }
+            BGEN_NODE *node = entries[i].node;
+            for (int j = 0; j <= node->len; j++) {
+                if (BGEN_SYM(pchild)(job, node, j)) {
+                    entries2[n2++] = (struct BGEN_SYM(pentry)){
+                        node->children[j], -1 };
+                    nsubs++;
+                }
+                if (j < node->len &&
+                    !BGEN_SYM(pskip)(job, node->items[j]) &&
+                    BGEN_SYM(pinrange)(job, node->items[j]))
+                {
+                    entries2[n2++] = (struct BGEN_SYM(pentry)){ node, j };
+                }
+            }
+        }
+        BGEN_FREE(entries);
+        entries = entries2;
+        n = n2;
+        height--;
+    }
+    job->entries = entries;
+    return (ptrdiff_t)n;
+}
+
+// The weight of an entry, for balancing the parts.
+static size_t BGEN_SYM(pweight)(struct BGEN_SYM(pjob) *job,
+    struct BGEN_SYM(pentry) *entry)
+{
+#ifdef BGEN_COUNTED
+    return entry->index < 0 ? BGEN_SYM(pcount)(job, entry->node) : 1;
+#else
+    (void)job;
+    return entry->index < 0;
+#endif
 }
 
-#ifdef BGEN_SPATIAL
-static bool BGEN_SYM(node_intersects_mut)(BGEN_NODE *node, BGEN_RECT target,
-    bool(*iter)(BGEN_ITEM item, void *udata),
-    void *udata, int *status)
+static int BGEN_SYM(parallel)(struct BGEN_SYM(pjob) *job, BGEN_NODE *root,
+    int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata))
 {
-    if (node->isleaf) {
-        for (int i = 0; i < node->len; i++) {
-            BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
-            if (BGEN_SYM(rect_intersects)(target, rect)) {
-                if (!iter(node->items[i], udata)) {
-                    return false;
-                }
-            }
+    nthreads = nthreads < 1 ? 1 : nthreads;
+    job->count = 0;
+    if (!root) {
+        return BGEN_FINISHED;
+    }
+    size_t want = (size_t)nthreads*BGEN_PTASKS;
+    // Split into more subtrees than parts, such that the parts can be
+    // balanced.
+    ptrdiff_t n = BGEN_SYM(psplit)(job, root, want*BGEN_PTASKS);
+    if (n < 0) {
+        return BGEN_NOMEM;
+    }
+    size_t nentries = (size_t)n;
+    job->starts = (size_t*)BGEN_MALLOC(sizeof(size_t)*(want+1));
+    if (!job->starts) {
+        BGEN_FREE(job->entries);
+        return BGEN_NOMEM;
+    }
+    // Group the entries into parts of about the same weight.
+    size_t total = 0;
+    for (size_t i = 0; i < nentries; i++) {
+        total += BGEN_SYM(pweight)(job, &job->entries[i]);
+    }
+    int nparts = 0;
+    size_t weight = 0;
+    job->starts[0] = 0;
+    for (size_t i = 0; i < nentries; i++) {
+        weight += BGEN_SYM(pweight)(job, &job->entries[i]);
+        if (i == nentries-1 || (nparts < (int)want-1 &&
+            weight*want >= total*(size_t)(nparts+1)))
+        {
+            job->starts[++nparts] = i+1;
         }
-        return true;
     }
-    for (int i = 0; i < node->len; i++) {
-        if (BGEN_SYM(rect_intersects)(target, node->rects[i])) {
-            if (!BGEN_SYM(cow)(&node->children[i], udata)) {
-                *status = BGEN_NOMEM;
-                return false;
-            }
-            BGEN_NODE *child = node->children[i];
-            if (!BGEN_SYM(node_intersects_mut)(child, target, iter, udata, 
-                status))
+    job->nparts = nentries > 0 ? nparts : 0;
+    job->next = 0;
+    job->stop = false;
+    int njobs = nthreads < job->nparts ? nthreads : job->nparts;
+    if (exec && njobs > 0) {
+        exec(njobs, BGEN_SYM(prun), job, job->udata);
+    } else {
+#ifdef BGEN_PARALLEL
+        // When threads cannot be started, the calling thread picks up the
+        // remaining parts.
+        int nstarted = 0;
+        int nwant = njobs-1;
+        pthread_t *threads = nwant > 0 ?
+            (pthread_t*)BGEN_MALLOC(sizeof(pthread_t)*nwant) : 0;
+        for (int i = 0; threads && i < nwant; i++) {
+            if (pthread_create(&threads[nstarted], 0, BGEN_SYM(pthread),
+                job))
             {
-                return false;
-            }
-            BGEN_RECT rect = BGEN_SYM(item_rect)(node->items[i], udata);
-            if (BGEN_SYM(rect_intersects)(target, rect)) {
-                if (!iter(node->items[i], udata)) {
-                    return false;
-                }
+                break;
             }
+            nstarted++;
         }
-    }
-    if (!BGEN_SYM(cow)(&node->children[node->len], udata)) {
-        *status = BGEN_NOMEM;
-        return false;
-    }
-    if (BGEN_SYM(rect_intersects)(target, node->rects[node->len])) {
-        BGEN_NODE *child = node->children[node->len];
-        if (!BGEN_SYM(node_intersects_mut)(child, target, iter, udata, status)){
-            return false;
+        BGEN_SYM(pwork)(job);
+        for (int i = 0; i < nstarted; i++) {
+            pthread_join(threads[i], 0);
+        }
+        if (threads) {
+            BGEN_FREE(threads);
         }
+#else
+        BGEN_SYM(pwork)(job);
+#endif
     }
-    return true;
+    BGEN_FREE(job->starts);
+    BGEN_FREE(job->entries);
+    return BGEN_SYM(pstopped)(job) ? BGEN_STOPPED : BGEN_FINISHED;
 }
+
+// Scan all items, in parts that are visited in parallel.
+// Returns FINISHED, STOPPED, or NOMEM
+static int BGEN_SYM(scan_parallel)(BGEN_NODE **root, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    struct BGEN_SYM(pjob) job;
+    BGEN_SYM(pjob_init)(&job, iter, udata);
+    return BGEN_SYM(parallel)(&job, *root, nthreads, exec);
+}
+
+// Scan the items that are greater than or equal to lo and less than hi, in
+// parts that are visited in parallel. Only the subtrees that overlap the
+// range are split into parts.
+// Returns FINISHED, STOPPED, NOMEM, or UNSUPPORTED (the tree has no order)
+static int BGEN_SYM(seek_parallel)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)lo, (void)hi, (void)nthreads, (void)exec, (void)iter;
+    (void)udata;
+    return BGEN_UNSUPPORTED;
+#else
+    if (!BGEN_SYM(less)(lo, hi, udata)) {
+        return BGEN_FINISHED;
+    }
+    struct BGEN_SYM(pjob) job;
+    BGEN_SYM(pjob_init)(&job, iter, udata);
+    job.bounded = true;
+    job.lo = lo;
+    job.hi = hi;
+    return BGEN_SYM(parallel)(&job, *root, nthreads, exec);
 #endif
+}
 
-static int BGEN_SYM(intersects_mut)(BGEN_NODE **root, 
-    BGEN_RTYPE min[], BGEN_RTYPE max[], 
-    bool(*iter)(BGEN_ITEM item, void *udata),
-    void *udata)
-{  
-    (void)root, (void)min, (void)max, (void)iter, (void)udata; 
+// Count the items that are greater than or equal to lo and less than hi, in
+// parts that are counted in parallel. With BGEN_COUNTED this is just
+// 'count_range', which takes O(log n) time without any threads.
+// Returns FINISHED, NOMEM, or UNSUPPORTED (the tree has no order)
+static int BGEN_SYM(count_parallel)(BGEN_NODE **root, BGEN_ITEM lo,
+    BGEN_ITEM hi, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    size_t *count, void *udata)
+{
+#ifdef BGEN_NOORDER
+    (void)root, (void)lo, (void)hi, (void)nthreads, (void)exec, (void)udata;
+    *count = 0;
+    return BGEN_UNSUPPORTED;
+#elif defined(BGEN_COUNTED)
+    (void)nthreads, (void)exec;
+    *count = BGEN_SYM(count_range)(root, lo, hi, udata);
+    return BGEN_FINISHED;
+#else
+    *count = 0;
+    if (!BGEN_SYM(less)(lo, hi, udata)) {
+        return BGEN_FINISHED;
+    }
+    struct BGEN_SYM(pjob) job;
+    BGEN_SYM(pjob_init)(&job, 0, udata);
+    job.bounded = true;
+    job.lo = lo;
+    job.hi = hi;
+    job.counting = true;
+    int status = BGEN_SYM(parallel)(&job, *root, nthreads, exec);
+    if (status == BGEN_FINISHED) {
+        *count = job.count;
+    }
+    return status;
+#endif
+}
+
+// Scan all items intersecting the rectangle, in parts that are visited in
+// parallel.
+// Returns FINISHED, STOPPED, or NOMEM
+static int BGEN_SYM(intersects_parallel)(BGEN_NODE **root, BGEN_RTYPE min[],
+    BGEN_RTYPE max[], int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    (void)root, (void)min, (void)max, (void)nthreads, (void)exec, (void)iter;
+    (void)udata;
     int status = BGEN_FINISHED;
 #ifdef BGEN_SPATIAL
-    if (*root) {
-        BGEN_RECT target;
-        for (int i = 0; i < BGEN_DIMS; i++) {
-            target.min[i] = min[i];
-        }
-        for (int i = 0; i < BGEN_DIMS; i++) {
-            target.max[i] = max[i];
-        }
-        if (!BGEN_SYM(cow)(root, udata)) {
-            return BGEN_NOMEM;
-        }
-        if (!BGEN_SYM(node_intersects_mut)(*root, target, iter, udata, &status))
-        {
-            if (status == BGEN_FINISHED) {
-                status = BGEN_STOPPED;
-            }
-        }
+    struct BGEN_SYM(pjob) job;
+    BGEN_SYM(pjob_init)(&job, iter, udata);
+    job.intersects = true;
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        job.target.min[i] = min[i];
+    }
+    for (int i = 0; i < BGEN_DIMS; i++) {
+        job.target.max[i] = max[i];
     }
+    status = BGEN_SYM(parallel)(&job, *root, nthreads, exec);
 #endif
     return status;
 }
@@ -4469,6 +9121,22 @@ static int BGEN_SYM(nearby)(BGEN_NODE **root, void *target,
     return BGEN_SYM(nearby0)(root, target, dist, iter, udata, 0);
 }
 
+// Find the k nearest items, without allocating.
+// The buffer must have room for k neighbors, and is filled nearest first,
+// with fewer than k when the tree is smaller.
+// Returns the number of neighbors in the buffer.
+static size_t BGEN_SYM(nearby_k)(BGEN_NODE **root, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf, void *udata)
+{
+#ifndef BGEN_SPATIAL
+    (void)root, (void)target, (void)dist, (void)k, (void)buf, (void)udata;
+    return 0;
+#else
+    return BGEN_SYM(knn_search)(*root, target, dist, k, buf, udata);
+#endif
+}
+
 static int BGEN_SYM(nearby_mut)(BGEN_NODE **root, void *target,
     BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS], 
     void *target, void *udata), bool(*iter)(BGEN_ITEM item, void *udata),
@@ -4564,7 +9232,10 @@ static inline void BGEN_SYM(all_sym_calls)(void) {
     (void)BGEN_SYM(delete_at);
     (void)BGEN_SYM(replace_at);
     (void)BGEN_SYM(count);
+    (void)BGEN_SYM(count_range);
     (void)BGEN_SYM(height);
+    (void)BGEN_SYM(stats);
+    (void)BGEN_SYM(stats_reset);
     (void)BGEN_SYM(clear);
     (void)BGEN_SYM(sane);
     (void)BGEN_SYM(front);
@@ -4575,8 +9246,32 @@ static inline void BGEN_SYM(all_sym_calls)(void) {
     (void)BGEN_SYM(pop_back);
     (void)BGEN_SYM(push_front);
     (void)BGEN_SYM(push_back);
+    (void)BGEN_SYM(load_sorted);
+    (void)BGEN_SYM(load);
+    (void)BGEN_SYM(get_many);
+    (void)BGEN_SYM(insert_many);
+    (void)BGEN_SYM(split_at);
+    (void)BGEN_SYM(fix_edge);
+    (void)BGEN_SYM(tree_join);
+    (void)BGEN_SYM(delete_range);
     (void)BGEN_SYM(copy);
     (void)BGEN_SYM(clone);
+    (void)BGEN_SYM(vroot_init);
+    (void)BGEN_SYM(vroot_destroy);
+    (void)BGEN_SYM(vroot_acquire);
+    (void)BGEN_SYM(vroot_release);
+    (void)BGEN_SYM(vroot_begin);
+    (void)BGEN_SYM(vroot_publish);
+    (void)BGEN_SYM(vroot_abort);
+    (void)BGEN_SYM(save);
+    (void)BGEN_SYM(open_mapped);
+    (void)BGEN_SYM(close_mapped);
+    (void)BGEN_SYM(save_compressed);
+    (void)BGEN_SYM(open_compressed);
+    (void)BGEN_SYM(close_compressed);
+    (void)BGEN_SYM(cimage_get);
+    (void)BGEN_SYM(cimage_seek);
+    (void)BGEN_SYM(cimage_scan);
     (void)BGEN_SYM(compare);
     (void)BGEN_SYM(less);
     (void)BGEN_SYM(iter_init);
@@ -4590,11 +9285,16 @@ static inline void BGEN_SYM(all_sym_calls)(void) {
     (void)BGEN_SYM(iter_scan_desc);
     (void)BGEN_SYM(iter_intersects);
     (void)BGEN_SYM(iter_nearby);
+    (void)BGEN_SYM(iter_nearby_k);
     (void)BGEN_SYM(iter_seek_at);
     (void)BGEN_SYM(iter_seek_at_desc);
     (void)BGEN_SYM(iter_next);
     (void)BGEN_SYM(iter_item);
     (void)BGEN_SYM(intersects);
+    (void)BGEN_SYM(scan_parallel);
+    (void)BGEN_SYM(seek_parallel);
+    (void)BGEN_SYM(count_parallel);
+    (void)BGEN_SYM(intersects_parallel);
     (void)BGEN_SYM(scan);
     (void)BGEN_SYM(scan_desc);
     (void)BGEN_SYM(seek);
@@ -4607,6 +9307,7 @@ static inline void BGEN_SYM(all_sym_calls)(void) {
     (void)BGEN_SYM(seek_desc_mut);
     (void)BGEN_SYM(intersects_mut);
     (void)BGEN_SYM(nearby);
+    (void)BGEN_SYM(nearby_k);
     (void)BGEN_SYM(nearby_mut);
     (void)BGEN_API(seek_at_mut);
     (void)BGEN_SYM(seek_at_desc_mut);
@@ -4642,7 +9343,10 @@ static inline void BGEN_SYM(all_api_calls)(void) {
     (void)BGEN_API(delete_at);
     (void)BGEN_API(replace_at);
     (void)BGEN_API(count);
+    (void)BGEN_API(count_range);
     (void)BGEN_API(height);
+    (void)BGEN_API(stats);
+    (void)BGEN_API(stats_reset);
     (void)BGEN_API(clear);
     (void)BGEN_API(sane);
     (void)BGEN_API(front);
@@ -4653,8 +9357,31 @@ static inline void BGEN_SYM(all_api_calls)(void) {
     (void)BGEN_API(pop_back);
     (void)BGEN_API(push_front);
     (void)BGEN_API(push_back);
+    (void)BGEN_API(load_sorted);
+    (void)BGEN_API(load);
+    (void)BGEN_API(get_many);
+    (void)BGEN_API(insert_many);
+    (void)BGEN_API(split_at);
+    (void)BGEN_API(join);
+    (void)BGEN_API(delete_range);
     (void)BGEN_API(copy);
     (void)BGEN_API(clone);
+    (void)BGEN_API(vroot_init);
+    (void)BGEN_API(vroot_destroy);
+    (void)BGEN_API(vroot_acquire);
+    (void)BGEN_API(vroot_release);
+    (void)BGEN_API(vroot_begin);
+    (void)BGEN_API(vroot_publish);
+    (void)BGEN_API(vroot_abort);
+    (void)BGEN_API(save);
+    (void)BGEN_API(open_mapped);
+    (void)BGEN_API(close_mapped);
+    (void)BGEN_API(save_compressed);
+    (void)BGEN_API(open_compressed);
+    (void)BGEN_API(close_compressed);
+    (void)BGEN_API(cimage_get);
+    (void)BGEN_API(cimage_seek);
+    (void)BGEN_API(cimage_scan);
     (void)BGEN_API(compare);
     (void)BGEN_API(less);
     (void)BGEN_API(iter_init);
@@ -4668,6 +9395,7 @@ static inline void BGEN_SYM(all_api_calls)(void) {
     (void)BGEN_API(iter_scan_desc);
     (void)BGEN_API(iter_intersects);
     (void)BGEN_API(iter_nearby);
+    (void)BGEN_API(iter_nearby_k);
     (void)BGEN_API(iter_seek_at);
     (void)BGEN_API(iter_seek_at_desc);
     (void)BGEN_API(iter_next);
@@ -4679,12 +9407,17 @@ static inline void BGEN_SYM(all_api_calls)(void) {
     (void)BGEN_API(seek_at_desc);
     (void)BGEN_API(seek_desc);
     (void)BGEN_API(intersects);
+    (void)BGEN_API(scan_parallel);
+    (void)BGEN_API(seek_parallel);
+    (void)BGEN_API(count_parallel);
+    (void)BGEN_API(intersects_parallel);
     (void)BGEN_API(scan_mut);
     (void)BGEN_API(scan_desc_mut);
     (void)BGEN_API(seek_mut);
     (void)BGEN_API(seek_desc_mut);
     (void)BGEN_API(intersects_mut);
     (void)BGEN_API(nearby);
+    (void)BGEN_API(nearby_k);
     (void)BGEN_API(nearby_mut);
     (void)BGEN_API(seek_at_mut);
     (void)BGEN_API(seek_at_desc_mut);
@@ -4743,7 +9476,11 @@ int BGEN_API(feat_dims)(void) {
 }
 
 void BGEN_API(clear)(BGEN_NODE **root, void *udata) {
+#ifdef BGEN_ARENA
+    BGEN_SYM(arena_clear)(root, &BGEN_SYM(atree)(root)->arena, udata);
+#else
     BGEN_SYM(clear)(root, udata);
+#endif
 }
 
 bool BGEN_API(sane)(BGEN_NODE **root, void *udata) {
@@ -4754,10 +9491,24 @@ size_t BGEN_API(count)(BGEN_NODE **root, void *udata) {
     return BGEN_SYM(count)(root, udata);
 }
 
+size_t BGEN_API(count_range)(BGEN_NODE **root, BGEN_ITEM lo, BGEN_ITEM hi,
+    void *udata)
+{
+    return BGEN_SYM(count_range)(root, lo, hi, udata);
+}
+
 size_t BGEN_API(height)(BGEN_NODE **root, void *udata) {
     return BGEN_SYM(height)(root, udata);
 }
 
+void BGEN_API(stats)(BGEN_COUNTERS *stats) {
+    BGEN_SYM(stats)(stats);
+}
+
+void BGEN_API(stats_reset)(void) {
+    BGEN_SYM(stats_reset)();
+}
+
 int BGEN_API(index_of)(BGEN_NODE **root, BGEN_ITEM key, size_t *index,
     void *udata)
 {
@@ -4773,7 +9524,10 @@ int BGEN_API(get)(BGEN_NODE **root, BGEN_ITEM key, BGEN_ITEM *item_out,
 int BGEN_API(get_mut)(BGEN_NODE **root, BGEN_ITEM key, BGEN_ITEM *item_out,
     void *udata)
 {
-    return BGEN_SYM(get_mut)(root, key, item_out, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(get_mut)(root, key, item_out, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 bool BGEN_API(contains)(BGEN_NODE **root, BGEN_ITEM key, void *udata) {
@@ -4783,13 +9537,19 @@ bool BGEN_API(contains)(BGEN_NODE **root, BGEN_ITEM key, void *udata) {
 int BGEN_API(insert)(BGEN_NODE **root, BGEN_ITEM item, BGEN_ITEM *olditem,
     void *udata)
 {
-    return BGEN_SYM(insert)(root, item, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(insert)(root, item, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(delete)(BGEN_NODE **root, BGEN_ITEM key, BGEN_ITEM *olditem, 
     void *udata)
 {
-    return BGEN_SYM(delete)(root, key, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(delete)(root, key, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(front)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
@@ -4797,7 +9557,10 @@ int BGEN_API(front)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
 }
 
 int BGEN_API(front_mut)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
-    return BGEN_SYM(front_mut)(root, item_out, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(front_mut)(root, item_out, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(back)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
@@ -4805,27 +9568,42 @@ int BGEN_API(back)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
 }
 
 int BGEN_API(back_mut)(BGEN_NODE **root, BGEN_ITEM *item_out, void *udata) {
-    return BGEN_SYM(back_mut)(root, item_out, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(back_mut)(root, item_out, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(delete_at)(BGEN_NODE **root, size_t index, BGEN_ITEM *olditem,
     void *udata)
 {
-    return BGEN_SYM(delete_at)(root, index, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(delete_at)(root, index, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(replace_at)(BGEN_NODE **root, size_t index, BGEN_ITEM item,
     BGEN_ITEM *olditem, void *udata)
 {
-    return BGEN_SYM(replace_at)(root, index, item, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(replace_at)(root, index, item, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(pop_front)(BGEN_NODE **root, BGEN_ITEM *olditem, void *udata) {
-    return BGEN_SYM(pop_front)(root, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(pop_front)(root, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(pop_back)(BGEN_NODE **root, BGEN_ITEM *olditem, void *udata) {
-    return BGEN_SYM(pop_back)(root, olditem, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(pop_back)(root, olditem, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(get_at)(BGEN_NODE **root, size_t index, BGEN_ITEM *item,
@@ -4837,29 +9615,188 @@ int BGEN_API(get_at)(BGEN_NODE **root, size_t index, BGEN_ITEM *item,
 int BGEN_API(get_at_mut)(BGEN_NODE **root, size_t index, BGEN_ITEM *item,
     void *udata)
 {
-    return BGEN_SYM(get_at_mut)(root, index, item, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(get_at_mut)(root, index, item, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(push_front)(BGEN_NODE **root, BGEN_ITEM item, void *udata) {
-    return BGEN_SYM(push_front)(root, item, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(push_front)(root, item, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(push_back)(BGEN_NODE **root, BGEN_ITEM item, void *udata) {
-    return BGEN_SYM(push_back)(root, item, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(push_back)(root, item, udata);
+    BGEN_ALEAVE();
+    return ret;
+}
+
+int BGEN_API(load_sorted)(BGEN_NODE **root, const BGEN_ITEM *items, size_t n,
+    double fill_factor, void *udata)
+{
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(load_sorted)(root, items, n, fill_factor, udata);
+    BGEN_ALEAVE();
+    return ret;
+}
+
+int BGEN_API(load)(BGEN_NODE **root, const BGEN_ITEM *items, size_t n,
+    double fill_factor, void *udata)
+{
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(load)(root, items, n, fill_factor, udata);
+    BGEN_ALEAVE();
+    return ret;
+}
+
+int BGEN_API(get_many)(BGEN_NODE **root, const BGEN_ITEM *keys, size_t nkeys,
+    BGEN_ITEM *items_out, int *statuses, void *udata)
+{
+    return BGEN_SYM(get_many)(root, keys, nkeys, items_out, statuses, udata);
+}
+
+int BGEN_API(insert_many)(BGEN_NODE **root, const BGEN_ITEM *items,
+    size_t nitems, BGEN_ITEM *olditems, int *statuses, void *udata)
+{
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(insert_many)(root, items, nitems, olditems, statuses,
+        udata);
+    BGEN_ALEAVE();
+    return ret;
+}
+
+int BGEN_API(split_at)(BGEN_NODE **root, BGEN_ITEM key, BGEN_NODE **right,
+    void *udata)
+{
+#ifdef BGEN_ARENA
+    return BGEN_SYM(arena_split_at)(root, key, right, udata);
+#else
+    return BGEN_SYM(split_at)(root, key, right, udata);
+#endif
+}
+
+int BGEN_API(join)(BGEN_NODE **left, BGEN_NODE **right, void *udata) {
+#ifdef BGEN_ARENA
+    return BGEN_SYM(arena_join)(left, right, udata);
+#else
+    return BGEN_SYM(tree_join)(left, right, udata);
+#endif
+}
+
+int BGEN_API(delete_range)(BGEN_NODE **root, BGEN_ITEM lo, BGEN_ITEM hi,
+    void *udata)
+{
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(delete_range)(root, lo, hi, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(insert_at)(BGEN_NODE **root, size_t index, BGEN_ITEM item,
     void *udata)
 {
-    return BGEN_SYM(insert_at)(root, index, item, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(insert_at)(root, index, item, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(copy)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
+#ifdef BGEN_ARENA
+    return BGEN_SYM(arena_copy)(root, newroot, udata);
+#else
     return BGEN_SYM(copy)(root, newroot, udata);
+#endif
 }
 
 int BGEN_API(clone)(BGEN_NODE **root, BGEN_NODE **newroot, void *udata) {
+#ifdef BGEN_ARENA
+    return BGEN_SYM(arena_clone)(root, newroot, udata);
+#else
     return BGEN_SYM(clone)(root, newroot, udata);
+#endif
+}
+
+void BGEN_API(vroot_init)(BGEN_VROOT *vroot, BGEN_NODE **root) {
+    BGEN_SYM(vroot_init)(vroot, root);
+}
+
+void BGEN_API(vroot_destroy)(BGEN_VROOT *vroot, void *udata) {
+    BGEN_SYM(vroot_destroy)(vroot, udata);
+}
+
+int BGEN_API(vroot_acquire)(BGEN_VROOT *vroot, BGEN_NODE **snapshot) {
+    return BGEN_SYM(vroot_acquire)(vroot, snapshot);
+}
+
+void BGEN_API(vroot_release)(BGEN_VROOT *vroot, BGEN_NODE **snapshot,
+    void *udata)
+{
+    BGEN_SYM(vroot_release)(vroot, snapshot, udata);
+}
+
+int BGEN_API(vroot_begin)(BGEN_VROOT *vroot, BGEN_NODE **root, void *udata) {
+    return BGEN_SYM(vroot_begin)(vroot, root, udata);
+}
+
+void BGEN_API(vroot_publish)(BGEN_VROOT *vroot, BGEN_NODE **root,
+    void *udata)
+{
+    BGEN_SYM(vroot_publish)(vroot, root, udata);
+}
+
+void BGEN_API(vroot_abort)(BGEN_VROOT *vroot, BGEN_NODE **root, void *udata) {
+    BGEN_SYM(vroot_abort)(vroot, root, udata);
+}
+
+int BGEN_API(save)(BGEN_NODE **root, FILE *file, void *udata) {
+    return BGEN_SYM(save)(root, file, udata);
+}
+
+int BGEN_API(open_mapped)(BGEN_NODE **root, const char *path,
+    bool checkleaves)
+{
+    return BGEN_SYM(open_mapped)(root, path, checkleaves);
+}
+
+void BGEN_API(close_mapped)(BGEN_NODE **root) {
+    BGEN_SYM(close_mapped)(root);
+}
+
+int BGEN_API(save_compressed)(BGEN_NODE **root, FILE *file, void *udata) {
+    return BGEN_SYM(save_compressed)(root, file, udata);
+}
+
+int BGEN_API(open_compressed)(BGEN_CIMAGE **image, const char *path,
+    size_t cachesize)
+{
+    return BGEN_SYM(open_compressed)(image, path, cachesize);
+}
+
+void BGEN_API(close_compressed)(BGEN_CIMAGE **image) {
+    BGEN_SYM(close_compressed)(image);
+}
+
+int BGEN_API(cimage_get)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    BGEN_ITEM *item_out, void *udata)
+{
+    return BGEN_SYM(cimage_get)(image, key, item_out, udata);
+}
+
+int BGEN_API(cimage_seek)(BGEN_CIMAGE *image, BGEN_ITEM key,
+    bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
+{
+    return BGEN_SYM(cimage_seek)(image, key, iter, udata);
+}
+
+int BGEN_API(cimage_scan)(BGEN_CIMAGE *image,
+    bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
+{
+    return BGEN_SYM(cimage_scan)(image, iter, udata);
 }
 
 int BGEN_API(compare)(BGEN_ITEM a, BGEN_ITEM b, void *udata) {
@@ -4891,44 +9828,71 @@ void BGEN_API(iter_release)(BGEN_ITER *iter) {
 }
 
 void BGEN_API(iter_seek)(BGEN_ITER *iter, BGEN_ITEM key) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_seek)(iter, key);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_seek_at)(BGEN_ITER *iter, size_t index) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_seek_at)(iter, index);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_seek_at_desc)(BGEN_ITER *iter, size_t index) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_seek_at_desc)(iter, index);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_seek_desc)(BGEN_ITER *iter, BGEN_ITEM key) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_seek_desc)(iter, key);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_scan)(BGEN_ITER *iter) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_scan)(iter);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_scan_desc)(BGEN_ITER *iter) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_scan_desc)(iter);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_intersects)(BGEN_ITER *iter, BGEN_RTYPE min[],
     BGEN_RTYPE max[])
 {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_intersects)(iter, min, max);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_nearby)(BGEN_ITER *iter, void *target,
     BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
     void *target, void *udata))
 {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_nearby)(iter, target, dist);
+    BGEN_ALEAVE();
+}
+
+void BGEN_API(iter_nearby_k)(BGEN_ITER *iter, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf)
+{
+    BGEN_AENTER(iter->mut ? iter->root : 0);
+    BGEN_SYM(iter_nearby_k)(iter, target, dist, k, buf);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_next)(BGEN_ITER *iter) {
+    BGEN_AENTER(iter->mut ? iter->root : 0);
     BGEN_SYM(iter_next)(iter);
+    BGEN_ALEAVE();
 }
 
 void BGEN_API(iter_item)(BGEN_ITER *iter, BGEN_ITEM *item) {
@@ -4966,6 +9930,39 @@ int BGEN_API(intersects)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
     return BGEN_SYM(intersects)(root, min, max, iter, udata);
 }
 
+int BGEN_API(scan_parallel)(BGEN_NODE **root, int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    return BGEN_SYM(scan_parallel)(root, nthreads, exec, iter, udata);
+}
+
+int BGEN_API(seek_parallel)(BGEN_NODE **root, BGEN_ITEM lo, BGEN_ITEM hi,
+    int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    return BGEN_SYM(seek_parallel)(root, lo, hi, nthreads, exec, iter, udata);
+}
+
+int BGEN_API(count_parallel)(BGEN_NODE **root, BGEN_ITEM lo, BGEN_ITEM hi,
+    int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    size_t *count, void *udata)
+{
+    return BGEN_SYM(count_parallel)(root, lo, hi, nthreads, exec, count,
+        udata);
+}
+
+int BGEN_API(intersects_parallel)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
+    BGEN_RTYPE max[BGEN_DIMS], int nthreads,
+    void(*exec)(int njobs, void(*run)(void *arg), void *arg, void *udata),
+    bool(*iter)(BGEN_ITEM item, int part, void *udata), void *udata)
+{
+    return BGEN_SYM(intersects_parallel)(root, min, max, nthreads, exec, iter,
+        udata);
+}
+
 int BGEN_API(seek_at)(BGEN_NODE **root, size_t index, 
     bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
 {
@@ -4975,7 +9972,10 @@ int BGEN_API(seek_at)(BGEN_NODE **root, size_t index,
 int BGEN_API(seek_at_mut)(BGEN_NODE **root, size_t index, 
     bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
 {
-    return BGEN_SYM(seek_at_mut)(root, index, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(seek_at_mut)(root, index, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(seek_at_desc)(BGEN_NODE **root, size_t index, 
@@ -4987,38 +9987,56 @@ int BGEN_API(seek_at_desc)(BGEN_NODE **root, size_t index,
 int BGEN_API(seek_at_desc_mut)(BGEN_NODE **root, size_t index, 
     bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
 {
-    return BGEN_SYM(seek_at_desc_mut)(root, index, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(seek_at_desc_mut)(root, index, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(scan_mut)(BGEN_NODE **root, bool(*iter)(BGEN_ITEM item,
     void *udata), void *udata)
 {
-    return BGEN_SYM(scan_mut)(root, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(scan_mut)(root, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(scan_desc_mut)(BGEN_NODE **root, bool(*iter)(BGEN_ITEM item, 
     void *udata), void *udata)
 {
-    return BGEN_SYM(scan_desc_mut)(root, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(scan_desc_mut)(root, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(seek_mut)(BGEN_NODE **root, BGEN_ITEM key,
     bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
 {
-    return BGEN_SYM(seek_mut)(root, key, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(seek_mut)(root, key, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(seek_desc_mut)(BGEN_NODE **root, BGEN_ITEM key, 
     bool(*iter)(BGEN_ITEM item, void *udata), void *udata)
 {
-    return BGEN_SYM(seek_desc_mut)(root, key, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(seek_desc_mut)(root, key, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(intersects_mut)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS], 
     BGEN_RTYPE max[BGEN_DIMS], bool(*iter)(BGEN_ITEM item, void *udata), 
     void *udata)
 {
-    return BGEN_SYM(intersects_mut)(root, min, max, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(intersects_mut)(root, min, max, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 int BGEN_API(nearby)(BGEN_NODE **root, void *target,
@@ -5029,12 +10047,22 @@ int BGEN_API(nearby)(BGEN_NODE **root, void *target,
     return BGEN_SYM(nearby)(root, target, dist, iter, udata);
 }
 
+size_t BGEN_API(nearby_k)(BGEN_NODE **root, void *target,
+    BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS],
+    void *target, void *udata), size_t k, BGEN_NEIGHBOR *buf, void *udata)
+{
+    return BGEN_SYM(nearby_k)(root, target, dist, k, buf, udata);
+}
+
 int BGEN_API(nearby_mut)(BGEN_NODE **root, void *target,
     BGEN_RTYPE(*dist)(BGEN_RTYPE min[BGEN_DIMS], BGEN_RTYPE max[BGEN_DIMS], 
     void *target, void *udata), bool(*iter)(BGEN_ITEM item, void *udata), 
     void *udata)
 {
-    return BGEN_SYM(nearby_mut)(root, target, dist, iter, udata);
+    BGEN_AENTER(root);
+    int ret = BGEN_SYM(nearby_mut)(root, target, dist, iter, udata);
+    BGEN_ALEAVE();
+    return ret;
 }
 
 /// Returns the minimum bounding rectangle for a spatial B-tree.
@@ -5055,6 +10083,23 @@ void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
 #undef BGEN_NOPATHHINT
 #undef BGEN_NODE
 #undef BGEN_ASSERT
+#undef BGEN_ARENA
+#undef BGEN_AENTER
+#undef BGEN_ALEAVE
+#undef BGEN_ARENABLOCK
+#undef BGEN_ALINE
+#undef BGEN_AMIN
+#undef BGEN_AALIGN
+#undef BGEN_ABASE
+#undef BGEN_ASIZE
+#undef BGEN_SIMDKEY
+#undef BGEN_SIMDKEY_u32
+#undef BGEN_SIMDKEY_i32
+#undef BGEN_SIMDKEY_u64
+#undef BGEN_SIMDKEY_i64
+#undef BGEN_SIMDKEY_f64
+#undef BGEN_SKIND
+#undef BGEN_SWINDOW
 #undef BGEN_MINITEMS
 #undef BGEN_NOINLINE
 #undef BGEN_DIMS
@@ -5067,11 +10112,15 @@ void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
 #undef BGEN_PUSHFRONT
 #undef BGEN_OUTOFORDER
 #undef BGEN_NOATOMICS
+#undef BGEN_STDATOMIC
+#undef BGEN_STD
+#undef BGEN_ATOMIC
 #undef BGEN_BSEARCH
 #undef BGEN_EXTERN
 #undef BGEN_MAP
 #undef BGEN_SYM
 #undef BGEN_UNSUPPORTED
+#undef BGEN_IOERROR
 #undef BGEN_POPBACK
 #undef BGEN_INSERTED
 #undef BGEN_ITEMCOPY
@@ -5082,12 +10131,34 @@ void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
 #undef BGEN_ITEMRECT
 #undef BGEN_MAXITEMS
 #undef BGEN_KEYED
+#undef BGEN_SOA
+#undef BGEN_HILBERT
+#undef BGEN_ZORDER
+#undef BGEN_CURVE
+#undef BGEN_CURVERECT
+#undef BGEN_CURVEBITS
+#undef BGEN_CMPSYM
+#undef BGEN_PREFETCH
+#undef BGEN_PARALLEL
+#undef BGEN_MAPPED
+#undef BGEN_LZ4
+#undef BGEN_IMAGELZ4
+#undef BGEN_CNONE
+#undef BGEN_IMAGEVERSION
+#undef BGEN_IALIGN
+#undef BGEN_ISTART
+#undef BGEN_IBRANCH
+#undef BGEN_ILEAF
+#undef BGEN_PTASKS
+#undef BGEN_PATOMIC
+#undef BGEN_CACHELINE
 #undef BGEN_NOMEM
 #undef BGEN_PITEM
 #undef BGEN_REPAT
 #undef BGEN_COPIED
 #undef BGEN_DELKEY
 #undef BGEN_RECT
+#undef BGEN_ALIGNOF
 #undef BGEN_SCAN
 #undef BGEN_TYPE
 #undef BGEN_API
@@ -5100,6 +10171,7 @@ void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
 #undef BGEN_DELAT
 #undef BGEN_DSIZE
 #undef BGEN_NEARBY
+#undef BGEN_NEARBYK
 #undef BGEN_SPATIAL
 #undef BGEN_REALLOC
 #undef BGEN_STOPPED
@@ -5118,6 +10190,14 @@ void BGEN_API(rect)(BGEN_NODE **root, BGEN_RTYPE min[BGEN_DIMS],
 #undef BGEN_FANOUT
 #undef BGEN_INLINE
 #undef BGEN_ITER
+#undef BGEN_VROOT
+#undef BGEN_TREE
+#undef BGEN_CIMAGE
+#undef BGEN_NEIGHBOR
+#undef BGEN_COUNTERS
+#undef BGEN_STATS
+#undef BGEN_STAT
+#undef BGEN_STATN
 #undef BGEN_LESS
 #undef BGEN_NAME
 #undef BGEN_COMPARE
@@ -0,0 +1,641 @@
+// https://github.com/tidwall/bgen
+//
+// Copyright 2024 Joshua J Baker. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+//
+// Benchmarks for bgen.h
+//
+// The header is instantiated once for each configuration in a matrix of the
+// FANOUT, BSEARCH, PATHHINT, COUNTED, SPATIAL, COW, NOATOMICS, HILBERT, and
+// PREFETCH options, and every configuration runs the insert, get, delete,
+// seek, range, scan, iter, iter_desc, iter_range, get_at, intersects, and
+// nearby workloads for random, sequential, and zipfian keys. The range and
+// iter_range workloads read 1000 items from each probe key, with seek and a
+// callback or with iter_seek and iter_next.
+//
+// Build and run:
+//
+//     cc -O3 -o bgen_bench bgen_bench.c -lm
+//     ./bgen_bench -n 1000,1000000,100000000 -c bsearch64,spatial32
+//
+// The effect of BGEN_PREFETCH on a tree that is too large for the caches,
+// with the items inserted in random order:
+//
+//     cc -O2 -o bgen_bench bgen_bench.c -lm
+//     ./bgen_bench -n 100000000 -d random -o get,scan,iter,iter_desc,range,
+//         iter_range -c bsearch64,bsearch64_prefetch
+//
+// which is one command line.
+//
+// Options:
+//
+//     -n sizes    Comma separated list of item counts (1000,100000,1000000)
+//     -c configs  Comma separated list of configurations (all)
+//     -d dists    Comma separated list of random, sequential, zipfian (all)
+//     -o ops      Comma separated list of operations (all)
+//     -l          List the configurations and exit
+//
+// Each measurement is printed as one line of JSON, for example:
+//
+//     {"config":"bsearch64","fanout":64,"bsearch":1,"pathhint":1,
+//      "counted":0,"spatial":0,"cow":0,"atomics":1,"op":"get",
+//      "dist":"random","n":1000000,"ops":1000000,"ns_op":231.60,
+//      "misses_op":3.12,"rss_kb":23884}
+//
+// but all on a single line. The misses_op field is the number of CPU cache
+// misses per operation and is null when hardware counters are not available,
+// such as in most containers and virtual machines. The rss_kb field is the
+// resident memory after the operation, which includes the key arrays used by
+// the benchmark itself (16 bytes per item).
+
+#ifndef BENCH_TEMPLATE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define BENCH_CC(a, b) a ## b
+#define BENCH_C(a, b)  BENCH_CC(a, b)
+
+#define DIST_RANDOM     0
+#define DIST_SEQUENTIAL 1
+#define DIST_ZIPFIAN    2
+
+static const char *dist_names[] = { "random", "sequential", "zipfian" };
+
+// Results are added to the sink so that the compiler keeps the lookups.
+static volatile uint64_t sink;
+
+// A single benchmark run of one configuration, item count, and distribution.
+struct bench {
+    const char *config; // configuration name
+    int dist;           // key distribution
+    size_t n;           // number of items
+    uint64_t *keys;     // keys inserted, in insertion order
+    uint64_t *probes;   // keys for get and seek
+    const char *ops;    // comma separated operations to run, or NULL for all
+    int perf_fd;        // cache misses counter, or -1
+    double start;       // start time of the current operation
+    uint64_t misses;    // cache misses at the start of the current operation
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t rand_next(uint64_t *seed) {
+    *seed += 0x9e3779b97f4a7c15;
+    return mix64(*seed);
+}
+
+// Returns a uniformly random number in the range [0,1).
+static double rand_double(uint64_t *seed) {
+    return (double)(rand_next(seed) >> 11) / (double)((uint64_t)1 << 53);
+}
+
+// Zipfian generator, from "Quickly Generating Billion-Record Synthetic
+// Databases" by Gray et al. (1994). Rank zero is the most popular.
+struct zipf {
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+};
+
+static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+static void zipf_init(struct zipf *z, uint64_t n, double theta) {
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zetan = zeta(n, theta);
+    z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) /
+        (1.0 - zeta(2, theta) / z->zetan);
+}
+
+static uint64_t zipf_next(struct zipf *z, uint64_t *seed) {
+    double u = rand_double(seed);
+    double uz = u * z->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta)) {
+        return 1;
+    }
+    uint64_t rank = (uint64_t)((double)z->n *
+        pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return rank < z->n ? rank : z->n-1;
+}
+
+// Fills the keys and probes of a run.
+// Random keys are inserted and probed in random order, sequential keys in
+// ascending order, and zipfian keys are inserted in random order and probed
+// with a zipfian skew, where a few keys receive most of the lookups.
+static void gen_keys(struct bench *b) {
+    uint64_t seed = 0x20240101;
+    for (size_t i = 0; i < b->n; i++) {
+        b->keys[i] = b->dist == DIST_SEQUENTIAL ? i : mix64(i+1);
+    }
+    if (b->dist == DIST_ZIPFIAN) {
+        struct zipf z;
+        zipf_init(&z, b->n, 0.99);
+        for (size_t i = 0; i < b->n; i++) {
+            b->probes[i] = b->keys[zipf_next(&z, &seed)];
+        }
+    } else if (b->dist == DIST_RANDOM) {
+        for (size_t i = 0; i < b->n; i++) {
+            b->probes[i] = b->keys[rand_next(&seed) % b->n];
+        }
+    } else {
+        memcpy(b->probes, b->keys, sizeof(uint64_t)*b->n);
+    }
+}
+
+// The point of a key, for spatial configurations.
+static void key_point(uint64_t key, double point[2]) {
+    uint64_t h = mix64(key ^ 0x5bd1e995);
+    point[0] = (double)(h >> 32) / 4294967296.0;
+    point[1] = (double)(h & 0xffffffff) / 4294967296.0;
+}
+
+static double point_dist(double min[2], double max[2], void *target,
+    void *udata)
+{
+    (void)udata;
+    double *point = target;
+    double dist = 0;
+    for (int i = 0; i < 2; i++) {
+        double d = point[i] < min[i] ? min[i] - point[i] :
+                   point[i] > max[i] ? point[i] - max[i] : 0;
+        dist += d*d;
+    }
+    return dist;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int perf_open(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static uint64_t perf_read(int fd) {
+    uint64_t count = 0;
+    if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+    }
+    return count;
+}
+
+// Returns the resident memory of the process in KB.
+static size_t rss_kb(void) {
+    size_t pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (size_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+// Returns true if the name is in the comma separated list, or the list is
+// NULL.
+static bool listed(const char *list, const char *name) {
+    if (!list) {
+        return true;
+    }
+    size_t len = strlen(name);
+    const char *p = list;
+    while (1) {
+        const char *end = strchr(p, ',');
+        size_t n = end ? (size_t)(end-p) : strlen(p);
+        if (n == len && memcmp(p, name, n) == 0) {
+            return true;
+        }
+        if (!end) {
+            return false;
+        }
+        p = end+1;
+    }
+}
+
+static bool op_begin(struct bench *b, const char *op) {
+    if (!listed(b->ops, op)) {
+        return false;
+    }
+    b->misses = perf_read(b->perf_fd);
+    b->start = now();
+    return true;
+}
+
+// Prints the measurement of an operation that ran 'ops' times.
+static void op_end(struct bench *b, const char *op, size_t ops, int fanout,
+    bool bsearch, bool pathhint, bool counted, bool spatial, bool cow,
+    bool atomics)
+{
+    double elapsed = now() - b->start;
+    uint64_t misses = perf_read(b->perf_fd) - b->misses;
+    ops = ops > 0 ? ops : 1;
+    printf("{\"config\":\"%s\",\"fanout\":%d,\"bsearch\":%d,\"pathhint\":%d,"
+        "\"counted\":%d,\"spatial\":%d,\"cow\":%d,\"atomics\":%d,"
+        "\"op\":\"%s\",\"dist\":\"%s\",\"n\":%zu,\"ops\":%zu,"
+        "\"ns_op\":%.2f,", b->config, fanout, bsearch, pathhint, counted,
+        spatial, cow, atomics, op, dist_names[b->dist], b->n, ops,
+        elapsed / (double)ops);
+    if (b->perf_fd >= 0) {
+        printf("\"misses_op\":%.2f,", (double)misses / (double)ops);
+    } else {
+        printf("\"misses_op\":null,");
+    }
+    printf("\"rss_kb\":%zu}\n", rss_kb());
+    fflush(stdout);
+}
+
+static bool stop_iter(uint64_t item, void *udata) {
+    (void)item;
+    size_t *count = udata;
+    (*count)++;
+    return false;
+}
+
+// Collects up to 1000 items.
+static bool range_iter(uint64_t item, void *udata) {
+    (void)item;
+    size_t *count = udata;
+    (*count)++;
+    return *count % 1000 != 0;
+}
+
+static bool count_iter(uint64_t item, void *udata) {
+    (void)item;
+    size_t *count = udata;
+    (*count)++;
+    return true;
+}
+
+// Collects up to 10 nearby items.
+static bool nearby_iter(uint64_t item, void *udata) {
+    (void)item;
+    size_t *count = udata;
+    (*count)++;
+    return *count % 10 != 0;
+}
+
+#define BENCH_TEMPLATE
+
+// The configurations.
+// Each one needs an entry in the configs array below.
+
+#define BENCH_NAME linear16
+#define BGEN_FANOUT 16
+#include "bgen_bench.c"
+
+#define BENCH_NAME linear64
+#define BGEN_FANOUT 64
+#include "bgen_bench.c"
+
+#define BENCH_NAME bsearch64
+#define BGEN_FANOUT 64
+#define BGEN_BSEARCH
+#include "bgen_bench.c"
+
+#define BENCH_NAME bsearch64_prefetch
+#define BGEN_FANOUT 64
+#define BGEN_BSEARCH
+#define BGEN_PREFETCH
+#include "bgen_bench.c"
+
+#define BENCH_NAME bsearch64_nohint
+#define BGEN_FANOUT 64
+#define BGEN_BSEARCH
+#define BGEN_NOPATHHINT
+#include "bgen_bench.c"
+
+#define BENCH_NAME bsearch256
+#define BGEN_FANOUT 256
+#define BGEN_BSEARCH
+#include "bgen_bench.c"
+
+#define BENCH_NAME counted32
+#define BGEN_FANOUT 32
+#define BGEN_COUNTED
+#include "bgen_bench.c"
+
+#define BENCH_NAME cow32
+#define BGEN_FANOUT 32
+#define BGEN_COW
+#include "bgen_bench.c"
+
+#define BENCH_NAME cow32_noatomics
+#define BGEN_FANOUT 32
+#define BGEN_COW
+#define BGEN_NOATOMICS
+#include "bgen_bench.c"
+
+#define BENCH_NAME spatial32
+#define BGEN_FANOUT 32
+#define BGEN_SPATIAL
+#include "bgen_bench.c"
+
+#define BENCH_NAME spatial32_counted_cow
+#define BGEN_FANOUT 32
+#define BGEN_SPATIAL
+#define BGEN_COUNTED
+#define BGEN_COW
+#include "bgen_bench.c"
+
+// The curve tree searches the curve indexes of its nodes with a binary search.
+#define BENCH_NAME hilbert32
+#define BGEN_FANOUT 32
+#define BGEN_BSEARCH
+#define BGEN_SPATIAL
+#define BGEN_HILBERT
+#define BGEN_CURVERECT { min[0] = 0; min[1] = 0; max[0] = 1; max[1] = 1; }
+#include "bgen_bench.c"
+
+#undef BENCH_TEMPLATE
+
+struct config {
+    const char *name;
+    void(*run)(struct bench *b);
+};
+
+static struct config configs[] = {
+    { "linear16", linear16_bench },
+    { "linear64", linear64_bench },
+    { "bsearch64", bsearch64_bench },
+    { "bsearch64_prefetch", bsearch64_prefetch_bench },
+    { "bsearch64_nohint", bsearch64_nohint_bench },
+    { "bsearch256", bsearch256_bench },
+    { "counted32", counted32_bench },
+    { "cow32", cow32_bench },
+    { "cow32_noatomics", cow32_noatomics_bench },
+    { "spatial32", spatial32_bench },
+    { "spatial32_counted_cow", spatial32_counted_cow_bench },
+    { "hilbert32", hilbert32_bench },
+};
+
+#define NCONFIGS (sizeof(configs)/sizeof(configs[0]))
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n sizes] [-c configs] [-d dists] [-o ops] "
+        "[-l]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizes = "1000,100000,1000000";
+    const char *cfgs = 0;
+    const char *dists = 0;
+    const char *ops = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:d:o:l")) != -1) {
+        switch (opt) {
+        case 'n': sizes = optarg; break;
+        case 'c': cfgs = optarg; break;
+        case 'd': dists = optarg; break;
+        case 'o': ops = optarg; break;
+        case 'l':
+            for (size_t i = 0; i < NCONFIGS; i++) {
+                printf("%s\n", configs[i].name);
+            }
+            return 0;
+        default:
+            usage(argv[0]);
+        }
+    }
+    struct bench b = { .ops = ops, .perf_fd = perf_open() };
+#ifdef __linux__
+    if (b.perf_fd >= 0) {
+        ioctl(b.perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(b.perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    const char *p = sizes;
+    while (*p) {
+        char *end;
+        b.n = (size_t)strtoull(p, &end, 10);
+        if (end == p || b.n == 0) {
+            usage(argv[0]);
+        }
+        p = *end == ',' ? end+1 : end;
+        b.keys = malloc(sizeof(uint64_t)*b.n);
+        b.probes = malloc(sizeof(uint64_t)*b.n);
+        if (!b.keys || !b.probes) {
+            fprintf(stderr, "out of memory for %zu items\n", b.n);
+            return 1;
+        }
+        for (b.dist = 0; b.dist < 3; b.dist++) {
+            if (!listed(dists, dist_names[b.dist])) {
+                continue;
+            }
+            gen_keys(&b);
+            for (size_t i = 0; i < NCONFIGS; i++) {
+                if (listed(cfgs, configs[i].name)) {
+                    b.config = configs[i].name;
+                    configs[i].run(&b);
+                }
+            }
+        }
+        free(b.keys);
+        free(b.probes);
+    }
+    return 0;
+}
+
+#else // BENCH_TEMPLATE
+
+// One configuration of the tree and its benchmark function.
+// BENCH_NAME and the bgen options are defined by the including code.
+
+#define BGEN_NAME BENCH_NAME
+#define BGEN_TYPE uint64_t
+#define BGEN_COMPARE { return a < b ? -1 : a > b; }
+#ifdef BGEN_SPATIAL
+#define BGEN_ITEMRECT { key_point(item, min); key_point(item, max); }
+#endif
+#include "bgen.h"
+
+#define BT(name) BENCH_C(BENCH_C(BENCH_NAME, _), name)
+#define BENCH_ITER struct BT(iter)
+
+static void BT(bench)(struct bench *b) {
+    struct BENCH_NAME *tree = 0;
+    int fanout = BT(feat_fanout)();
+    bool counted = BT(feat_counted)();
+    bool spatial = BT(feat_spatial)();
+#define BENCH_END(op, ops) \
+    op_end(b, op, ops, fanout, BT(feat_bsearch)(), BT(feat_pathhint)(), \
+        counted, spatial, BT(feat_cow)(), BT(feat_atomics)())
+    size_t n = b->n;
+    size_t count = 0;
+    uint64_t seed = 0x1234;
+    // Queries for intersects and nearby are capped to keep large runs short,
+    // since trees that are not in curve order have overlapping node rects
+    // and each query may visit most of the tree.
+    size_t nqueries = n < 10000 ? n : 10000;
+    // Windows that hold about ten items each.
+    double side = sqrt(10.0 / (double)n);
+
+    // The tree is always built, because the other operations need it.
+    bool timed = op_begin(b, "insert");
+    for (size_t i = 0; i < n; i++) {
+        BT(insert)(&tree, b->keys[i], 0, 0);
+    }
+    if (timed) {
+        BENCH_END("insert", n);
+    }
+    if (op_begin(b, "get")) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t item = 0;
+            BT(get)(&tree, b->probes[i], &item, 0);
+            sink += item;
+        }
+        BENCH_END("get", n);
+    }
+    if (op_begin(b, "seek")) {
+        for (size_t i = 0; i < n; i++) {
+            BT(seek)(&tree, b->probes[i], stop_iter, &count);
+        }
+        sink += count;
+        BENCH_END("seek", n);
+    }
+    // Ranges are capped like the spatial queries.
+    if (op_begin(b, "range")) {
+        size_t read = 0;
+        for (size_t i = 0; i < nqueries; i++) {
+            size_t found = 0;
+            BT(seek)(&tree, b->probes[i], range_iter, &found);
+            read += found;
+        }
+        sink += read;
+        BENCH_END("range", nqueries);
+    }
+    if (op_begin(b, "scan")) {
+        size_t scanned = 0;
+        BT(scan)(&tree, count_iter, &scanned);
+        BENCH_END("scan", scanned);
+    }
+    if (op_begin(b, "iter")) {
+        size_t scanned = 0;
+        BENCH_ITER iter;
+        BT(iter_init)(&tree, &iter, 0);
+        for (BT(iter_scan)(&iter); BT(iter_valid)(&iter); BT(iter_next)(&iter)) {
+            scanned++;
+        }
+        BT(iter_release)(&iter);
+        BENCH_END("iter", scanned);
+    }
+    if (op_begin(b, "iter_desc")) {
+        size_t scanned = 0;
+        BENCH_ITER iter;
+        BT(iter_init)(&tree, &iter, 0);
+        BT(iter_scan_desc)(&iter);
+        for (; BT(iter_valid)(&iter); BT(iter_next)(&iter)) {
+            scanned++;
+        }
+        BT(iter_release)(&iter);
+        BENCH_END("iter_desc", scanned);
+    }
+    if (op_begin(b, "iter_range")) {
+        size_t read = 0;
+        BENCH_ITER iter;
+        BT(iter_init)(&tree, &iter, 0);
+        for (size_t i = 0; i < nqueries; i++) {
+            BT(iter_seek)(&iter, b->probes[i]);
+            for (int j = 0; j < 1000 && BT(iter_valid)(&iter); j++) {
+                uint64_t item;
+                BT(iter_item)(&iter, &item);
+                sink += item;
+                BT(iter_next)(&iter);
+                read++;
+            }
+        }
+        BT(iter_release)(&iter);
+        sink += read;
+        BENCH_END("iter_range", nqueries);
+    }
+    if (counted && op_begin(b, "get_at")) {
+        size_t total = BT(count)(&tree, 0);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t item = 0;
+            BT(get_at)(&tree, rand_next(&seed) % total, &item, 0);
+            sink += item;
+        }
+        BENCH_END("get_at", n);
+    }
+    if (spatial && op_begin(b, "intersects")) {
+        for (size_t i = 0; i < nqueries; i++) {
+            double min[2], max[2];
+            key_point(b->probes[i], min);
+            max[0] = min[0] + side;
+            max[1] = min[1] + side;
+            BT(intersects)(&tree, min, max, count_iter, &count);
+        }
+        sink += count;
+        BENCH_END("intersects", nqueries);
+    }
+    if (spatial && op_begin(b, "nearby")) {
+        for (size_t i = 0; i < nqueries; i++) {
+            double point[2];
+            key_point(b->probes[i], point);
+            size_t found = 0;
+            BT(nearby)(&tree, point, point_dist, nearby_iter, &found);
+            sink += found;
+        }
+        BENCH_END("nearby", nqueries);
+    }
+    if (op_begin(b, "delete")) {
+        for (size_t i = 0; i < n; i++) {
+            BT(delete)(&tree, b->keys[i], 0, 0);
+        }
+        BENCH_END("delete", n);
+    }
+    BT(clear)(&tree, 0);
+#undef BENCH_END
+}
+
+#undef BT
+#undef BENCH_ITER
+#undef BENCH_NAME
+
+#endif // BENCH_TEMPLATE
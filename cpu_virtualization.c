@@ -1,24 +1,244 @@
 // A very basic program to understand virtualization of the CPU by the OS
-// gcc cpu.c -o cpu 
-/* ./cpu A & ; ./cpu B &; ./cpu C &; ./cpu D & 
+// gcc cpu.c -o cpu
+/* ./cpu A & ; ./cpu B &; ./cpu C &; ./cpu D &
 and see the output to understand what happened */
 
+/* To measure it instead:
+     ./cpu -m <workers> <seconds> [none|spread|<cpu>] [gap_us]
+   starts that many CPU-bound worker processes at once, unpinned (none, the
+   default), pinned one per CPU (spread), or all pinned to one CPU, where
+   they have to take turns.  Each worker reads CLOCK_MONOTONIC in a tight
+   loop; a jump of more than gap_us (default 5) between two reads means it
+   was not running, taken off the CPU or interrupted.  The time between two
+   such gaps is a slice.  At the end it prints, for all workers together,
+   histograms of the slice lengths and of the gaps (the scheduling delay),
+   and for each worker its context switches, from /proc/self/sched (or
+   getrusage, without it).  On an isolated CPU, one worker should see no
+   gaps beyond the odd interrupt. */
+
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <assert.h>
 // #include "common.h"
 
-int 
+#define MAXGAPS (1 << 20)   // per worker; any more are only counted
+#define BUCKETS (40)        // powers of two of nanoseconds
+
+typedef struct {
+    int cpu;                // where it was pinned, or -1
+    uint64_t loops;         // clock reads
+    uint64_t gaps;          // all of them, also those not recorded
+    uint64_t stolen;        // time in gaps, ns
+    uint64_t max_gap;
+    uint64_t slices[BUCKETS];
+    uint64_t delays[BUCKETS];
+    long switches[2][3];    // before and after: all, voluntary, involuntary
+} result_t;
+
+static uint64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int bucket(uint64_t ns) {
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+// Reads the context switch counts: all, voluntary, involuntary
+static void read_switches(long sw[3]) {
+    FILE *f = fopen("/proc/self/sched", "r");
+    sw[0] = sw[1] = sw[2] = -1;
+    if (f != NULL) {
+        char line[256];
+        long v;
+        while (fgets(line, sizeof(line), f) != NULL) {
+            char *colon = strchr(line, ':');
+            if (colon == NULL || sscanf(colon + 1, "%ld", &v) != 1)
+                continue;
+            if (strncmp(line, "nr_switches ", 12) == 0)
+                sw[0] = v;
+            else if (strncmp(line, "nr_voluntary_switches ", 22) == 0)
+                sw[1] = v;
+            else if (strncmp(line, "nr_involuntary_switches ", 24) == 0)
+                sw[2] = v;
+        }
+        fclose(f);
+    }
+    if (sw[1] < 0 || sw[2] < 0) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        sw[1] = ru.ru_nvcsw;
+        sw[2] = ru.ru_nivcsw;
+        sw[0] = sw[1] + sw[2];
+    }
+}
+
+static void worker(result_t *r, volatile int *go, double seconds, uint64_t gap) {
+    // one record per gap: when it started and how long it was
+    uint64_t *at = malloc(2 * MAXGAPS * sizeof(uint64_t));
+    assert(at != NULL);
+    memset(at, 0, 2 * MAXGAPS * sizeof(uint64_t)); // no page faults later
+    uint64_t n = 0, loops = 0;
+
+    if (r->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(r->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            perror("sched_setaffinity");
+            exit(1);
+        }
+    }
+    while (!__atomic_load_n(go, __ATOMIC_ACQUIRE))
+        ;
+    read_switches(r->switches[0]);
+
+    // the hot loop: nothing in it but the clock and the record
+    uint64_t start = now_ns(), end = start + (uint64_t) (seconds * 1e9);
+    uint64_t prev = start, t;
+    while ((t = now_ns()) < end) {
+        if (t - prev > gap) {
+            if (n < MAXGAPS) {
+                at[2 * n] = prev;
+                at[2 * n + 1] = t - prev;
+            }
+            n++;
+        }
+        prev = t;
+        loops++;
+    }
+
+    read_switches(r->switches[1]);
+    r->loops = loops;
+    r->gaps = n;
+    uint64_t slice_start = start;
+    for (uint64_t i = 0; i < n && i < MAXGAPS; i++) {
+        uint64_t when = at[2 * i], len = at[2 * i + 1];
+        r->slices[bucket(when - slice_start)]++;
+        r->delays[bucket(len)]++;
+        r->stolen += len;
+        if (len > r->max_gap)
+            r->max_gap = len;
+        slice_start = when + len;
+    }
+    r->slices[bucket(prev - slice_start)]++;
+    free(at);
+}
+
+static void print_histogram(const char *what, uint64_t h[BUCKETS]) {
+    uint64_t total = 0, most = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        total += h[b];
+        if (h[b] > most)
+            most = h[b];
+    }
+    printf("%s (%lu)\n", what, (unsigned long) total);
+    for (int b = 0; b < BUCKETS; b++) {
+        if (h[b] == 0)
+            continue;
+        char bar[41];
+        int len = (int) (40 * h[b] / most);
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        printf("  %10.3fus - %10.3fus %10lu %s\n", (1ULL << b) / 1e3, (2ULL << b) / 1e3,
+               (unsigned long) h[b], bar);
+    }
+}
+
+static int measure(int workers, double seconds, const char *pin, double gap_us) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int single = strcmp(pin, "none") != 0 && strcmp(pin, "spread") != 0;
+    if (workers < 1 || seconds <= 0 || gap_us <= 0 ||
+        (single && (atoi(pin) < 0 || atoi(pin) >= ncpus))) {
+        fprintf(stderr, "usage: cpu -m <workers> <seconds> [none|spread|<cpu>] [gap_us]\n");
+        exit(1);
+    }
+    // shared with the workers: a flag to start them at once, in a cache
+    // line of its own, then the results
+    size_t size = 64 + workers * sizeof(result_t);
+    char *shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(shared != MAP_FAILED);
+    volatile int *go = (volatile int *) shared;
+    result_t *results = (result_t *) (shared + 64);
+
+    for (int i = 0; i < workers; i++) {
+        if (single)
+            results[i].cpu = atoi(pin);
+        else if (strcmp(pin, "spread") == 0)
+            results[i].cpu = i % ncpus;
+        else
+            results[i].cpu = -1;
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            worker(&results[i], go, seconds, (uint64_t) (gap_us * 1e3));
+            _exit(0);
+        }
+    }
+    usleep(100000); // for all of them to be ready
+    __atomic_store_n(go, 1, __ATOMIC_RELEASE);
+    int failed = 0, status;
+    while (wait(&status) > 0)
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    if (failed) {
+        fprintf(stderr, "cpu: a worker failed\n");
+        exit(1);
+    }
+
+    uint64_t slices[BUCKETS] = {0}, delays[BUCKETS] = {0};
+    printf("%d workers for %.2fs on %ld CPUs, gaps over %.1fus\n", workers, seconds, ncpus, gap_us);
+    printf("worker  cpu   reads/us     gaps  stolen  max gap    switches (vol/invol)\n");
+    for (int i = 0; i < workers; i++) {
+        result_t *r = &results[i];
+        for (int b = 0; b < BUCKETS; b++) {
+            slices[b] += r->slices[b];
+            delays[b] += r->delays[b];
+        }
+        char cpu[16];
+        if (r->cpu >= 0)
+            snprintf(cpu, sizeof(cpu), "%d", r->cpu);
+        else
+            snprintf(cpu, sizeof(cpu), "-");
+        printf("%6d %4s %10.1f %8lu %6.1f%% %7.3fms %8ld (%ld/%ld)\n", i, cpu,
+               r->loops / (seconds * 1e6), (unsigned long) r->gaps,
+               100.0 * r->stolen / (seconds * 1e9), r->max_gap / 1e6,
+               r->switches[1][0] - r->switches[0][0],
+               r->switches[1][1] - r->switches[0][1],
+               r->switches[1][2] - r->switches[0][2]);
+        if (r->gaps > MAXGAPS)
+            printf("       (only the first %d gaps are in the histograms)\n", MAXGAPS);
+    }
+    print_histogram("slice lengths", slices);
+    print_histogram("scheduling delays", delays);
+    munmap(shared, size);
+    return 0;
+}
+
+int
 main(int argc, char *argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "-m") == 0)
+        return measure(atoi(argv[2]), atof(argv[3]), argc > 4 ? argv[4] : "none",
+                       argc > 5 ? atof(argv[5]) : 5.0);
     if (argc != 2) {
         fprintf(stderr, "usage: cpu <string>\n");
+        fprintf(stderr, "       cpu -m <workers> <seconds> [none|spread|<cpu>] [gap_us]\n");
         exit(1);
     }
     struct timeval start;
     gettimeofday(&start, NULL);
-    
+
     char *str = argv[1];
     int counter = 0;
     while (counter <= 5) {
@@ -84,6 +84,22 @@
 #  define LZ4_FORCE_SW_BITCOUNT
 #endif
 
+/*
+ * LZ4_SHUFFLE_COPY
+ * Decoding of matches with offset < 16 builds the repeated pattern in a vector register
+ * with a single byte shuffle (SSSE3 pshufb, or AArch64 NEON tbl), then stores it 16 bytes at a time.
+ * It is selected at compile time, since LZ4_decompress_generic() is inlined into each entry point :
+ * build with -mssse3 (or any -march implying it) to enable it on x86.
+ * Define to 0 to use the portable 8-byte path instead.
+ */
+#ifndef LZ4_SHUFFLE_COPY
+#  if defined(__SSSE3__) || (defined(__aarch64__) && defined(__ARM_NEON))
+#    define LZ4_SHUFFLE_COPY 1
+#  else
+#    define LZ4_SHUFFLE_COPY 0
+#  endif
+#endif
+
 
 
 /*-************************************
@@ -96,6 +112,14 @@
 /*-************************************
 *  Compiler Options
 **************************************/
+#if LZ4_SHUFFLE_COPY
+#  if defined(__SSSE3__)
+#    include <tmmintrin.h>   /* _mm_shuffle_epi8 */
+#  else
+#    include <arm_neon.h>    /* vqtbl1q_u8 */
+#  endif
+#endif
+
 #ifdef _MSC_VER    /* Visual Studio */
 #  include <intrin.h>
 #  pragma warning(disable : 4127)        /* disable: C4127: conditional expression is constant */
@@ -286,6 +310,64 @@ void LZ4_wildCopy(void* dstPtr, const void* srcPtr, void* dstEnd)
     do { LZ4_copy8(d,s); d+=8; s+=8; } while (d<e);
 }
 
+static void LZ4_copy16(void* dst, const void* src)
+{
+    memcpy(dst,src,16);   /* a single SSE2 / NEON load and store */
+}
+
+/* customized variant of memcpy, which can overwrite up to 16 bytes beyond dstEnd.
+ * Also valid for overlapping matches, as long as offset >= 16 */
+LZ4_FORCE_O2_INLINE_GCC_PPC64LE
+void LZ4_wildCopy16(void* dstPtr, const void* srcPtr, void* dstEnd)
+{
+    BYTE* d = (BYTE*)dstPtr;
+    const BYTE* s = (const BYTE*)srcPtr;
+    BYTE* const e = (BYTE*)dstEnd;
+
+    do { LZ4_copy16(d,s); d+=16; s+=16; } while (d<e);
+}
+
+#if LZ4_SHUFFLE_COPY
+/* byte n of the pattern is byte (n % offset) of the match */
+static const BYTE LZ4_patternShuffle[16][16] = {
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },  /* 0 : invalid offset */
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+    {  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1 },
+    {  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0 },
+    {  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  0,  1,  2,  3,  4,  0,  1,  2,  3,  4,  0 },
+    {  0,  1,  2,  3,  4,  5,  0,  1,  2,  3,  4,  5,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  0,  1,  2,  3,  4,  5,  6,  0,  1 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  0,  1,  2,  3,  4,  5,  6,  7 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  0,  1,  2,  3,  4,  5,  6 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  1,  2,  3,  4,  5 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10,  0,  1,  2,  3,  4 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12,  0,  1,  2 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13,  0,  1 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  0 },
+};
+/* largest multiple of offset <= 16 : the same vector can be stored again from there */
+static const BYTE LZ4_patternStep[16] = { 16, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15 };
+
+/* LZ4_patternCopy16() :
+ * copies an overlapping match of offset < 16, i.e. a repeated pattern.
+ * Reads 16 bytes from match, and can overwrite up to 16 bytes beyond dstEnd. */
+LZ4_FORCE_INLINE
+void LZ4_patternCopy16(BYTE* op, const BYTE* match, size_t offset, BYTE* const dstEnd)
+{
+    size_t const step = LZ4_patternStep[offset];
+#  if defined(__SSSE3__)
+    __m128i const pattern = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)match),
+                                             _mm_loadu_si128((const __m128i*)LZ4_patternShuffle[offset]));
+    do { _mm_storeu_si128((__m128i*)op, pattern); op += step; } while (op < dstEnd);
+#  else
+    uint8x16_t const pattern = vqtbl1q_u8(vld1q_u8(match), vld1q_u8(LZ4_patternShuffle[offset]));
+    do { vst1q_u8(op, pattern); op += step; } while (op < dstEnd);
+#  endif
+}
+#endif /* LZ4_SHUFFLE_COPY */
+
 
 /*-************************************
 *  Common Constants
@@ -453,7 +535,7 @@ static const U32 LZ4_skipTrigger = 6;  /* Increase this value ==> compression ru
 typedef enum { notLimited = 0, limitedOutput = 1 } limitedOutput_directive;
 typedef enum { byPtr, byU32, byU16 } tableType_t;
 
-typedef enum { noDict = 0, withPrefix64k, usingExtDict } dict_directive;
+typedef enum { noDict = 0, withPrefix64k, usingExtDict, usingDictCtx } dict_directive;
 typedef enum { noDictIssue = 0, dictSmall } dictIssue_directive;
 
 typedef enum { endOnOutputSize = 0, endOnInputSize = 1 } endCondition_directive;
@@ -513,11 +595,11 @@ LZ4_FORCE_INLINE void LZ4_putPosition(const BYTE* p, void* tableBase, tableType_
     LZ4_putPositionOnHash(p, h, tableBase, tableType, srcBase);
 }
 
-static const BYTE* LZ4_getPositionOnHash(U32 h, void* tableBase, tableType_t tableType, const BYTE* srcBase)
+static const BYTE* LZ4_getPositionOnHash(U32 h, const void* tableBase, tableType_t tableType, const BYTE* srcBase)
 {
-    if (tableType == byPtr) { const BYTE** hashTable = (const BYTE**) tableBase; return hashTable[h]; }
-    if (tableType == byU32) { const U32* const hashTable = (U32*) tableBase; return hashTable[h] + srcBase; }
-    { const U16* const hashTable = (U16*) tableBase; return hashTable[h] + srcBase; }   /* default, to ensure a return */
+    if (tableType == byPtr) { const BYTE* const* hashTable = (const BYTE* const*) tableBase; return hashTable[h]; }
+    if (tableType == byU32) { const U32* const hashTable = (const U32*) tableBase; return hashTable[h] + srcBase; }
+    { const U16* const hashTable = (const U16*) tableBase; return hashTable[h] + srcBase; }   /* default, to ensure a return */
 }
 
 LZ4_FORCE_INLINE const BYTE* LZ4_getPosition(const BYTE* p, void* tableBase, tableType_t tableType, const BYTE* srcBase)
@@ -539,15 +621,19 @@ LZ4_FORCE_INLINE int LZ4_compress_generic(
                  const tableType_t tableType,
                  const dict_directive dict,
                  const dictIssue_directive dictIssue,
-                 const U32 acceleration)
+                 const U32 acceleration,
+                 const LZ4_stream_t_internal* const dictCtx)
 {
     const BYTE* ip = (const BYTE*) source;
     const BYTE* base;
     const BYTE* lowLimit;
-    const BYTE* const lowRefLimit = ip - cctx->dictSize;
-    const BYTE* const dictionary = cctx->dictionary;
-    const BYTE* const dictEnd = dictionary + cctx->dictSize;
+    const U32 dictSize = (dict==usingDictCtx) ? dictCtx->dictSize : cctx->dictSize;
+    const BYTE* const lowRefLimit = ip - dictSize;
+    const BYTE* const dictionary = (dict==usingDictCtx) ? dictCtx->dictionary : cctx->dictionary;
+    const BYTE* const dictEnd = dictionary + dictSize;
     const ptrdiff_t dictDelta = dictEnd - (const BYTE*)source;
+    /* usingDictCtx : positions in dictCtx->hashTable are relative to dictBase */
+    const BYTE* const dictBase = (dict==usingDictCtx) ? dictEnd - dictCtx->currentOffset : NULL;
     const BYTE* anchor = (const BYTE*) source;
     const BYTE* const iend = ip + inputSize;
     const BYTE* const mflimit = iend - MFLIMIT;
@@ -572,6 +658,7 @@ LZ4_FORCE_INLINE int LZ4_compress_generic(
         lowLimit = (const BYTE*)source - cctx->dictSize;
         break;
     case usingExtDict:
+    case usingDictCtx:
         base = (const BYTE*)source - cctx->currentOffset;
         lowLimit = (const BYTE*)source;
         break;
@@ -602,6 +689,16 @@ LZ4_FORCE_INLINE int LZ4_compress_generic(
                 if (unlikely(forwardIp > mflimit)) goto _last_literals;
 
                 match = LZ4_getPositionOnHash(h, cctx->hashTable, tableType, base);
+                if (dict==usingDictCtx) {
+                    if (match < (const BYTE*)source) {
+                        /* not from this block : look it up in the attached dictionary */
+                        match = LZ4_getPositionOnHash(h, dictCtx->hashTable, byU32, dictBase) - dictDelta;
+                        refDelta = dictDelta;
+                        lowLimit = dictionary;
+                    } else {
+                        refDelta = 0;
+                        lowLimit = (const BYTE*)source;
+                }   }
                 if (dict==usingExtDict) {
                     if (match < (const BYTE*)source) {
                         refDelta = dictDelta;
@@ -647,7 +744,7 @@ _next_match:
         /* Encode MatchLength */
         {   unsigned matchCode;
 
-            if ((dict==usingExtDict) && (lowLimit==dictionary)) {
+            if (((dict==usingExtDict) || (dict==usingDictCtx)) && (lowLimit==dictionary)) {
                 const BYTE* limit;
                 match += refDelta;
                 limit = ip + (dictEnd-match);
@@ -691,16 +788,27 @@ _next_match:
         LZ4_putPosition(ip-2, cctx->hashTable, tableType, base);
 
         /* Test next position */
-        match = LZ4_getPosition(ip, cctx->hashTable, tableType, base);
-        if (dict==usingExtDict) {
-            if (match < (const BYTE*)source) {
-                refDelta = dictDelta;
-                lowLimit = dictionary;
-            } else {
-                refDelta = 0;
-                lowLimit = (const BYTE*)source;
-        }   }
-        LZ4_putPosition(ip, cctx->hashTable, tableType, base);
+        {   U32 const h = LZ4_hashPosition(ip, tableType);
+            match = LZ4_getPositionOnHash(h, cctx->hashTable, tableType, base);
+            if (dict==usingDictCtx) {
+                if (match < (const BYTE*)source) {
+                    match = LZ4_getPositionOnHash(h, dictCtx->hashTable, byU32, dictBase) - dictDelta;
+                    refDelta = dictDelta;
+                    lowLimit = dictionary;
+                } else {
+                    refDelta = 0;
+                    lowLimit = (const BYTE*)source;
+            }   }
+            if (dict==usingExtDict) {
+                if (match < (const BYTE*)source) {
+                    refDelta = dictDelta;
+                    lowLimit = dictionary;
+                } else {
+                    refDelta = 0;
+                    lowLimit = (const BYTE*)source;
+            }   }
+            LZ4_putPositionOnHash(ip, h, cctx->hashTable, tableType, base);
+        }
         if ( ((dictIssue==dictSmall) ? (match>=lowRefLimit) : 1)
             && (match+MAX_DISTANCE>=ip)
             && (LZ4_read32(match+refDelta)==LZ4_read32(ip)) )
@@ -741,14 +849,14 @@ int LZ4_compress_fast_extState(void* state, const char* source, char* dest, int
 
     if (maxOutputSize >= LZ4_compressBound(inputSize)) {
         if (inputSize < LZ4_64Klimit)
-            return LZ4_compress_generic(ctx, source, dest, inputSize,             0,    notLimited,                        byU16, noDict, noDictIssue, acceleration);
+            return LZ4_compress_generic(ctx, source, dest, inputSize,             0,    notLimited,                        byU16, noDict, noDictIssue, acceleration, NULL);
         else
-            return LZ4_compress_generic(ctx, source, dest, inputSize,             0,    notLimited, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, acceleration);
+            return LZ4_compress_generic(ctx, source, dest, inputSize,             0,    notLimited, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, acceleration, NULL);
     } else {
         if (inputSize < LZ4_64Klimit)
-            return LZ4_compress_generic(ctx, source, dest, inputSize, maxOutputSize, limitedOutput,                        byU16, noDict, noDictIssue, acceleration);
+            return LZ4_compress_generic(ctx, source, dest, inputSize, maxOutputSize, limitedOutput,                        byU16, noDict, noDictIssue, acceleration, NULL);
         else
-            return LZ4_compress_generic(ctx, source, dest, inputSize, maxOutputSize, limitedOutput, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, acceleration);
+            return LZ4_compress_generic(ctx, source, dest, inputSize, maxOutputSize, limitedOutput, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, acceleration, NULL);
     }
 }
 
@@ -785,9 +893,57 @@ int LZ4_compress_fast_force(const char* source, char* dest, int inputSize, int m
     LZ4_resetStream(&ctx);
 
     if (inputSize < LZ4_64Klimit)
-        return LZ4_compress_generic(&ctx.internal_donotuse, source, dest, inputSize, maxOutputSize, limitedOutput, byU16,                        noDict, noDictIssue, acceleration);
+        return LZ4_compress_generic(&ctx.internal_donotuse, source, dest, inputSize, maxOutputSize, limitedOutput, byU16,                        noDict, noDictIssue, acceleration, NULL);
     else
-        return LZ4_compress_generic(&ctx.internal_donotuse, source, dest, inputSize, maxOutputSize, limitedOutput, sizeof(void*)==8 ? byU32 : byPtr, noDict, noDictIssue, acceleration);
+        return LZ4_compress_generic(&ctx.internal_donotuse, source, dest, inputSize, maxOutputSize, limitedOutput, sizeof(void*)==8 ? byU32 : byPtr, noDict, noDictIssue, acceleration, NULL);
+}
+
+
+/*-******************************
+*  Incompressible data
+********************************/
+#define LZ4_PROBE_NBWINDOWS  4
+#define LZ4_PROBE_WINDOWSIZE (1 KB)
+#define LZ4_PROBE_HASHLOG    10
+
+/*! LZ4_probeSavings() :
+ *  Estimates how much LZ4 would save on `source`, without compressing it :
+ *  scans up to 4 windows of 1 KB spread over the input, against a 4 KB table,
+ *  and counts matched bytes, minus 3 bytes (token and offset) per match.
+ *  Every position is tried, so the estimate is rather optimistic :
+ *  a low result reliably means that compression is not worth trying.
+ *  Costs about as much as compressing 1 KB of incompressible data, whatever inputSize.
+ *  @return : estimated savings, in 1/1024 of inputSize (0 = incompressible).
+ *  Not part of lz4.h : used by lz4frame.c */
+int LZ4_probeSavings(const char* source, int inputSize)
+{
+    const BYTE* const istart = (const BYTE*)source;
+    U32 table[1 << LZ4_PROBE_HASHLOG];   /* positions from istart, + 1 ; 0 = empty */
+    int const windowSize = (inputSize < LZ4_PROBE_WINDOWSIZE) ? inputSize : LZ4_PROBE_WINDOWSIZE;
+    int const nbWindows = (inputSize < LZ4_PROBE_NBWINDOWS * LZ4_PROBE_WINDOWSIZE) ?
+                          (inputSize / LZ4_PROBE_WINDOWSIZE) + (inputSize < LZ4_PROBE_WINDOWSIZE) : LZ4_PROBE_NBWINDOWS;
+    size_t saved = 0;
+    int w;
+
+    if (inputSize < LZ4_minLength) return 0;   /* stored as literals anyway */
+    MEM_INIT(table, 0, sizeof(table));
+    for (w = 0; w < nbWindows; w++) {
+        const BYTE* const wStart = istart + (nbWindows > 1 ? (size_t)(inputSize - windowSize) * w / (nbWindows-1) : 0);
+        const BYTE* const wEnd = wStart + windowSize;
+        const BYTE* ip = wStart;
+        while (ip <= wEnd - MINMATCH) {
+            U32 const h = (LZ4_read32(ip) * 2654435761U) >> ((MINMATCH*8)-LZ4_PROBE_HASHLOG);
+            const BYTE* const match = istart + table[h] - 1;
+            U32 const prev = table[h];
+            table[h] = (U32)(ip - istart) + 1;
+            if ((prev) && (match + MAX_DISTANCE >= ip) && (LZ4_read32(match) == LZ4_read32(ip))) {
+                unsigned const matchLength = MINMATCH + LZ4_count(ip+MINMATCH, match+MINMATCH, wEnd);
+                saved += matchLength - 3;
+                ip += matchLength;
+            } else {
+                ip++;
+    }   }   }
+    return (int)((saved * 1024) / ((size_t)windowSize * nbWindows));
 }
 
 
@@ -1088,9 +1244,9 @@ int LZ4_compress_fast_continue (LZ4_stream_t* LZ4_stream, const char* source, ch
     if (dictEnd == (const BYTE*)source) {
         int result;
         if ((streamPtr->dictSize < 64 KB) && (streamPtr->dictSize < streamPtr->currentOffset))
-            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, withPrefix64k, dictSmall, acceleration);
+            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, withPrefix64k, dictSmall, acceleration, NULL);
         else
-            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, withPrefix64k, noDictIssue, acceleration);
+            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, withPrefix64k, noDictIssue, acceleration, NULL);
         streamPtr->dictSize += (U32)inputSize;
         streamPtr->currentOffset += (U32)inputSize;
         return result;
@@ -1099,9 +1255,9 @@ int LZ4_compress_fast_continue (LZ4_stream_t* LZ4_stream, const char* source, ch
     /* external dictionary mode */
     {   int result;
         if ((streamPtr->dictSize < 64 KB) && (streamPtr->dictSize < streamPtr->currentOffset))
-            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingExtDict, dictSmall, acceleration);
+            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingExtDict, dictSmall, acceleration, NULL);
         else
-            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingExtDict, noDictIssue, acceleration);
+            result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingExtDict, noDictIssue, acceleration, NULL);
         streamPtr->dictionary = (const BYTE*)source;
         streamPtr->dictSize = (U32)inputSize;
         streamPtr->currentOffset += (U32)inputSize;
@@ -1121,7 +1277,7 @@ int LZ4_compress_forceExtDict (LZ4_stream_t* LZ4_dict, const char* source, char*
     if (smallest > (const BYTE*) source) smallest = (const BYTE*) source;
     LZ4_renormDictT(streamPtr, smallest);
 
-    result = LZ4_compress_generic(streamPtr, source, dest, inputSize, 0, notLimited, byU32, usingExtDict, noDictIssue, 1);
+    result = LZ4_compress_generic(streamPtr, source, dest, inputSize, 0, notLimited, byU32, usingExtDict, noDictIssue, 1, NULL);
 
     streamPtr->dictionary = (const BYTE*)source;
     streamPtr->dictSize = (U32)inputSize;
@@ -1131,6 +1287,74 @@ int LZ4_compress_forceExtDict (LZ4_stream_t* LZ4_dict, const char* source, char*
 }
 
 
+/*! LZ4_compress_fast_usingDictStream() :
+ *  Compresses `source` as the first block of a stream whose history is the dictionary
+ *  loaded into `dictStream` by LZ4_loadDict(). The hash table of `dictStream` is referenced,
+ *  not copied : it can be shared by any number of streams, and must not change meanwhile.
+ *  `LZ4_stream` is not reset : entries left by previous blocks are below its currentOffset,
+ *  and are simply ignored. Afterwards, `LZ4_stream` goes on from `source`,
+ *  as after LZ4_compress_fast_continue(). Used by lz4dict.c; not part of lz4.h.
+ */
+int LZ4_compress_fast_usingDictStream (LZ4_stream_t* LZ4_stream, const LZ4_stream_t* dictStream,
+                                       const char* source, char* dest, int inputSize, int maxOutputSize, int acceleration)
+{
+    LZ4_stream_t_internal* const streamPtr = &LZ4_stream->internal_donotuse;
+    const LZ4_stream_t_internal* const dictCtx = &dictStream->internal_donotuse;
+    int result;
+
+    if ((streamPtr->initCheck) || (dictCtx->initCheck)) return 0;   /* Uninitialized structure detected */
+    if ((dictCtx->dictSize == 0) || (inputSize > 4 KB)) {
+        /* a larger block amortizes a copy of the table, and then runs the faster extDict loop */
+        if (dictCtx->dictSize == 0) {
+            streamPtr->dictionary = NULL;
+            streamPtr->dictSize = 0;
+        } else {
+            memcpy(streamPtr, dictCtx, sizeof(*streamPtr));
+        }
+        return LZ4_compress_fast_continue(LZ4_stream, source, dest, inputSize, maxOutputSize, acceleration);
+    }
+    if ((streamPtr->currentOffset > 0x80000000) ||
+        ((uptrval)streamPtr->currentOffset > (uptrval)source))   /* stale entries must remain below currentOffset */
+        LZ4_resetStream(LZ4_stream);
+    /* empty slots hold position 0 : it must sit below `source`, so that they send the search to dictCtx */
+    if (streamPtr->currentOffset == 0) streamPtr->currentOffset = 64 KB;
+    if (acceleration < 1) acceleration = ACCELERATION_DEFAULT;
+
+    if (dictCtx->dictSize < 64 KB)
+        result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingDictCtx, dictSmall, acceleration, dictCtx);
+    else
+        result = LZ4_compress_generic(streamPtr, source, dest, inputSize, maxOutputSize, limitedOutput, byU32, usingDictCtx, noDictIssue, acceleration, dictCtx);
+    streamPtr->dictionary = (const BYTE*)source;
+    streamPtr->dictSize = (U32)inputSize;
+    streamPtr->currentOffset += (U32)inputSize;
+    return result;
+}
+
+
+/*! LZ4_storeBlock_continue() :
+ *  Appends `source` to the history of `LZ4_stream`, as LZ4_compress_fast_continue() would,
+ *  but without compressing nor hashing it : for a block the caller stores uncompressed.
+ *  Next blocks find no match within it, but their offsets stay consistent with the decoder's history.
+ *  Not part of lz4.h : used by lz4frame.c */
+void LZ4_storeBlock_continue (LZ4_stream_t* LZ4_stream, const char* source, int inputSize)
+{
+    LZ4_stream_t_internal* const streamPtr = &LZ4_stream->internal_donotuse;
+    const BYTE* const dictEnd = streamPtr->dictionary + streamPtr->dictSize;
+    const BYTE* smallest = (const BYTE*) source;
+
+    if ((streamPtr->dictSize>0) && (smallest>dictEnd)) smallest = dictEnd;
+    LZ4_renormDictT(streamPtr, smallest);
+
+    if (dictEnd == (const BYTE*)source) {   /* prefix mode */
+        streamPtr->dictSize += (U32)inputSize;
+    } else {
+        streamPtr->dictionary = (const BYTE*)source;
+        streamPtr->dictSize = (U32)inputSize;
+    }
+    streamPtr->currentOffset += (U32)inputSize;
+}
+
+
 /*! LZ4_saveDict() :
  *  If previously compressed data block is not guaranteed to remain available at its memory location,
  *  save it into a safer place (char* safeBuffer).
@@ -1256,7 +1480,10 @@ LZ4_FORCE_INLINE int LZ4_decompress_generic(
             op += length;
             break;     /* Necessarily EOF, due to parsing restrictions */
         }
-        LZ4_wildCopy(op, ip, cpy);
+        if ((endOnInput) && (cpy <= oend-16) && (ip+length <= iend-16))
+            LZ4_wildCopy16(op, ip, cpy);
+        else
+            LZ4_wildCopy(op, ip, cpy);
         ip += length; op = cpy;
 
         /* get offset */
@@ -1305,6 +1532,19 @@ LZ4_FORCE_INLINE int LZ4_decompress_generic(
 
         /* copy match within block */
         cpy = op + length;
+        if (likely(cpy <= oend-16)) {
+            /* room for 16-byte steps : match may overlap, but is not near the end of the block */
+            if (offset >= 16) {
+                LZ4_wildCopy16(op, match, cpy);
+                op = cpy;
+                continue;
+            }
+#if LZ4_SHUFFLE_COPY
+            LZ4_patternCopy16(op, match, offset, cpy);
+            op = cpy;
+            continue;
+#endif
+        }
         if (unlikely(offset<8)) {
             op[0] = match[0];
             op[1] = match[1];
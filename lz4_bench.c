@@ -0,0 +1,714 @@
+/*
+   lz4_bench - benchmark of lz4.c entry points
+   Measures lz4.c, which keeps its own copyright and BSD 2-Clause license.
+*/
+
+/*
+ * Runs the compression and decompression entry points of lz4.c
+ * over generated corpora (json, logs, random) and over files (e.g. Silesia).
+ *
+ * Build and run (lz4.h comes with the LZ4 distribution) :
+ *
+ *     cc -O3 -o lz4_bench lz4_bench.c lz4.c
+ *     ./lz4_bench -c json,files -f compress_fast -a 1,8 silesia/dickens silesia/xml
+ *
+ * Options :
+ *
+ *     -c corpora  Comma separated list of json, logs, random, files (all)
+ *     -f funcs    Comma separated list of functions (all), see -l
+ *     -a accels   Accelerations of compress_fast (1,2,4,8,16)
+ *     -b size     Block size of logs, random and files, in bytes (65536)
+ *     -s size     Size of generated corpora, in bytes (8388608)
+ *     -i n        Iterations, the fastest one is reported (5)
+ *     -t ms       Minimum duration of an iteration (200)
+ *     -l          List the functions and exit
+ *
+ * Files given as arguments form the "files" corpus, one measurement per file.
+ * Json messages are compressed one by one; other corpora are cut into blocks.
+ * Each measurement is printed as one line of JSON, for example :
+ *
+ *     {"corpus":"logs","func":"compress_fast","accel":4,"block":65536,
+ *      "chunks":128,"bytes":8388608,"out_bytes":1536210,"ratio":5.461,
+ *      "mb_s":912.40,"cycles_byte":2.87,"instr_byte":6.12,
+ *      "branch_misses_kb":3.41}
+ *
+ * but all on a single line. bytes is the uncompressed data of one pass over the chunks
+ * (for compress_destSize, the input it consumed; for decompress_safe_partial,
+ * the output it was asked for), and MB are 10^6 of those bytes.
+ * ratio is bytes / out_bytes, and null for decompress_safe_partial.
+ * Hardware counters are null when not available, such as in most containers
+ * and virtual machines. Every function's output is checked once, before timing.
+ */
+
+
+/*-************************************
+*  Dependencies
+**************************************/
+#ifdef __linux__
+#  define _GNU_SOURCE               /* syscall */
+#else
+#  define _POSIX_C_SOURCE 200112L   /* clock_gettime, getopt */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#endif
+#include "lz4.h"
+
+
+/*-************************************
+*  Basic Types
+**************************************/
+#if defined(__cplusplus) || (defined (__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L) /* C99 */)
+# include <stdint.h>
+  typedef  uint8_t BYTE;
+  typedef uint32_t U32;
+  typedef uint64_t U64;
+#else
+  typedef unsigned char       BYTE;
+  typedef unsigned int        U32;
+  typedef unsigned long long  U64;
+#endif
+
+#define KB *(1 <<10)
+#define MB *(1 <<20)
+
+
+/*-************************************
+*  Constants
+**************************************/
+#define BENCH_BLOCKSIZE_DEFAULT   (64 KB)
+#define BENCH_GENSIZE_DEFAULT     (8 MB)
+#define BENCH_ITERATIONS_DEFAULT  5
+#define BENCH_MINTIME_MS_DEFAULT  200
+#define BENCH_DICTSIZE            (64 KB)
+
+
+/*-************************************
+*  Timer and hardware counters
+**************************************/
+static double BENCH_nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef enum { cnt_cycles = 0, cnt_instructions, cnt_branchMisses, cnt_max } BENCH_counter_e;
+
+typedef struct {
+    int fd[cnt_max];        /* -1 when not available */
+} BENCH_counters_t;
+
+static int BENCH_perfOpen(U64 config)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    int fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    return fd;
+#else
+    (void)config;
+    return -1;
+#endif
+}
+
+static void BENCH_openCounters(BENCH_counters_t* c)
+{
+#ifdef __linux__
+    c->fd[cnt_cycles] = BENCH_perfOpen(PERF_COUNT_HW_CPU_CYCLES);
+    c->fd[cnt_instructions] = BENCH_perfOpen(PERF_COUNT_HW_INSTRUCTIONS);
+    c->fd[cnt_branchMisses] = BENCH_perfOpen(PERF_COUNT_HW_BRANCH_MISSES);
+#else
+    int i;
+    for (i = 0; i < cnt_max; i++) c->fd[i] = -1;
+#endif
+}
+
+static void BENCH_readCounters(const BENCH_counters_t* c, U64 values[cnt_max])
+{
+    int i;
+    for (i = 0; i < cnt_max; i++) {
+        values[i] = 0;
+        if ((c->fd[i] >= 0) && (read(c->fd[i], &values[i], sizeof(values[i])) != sizeof(values[i])))
+            values[i] = 0;
+    }
+}
+
+
+/*-************************************
+*  Corpora
+**************************************/
+typedef struct {
+    const char* name;
+    BYTE*   src;            /* chunks, one after another */
+    size_t  srcSize;
+    size_t* chunkSizes;
+    size_t  nbChunks;
+    size_t  blockSize;      /* 0 : chunks are messages */
+} BENCH_corpus_t;
+
+static U64 BENCH_rand(U64* seed)
+{
+    U64 x = (*seed += 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* BENCH_cutBlocks() :
+ * @return : 0 on success, -1 on allocation failure */
+static int BENCH_cutBlocks(BENCH_corpus_t* c, size_t blockSize)
+{
+    size_t n;
+    c->blockSize = blockSize;
+    c->nbChunks = (c->srcSize + blockSize - 1) / blockSize;
+    c->chunkSizes = (size_t*)malloc((c->nbChunks + 1) * sizeof(size_t));
+    if (c->chunkSizes == NULL) return -1;
+    for (n = 0; n < c->nbChunks; n++)
+        c->chunkSizes[n] = (n+1 < c->nbChunks) ? blockSize : c->srcSize - n * blockSize;
+    return 0;
+}
+
+/* BENCH_genJson() :
+ * small events, compressed one by one, as an RPC or message queue would */
+static int BENCH_genJson(BENCH_corpus_t* c, size_t size)
+{
+    static const char* const users[] = { "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi" };
+    static const char* const actions[] = { "login", "logout", "view", "click", "search", "purchase", "refund" };
+    static const char* const agents[] = { "Mozilla/5.0 (X11; Linux x86_64)", "Mozilla/5.0 (iPhone; CPU iPhone OS 17_0)",
+                                          "curl/8.4.0", "okhttp/4.12.0" };
+    U64 seed = 1;
+    size_t capacity = size / 64 + 1;
+    c->src = (BYTE*)malloc(size + 512);
+    c->chunkSizes = (size_t*)malloc(capacity * sizeof(size_t));
+    if (!c->src || !c->chunkSizes) return -1;
+    c->srcSize = 0;
+    c->nbChunks = 0;
+    c->blockSize = 0;
+    while ((c->srcSize + 512 <= size) && (c->nbChunks < capacity)) {
+        int const len = sprintf((char*)c->src + c->srcSize,
+            "{\"id\":%u,\"ts\":%u,\"user\":\"%s\",\"action\":\"%s\",\"session\":\"%08x%08x\","
+            "\"client\":{\"agent\":\"%s\",\"lang\":\"en-US\"},\"amount\":%u.%02u,\"items\":[%u,%u]}",
+            (U32)BENCH_rand(&seed), 1700000000U + (U32)(BENCH_rand(&seed) % 10000000),
+            users[BENCH_rand(&seed) % 8], actions[BENCH_rand(&seed) % 7],
+            (U32)BENCH_rand(&seed), (U32)BENCH_rand(&seed), agents[BENCH_rand(&seed) % 4],
+            (U32)(BENCH_rand(&seed) % 1000), (U32)(BENCH_rand(&seed) % 100),
+            (U32)(BENCH_rand(&seed) % 100000), (U32)(BENCH_rand(&seed) % 100000));
+        c->chunkSizes[c->nbChunks++] = (size_t)len;
+        c->srcSize += (size_t)len;
+    }
+    return 0;
+}
+
+static int BENCH_genLogs(BENCH_corpus_t* c, size_t size, size_t blockSize)
+{
+    static const char* const levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char* const paths[] = { "/api/v1/items", "/api/v1/users", "/api/v1/orders", "/healthz", "/static/app.js" };
+    static const int statuses[] = { 200, 200, 200, 304, 404, 500 };
+    U64 seed = 2;
+    U64 ms = 1700000000000ULL;
+    c->src = (BYTE*)malloc(size + 256);
+    if (!c->src) return -1;
+    c->srcSize = 0;
+    while (c->srcSize + 256 <= size) {
+        ms += BENCH_rand(&seed) % 50;
+        c->srcSize += (size_t)sprintf((char*)c->src + c->srcSize,
+            "%llu.%03u %-5s [worker-%u] GET %s/%u %d %ums bytes=%u\n",
+            (unsigned long long)(ms / 1000), (U32)(ms % 1000), levels[BENCH_rand(&seed) % 6],
+            (U32)(BENCH_rand(&seed) % 16), paths[BENCH_rand(&seed) % 5], (U32)(BENCH_rand(&seed) % 100000),
+            statuses[BENCH_rand(&seed) % 6], (U32)(BENCH_rand(&seed) % 300), (U32)(BENCH_rand(&seed) % 65536));
+    }
+    return BENCH_cutBlocks(c, blockSize);
+}
+
+static int BENCH_genRandom(BENCH_corpus_t* c, size_t size, size_t blockSize)
+{
+    U64 seed = 3;
+    size_t i;
+    c->src = (BYTE*)malloc(size + 8);
+    if (!c->src) return -1;
+    for (i = 0; i < size; i += 8) {
+        U64 const r = BENCH_rand(&seed);
+        memcpy(c->src + i, &r, 8);
+    }
+    c->srcSize = size;
+    return BENCH_cutBlocks(c, blockSize);
+}
+
+static int BENCH_loadFile(BENCH_corpus_t* c, const char* path, size_t blockSize)
+{
+    FILE* const f = fopen(path, "rb");
+    long size;
+    if (f == NULL) return -1;
+    if ((fseek(f, 0, SEEK_END) != 0) || ((size = ftell(f)) < 0) || (fseek(f, 0, SEEK_SET) != 0)) { fclose(f); return -1; }
+    c->src = (BYTE*)malloc((size_t)size + 1);
+    if ((c->src == NULL) || (fread(c->src, 1, (size_t)size, f) != (size_t)size)) { fclose(f); return -1; }
+    fclose(f);
+    c->srcSize = (size_t)size;
+    c->name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    return BENCH_cutBlocks(c, blockSize);
+}
+
+static void BENCH_freeCorpus(BENCH_corpus_t* c)
+{
+    free(c->src);
+    free(c->chunkSizes);
+    memset(c, 0, sizeof(*c));
+}
+
+
+/*-************************************
+*  Functions under test
+**************************************/
+typedef struct {
+    const BENCH_corpus_t* corpus;
+    size_t* slots;          /* offset of each chunk's compressed slot within cBuf */
+    char*   cBuf;           /* compressed chunks, LZ4_compressBound() bytes per slot */
+    int*    cSizes;         /* independent blocks (LZ4_compress_default()) */
+    char*   lBuf;           /* linked blocks (LZ4_compress_fast_continue()), same slots */
+    int*    lSizes;
+    char*   outBuf;         /* compression output, same slots */
+    BYTE*   dBuf;           /* decompression output, same layout as src */
+    LZ4_stream_t* stream;
+    int     accel;
+} BENCH_ctx_t;
+
+/* A pass processes every chunk once.
+ * @return : bytes of uncompressed data processed, `*outSize` being the size of compressed data */
+typedef size_t (*BENCH_pass_f)(BENCH_ctx_t* b, size_t* outSize);
+
+static size_t BENCH_compress_default(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    const BYTE* src = c->src;
+    size_t n, total = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        int const srcSize = (int)c->chunkSizes[n];
+        total += (size_t)LZ4_compress_default((const char*)src, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize));
+        src += srcSize;
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+static size_t BENCH_compress_fast(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    const BYTE* src = c->src;
+    size_t n, total = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        int const srcSize = (int)c->chunkSizes[n];
+        total += (size_t)LZ4_compress_fast((const char*)src, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize), b->accel);
+        src += srcSize;
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+/* target : half of the chunk, so that compression stops early on compressible data
+ * and output fills up on incompressible data */
+static size_t BENCH_compress_destSize(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    const BYTE* src = c->src;
+    size_t n, total = 0, consumed = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        int srcSize = (int)c->chunkSizes[n];
+        int const target = srcSize / 2 + 16;
+        total += (size_t)LZ4_compress_destSize((const char*)src, b->outBuf + b->slots[n], &srcSize, target);
+        consumed += (size_t)srcSize;
+        src += c->chunkSizes[n];
+    }
+    *outSize = total;
+    return consumed;
+}
+
+/* chunks are linked : each block references those before it */
+static size_t BENCH_compress_fast_continue(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    const BYTE* src = c->src;
+    size_t n, total = 0;
+    LZ4_resetStream(b->stream);
+    for (n = 0; n < c->nbChunks; n++) {
+        int const srcSize = (int)c->chunkSizes[n];
+        total += (size_t)LZ4_compress_fast_continue(b->stream, (const char*)src, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize), b->accel);
+        src += srcSize;
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+static size_t BENCH_decompress_safe(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    BYTE* dst = b->dBuf;
+    size_t n, total = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        int const r = LZ4_decompress_safe(b->cBuf + b->slots[n], (char*)dst, b->cSizes[n], (int)c->chunkSizes[n]);
+        total += (size_t)b->cSizes[n];
+        dst += (r > 0) ? (size_t)r : c->chunkSizes[n];
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+static size_t BENCH_decompress_fast(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    BYTE* dst = b->dBuf;
+    size_t n, total = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        LZ4_decompress_fast(b->cBuf + b->slots[n], (char*)dst, (int)c->chunkSizes[n]);
+        total += (size_t)b->cSizes[n];
+        dst += c->chunkSizes[n];
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+/* decodes the first half of each chunk */
+static size_t BENCH_decompress_safe_partial(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    BYTE* dst = b->dBuf;
+    size_t n, total = 0, produced = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        int const target = (int)c->chunkSizes[n] / 2;
+        LZ4_decompress_safe_partial(b->cBuf + b->slots[n], (char*)dst, b->cSizes[n], target, (int)c->chunkSizes[n]);
+        total += (size_t)b->cSizes[n];
+        produced += (size_t)target;
+        dst += c->chunkSizes[n];
+    }
+    *outSize = total;
+    return produced;
+}
+
+/* decodes linked blocks, the previous 64 KB of output being the dictionary */
+static size_t BENCH_decompress_safe_usingDict(BENCH_ctx_t* b, size_t* outSize)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    BYTE* dst = b->dBuf;
+    size_t n, total = 0;
+    for (n = 0; n < c->nbChunks; n++) {
+        size_t const dictSize = ((size_t)(dst - b->dBuf) < BENCH_DICTSIZE) ? (size_t)(dst - b->dBuf) : BENCH_DICTSIZE;
+        LZ4_decompress_safe_usingDict(b->lBuf + b->slots[n], (char*)dst, b->lSizes[n], (int)c->chunkSizes[n],
+                                      (const char*)dst - dictSize, (int)dictSize);
+        total += (size_t)b->lSizes[n];
+        dst += c->chunkSizes[n];
+    }
+    *outSize = total;
+    return c->srcSize;
+}
+
+typedef enum { check_compressed, check_linked, check_decompressed, check_partial } BENCH_check_e;
+
+typedef struct {
+    const char* name;
+    BENCH_pass_f pass;
+    BENCH_check_e check;
+    int usesAccel;
+} BENCH_func_t;
+
+static const BENCH_func_t BENCH_funcs[] = {
+    { "compress_default",            BENCH_compress_default,          check_compressed,   0 },
+    { "compress_fast",               BENCH_compress_fast,             check_compressed,   1 },
+    { "compress_destSize",           BENCH_compress_destSize,         check_partial,      0 },
+    { "compress_fast_continue",      BENCH_compress_fast_continue,    check_linked,       0 },
+    { "decompress_safe",             BENCH_decompress_safe,           check_decompressed, 0 },
+    { "decompress_fast",             BENCH_decompress_fast,           check_decompressed, 0 },
+    { "decompress_safe_partial",     BENCH_decompress_safe_partial,   check_partial,      0 },
+    { "decompress_safe_usingDict",   BENCH_decompress_safe_usingDict, check_decompressed, 0 },
+};
+#define BENCH_NBFUNCS (sizeof(BENCH_funcs) / sizeof(BENCH_funcs[0]))
+
+
+/*-************************************
+*  Checks
+**************************************/
+/* BENCH_check() :
+ * runs `f` once, and verifies its output against the corpus.
+ * @return : 0 if output is correct */
+static int BENCH_check(BENCH_ctx_t* b, const BENCH_func_t* f)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    size_t outSize, n, pos = 0;
+    memset(b->dBuf, 0, c->srcSize);
+    f->pass(b, &outSize);
+    if (f->check == check_decompressed)
+        return memcmp(b->dBuf, c->src, c->srcSize) != 0;
+    if (f->check == check_partial) {
+        if (f->pass == BENCH_decompress_safe_partial) {
+            for (n = 0; n < c->nbChunks; pos += c->chunkSizes[n], n++)
+                if (memcmp(b->dBuf + pos, c->src + pos, c->chunkSizes[n] / 2)) return 1;
+            return 0;
+        }
+        /* compress_destSize : the output decodes into a prefix of the chunk */
+        for (n = 0; n < c->nbChunks; pos += c->chunkSizes[n], n++) {
+            int const srcSize = (int)c->chunkSizes[n];
+            int consumed = srcSize;
+            int const cSize = LZ4_compress_destSize((const char*)c->src + pos, b->outBuf + b->slots[n], &consumed, srcSize / 2 + 16);
+            if (LZ4_decompress_safe(b->outBuf + b->slots[n], (char*)b->dBuf + pos, cSize, srcSize) != consumed) return 1;
+            if (memcmp(b->dBuf + pos, c->src + pos, (size_t)consumed)) return 1;
+        }
+        return 0;
+    }
+    for (n = 0; n < c->nbChunks; pos += c->chunkSizes[n], n++) {
+        int const srcSize = (int)c->chunkSizes[n];
+        const char* dictStart = (const char*)b->dBuf + pos;
+        int dictSize = 0;
+        int cSize, r;
+        if (f->check == check_linked) {
+            dictSize = (pos < BENCH_DICTSIZE) ? (int)pos : BENCH_DICTSIZE;
+            dictStart -= dictSize;
+        }
+        /* compressed sizes are not kept by passes : compress again, they are deterministic */
+        if (f->pass == BENCH_compress_fast_continue) {
+            if (n == 0) LZ4_resetStream(b->stream);
+            cSize = LZ4_compress_fast_continue(b->stream, (const char*)c->src + pos, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize), b->accel);
+        } else if (f->pass == BENCH_compress_fast) {
+            cSize = LZ4_compress_fast((const char*)c->src + pos, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize), b->accel);
+        } else {
+            cSize = LZ4_compress_default((const char*)c->src + pos, b->outBuf + b->slots[n], srcSize, LZ4_compressBound(srcSize));
+        }
+        r = LZ4_decompress_safe_usingDict(b->outBuf + b->slots[n], (char*)b->dBuf + pos, cSize, srcSize, dictStart, dictSize);
+        if ((r != srcSize) || memcmp(b->dBuf + pos, c->src + pos, (size_t)srcSize)) return 1;
+    }
+    return 0;
+}
+
+
+/*-************************************
+*  Measurement
+**************************************/
+typedef struct {
+    const char* funcs;      /* comma separated, NULL = all */
+    const char* accels;
+    int iterations;
+    double minTimeNs;
+    BENCH_counters_t counters;
+} BENCH_params_t;
+
+/* Returns 1 if `name` is in the comma separated `list`, or `list` is NULL. */
+static int BENCH_listed(const char* list, const char* name)
+{
+    size_t const len = strlen(name);
+    const char* p = list;
+    if (list == NULL) return 1;
+    for (;;) {
+        const char* const end = strchr(p, ',');
+        size_t const n = end ? (size_t)(end - p) : strlen(p);
+        if ((n == len) && !memcmp(p, name, n)) return 1;
+        if (end == NULL) return 0;
+        p = end + 1;
+    }
+}
+
+static void BENCH_printCounter(const BENCH_counters_t* c, BENCH_counter_e id, const char* key, U64 value, double per, int last)
+{
+    if (c->fd[id] >= 0) printf("\"%s\":%.2f%s", key, (double)value / per, last ? "" : ",");
+    else printf("\"%s\":null%s", key, last ? "" : ",");
+}
+
+/* BENCH_measure() :
+ * runs passes of `f` for at least minTimeNs, `iterations` times, and prints the fastest iteration */
+static void BENCH_measure(BENCH_ctx_t* b, const BENCH_func_t* f, const BENCH_params_t* p)
+{
+    const BENCH_corpus_t* const c = b->corpus;
+    double bestNs = 0;
+    size_t bestBytes = 0, passBytes = 0, outSize = 0;
+    U64 best[cnt_max] = { 0, 0, 0 };
+    int it;
+
+    if (BENCH_check(b, f)) {
+        fprintf(stderr, "%s : %s produced wrong output\n", c->name, f->name);
+        exit(1);
+    }
+    for (it = 0; it < p->iterations; it++) {
+        U64 before[cnt_max], after[cnt_max];
+        size_t bytes = 0;
+        double start, elapsed;
+        int i;
+        BENCH_readCounters(&p->counters, before);
+        start = BENCH_nowNs();
+        do {
+            passBytes = f->pass(b, &outSize);
+            bytes += passBytes;
+            elapsed = BENCH_nowNs() - start;
+        } while (elapsed < p->minTimeNs);
+        BENCH_readCounters(&p->counters, after);
+        if ((bestNs == 0) || ((double)bytes / elapsed > (double)bestBytes / bestNs)) {
+            bestNs = elapsed;
+            bestBytes = bytes;
+            for (i = 0; i < cnt_max; i++) best[i] = after[i] - before[i];
+    }   }
+
+    printf("{\"corpus\":\"%s\",\"func\":\"%s\",", c->name, f->name);
+    if (f->usesAccel) printf("\"accel\":%d,", b->accel); else printf("\"accel\":null,");
+    printf("\"block\":%zu,\"chunks\":%zu,\"bytes\":%zu,\"out_bytes\":%zu,",
+           c->blockSize, c->nbChunks, passBytes, outSize);
+    /* a partial decode reads every compressed byte, but produces only part of the data */
+    if ((f->pass == BENCH_decompress_safe_partial) || !outSize) printf("\"ratio\":null,");
+    else printf("\"ratio\":%.3f,", (double)passBytes / (double)outSize);
+    printf("\"mb_s\":%.2f,", (double)bestBytes * 1e3 / bestNs);
+    BENCH_printCounter(&p->counters, cnt_cycles, "cycles_byte", best[cnt_cycles], (double)bestBytes, 0);
+    BENCH_printCounter(&p->counters, cnt_instructions, "instr_byte", best[cnt_instructions], (double)bestBytes, 0);
+    BENCH_printCounter(&p->counters, cnt_branchMisses, "branch_misses_kb", best[cnt_branchMisses], (double)bestBytes / 1024, 1);
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* BENCH_corpus() :
+ * prepares compressed forms of the corpus, then measures every listed function */
+static int BENCH_corpus(const BENCH_corpus_t* c, const BENCH_params_t* p)
+{
+    BENCH_ctx_t b;
+    size_t n, cap = 0, pos = 0;
+    size_t fi;
+    int result = 0;
+
+    memset(&b, 0, sizeof(b));
+    b.corpus = c;
+    b.slots = (size_t*)malloc((c->nbChunks + 1) * sizeof(size_t));
+    b.cSizes = (int*)malloc((c->nbChunks + 1) * sizeof(int));
+    b.lSizes = (int*)malloc((c->nbChunks + 1) * sizeof(int));
+    if (!b.slots || !b.cSizes || !b.lSizes) { result = -1; goto _end; }
+    for (n = 0; n < c->nbChunks; n++) {
+        b.slots[n] = cap;
+        cap += (size_t)LZ4_compressBound((int)c->chunkSizes[n]);
+    }
+    b.cBuf = (char*)malloc(cap + 1);
+    b.lBuf = (char*)malloc(cap + 1);
+    b.outBuf = (char*)malloc(cap + 1);
+    b.dBuf = (BYTE*)malloc(c->srcSize + 1);
+    b.stream = LZ4_createStream();
+    if (!b.cBuf || !b.lBuf || !b.outBuf || !b.dBuf || !b.stream) { result = -1; goto _end; }
+
+    b.accel = 1;
+    for (n = 0; n < c->nbChunks; pos += c->chunkSizes[n], n++) {
+        int const srcSize = (int)c->chunkSizes[n];
+        b.cSizes[n] = LZ4_compress_default((const char*)c->src + pos, b.cBuf + b.slots[n], srcSize, LZ4_compressBound(srcSize));
+        b.lSizes[n] = LZ4_compress_fast_continue(b.stream, (const char*)c->src + pos, b.lBuf + b.slots[n], srcSize, LZ4_compressBound(srcSize), 1);
+    }
+
+    for (fi = 0; fi < BENCH_NBFUNCS; fi++) {
+        const BENCH_func_t* const f = &BENCH_funcs[fi];
+        if (!BENCH_listed(p->funcs, f->name)) continue;
+        if (f->usesAccel) {
+            const char* a = p->accels;
+            while (*a) {
+                char* end;
+                b.accel = (int)strtol(a, &end, 10);
+                if ((end == a) || (b.accel < 1)) { result = -2; goto _end; }
+                BENCH_measure(&b, f, p);
+                a = (*end == ',') ? end + 1 : end;
+            }
+            b.accel = 1;
+        } else {
+            BENCH_measure(&b, f, p);
+    }   }
+
+_end:
+    free(b.slots); free(b.cSizes); free(b.lSizes);
+    free(b.cBuf); free(b.lBuf); free(b.outBuf); free(b.dBuf);
+    LZ4_freeStream(b.stream);
+    return result;
+}
+
+
+/*-************************************
+*  Command line
+**************************************/
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-c corpora] [-f funcs] [-a accels] [-b blockSize] [-s genSize] "
+                    "[-i iterations] [-t ms] [-l] [files...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const char* corpora = NULL;
+    size_t blockSize = BENCH_BLOCKSIZE_DEFAULT;
+    size_t genSize = BENCH_GENSIZE_DEFAULT;
+    BENCH_params_t p;
+    int opt;
+
+    memset(&p, 0, sizeof(p));
+    p.accels = "1,2,4,8,16";
+    p.iterations = BENCH_ITERATIONS_DEFAULT;
+    p.minTimeNs = BENCH_MINTIME_MS_DEFAULT * 1e6;
+    while ((opt = getopt(argc, argv, "c:f:a:b:s:i:t:l")) != -1) {
+        switch (opt) {
+        case 'c': corpora = optarg; break;
+        case 'f': p.funcs = optarg; break;
+        case 'a': p.accels = optarg; break;
+        case 'b': blockSize = (size_t)strtoull(optarg, NULL, 10); break;
+        case 's': genSize = (size_t)strtoull(optarg, NULL, 10); break;
+        case 'i': p.iterations = atoi(optarg); break;
+        case 't': p.minTimeNs = atof(optarg) * 1e6; break;
+        case 'l':
+            {   size_t fi;
+                for (fi = 0; fi < BENCH_NBFUNCS; fi++) printf("%s\n", BENCH_funcs[fi].name);
+                return 0;
+            }
+        default:
+            usage(argv[0]);
+        }
+    }
+    if ((blockSize == 0) || (blockSize > LZ4_MAX_INPUT_SIZE) || (genSize < 4 KB) || (p.iterations < 1)) usage(argv[0]);
+    BENCH_openCounters(&p.counters);
+
+    {   static const char* const generated[] = { "json", "logs", "random" };
+        int g;
+        for (g = 0; g < 3; g++) {
+            BENCH_corpus_t c;
+            int r;
+            if (!BENCH_listed(corpora, generated[g])) continue;
+            memset(&c, 0, sizeof(c));
+            c.name = generated[g];
+            r = (g == 0) ? BENCH_genJson(&c, genSize)
+              : (g == 1) ? BENCH_genLogs(&c, genSize, blockSize)
+              :            BENCH_genRandom(&c, genSize, blockSize);
+            if ((r != 0) || (BENCH_corpus(&c, &p) != 0)) {
+                fprintf(stderr, "%s : allocation failed, or invalid -a\n", generated[g]);
+                return 1;
+            }
+            BENCH_freeCorpus(&c);
+    }   }
+
+    if (BENCH_listed(corpora, "files")) {
+        int i;
+        for (i = optind; i < argc; i++) {
+            BENCH_corpus_t c;
+            memset(&c, 0, sizeof(c));
+            if ((BENCH_loadFile(&c, argv[i], blockSize) != 0) || (c.srcSize == 0)) {
+                fprintf(stderr, "%s : cannot read, or empty\n", argv[i]);
+                BENCH_freeCorpus(&c);
+                continue;
+            }
+            if (BENCH_corpus(&c, &p) != 0) {
+                fprintf(stderr, "%s : allocation failed, or invalid -a\n", argv[i]);
+                return 1;
+            }
+            BENCH_freeCorpus(&c);
+    }   }
+    return 0;
+}
@@ -0,0 +1,391 @@
+/*
+   LZ4dict - dictionary training and prepared dictionaries for LZ4
+   Trains dictionaries for, and shares prepared dictionaries between, lz4.c streams.
+   lz4.c keeps its own copyright and BSD 2-Clause license.
+*/
+
+
+/*-************************************
+*  Tuning parameters
+**************************************/
+/*
+ * LZ4DICT_HASHLOG_MAX :
+ * d-mers are counted in a table of up to (1 << LZ4DICT_HASHLOG_MAX) entries, 14 bytes each.
+ * Colliding d-mers share their count, which only matters when samples total far more
+ * than the table size.
+ */
+#ifndef LZ4DICT_HASHLOG_MAX
+#  define LZ4DICT_HASHLOG_MAX 20
+#endif
+
+
+/*-************************************
+*  Dependencies
+**************************************/
+#include "lz4.h"
+#include "lz4dict.h"
+#include <stdlib.h>   /* malloc, calloc, free */
+#include <string.h>   /* memcpy, memmove, memset */
+
+/* lz4.c : references the hash table of `dictStream` (not declared in lz4.h) */
+int LZ4_compress_fast_usingDictStream (LZ4_stream_t* LZ4_stream, const LZ4_stream_t* dictStream,
+                                       const char* source, char* dest, int inputSize, int maxOutputSize, int acceleration);
+
+
+/*-************************************
+*  Basic Types
+**************************************/
+#if defined(__cplusplus) || (defined (__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L) /* C99 */)
+# include <stdint.h>
+  typedef  uint8_t BYTE;
+  typedef uint16_t U16;
+  typedef uint32_t U32;
+  typedef uint64_t U64;
+#else
+  typedef unsigned char       BYTE;
+  typedef unsigned short      U16;
+  typedef unsigned int        U32;
+  typedef unsigned long long  U64;
+#endif
+
+#define KB *(1 <<10)
+#define MIN(a,b) ((a)<(b) ? (a) : (b))
+#define MAX(a,b) ((a)>(b) ? (a) : (b))
+
+
+/*-************************************
+*  Prepared dictionary
+**************************************/
+struct LZ4DICT_CDict_s {
+    LZ4_stream_t stream;    /* filled once by LZ4_loadDict(), read-only afterwards */
+    char* dictContent;      /* owned copy, referenced by stream */
+    int dictSize;
+};
+
+LZ4DICT_CDict* LZ4DICT_createCDict(const void* dictBuffer, size_t dictSize)
+{
+    const char* dictStart = (const char*)dictBuffer;
+    LZ4DICT_CDict* cdict;
+
+    if (dictSize > LZ4DICT_DICTSIZE_MAX) {
+        dictStart += dictSize - LZ4DICT_DICTSIZE_MAX;
+        dictSize = LZ4DICT_DICTSIZE_MAX;
+    }
+    cdict = (LZ4DICT_CDict*)malloc(sizeof(LZ4DICT_CDict) + dictSize);
+    if (cdict == NULL) return NULL;
+    cdict->dictContent = (char*)(cdict + 1);
+    if (dictSize) memcpy(cdict->dictContent, dictStart, dictSize);
+    cdict->dictSize = (int)dictSize;
+    LZ4_resetStream(&cdict->stream);
+    LZ4_loadDict(&cdict->stream, cdict->dictContent, cdict->dictSize);
+    return cdict;
+}
+
+void LZ4DICT_freeCDict(LZ4DICT_CDict* cdict)
+{
+    free(cdict);   /* support free on NULL */
+}
+
+int LZ4DICT_compress_usingCDict(LZ4_stream_t* stream, const LZ4DICT_CDict* cdict,
+                                const char* src, char* dst, int srcSize, int dstCapacity, int acceleration)
+{
+    return LZ4_compress_fast_usingDictStream(stream, &cdict->stream, src, dst, srcSize, dstCapacity, acceleration);
+}
+
+void LZ4DICT_attachCDict(LZ4_stream_t* stream, const LZ4DICT_CDict* cdict)
+{
+    memcpy(stream, &cdict->stream, sizeof(*stream));
+}
+
+const char* LZ4DICT_getDictContent(const LZ4DICT_CDict* cdict, int* dictSizePtr)
+{
+    *dictSizePtr = cdict->dictSize;
+    return cdict->dictContent;
+}
+
+int LZ4DICT_decompress_usingCDict(const LZ4DICT_CDict* cdict,
+                                  const char* src, char* dst, int srcSize, int dstCapacity)
+{
+    return LZ4_decompress_safe_usingDict(src, dst, srcSize, dstCapacity, cdict->dictContent, cdict->dictSize);
+}
+
+
+/*-************************************
+*  Training
+**************************************/
+/*
+ * The trainer follows the cover algorithm of Liao, Petri, Moffat and Wirth
+ * ("Effective construction of relative Lempel-Ziv dictionaries", 2016) :
+ * each d-mer (substring of d bytes) is worth the number of samples containing it,
+ * and a segment of k bytes is worth the sum of its distinct d-mers.
+ * Samples are split into epochs; each epoch in turn gives its best segment,
+ * whose d-mers are then worth 0, so that the dictionary does not repeat itself.
+ * The first (best) segments are written at the end of the dictionary.
+ */
+#define LZ4DICT_SPLIT_DIVISOR     5    /* 1 sample in 5 tests the trial dictionaries */
+
+typedef struct {
+    const BYTE* samples;
+    const size_t* samplesSizes;
+    unsigned nbSamples;     /* samples counted into freqs */
+    size_t nbDmers;         /* positions starting a d-mer (d-mers are read 8 bytes at a time) */
+    unsigned d;
+    unsigned hashLog;
+    U32* freqs;             /* samples holding each (hashed) d-mer; 0 once covered */
+    U32* freqsInit;         /* freqs before any selection */
+    U32* lastSample;        /* last sample counted for each d-mer, + 1 */
+    U16* segmentFreqs;      /* occurrences of each d-mer within the current window */
+} LZ4DICT_ctx_t;
+
+typedef struct {
+    size_t begin;           /* first d-mer */
+    size_t end;             /* last d-mer + 1 */
+    U64 score;
+} LZ4DICT_segment_t;
+
+static U64 LZ4DICT_read64(const void* p) { U64 v; memcpy(&v, p, sizeof(v)); return v; }
+
+static unsigned LZ4DICT_isLittleEndian(void)
+{
+    const union { U32 u; BYTE c[4]; } one = { 1 };   /* don't use static : performance detrimental */
+    return one.c[0];
+}
+
+static size_t LZ4DICT_hashDmer(const LZ4DICT_ctx_t* ctx, size_t pos)
+{
+    static const U64 prime8bytes = 11400714785074694791ULL;
+    U64 const v = LZ4DICT_read64(ctx->samples + pos);
+    U64 const dmer = LZ4DICT_isLittleEndian() ? v << (64 - 8*ctx->d) : v >> (64 - 8*ctx->d);
+    return (size_t)((dmer * prime8bytes) >> (64 - ctx->hashLog));
+}
+
+static unsigned LZ4DICT_highbit(size_t v)
+{
+    unsigned r = 0;
+    while (v >>= 1) r++;
+    return r;
+}
+
+/* LZ4DICT_initCtx() :
+ * sizes tables for the full sample set; later counts may use fewer samples.
+ * @return : 0 on success, or -1 if samples are too small, or on allocation failure */
+static int LZ4DICT_initCtx(LZ4DICT_ctx_t* ctx, const void* samplesBuffer, const size_t* samplesSizes, unsigned nbSamples)
+{
+    size_t totalSize = 0;
+    unsigned n;
+    memset(ctx, 0, sizeof(*ctx));
+    for (n = 0; n < nbSamples; n++) totalSize += samplesSizes[n];
+    if (totalSize < 8) return -1;
+    ctx->samples = (const BYTE*)samplesBuffer;
+    ctx->samplesSizes = samplesSizes;
+    ctx->hashLog = MAX(12, MIN(LZ4DICT_HASHLOG_MAX, LZ4DICT_highbit(totalSize) + 1));
+    ctx->freqs = (U32*)malloc(sizeof(U32) << ctx->hashLog);
+    ctx->freqsInit = (U32*)malloc(sizeof(U32) << ctx->hashLog);
+    ctx->lastSample = (U32*)malloc(sizeof(U32) << ctx->hashLog);
+    ctx->segmentFreqs = (U16*)calloc((size_t)1 << ctx->hashLog, sizeof(U16));
+    if (!ctx->freqs || !ctx->freqsInit || !ctx->lastSample || !ctx->segmentFreqs) return -1;
+    return 0;
+}
+
+static void LZ4DICT_freeCtx(LZ4DICT_ctx_t* ctx)
+{
+    free(ctx->freqs);
+    free(ctx->freqsInit);
+    free(ctx->lastSample);
+    free(ctx->segmentFreqs);
+}
+
+/* LZ4DICT_countDmers() :
+ * counts d-mers of the first `nbSamples` samples into freqsInit, each once per sample */
+static void LZ4DICT_countDmers(LZ4DICT_ctx_t* ctx, unsigned nbSamples, unsigned d)
+{
+    size_t const tableSize = (size_t)1 << ctx->hashLog;
+    size_t start = 0;
+    unsigned n;
+
+    ctx->d = d;
+    ctx->nbSamples = nbSamples;
+    for (n = 0; n < nbSamples; n++) start += ctx->samplesSizes[n];
+    ctx->nbDmers = (start >= 8) ? start - 7 : 0;
+
+    memset(ctx->freqsInit, 0, tableSize * sizeof(U32));
+    memset(ctx->lastSample, 0, tableSize * sizeof(U32));
+    for (n = 0, start = 0; n < nbSamples; n++) {
+        size_t const end = start + ctx->samplesSizes[n];
+        size_t pos;
+        for (pos = start; (pos + d <= end) && (pos < ctx->nbDmers); pos++) {
+            size_t const h = LZ4DICT_hashDmer(ctx, pos);
+            if (ctx->lastSample[h] != n+1) {
+                ctx->lastSample[h] = n+1;
+                ctx->freqsInit[h]++;
+        }   }
+        start = end;
+    }
+}
+
+/* LZ4DICT_selectSegment() :
+ * best window of (k - d + 1) d-mers within [begin, end), trimmed of worthless d-mers at both ends.
+ * Its d-mers are then zeroed in freqs. */
+static LZ4DICT_segment_t LZ4DICT_selectSegment(LZ4DICT_ctx_t* ctx, size_t begin, size_t end, unsigned k)
+{
+    size_t const windowSize = k - ctx->d + 1;
+    LZ4DICT_segment_t best;
+    size_t activeBegin = begin;
+    size_t activeEnd;
+    U64 score = 0;
+
+    best.begin = best.end = begin;
+    best.score = 0;
+    for (activeEnd = begin; activeEnd < end; activeEnd++) {
+        size_t const h = LZ4DICT_hashDmer(ctx, activeEnd);
+        if (ctx->segmentFreqs[h]++ == 0) score += ctx->freqs[h];
+        if (activeEnd + 1 - activeBegin > windowSize) {
+            size_t const h0 = LZ4DICT_hashDmer(ctx, activeBegin);
+            if (--ctx->segmentFreqs[h0] == 0) score -= ctx->freqs[h0];
+            activeBegin++;
+        }
+        if (score > best.score) {
+            best.begin = activeBegin;
+            best.end = activeEnd + 1;
+            best.score = score;
+    }   }
+    while (activeBegin < end) {   /* leave segmentFreqs clean for the next call */
+        ctx->segmentFreqs[LZ4DICT_hashDmer(ctx, activeBegin)]--;
+        activeBegin++;
+    }
+
+    while ((best.begin < best.end) && (ctx->freqs[LZ4DICT_hashDmer(ctx, best.begin)] == 0)) best.begin++;
+    while ((best.begin < best.end) && (ctx->freqs[LZ4DICT_hashDmer(ctx, best.end-1)] == 0)) best.end--;
+    {   size_t pos;
+        for (pos = best.begin; pos < best.end; pos++) ctx->freqs[LZ4DICT_hashDmer(ctx, pos)] = 0;
+    }
+    return best;
+}
+
+/* LZ4DICT_buildDictionary() :
+ * selects segments of `k` bytes from the counted samples (see LZ4DICT_countDmers()).
+ * @return : dictionary size, written at the start of `dict` */
+static size_t LZ4DICT_buildDictionary(LZ4DICT_ctx_t* ctx, BYTE* dict, size_t dictCapacity, unsigned k)
+{
+    size_t tail = dictCapacity;
+    size_t nbEpochs = MAX(1, dictCapacity / k / 4);
+    size_t epochSize = ctx->nbDmers / nbEpochs;
+    unsigned zeroScoreRun = 0;
+    unsigned maxZeroScoreRun;
+    size_t epoch;
+
+    if (ctx->nbDmers == 0) return 0;
+    if (epochSize < (size_t)k * 10) {   /* an epoch should offer a choice of segments */
+        epochSize = MIN((size_t)k * 10, ctx->nbDmers);
+        nbEpochs = ctx->nbDmers / epochSize;
+    }
+    maxZeroScoreRun = (unsigned)MAX(10, MIN(100, nbEpochs >> 3));
+    memcpy(ctx->freqs, ctx->freqsInit, sizeof(U32) << ctx->hashLog);
+
+    for (epoch = 0; tail > 0; epoch = (epoch + 1) % nbEpochs) {
+        size_t const epochBegin = epoch * epochSize;
+        size_t const epochEnd = (epoch == nbEpochs-1) ? ctx->nbDmers : epochBegin + epochSize;
+        LZ4DICT_segment_t const segment = LZ4DICT_selectSegment(ctx, epochBegin, epochEnd, k);
+        size_t segmentSize;
+        if (segment.score == 0) {   /* this epoch is exhausted; others may not be yet */
+            if (++zeroScoreRun >= maxZeroScoreRun) break;
+            continue;
+        }
+        zeroScoreRun = 0;
+        segmentSize = MIN(segment.end - segment.begin + ctx->d - 1, tail);
+        if (segmentSize < ctx->d) break;
+        tail -= segmentSize;
+        memcpy(dict + tail, ctx->samples + segment.begin, segmentSize);
+    }
+
+    memmove(dict, dict + tail, dictCapacity - tail);
+    return dictCapacity - tail;
+}
+
+/* LZ4DICT_evaluate() :
+ * @return : compressed size of samples [firstSample, nbSamples) using `dict`, or 0 on allocation failure */
+static U64 LZ4DICT_evaluate(const LZ4DICT_ctx_t* ctx, const BYTE* dict, size_t dictSize,
+                            unsigned firstSample, unsigned nbSamples)
+{
+    LZ4DICT_CDict* const cdict = LZ4DICT_createCDict(dict, dictSize);
+    LZ4_stream_t* const stream = LZ4_createStream();
+    size_t maxSampleSize = 0;
+    size_t start = 0;
+    char* dst = NULL;
+    U64 total = 0;
+    unsigned n;
+
+    for (n = 0; n < nbSamples; n++) {
+        if (n < firstSample) start += ctx->samplesSizes[n];
+        else maxSampleSize = MAX(maxSampleSize, ctx->samplesSizes[n]);
+    }
+    if (maxSampleSize > LZ4_MAX_INPUT_SIZE) maxSampleSize = LZ4_MAX_INPUT_SIZE;
+    if (cdict && stream) dst = (char*)malloc((size_t)LZ4_compressBound((int)maxSampleSize));
+    if (dst) {
+        for (n = firstSample; n < nbSamples; n++) {
+            int const srcSize = (int)MIN(ctx->samplesSizes[n], maxSampleSize);
+            int const cSize = LZ4DICT_compress_usingCDict(stream, cdict, (const char*)ctx->samples + start,
+                                                          dst, srcSize, LZ4_compressBound(srcSize), 1);
+            total += (U64)cSize + (ctx->samplesSizes[n] - (size_t)srcSize);
+            start += ctx->samplesSizes[n];
+    }   }
+
+    free(dst);
+    LZ4_freeStream(stream);
+    LZ4DICT_freeCDict(cdict);
+    return total;
+}
+
+size_t LZ4DICT_trainFromBuffer(void* dictBuffer, size_t dictCapacity,
+                               const void* samplesBuffer, const size_t* samplesSizes, unsigned nbSamples,
+                               const LZ4DICT_params_t* params)
+{
+    static const unsigned kCandidates[] = { 32, 64, 128, 256, 512, 1024, 2048 };
+    static const unsigned dCandidates[] = { 6, 8 };
+    unsigned k = params ? params->segmentSize : 0;
+    unsigned d = params ? params->dmerSize : 0;
+    LZ4DICT_ctx_t ctx;
+    size_t dictSize = 0;
+
+    if (!dictBuffer || !samplesBuffer || !samplesSizes || (nbSamples < 2)) return 0;
+    if (dictCapacity > LZ4DICT_DICTSIZE_MAX) dictCapacity = LZ4DICT_DICTSIZE_MAX;
+    if (d && ((d < LZ4DICT_DMERSIZE_MIN) || (d > LZ4DICT_DMERSIZE_MAX))) return 0;
+    if (k && (k < LZ4DICT_SEGMENTSIZE_MIN)) return 0;
+    if (dictCapacity < LZ4DICT_SEGMENTSIZE_MIN) return 0;
+    if (LZ4DICT_initCtx(&ctx, samplesBuffer, samplesSizes, nbSamples)) { LZ4DICT_freeCtx(&ctx); return 0; }
+
+    if (!k || !d) {   /* search : train on the first samples, test on the others */
+        unsigned const nbTest = (nbSamples >= LZ4DICT_SPLIT_DIVISOR) ? nbSamples / LZ4DICT_SPLIT_DIVISOR : 0;
+        unsigned const nbTrain = nbSamples - nbTest;
+        unsigned const firstTest = nbTest ? nbTrain : 0;
+        BYTE* const trialDict = (BYTE*)malloc(dictCapacity);
+        U64 bestCost = 0;
+        unsigned bestK = 0, bestD = 0;
+        size_t di, ki;
+        if (trialDict == NULL) { LZ4DICT_freeCtx(&ctx); return 0; }
+        for (di = 0; di < sizeof(dCandidates)/sizeof(dCandidates[0]); di++) {
+            unsigned const trialD = d ? d : dCandidates[di];
+            LZ4DICT_countDmers(&ctx, nbTrain, trialD);
+            for (ki = 0; ki < sizeof(kCandidates)/sizeof(kCandidates[0]); ki++) {
+                unsigned const trialK = (unsigned)MIN(k ? k : kCandidates[ki], dictCapacity);
+                size_t const trialSize = LZ4DICT_buildDictionary(&ctx, trialDict, dictCapacity, MAX(trialK, trialD));
+                U64 const cost = LZ4DICT_evaluate(&ctx, trialDict, trialSize, firstTest, nbSamples);
+                if ((cost > 0) && ((bestCost == 0) || (cost < bestCost))) {
+                    bestCost = cost; bestK = trialK; bestD = trialD;
+                }
+                if (k || (trialK == dictCapacity)) break;
+            }
+            if (d) break;
+        }
+        free(trialDict);
+        if (bestCost == 0) { LZ4DICT_freeCtx(&ctx); return 0; }
+        k = bestK; d = bestD;
+    }
+
+    if (k > dictCapacity) k = (unsigned)dictCapacity;
+    if (k < d) k = d;
+    LZ4DICT_countDmers(&ctx, nbSamples, d);
+    dictSize = LZ4DICT_buildDictionary(&ctx, (BYTE*)dictBuffer, dictCapacity, k);
+    LZ4DICT_freeCtx(&ctx);
+    return dictSize;
+}
@@ -0,0 +1,109 @@
+/*
+   LZ4dict - dictionary training and prepared dictionaries for LZ4
+   Header File
+   See lz4dict.c.
+*/
+#ifndef LZ4DICT_H_23487623984761
+#define LZ4DICT_H_23487623984761
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * lz4dict.h targets many small, similar messages, compressed independently.
+ * Such messages are too short to find matches within themselves;
+ * a dictionary of content they have in common provides those matches instead.
+ *
+ * LZ4DICT_trainFromBuffer() builds the dictionary from sample messages.
+ * LZ4DICT_createCDict() hashes it once into a prepared dictionary (CDict),
+ * which is then shared, read-only, by any number of LZ4_stream_t, in any number of threads.
+ *
+ * Each message is compressed by LZ4DICT_compress_usingCDict(), which references
+ * the CDict hash table instead of loading the dictionary again :
+ * per-message setup is then a few stores, instead of hashing up to 64 KB.
+ * Messages are decoded by LZ4_decompress_safe_usingDict() with the same dictionary content,
+ * or by LZ4DICT_decompress_usingCDict().
+ */
+
+#include <stddef.h>   /* size_t */
+#include "lz4.h"      /* LZ4_stream_t */
+
+
+/*-************************************
+*  Constants
+**************************************/
+#define LZ4DICT_DICTSIZE_MAX      (64 << 10)   /* LZ4 window : larger dictionaries are cut to their last 64 KB */
+#define LZ4DICT_SEGMENTSIZE_MIN   16
+#define LZ4DICT_DMERSIZE_MIN      4
+#define LZ4DICT_DMERSIZE_MAX      8
+
+
+/*-************************************
+*  Training
+**************************************/
+typedef struct {
+    unsigned segmentSize;   /* bytes copied per selected segment; 0 = search for the best one */
+    unsigned dmerSize;      /* bytes per scored substring, 4..8; 0 = search for the best one */
+} LZ4DICT_params_t;
+
+/*! LZ4DICT_trainFromBuffer() :
+ *  Builds a dictionary from `nbSamples` samples, stored one after another in `samplesBuffer`,
+ *  the size of each being given by `samplesSizes`.
+ *  Selects the segments whose substrings (of `dmerSize` bytes) appear in most samples,
+ *  each substring being counted once, and puts the best segments at the end of the dictionary,
+ *  closest to the compressed data.
+ *  Parameters left to 0 in `params` (or `params == NULL`) are found by trial :
+ *  dictionaries are built from the first 80% of samples, and compared by compressing the rest.
+ *  A few hundred samples, totalling 10 to 100 times `dictCapacity`, is a good start.
+ *  @return : dictionary size (<= MIN(dictCapacity, LZ4DICT_DICTSIZE_MAX)), written at the start of `dictBuffer`,
+ *            or 0 if the samples are too few or too small, or on allocation failure. */
+size_t LZ4DICT_trainFromBuffer(void* dictBuffer, size_t dictCapacity,
+                               const void* samplesBuffer, const size_t* samplesSizes, unsigned nbSamples,
+                               const LZ4DICT_params_t* params);
+
+
+/*-************************************
+*  Prepared dictionary
+**************************************/
+typedef struct LZ4DICT_CDict_s LZ4DICT_CDict;
+
+/*! LZ4DICT_createCDict() :
+ *  Copies the last 64 KB (at most) of `dictBuffer`, and hashes them.
+ *  `dictBuffer` can be released afterwards.
+ *  @return : prepared dictionary, or NULL on allocation failure. */
+LZ4DICT_CDict* LZ4DICT_createCDict(const void* dictBuffer, size_t dictSize);
+void           LZ4DICT_freeCDict(LZ4DICT_CDict* cdict);
+
+/*! LZ4DICT_compress_usingCDict() :
+ *  Compresses `src` as an independent message, using `cdict` by reference.
+ *  `stream` is scratch state, created once by LZ4_createStream(), and reused for any number of messages :
+ *  it is not reset between messages, and never needs to be.
+ *  Messages larger than 4 KB copy the hash table instead, which runs faster for them.
+ *  @return : compressed size, or 0 if `dstCapacity` is too small (see LZ4_compressBound()). */
+int LZ4DICT_compress_usingCDict(LZ4_stream_t* stream, const LZ4DICT_CDict* cdict,
+                                const char* src, char* dst, int srcSize, int dstCapacity, int acceleration);
+
+/*! LZ4DICT_attachCDict() :
+ *  Copies `cdict` state into `stream`, as LZ4_loadDict() would have left it.
+ *  `stream` can then compress blocks with LZ4_compress_fast_continue(),
+ *  the first of them having the dictionary as history. */
+void LZ4DICT_attachCDict(LZ4_stream_t* stream, const LZ4DICT_CDict* cdict);
+
+/*! LZ4DICT_getDictContent() :
+ *  @return : dictionary content actually referenced by `cdict` (`*dictSizePtr` bytes),
+ *            as required by LZ4_decompress_safe_usingDict(). */
+const char* LZ4DICT_getDictContent(const LZ4DICT_CDict* cdict, int* dictSizePtr);
+
+/*! LZ4DICT_decompress_usingCDict() :
+ *  Decompresses a message compressed with `cdict`.
+ *  @return : decompressed size, or a negative value if `src` is malformed or `dst` is too small. */
+int LZ4DICT_decompress_usingCDict(const LZ4DICT_CDict* cdict,
+                                  const char* src, char* dst, int srcSize, int dstCapacity);
+
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif /* LZ4DICT_H_23487623984761 */
@@ -0,0 +1,109 @@
+/*
+ * Tests of lz4dict.c : prepared dictionaries must compress as well as
+ * LZ4_loadDict(), whatever state the scratch stream is in.
+ *
+ * Build and run (lz4.h comes with the LZ4 distribution) :
+ *
+ *     cc -O2 -o lz4dict_test lz4dict_test.c lz4dict.c lz4.c
+ *     ./lz4dict_test
+ *
+ * Prints one line per test, and exits with 1 on the first failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz4.h"
+#include "lz4dict.h"
+
+#define NB_SAMPLES  2000
+#define NB_MESSAGES 200
+#define MSG_MAX     400
+
+static const char* const users[] = { "alice", "bob", "carol", "dave", "eve", "mallory" };
+static const char* const events[] = { "login", "logout", "purchase", "view", "click" };
+
+/* small, deterministic generator, so that sizes are the same on every run */
+static unsigned rng_state = 5;
+static unsigned rng(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return (rng_state >> 16) & 0x7FFF;
+}
+
+static int gen_message(char* buf)
+{
+    return sprintf(buf, "{\"user\":\"%s\",\"event\":\"%s\",\"ts\":%u,\"session\":\"%04x%04x\","
+                        "\"ua\":\"Mozilla/5.0 (X11; Linux x86_64)\",\"ok\":true,\"amount\":%u}",
+                   users[rng() % 6], events[rng() % 5], 1700000000 + rng(), rng(), rng(), rng() % 1000);
+}
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL "); printf(__VA_ARGS__); printf("\n"); exit(1); } } while (0)
+
+/* compresses `msg` with `cdict`, checks that it decodes, and returns its size */
+static int compress_check(LZ4_stream_t* stream, const LZ4DICT_CDict* cdict, const char* msg, int size)
+{
+    char dst[LZ4_COMPRESSBOUND(MSG_MAX)];
+    char out[MSG_MAX];
+    int const csize = LZ4DICT_compress_usingCDict(stream, cdict, msg, dst, size, (int)sizeof(dst), 1);
+    CHECK(csize > 0, "compress_usingCDict returned %d", csize);
+    CHECK(LZ4DICT_decompress_usingCDict(cdict, dst, out, csize, (int)sizeof(out)) == size, "round trip size");
+    CHECK(memcmp(msg, out, (size_t)size) == 0, "round trip content");
+    return csize;
+}
+
+static int compress_loadDict(const char* dict, int dictSize, const char* msg, int size)
+{
+    char dst[LZ4_COMPRESSBOUND(MSG_MAX)];
+    LZ4_stream_t stream;
+    LZ4_resetStream(&stream);
+    LZ4_loadDict(&stream, dict, dictSize);
+    return LZ4_compress_fast_continue(&stream, msg, dst, size, (int)sizeof(dst), 1);
+}
+
+int main(void)
+{
+    size_t sizes[NB_SAMPLES];
+    char* const samples = (char*)malloc(NB_SAMPLES * MSG_MAX);
+    char dict[LZ4DICT_DICTSIZE_MAX];
+    size_t pos = 0;
+    int i;
+    CHECK(samples != NULL, "allocation");
+    for (i = 0; i < NB_SAMPLES; i++) {
+        sizes[i] = (size_t)gen_message(samples + pos);
+        pos += sizes[i];
+    }
+    {   size_t const dictSize = LZ4DICT_trainFromBuffer(dict, sizeof(dict), samples, sizes, NB_SAMPLES, NULL);
+        LZ4DICT_CDict* const cdict = LZ4DICT_createCDict(dict, dictSize);
+        LZ4_stream_t* const reused = LZ4_createStream();
+        long total[4] = { 0, 0, 0, 0 };   /* loadDict, fresh stream, reset stream, reused stream */
+        char msg[MSG_MAX];
+        CHECK(dictSize > 0, "trainFromBuffer returned 0");
+        CHECK(cdict != NULL && reused != NULL, "allocation");
+        for (i = 0; i < NB_MESSAGES; i++) {
+            int const size = gen_message(msg);
+            int const ref = compress_loadDict(dict, (int)dictSize, msg, size);
+            LZ4_stream_t* const fresh = LZ4_createStream();
+            int const sfresh = compress_check(fresh, cdict, msg, size);
+            int sreset;
+            LZ4_resetStream(fresh);
+            sreset = compress_check(fresh, cdict, msg, size);
+            LZ4_freeStream(fresh);
+            /* the dictionary must be consulted : a message alone is mostly literals */
+            CHECK(sfresh <= ref + ref / 8, "message %d : fresh stream %d bytes, loadDict %d", i, sfresh, ref);
+            CHECK(sreset <= ref + ref / 8, "message %d : reset stream %d bytes, loadDict %d", i, sreset, ref);
+            total[0] += ref;
+            total[1] += sfresh;
+            total[2] += sreset;
+            total[3] += compress_check(reused, cdict, msg, size);
+        }
+        printf("ok   dict %u bytes : loadDict %ld, fresh %ld, reset %ld, reused %ld bytes\n",
+               (unsigned)dictSize, total[0], total[1], total[2], total[3]);
+        CHECK(total[3] <= total[0] + total[0] / 8, "reused stream %ld bytes, loadDict %ld", total[3], total[0]);
+        LZ4_freeStream(reused);
+        LZ4DICT_freeCDict(cdict);
+    }
+    free(samples);
+    printf("ok   all tests passed\n");
+    return 0;
+}
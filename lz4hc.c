@@ -0,0 +1,574 @@
+/*
+   LZ4 HC - High Compression Mode of LZ4
+   Copyright (C) 2011-2017, Yann Collet.
+
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+    - LZ4 homepage : http://www.lz4.org
+    - LZ4 source repository : https://github.com/lz4/lz4
+*/
+
+/* note : lz4hc is not an independent module, it requires lz4.h/lz4.c for proper compilation */
+
+
+/* *************************************
+*  Tuning Parameter
+***************************************/
+
+/*! HEAPMODE :
+ *  Select how default compression function will allocate workplace memory,
+ *  in stack (0:fastest), or in heap (1:requires malloc()).
+ *  Since workplace is rather large, heap mode is recommended.
+ */
+#ifndef LZ4HC_HEAPMODE
+#  define LZ4HC_HEAPMODE 1
+#endif
+
+
+/*===    Dependency    ===*/
+#include "lz4hc.h"
+
+
+/*===   Common LZ4 definitions   ===*/
+#if defined(__GNUC__)
+#  pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#if defined (__clang__)
+#  pragma clang diagnostic ignored "-Wunused-function"
+#endif
+
+#define LZ4_COMMONDEFS_ONLY
+#include "lz4.c"   /* LZ4_count, constants, mem */
+
+
+/*===   Enums   ===*/
+typedef enum { noLimit = 0, limitedOutput = 1 } limitedOutput_directive;
+
+
+/*===   Constants   ===*/
+#define LZ4_OPT_NUM   (1<<12)
+
+
+/*===   Macros   ===*/
+#define HASH_FUNCTION(i)         (((i) * 2654435761U) >> ((MINMATCH*8)-LZ4HC_HASH_LOG))
+#define DELTANEXTU16(table, pos) table[(U16)(pos)]   /* faster */
+
+static U32 LZ4HC_hashPtr(const void* ptr) { return HASH_FUNCTION(LZ4_read32(ptr)); }
+
+
+/*-************************************
+*  Compression levels
+**************************************/
+typedef enum { lz4hc, lz4opt } lz4hc_strat_e;
+
+typedef struct {
+    lz4hc_strat_e strat;
+    U32 nbSearches;       /* candidates visited along a hash chain */
+    U32 targetLength;     /* optimal parser : matches longer than this are taken right away */
+} cParams_t;
+
+static const cParams_t clTable[LZ4HC_CLEVEL_MAX+1] = {
+    { lz4hc,     2, 16 },  /* 0, unused */
+    { lz4hc,     2, 16 },  /* 1, unused */
+    { lz4hc,     2, 16 },  /* 2, unused */
+    { lz4hc,     4, 16 },  /* 3 */
+    { lz4hc,     8, 16 },  /* 4 */
+    { lz4hc,    16, 16 },  /* 5 */
+    { lz4hc,    32, 16 },  /* 6 */
+    { lz4hc,    64, 16 },  /* 7 */
+    { lz4hc,   128, 16 },  /* 8 */
+    { lz4hc,   256, 16 },  /* 9 */
+    { lz4opt,   96, 64 },  /*10==LZ4HC_CLEVEL_OPT_MIN*/
+    { lz4opt,  512,128 },  /*11 */
+    { lz4opt, 8192, LZ4_OPT_NUM },  /* 12==LZ4HC_CLEVEL_MAX */
+};
+
+static const cParams_t* LZ4HC_getParams(int cLevel)
+{
+    if (cLevel < 1) cLevel = LZ4HC_CLEVEL_DEFAULT;
+    if (cLevel > LZ4HC_CLEVEL_MAX) cLevel = LZ4HC_CLEVEL_MAX;
+    return &clTable[cLevel];
+}
+
+
+/**************************************
+*  HC Compression
+**************************************/
+static void LZ4HC_init (LZ4HC_CCtx_internal* hc4, const BYTE* start)
+{
+    MEM_INIT((void*)hc4->hashTable, 0, sizeof(hc4->hashTable));
+    /* chainTable entries are always written before being read : no init needed */
+    hc4->base = start;
+    hc4->nextToUpdate = 0;
+}
+
+
+/* Update chains up to ip (excluded) */
+LZ4_FORCE_INLINE void LZ4HC_Insert (LZ4HC_CCtx_internal* hc4, const BYTE* ip)
+{
+    U16* const chainTable = hc4->chainTable;
+    U32* const hashTable  = hc4->hashTable;
+    const BYTE* const base = hc4->base;
+    U32 const target = (U32)(ip - base);
+    U32 idx = hc4->nextToUpdate;
+
+    while (idx < target) {
+        U32 const h = LZ4HC_hashPtr(base+idx);
+        size_t delta = idx - hashTable[h];
+        if (delta>MAX_DISTANCE) delta = MAX_DISTANCE;
+        DELTANEXTU16(chainTable, idx) = (U16)delta;
+        hashTable[h] = idx;
+        idx++;
+    }
+
+    hc4->nextToUpdate = target;
+}
+
+
+/* LZ4HC_FindLongestMatch() :
+ * visits up to `nbAttempts` earlier positions sharing the hash of `ip`.
+ * Only matches longer than `longest` are reported.
+ * @return : length of the longest match, or `longest` if none found */
+LZ4_FORCE_INLINE int LZ4HC_FindLongestMatch (LZ4HC_CCtx_internal* const hc4,
+                                               const BYTE* const ip, const BYTE* const iLimit,
+                                               const BYTE** matchpos,
+                                               int longest, U32 nbAttempts)
+{
+    U16* const chainTable = hc4->chainTable;
+    U32* const HashTable = hc4->hashTable;
+    const BYTE* const base = hc4->base;
+    U32 const ipIndex = (U32)(ip - base);
+    U32 const lowLimit = (ipIndex > MAX_DISTANCE) ? ipIndex - MAX_DISTANCE : 0;
+    U32 matchIndex;
+
+    /* HC4 match finder */
+    LZ4HC_Insert(hc4, ip);
+    matchIndex = HashTable[LZ4HC_hashPtr(ip)];
+
+    /* an empty slot reads as index 0, which is a real position unless ip sits on it */
+    while ((matchIndex < ipIndex) && (matchIndex >= lowLimit) && (nbAttempts)) {
+        const BYTE* const match = base + matchIndex;
+        nbAttempts--;
+        if ((match[longest] == ip[longest]) && (LZ4_read32(match) == LZ4_read32(ip))) {
+            int const mlt = MINMATCH + LZ4_count(ip+MINMATCH, match+MINMATCH, iLimit);
+            if (mlt > longest) {
+                longest = mlt;
+                *matchpos = match;
+                if (ip+mlt == iLimit) break;   /* can't do better */
+        }   }
+
+        {   U32 const delta = DELTANEXTU16(chainTable, matchIndex);
+            if ((delta == 0) || (matchIndex < lowLimit + delta)) break;
+            matchIndex -= delta;
+    }   }
+
+    return longest;
+}
+
+
+/* LZ4HC_encodeSequence() :
+ * @return : 0 if ok,
+ *           1 if buffer issue detected */
+LZ4_FORCE_INLINE int LZ4HC_encodeSequence (
+    const BYTE** ip,
+    BYTE** op,
+    const BYTE** anchor,
+    int matchLength,
+    const BYTE* const match,
+    limitedOutput_directive limit,
+    BYTE* oend)
+{
+    size_t length;
+    BYTE* const token = (*op)++;
+
+    /* Encode Literal length */
+    length = (size_t)(*ip - *anchor);
+    if ((limit) && ((*op + (length >> 8) + length + (2 + 1 + LASTLITERALS)) > oend)) return 1;   /* Check output limit */
+    if (length >= RUN_MASK) {
+        size_t len = length - RUN_MASK;
+        *token = (RUN_MASK << ML_BITS);
+        for(; len >= 255 ; len -= 255) *(*op)++ = 255;
+        *(*op)++ = (BYTE)len;
+    } else {
+        *token = (BYTE)(length << ML_BITS);
+    }
+
+    /* Copy Literals */
+    LZ4_wildCopy(*op, *anchor, (*op) + length);
+    *op += length;
+
+    /* Encode Offset */
+    LZ4_writeLE16(*op, (U16)(*ip-match)); *op += 2;
+
+    /* Encode MatchLength */
+    length = (size_t)(matchLength - MINMATCH);
+    if ((limit) && (*op + (length >> 8) + (1 + LASTLITERALS) > oend)) return 1;   /* Check output limit */
+    if (length >= ML_MASK) {
+        *token += ML_MASK;
+        length -= ML_MASK;
+        for(; length >= 510 ; length -= 510) { *(*op)++ = 255; *(*op)++ = 255; }
+        if (length >= 255) { length -= 255; *(*op)++ = 255; }
+        *(*op)++ = (BYTE)length;
+    } else {
+        *token += (BYTE)(length);
+    }
+
+    /* Prepare next loop */
+    *ip += matchLength;
+    *anchor = *ip;
+
+    return 0;
+}
+
+
+/* LZ4HC_encodeLastLiterals() :
+ * @return : 0 if ok,
+ *           1 if buffer issue detected */
+static int LZ4HC_encodeLastLiterals (const BYTE* anchor, const BYTE* iend, BYTE** op,
+                                     limitedOutput_directive limit, BYTE* oend)
+{
+    size_t lastRunSize = (size_t)(iend - anchor);
+    if ((limit) && ((*op + lastRunSize + 1 + ((lastRunSize+255-RUN_MASK)/255)) > oend)) return 1;   /* Check output limit */
+    if (lastRunSize >= RUN_MASK) {
+        size_t accumulator = lastRunSize - RUN_MASK;
+        *(*op)++ = (RUN_MASK << ML_BITS);
+        for(; accumulator >= 255 ; accumulator -= 255) *(*op)++ = 255;
+        *(*op)++ = (BYTE) accumulator;
+    } else {
+        *(*op)++ = (BYTE)(lastRunSize << ML_BITS);
+    }
+    memcpy(*op, anchor, lastRunSize);
+    *op += lastRunSize;
+    return 0;
+}
+
+
+/* LZ4HC_compress_hashChain() :
+ * lazy parsing : a match is only emitted once the next position
+ * does not offer a longer one, in which case the current byte becomes a literal. */
+static int LZ4HC_compress_hashChain (
+    LZ4HC_CCtx_internal* const ctx,
+    const char* const source,
+    char* const dest,
+    int const inputSize,
+    int const maxOutputSize,
+    U32 const maxNbAttempts,
+    limitedOutput_directive limit
+    )
+{
+    const BYTE* ip = (const BYTE*) source;
+    const BYTE* anchor = ip;
+    const BYTE* const iend = ip + inputSize;
+    const BYTE* const mflimit = iend - MFLIMIT;
+    const BYTE* const matchlimit = (iend - LASTLITERALS);
+
+    BYTE* op = (BYTE*) dest;
+    BYTE* const oend = op + maxOutputSize;
+
+    /* input too small, no compression (all literals) */
+    if (inputSize < LZ4_minLength) goto _last_literals;
+
+    /* Main Loop */
+    while (ip <= mflimit) {
+        const BYTE* ref = NULL;
+        int ml = LZ4HC_FindLongestMatch(ctx, ip, matchlimit, &ref, MINMATCH-1, maxNbAttempts);
+        if (ml < MINMATCH) { ip++; continue; }
+
+        /* lazy evaluation : would starting one byte later pay for its literal ? */
+        while (ip+1 <= mflimit) {
+            const BYTE* ref2 = NULL;
+            int const ml2 = LZ4HC_FindLongestMatch(ctx, ip+1, matchlimit, &ref2, ml, maxNbAttempts);
+            if (ml2 <= ml) break;
+            ip++; ml = ml2; ref = ref2;
+        }
+
+        if (LZ4HC_encodeSequence(&ip, &op, &anchor, ml, ref, limit, oend)) return 0;
+    }
+
+_last_literals:
+    if (LZ4HC_encodeLastLiterals(anchor, iend, &op, limit, oend)) return 0;
+
+    /* End */
+    return (int) (((char*)op)-dest);
+}
+
+
+/*-************************************
+*  Optimal parser
+**************************************/
+typedef struct {
+    int price;   /* cost in bytes of everything up to this position, trailing literals included */
+    int off;     /* offset of the match leading here */
+    int mlen;    /* length of the match leading here, 1 for a literal */
+    int litlen;  /* literals right before this position */
+    int next;    /* after backtracking : length of the match starting here, 0 for a literal */
+    int nextOff; /* after backtracking : offset of the match starting here */
+} LZ4HC_optimal_t;
+
+/* price of literals, length extension bytes included */
+LZ4_FORCE_INLINE int LZ4HC_literalsPrice(int const litlen)
+{
+    int price = litlen;
+    if (litlen >= (int)RUN_MASK)
+        price += 1 + (litlen-RUN_MASK)/255;
+    return price;
+}
+
+/* requires mlen >= MINMATCH */
+LZ4_FORCE_INLINE int LZ4HC_sequencePrice(int litlen, int mlen)
+{
+    int price = 1 + 2 ; /* token + 16-bit offset */
+
+    price += LZ4HC_literalsPrice(litlen);
+
+    if (mlen >= (int)(ML_MASK+MINMATCH))
+        price += 1 + (mlen-(ML_MASK+MINMATCH))/255;
+
+    return price;
+}
+
+#define LZ4HC_INFINITE_PRICE (1<<30)
+
+/* LZ4HC_compress_optimal() :
+ * Builds, over a window of up to LZ4_OPT_NUM positions, the cheapest way to
+ * reach each position, either with one more literal or with a match of any
+ * length up to the longest one found. The window closes when a match of
+ * `sufficient_len` or more shows up; it is then taken as is. The cheapest
+ * path to the end of the window is traced back and encoded. */
+static int LZ4HC_compress_optimal (
+    LZ4HC_CCtx_internal* ctx,
+    const char* const source,
+    char* dst,
+    int inputSize,
+    int dstCapacity,
+    limitedOutput_directive limit,
+    U32 nbSearches,
+    int sufficient_len
+    )
+{
+#if defined(LZ4HC_HEAPMODE) && (LZ4HC_HEAPMODE==1)
+    LZ4HC_optimal_t* const opt = (LZ4HC_optimal_t*)ALLOCATOR(LZ4_OPT_NUM + 1, sizeof(LZ4HC_optimal_t));
+#else
+    LZ4HC_optimal_t opt[LZ4_OPT_NUM + 1];   /* ~100 KB on stack : set LZ4HC_HEAPMODE to 1 if that's too much */
+#endif
+    int result = 0;
+
+    const BYTE* ip = (const BYTE*) source;
+    const BYTE* anchor = ip;
+    const BYTE* const iend = ip + inputSize;
+    const BYTE* const mflimit = iend - MFLIMIT;
+    const BYTE* const matchlimit = (iend - LASTLITERALS);
+    BYTE* op = (BYTE*) dst;
+    BYTE* const oend = op + dstCapacity;
+
+#if defined(LZ4HC_HEAPMODE) && (LZ4HC_HEAPMODE==1)
+    if (opt == NULL) return 0;
+#endif
+    if (sufficient_len >= LZ4_OPT_NUM) sufficient_len = LZ4_OPT_NUM-1;
+
+    /* input too small, no compression (all literals) */
+    if (inputSize < LZ4_minLength) goto _last_literals;
+
+    /* Main Loop */
+    while (ip <= mflimit) {
+        int const llen = (int)(ip - anchor);
+        int cur, last_match_pos, rPos;
+        int forcedPos = -1, forcedLen = 0;
+        const BYTE* forcedRef = NULL;
+        const BYTE* firstRef = NULL;
+        int const firstLen = LZ4HC_FindLongestMatch(ctx, ip, matchlimit, &firstRef, MINMATCH-1, nbSearches);
+        if (firstLen < MINMATCH) { ip++; continue; }
+
+        if (firstLen >= sufficient_len) {
+            /* good enough solution : immediate encoding */
+            if (LZ4HC_encodeSequence(&ip, &op, &anchor, firstLen, firstRef, limit, oend)) goto _return;
+            continue;
+        }
+
+        /* set prices for first positions (literals) */
+        opt[0].price = LZ4HC_literalsPrice(llen);
+        opt[0].mlen = 0;
+        opt[0].litlen = llen;
+        for (rPos = 1; rPos < MINMATCH; rPos++) {
+            opt[rPos].price = LZ4HC_literalsPrice(llen + rPos);
+            opt[rPos].mlen = 1;
+            opt[rPos].litlen = llen + rPos;
+        }
+        /* set prices using the first match */
+        for ( ; rPos <= firstLen; rPos++) {
+            opt[rPos].price = LZ4HC_sequencePrice(llen, rPos);
+            opt[rPos].off = (int)(ip - firstRef);
+            opt[rPos].mlen = rPos;
+            opt[rPos].litlen = 0;
+        }
+        last_match_pos = firstLen;
+
+        /* check further positions */
+        for (cur = 1; cur < last_match_pos; cur++) {
+            const BYTE* const curPtr = ip + cur;
+            const BYTE* ref = NULL;
+            int len, ml, basePrice, litlen;
+
+            /* one more literal from the previous position */
+            {   int const prevLit = opt[cur-1].litlen;
+                int const price = opt[cur-1].price - LZ4HC_literalsPrice(prevLit) + LZ4HC_literalsPrice(prevLit+1);
+                if (price < opt[cur].price) {
+                    opt[cur].price = price;
+                    opt[cur].mlen = 1;
+                    opt[cur].litlen = prevLit+1;
+            }   }
+
+            if (curPtr > mflimit) continue;   /* no match may start here : literals only */
+            len = LZ4HC_FindLongestMatch(ctx, curPtr, matchlimit, &ref, MINMATCH-1, nbSearches);
+            if (len < MINMATCH) continue;
+
+            if ((len >= sufficient_len) || (cur + len >= LZ4_OPT_NUM)) {
+                /* immediate encoding : close the window here */
+                forcedPos = cur;
+                forcedLen = len;
+                forcedRef = ref;
+                last_match_pos = cur;
+                break;
+            }
+
+            /* set prices using the match at position = cur */
+            litlen = opt[cur].litlen;
+            basePrice = opt[cur].price - LZ4HC_literalsPrice(litlen);
+            for (rPos = last_match_pos+1; rPos <= cur+len; rPos++)
+                opt[rPos].price = LZ4HC_INFINITE_PRICE;
+            for (ml = MINMATCH; ml <= len; ml++) {
+                int const pos = cur + ml;
+                int const price = basePrice + LZ4HC_sequencePrice(litlen, ml);
+                if (price < opt[pos].price) {
+                    opt[pos].price = price;
+                    opt[pos].off = (int)(curPtr - ref);
+                    opt[pos].mlen = ml;
+                    opt[pos].litlen = 0;
+            }   }
+            if (cur+len > last_match_pos) last_match_pos = cur+len;
+        }
+
+        /* last position may still be cheaper as a literal */
+        if (forcedPos < 0) {
+            int const prevLit = opt[last_match_pos-1].litlen;
+            int const price = opt[last_match_pos-1].price - LZ4HC_literalsPrice(prevLit) + LZ4HC_literalsPrice(prevLit+1);
+            if (price < opt[last_match_pos].price) {
+                opt[last_match_pos].price = price;
+                opt[last_match_pos].mlen = 1;
+                opt[last_match_pos].litlen = prevLit+1;
+        }   }
+
+        /* backtrack : mark the start of each selected match */
+        for (rPos = 0; rPos <= last_match_pos; rPos++) opt[rPos].next = 0;
+        cur = last_match_pos;
+        while (cur > 0) {
+            int const ml = opt[cur].mlen;
+            if (ml > 1) {
+                opt[cur-ml].next = ml;
+                opt[cur-ml].nextOff = opt[cur].off;
+                cur -= ml;
+            } else {
+                cur--;
+        }   }
+
+        /* encode selected sequences */
+        for (rPos = 0; rPos < last_match_pos; ) {
+            int const ml = opt[rPos].next;
+            if (ml) {
+                const BYTE* seqIp = ip + rPos;
+                if (LZ4HC_encodeSequence(&seqIp, &op, &anchor, ml, seqIp - opt[rPos].nextOff, limit, oend)) goto _return;
+                rPos += ml;
+            } else {
+                rPos++;
+        }   }
+        ip += last_match_pos;
+
+        if (forcedPos >= 0) {
+            if (LZ4HC_encodeSequence(&ip, &op, &anchor, forcedLen, forcedRef, limit, oend)) goto _return;
+        }
+    }
+
+_last_literals:
+    if (LZ4HC_encodeLastLiterals(anchor, iend, &op, limit, oend)) goto _return;
+
+    /* End */
+    result = (int) (((char*)op)-dst);
+_return:
+#if defined(LZ4HC_HEAPMODE) && (LZ4HC_HEAPMODE==1)
+    FREEMEM(opt);
+#endif
+    return result;
+}
+
+
+static int LZ4HC_compress_generic (
+    LZ4HC_CCtx_internal* const ctx,
+    const char* const src,
+    char* const dst,
+    int const srcSize,
+    int const dstCapacity,
+    int cLevel,
+    limitedOutput_directive limit
+    )
+{
+    const cParams_t* const params = LZ4HC_getParams(cLevel);
+    if ((U32)srcSize > (U32)LZ4_MAX_INPUT_SIZE) return 0;   /* Unsupported input size (too large or negative) */
+    ctx->compressionLevel = cLevel;
+    if (params->strat == lz4hc)
+        return LZ4HC_compress_hashChain(ctx, src, dst, srcSize, dstCapacity, params->nbSearches, limit);
+    return LZ4HC_compress_optimal(ctx, src, dst, srcSize, dstCapacity, limit, params->nbSearches, (int)params->targetLength);
+}
+
+
+int LZ4_sizeofStateHC(void) { return sizeof(LZ4_streamHC_t); }
+
+int LZ4_compress_HC_extStateHC (void* state, const char* src, char* dst, int srcSize, int dstCapacity, int compressionLevel)
+{
+    LZ4HC_CCtx_internal* const ctx = &((LZ4_streamHC_t*)state)->internal_donotuse;
+    if (((size_t)(state)&(sizeof(void*)-1)) != 0) return 0;   /* Error : state is not aligned for pointers (32 or 64 bits) */
+    LZ4HC_init (ctx, (const BYTE*)src);
+    if (dstCapacity < LZ4_compressBound(srcSize))
+        return LZ4HC_compress_generic (ctx, src, dst, srcSize, dstCapacity, compressionLevel, limitedOutput);
+    else
+        return LZ4HC_compress_generic (ctx, src, dst, srcSize, dstCapacity, compressionLevel, noLimit);
+}
+
+int LZ4_compress_HC(const char* src, char* dst, int srcSize, int dstCapacity, int compressionLevel)
+{
+#if defined(LZ4HC_HEAPMODE) && LZ4HC_HEAPMODE==1
+    LZ4_streamHC_t* const statePtr = (LZ4_streamHC_t*)ALLOCATOR(1, sizeof(LZ4_streamHC_t));
+    int cSize;
+    if (statePtr == NULL) return 0;
+    cSize = LZ4_compress_HC_extStateHC(statePtr, src, dst, srcSize, dstCapacity, compressionLevel);
+    FREEMEM(statePtr);
+    return cSize;
+#else
+    LZ4_streamHC_t state;
+    LZ4_streamHC_t* const statePtr = &state;
+    return LZ4_compress_HC_extStateHC(statePtr, src, dst, srcSize, dstCapacity, compressionLevel);
+#endif
+}
@@ -0,0 +1,422 @@
+/*
+   LZ4io.c - LZ4 file driver
+   Reads and writes .lz4 files through lz4frame.c.
+*/
+
+/*-************************************
+*  Tuning parameters
+**************************************/
+/*
+ * LZ4IO_NO_MMAP :
+ * Build without mmap(). Files are then read and written through stdio buffers only.
+ * The produced frames are unchanged.
+ */
+#if defined(_WIN32) && !defined(LZ4IO_NO_MMAP)
+#  define LZ4IO_NO_MMAP
+#endif
+
+#ifndef LZ4IO_NO_MMAP
+#  ifndef _FILE_OFFSET_BITS
+#    define _FILE_OFFSET_BITS 64   /* large files on 32-bits systems */
+#  endif
+#  ifndef _POSIX_C_SOURCE
+#    define _POSIX_C_SOURCE 200112L   /* fileno, fseeko, ftruncate, fstatvfs, posix_madvise */
+#  endif
+#endif
+
+
+/*-************************************
+*  Dependencies
+**************************************/
+#include <stdio.h>    /* fopen, fread, fwrite, fclose */
+#include <stdlib.h>   /* malloc, free */
+#include <string.h>   /* memmove, strcmp */
+#include "lz4frame.h"
+#include "lz4io.h"
+#ifndef LZ4IO_NO_MMAP
+#  include <sys/types.h>
+#  include <sys/stat.h>   /* fstat */
+#  include <sys/mman.h>   /* mmap, munmap, posix_madvise */
+#  include <sys/statvfs.h> /* fstatvfs */
+#  include <unistd.h>     /* ftruncate, sysconf */
+#endif
+#if defined(_WIN32)
+#  include <io.h>         /* _setmode */
+#  include <fcntl.h>      /* _O_BINARY */
+#  define SET_BINARY_MODE(file) _setmode(_fileno(file), _O_BINARY)
+#else
+#  define SET_BINARY_MODE(file)
+#endif
+
+
+/*-************************************
+*  Basic Types
+**************************************/
+#if defined(__cplusplus) || (defined (__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L) /* C99 */)
+# include <stdint.h>
+  typedef  uint8_t BYTE;
+  typedef uint64_t U64;
+#else
+  typedef unsigned char       BYTE;
+  typedef unsigned long long  U64;
+#endif
+
+#define KB *(1 <<10)
+#define MB *(1 <<20)
+
+#define MIN(a,b)   ( (a) < (b) ? (a) : (b) )
+#define MAX(a,b)   ( (a) > (b) ? (a) : (b) )
+
+
+/*-************************************
+*  Constants
+**************************************/
+#define LZ4IO_CHUNKSIZE   (1 MB)   /* read size of buffered input, and compression granularity */
+#define LZ4IO_MAXRATIO    256      /* no LZ4 block decodes to more than 256 bytes per compressed byte */
+
+
+/*-************************************
+*  Input
+**************************************/
+typedef struct {
+    FILE*  file;
+    const BYTE* map;      /* whole input, when mapped */
+    size_t mapSize;
+    BYTE*  buffer;        /* input buffer otherwise */
+    size_t bufferSize;
+    const BYTE* pos;      /* unconsumed input : [pos, end) */
+    const BYTE* end;
+    U64    fileSize;      /* 0 = unknown */
+    int    eof;
+} LZ4IO_src_t;
+
+static int LZ4IO_openSrc(LZ4IO_src_t* src, const char* srcFileName)
+{
+    memset(src, 0, sizeof(*src));
+    if (!strcmp(srcFileName, LZ4IO_STDIN)) {
+        src->file = stdin;
+        SET_BINARY_MODE(stdin);
+    } else {
+        src->file = fopen(srcFileName, "rb");
+        if (src->file == NULL) return -1;
+    }
+
+#ifndef LZ4IO_NO_MMAP
+    {   struct stat st;
+        if (src->file != stdin && !fstat(fileno(src->file), &st) && S_ISREG(st.st_mode)) {
+            src->fileSize = (U64)st.st_size;
+            if (st.st_size > 0 && (U64)st.st_size <= (size_t)-1) {
+                void* const map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(src->file), 0);
+                if (map != MAP_FAILED) {
+                    (void)posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+                    src->map = (const BYTE*)map;
+                    src->mapSize = (size_t)st.st_size;
+                    src->pos = src->map;
+                    src->end = src->map + src->mapSize;
+                    src->eof = 1;
+                    return 0;
+    }   }   }   }
+#endif
+
+    src->bufferSize = LZ4IO_CHUNKSIZE;
+    src->buffer = (BYTE*)malloc(src->bufferSize);
+    if (src->buffer == NULL) {
+        if (src->file != stdin) fclose(src->file);
+        return -1;
+    }
+    src->pos = src->end = src->buffer;
+    return 0;
+}
+
+static void LZ4IO_closeSrc(LZ4IO_src_t* src)
+{
+#ifndef LZ4IO_NO_MMAP
+    if (src->map) munmap((void*)src->map, src->mapSize);
+#endif
+    free(src->buffer);
+    if (src->file != stdin) fclose(src->file);
+}
+
+/* LZ4IO_fillSrc() :
+ * makes at least `wanted` bytes (<= bufferSize) available in [pos, end), unless input ends first.
+ * Mapped input is always entirely available.
+ * @return : nb of available bytes, or (size_t)-1 on read error */
+static size_t LZ4IO_fillSrc(LZ4IO_src_t* src, size_t wanted)
+{
+    if (!src->eof && (size_t)(src->end - src->pos) < wanted) {
+        size_t const left = (size_t)(src->end - src->pos);
+        memmove(src->buffer, src->pos, left);
+        src->pos = src->buffer;
+        src->end = src->buffer + left;
+        while (!src->eof && (size_t)(src->end - src->pos) < wanted) {
+            size_t const readSize = fread(src->buffer + (src->end - src->buffer), 1, src->bufferSize - (size_t)(src->end - src->buffer), src->file);
+            src->end += readSize;
+            if (readSize == 0) {
+                if (ferror(src->file)) return (size_t)-1;
+                src->eof = 1;
+        }   }
+    }
+    return (size_t)(src->end - src->pos);
+}
+
+
+/*-************************************
+*  Output
+**************************************/
+typedef struct {
+    FILE* file;
+    U64   written;      /* current output size */
+    int   mappable;     /* regular file, opened read-write */
+} LZ4IO_dst_t;
+
+static int LZ4IO_openDst(LZ4IO_dst_t* dst, const char* dstFileName)
+{
+    memset(dst, 0, sizeof(*dst));
+    if (!strcmp(dstFileName, LZ4IO_STDOUT)) {
+        dst->file = stdout;
+        SET_BINARY_MODE(stdout);
+        return 0;
+    }
+    dst->file = fopen(dstFileName, "w+b");   /* read access is required by PROT_WRITE mappings */
+    if (dst->file == NULL) return -1;
+#ifndef LZ4IO_NO_MMAP
+    {   struct stat st;
+        dst->mappable = !fstat(fileno(dst->file), &st) && S_ISREG(st.st_mode);
+    }
+#endif
+    return 0;
+}
+
+static int LZ4IO_closeDst(LZ4IO_dst_t* dst)
+{
+    if (dst->file == stdout) return fflush(stdout) ? -1 : 0;
+    return fclose(dst->file) ? -1 : 0;
+}
+
+static int LZ4IO_write(LZ4IO_dst_t* dst, const void* buffer, size_t size)
+{
+    if (fwrite(buffer, 1, size, dst->file) != size) return -1;
+    dst->written += size;
+    return 0;
+}
+
+
+/*-************************************
+*  Compression
+**************************************/
+static size_t LZ4IO_blockSize(LZ4F_blockSizeID_t blockSizeID)
+{
+    if (blockSizeID < LZ4F_max64KB || blockSizeID > LZ4F_max4MB) return 64 KB;   /* default, or invalid (rejected by LZ4F_compressBegin()) */
+    return (size_t)1 << (8 + 2 * blockSizeID);
+}
+
+int LZ4IO_compressFilename(const char* srcFileName, const char* dstFileName, const LZ4F_preferences_t* prefsPtr)
+{
+    LZ4IO_src_t src;
+    LZ4IO_dst_t dst;
+    LZ4F_preferences_t prefs;
+    LZ4F_compressOptions_t cOpt;
+    LZ4F_cctx* cctx = NULL;
+    BYTE* outBuff = NULL;
+    size_t outCapacity, chunkSize;
+    int result = -1;
+
+    if (LZ4IO_openSrc(&src, srcFileName)) return -1;
+    if (LZ4IO_openDst(&dst, dstFileName)) { LZ4IO_closeSrc(&src); return -1; }
+
+    if (prefsPtr) prefs = *prefsPtr;
+    else memset(&prefs, 0, sizeof(prefs));
+    if (src.fileSize) prefs.frameInfo.contentSize = src.fileSize;
+
+    /* mapped input is fed whole blocks, which are compressed in place;
+     * buffered input is fed what was read, and LZ4F_compressUpdate() buffers partial blocks */
+    memset(&cOpt, 0, sizeof(cOpt));
+    cOpt.stableSrc = (src.map != NULL);
+    chunkSize = src.map ? MAX(LZ4IO_CHUNKSIZE, LZ4IO_blockSize(prefs.frameInfo.blockSizeID)) : src.bufferSize;
+    outCapacity = LZ4F_compressBound(chunkSize, &prefs);
+    outBuff = (BYTE*)malloc(outCapacity);
+    if (outBuff == NULL) goto _end;
+    if (LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) goto _end;
+
+    {   size_t const headerSize = LZ4F_compressBegin(cctx, outBuff, outCapacity, &prefs);
+        if (LZ4F_isError(headerSize)) goto _end;
+        if (LZ4IO_write(&dst, outBuff, headerSize)) goto _end;
+    }
+
+    for (;;) {
+        size_t const available = LZ4IO_fillSrc(&src, src.bufferSize);
+        size_t srcSize, cSize;
+        if (available == (size_t)-1) goto _end;
+        if (available == 0) break;
+        srcSize = MIN(available, chunkSize);
+        cSize = LZ4F_compressUpdate(cctx, outBuff, outCapacity, src.pos, srcSize, &cOpt);
+        if (LZ4F_isError(cSize)) goto _end;
+        src.pos += srcSize;
+        if (LZ4IO_write(&dst, outBuff, cSize)) goto _end;
+    }
+
+    {   size_t const endSize = LZ4F_compressEnd(cctx, outBuff, outCapacity, &cOpt);
+        if (LZ4F_isError(endSize)) goto _end;   /* notably, input size changed while compressing */
+        if (LZ4IO_write(&dst, outBuff, endSize)) goto _end;
+    }
+    result = 0;
+
+_end:
+    LZ4F_freeCompressionContext(cctx);
+    free(outBuff);
+    LZ4IO_closeSrc(&src);
+    if (LZ4IO_closeDst(&dst)) result = -1;
+    return result;
+}
+
+
+/*-************************************
+*  Decompression
+**************************************/
+/* LZ4IO_feed() :
+ * one LZ4F_decompress() call, on all available input.
+ * @return : next hint from LZ4F_decompress() (0 = frame completed), or (size_t)-1 on error */
+static size_t LZ4IO_feed(LZ4F_dctx* dctx, LZ4IO_src_t* src, BYTE* dstPtr, size_t* dstSizePtr,
+                         const LZ4F_decompressOptions_t* dOpt)
+{
+    size_t const available = LZ4IO_fillSrc(src, 1);
+    size_t srcSize = available;
+    size_t hint;
+    if (available == (size_t)-1 || available == 0) return (size_t)-1;   /* read error, or truncated frame */
+    hint = LZ4F_decompress(dctx, dstPtr, dstSizePtr, src->pos, &srcSize, dOpt);
+    if (LZ4F_isError(hint)) return (size_t)-1;
+    if (srcSize == 0 && *dstSizePtr == 0) return (size_t)-1;   /* no progress : content larger than announced */
+    src->pos += srcSize;
+    return hint;
+}
+
+/* LZ4IO_decodeFrameRing() :
+ * decodes the rest of current frame through `ring`, of size >= 64 KB + 2 * blockSize.
+ * Blocks are decoded directly into the ring, which always has room for a full block.
+ * Wrapping around only happens when less than one block is left at its end :
+ * the 64 KB of history preceding the write position are then beyond the first block,
+ * and stay valid until it is decoded, hence `stableDst`. */
+static int LZ4IO_decodeFrameRing(LZ4F_dctx* dctx, LZ4IO_src_t* src, LZ4IO_dst_t* dst,
+                                 BYTE* ring, size_t ringSize, size_t blockSize)
+{
+    LZ4F_decompressOptions_t dOpt;
+    size_t ringPos = 0;
+    size_t hint = 1;
+
+    memset(&dOpt, 0, sizeof(dOpt));
+    dOpt.stableDst = 1;
+    while (hint) {
+        size_t dstSize;
+        if (ringSize - ringPos < blockSize) ringPos = 0;
+        dstSize = ringSize - ringPos;
+        hint = LZ4IO_feed(dctx, src, ring + ringPos, &dstSize, &dOpt);
+        if (hint == (size_t)-1) return -1;
+        if (LZ4IO_write(dst, ring + ringPos, dstSize)) return -1;
+        ringPos += dstSize;
+    }
+    return 0;
+}
+
+#ifndef LZ4IO_NO_MMAP
+/* LZ4IO_decodeFrameMapped() :
+ * extends output file by `contentSize`, maps the extension and decodes the rest of current frame into it.
+ * `contentSize` comes from the frame header, so it is first checked against the free space of the output
+ * file system, and, for mapped input, against what the rest of the input could decode to :
+ * a mapping must not grow past the disk, where writing it would fault instead of failing.
+ * On error, the output is truncated back to the content decoded so far.
+ * @return : 0 on success, -1 on error, 1 when the file cannot be mapped (nothing consumed nor written) */
+static int LZ4IO_decodeFrameMapped(LZ4F_dctx* dctx, LZ4IO_src_t* src, LZ4IO_dst_t* dst, U64 contentSize)
+{
+    LZ4F_decompressOptions_t dOpt;
+    int const fd = fileno(dst->file);
+    U64 const pageSize = (U64)sysconf(_SC_PAGESIZE);
+    U64 const mapStart = dst->written - (dst->written % pageSize);   /* mmap offset must be page aligned */
+    U64 const mapSize = dst->written + contentSize - mapStart;
+    BYTE* map;
+    BYTE* out;
+    size_t outPos = 0;
+    size_t hint = 1;
+    int result = 0;
+
+    if (mapSize > (size_t)-1 || (off_t)(dst->written + contentSize) < 0) return 1;
+    if (src->map && contentSize / LZ4IO_MAXRATIO > (U64)(src->end - src->pos)) return 1;   /* header lies; decoding fails on the ring buffer path */
+    {   struct statvfs fs;
+        if (fstatvfs(fd, &fs) || !fs.f_frsize || contentSize / fs.f_frsize >= (U64)fs.f_bavail) return 1;
+    }
+    if (fflush(dst->file)) return -1;
+    if (ftruncate(fd, (off_t)(dst->written + contentSize))) return 1;
+    map = (BYTE*)mmap(NULL, (size_t)mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)mapStart);
+    if (map == (BYTE*)MAP_FAILED) {
+        if (ftruncate(fd, (off_t)dst->written)) return -1;
+        return 1;
+    }
+    out = map + (dst->written - mapStart);
+
+    /* content is never moved once decoded : history is read in place */
+    memset(&dOpt, 0, sizeof(dOpt));
+    dOpt.stableDst = 1;
+    while (hint) {
+        size_t dstSize = (size_t)contentSize - outPos;
+        hint = LZ4IO_feed(dctx, src, out + outPos, &dstSize, &dOpt);
+        if (hint == (size_t)-1) { result = -1; break; }
+        outPos += dstSize;
+    }
+
+    munmap(map, (size_t)mapSize);
+    dst->written += outPos;
+    if (outPos != contentSize) result = -1;   /* content size checked by LZ4F_decompress(); only reachable on error */
+    if (result && ftruncate(fd, (off_t)dst->written)) return -1;   /* drop the part that was never decoded */
+    if (fseeko(dst->file, (off_t)dst->written, SEEK_SET)) result = -1;
+    return result;
+}
+#endif
+
+int LZ4IO_decompressFilename(const char* srcFileName, const char* dstFileName)
+{
+    LZ4IO_src_t src;
+    LZ4IO_dst_t dst;
+    LZ4F_dctx* dctx = NULL;
+    BYTE* ring = NULL;
+    size_t ringSize = 0;
+    int result = -1;
+
+    if (LZ4IO_openSrc(&src, srcFileName)) return -1;
+    if (LZ4IO_openDst(&dst, dstFileName)) { LZ4IO_closeSrc(&src); return -1; }
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) goto _end;
+
+    for (;;) {   /* one frame per loop */
+        LZ4F_frameInfo_t info;
+        size_t const available = LZ4IO_fillSrc(&src, LZ4F_HEADER_SIZE_MAX);
+        size_t headerSize = available;
+        size_t blockSize;
+        if (available == (size_t)-1) goto _end;
+        if (available == 0) break;   /* no more frame */
+        if (LZ4F_isError(LZ4F_getFrameInfo(dctx, &info, src.pos, &headerSize))) goto _end;
+        src.pos += headerSize;
+
+#ifndef LZ4IO_NO_MMAP
+        if (info.frameType == LZ4F_frame && info.contentSize && dst.mappable) {
+            int const mapped = LZ4IO_decodeFrameMapped(dctx, &src, &dst, info.contentSize);
+            if (mapped < 0) goto _end;
+            if (mapped == 0) continue;
+        }   /* fall back to ring buffer */
+#endif
+
+        blockSize = (info.frameType == LZ4F_frame) ? LZ4IO_blockSize(info.blockSizeID) : 64 KB;
+        if (ringSize < 64 KB + 2 * blockSize) {
+            free(ring);
+            ringSize = 64 KB + 2 * blockSize;
+            ring = (BYTE*)malloc(ringSize);
+            if (ring == NULL) goto _end;
+        }
+        if (LZ4IO_decodeFrameRing(dctx, &src, &dst, ring, ringSize, blockSize)) goto _end;
+    }
+    result = 0;
+
+_end:
+    LZ4F_freeDecompressionContext(dctx);
+    free(ring);
+    LZ4IO_closeSrc(&src);
+    if (LZ4IO_closeDst(&dst)) result = -1;
+    return result;
+}
@@ -0,0 +1,64 @@
+/*
+   LZ4io.h - LZ4 file driver
+   Header File
+   See lz4io.c.
+*/
+#ifndef LZ4IO_H_237902873
+#define LZ4IO_H_237902873
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * lz4io.h compresses and decompresses whole files to and from the LZ4 frame format
+ * (see lz4frame.h), with as few copies as the platform allows :
+ *
+ * - Compression maps the input file, and compresses blocks straight out of the mapping
+ *   (LZ4F_compressOptions_t.stableSrc) : linked blocks find their history in place,
+ *   instead of in a copy saved with LZ4_saveDict().
+ * - Decompression maps the input file too, so that blocks are decoded straight from it.
+ *   When a frame records its content size, the output file is extended to that size,
+ *   mapped, and the frame is decoded into it in a single call (LZ4F_decompressOptions_t.stableDst).
+ *   Otherwise, output goes through a ring buffer of 64 KB + 2 x block size :
+ *   each block is decoded into the ring, behind the 64 KB its successor may reference,
+ *   so history is never copied either.
+ *
+ * Anything which cannot be mapped (pipes, `LZ4IO_STDIN`, or LZ4IO_NO_MMAP builds)
+ * falls back to buffered reads and writes, with identical results. Concatenated frames
+ * and skippable frames are supported on decompression.
+ */
+
+#include "lz4frame.h"
+
+
+/*-************************************
+*  Special input/output names
+**************************************/
+#define LZ4IO_STDIN  "stdin"
+#define LZ4IO_STDOUT "stdout"
+
+
+/*-************************************
+*  Operations
+**************************************/
+/*! LZ4IO_compressFilename() :
+ *  Compresses `srcFileName` into a single frame written to `dstFileName` (overwritten).
+ *  `prefs` is optional (NULL = defaults). When the input is a regular file,
+ *  its size is recorded as the frame's content size, which lets LZ4IO_decompressFilename()
+ *  decode directly into the mapped output file.
+ *  @return : 0 on success, or a negative value on error (I/O error, invalid `prefs`). */
+int LZ4IO_compressFilename(const char* srcFileName, const char* dstFileName, const LZ4F_preferences_t* prefs);
+
+/*! LZ4IO_decompressFilename() :
+ *  Decompresses all frames in `srcFileName` into `dstFileName` (overwritten).
+ *  @return : 0 on success, or a negative value on error (I/O error, corrupted or truncated input).
+ *  On error, `dstFileName` may hold partially decoded content. */
+int LZ4IO_decompressFilename(const char* srcFileName, const char* dstFileName);
+
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif  /* LZ4IO_H_237902873 */
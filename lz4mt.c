@@ -0,0 +1,448 @@
+/*
+   LZ4mt - block-parallel front-end for LZ4
+   Compresses independent blocks on worker threads with lz4.c.
+   lz4.c keeps its own copyright and BSD 2-Clause license.
+*/
+
+
+/*-************************************
+*  Tuning parameters
+**************************************/
+/*
+ * LZ4MT_NO_THREADS :
+ * Build without pthread. All blocks are then processed by the calling thread,
+ * whatever the requested number of workers. The frame format is unchanged.
+ */
+#if defined(_WIN32) && !defined(LZ4MT_NO_THREADS)
+#  define LZ4MT_NO_THREADS
+#endif
+
+
+/*-************************************
+*  Dependencies
+**************************************/
+#include "lz4.h"
+#include "lz4mt.h"
+#include <stdlib.h>   /* malloc, free */
+#include <string.h>   /* memcpy */
+#ifndef LZ4MT_NO_THREADS
+#  include <pthread.h>
+#endif
+
+
+/*-************************************
+*  Basic Types
+**************************************/
+#if defined(__cplusplus) || (defined (__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L) /* C99 */)
+# include <stdint.h>
+  typedef  uint8_t BYTE;
+  typedef uint32_t U32;
+  typedef uint64_t U64;
+#else
+  typedef unsigned char       BYTE;
+  typedef unsigned int        U32;
+  typedef unsigned long long  U64;
+#endif
+
+#define KB *(1 <<10)
+
+
+/*-************************************
+*  Threading
+**************************************/
+#ifndef LZ4MT_NO_THREADS
+  typedef pthread_mutex_t LZ4MT_mutex_t;
+  typedef pthread_cond_t  LZ4MT_cond_t;
+# define LZ4MT_mutex_init(m)   pthread_mutex_init((m), NULL)
+# define LZ4MT_mutex_destroy(m) pthread_mutex_destroy(m)
+# define LZ4MT_mutex_lock(m)   pthread_mutex_lock(m)
+# define LZ4MT_mutex_unlock(m) pthread_mutex_unlock(m)
+# define LZ4MT_cond_init(c)    pthread_cond_init((c), NULL)
+# define LZ4MT_cond_destroy(c) pthread_cond_destroy(c)
+# define LZ4MT_cond_wait(c, m) pthread_cond_wait((c), (m))
+# define LZ4MT_cond_broadcast(c) pthread_cond_broadcast(c)
+#else
+  /* single thread : blocks are handed out and committed in order, nothing ever waits */
+  typedef int LZ4MT_mutex_t;
+  typedef int LZ4MT_cond_t;
+# define LZ4MT_mutex_init(m)   ((void)(m), 0)
+# define LZ4MT_mutex_destroy(m) ((void)(m))
+# define LZ4MT_mutex_lock(m)   ((void)(m))
+# define LZ4MT_mutex_unlock(m) ((void)(m))
+# define LZ4MT_cond_init(c)    ((void)(c), 0)
+# define LZ4MT_cond_destroy(c) ((void)(c))
+# define LZ4MT_cond_wait(c, m) ((void)(c), (void)(m))
+# define LZ4MT_cond_broadcast(c) ((void)(c))
+#endif
+
+typedef void* (*LZ4MT_worker_f)(void* ctx);
+
+/* LZ4MT_runWorkers() :
+ * runs `worker(ctx)` on `nbWorkers` threads, the calling thread being one of them.
+ * Threads which cannot be created are simply not started :
+ * workers pull jobs from a shared counter, so fewer threads only means less parallelism. */
+static void LZ4MT_runWorkers(LZ4MT_worker_f worker, void* ctx, int nbWorkers)
+{
+#ifndef LZ4MT_NO_THREADS
+    pthread_t threads[LZ4MT_NBWORKERS_MAX];
+    int nbStarted = 0;
+    int t;
+    for (t = 1; t < nbWorkers; t++) {
+        if (pthread_create(&threads[nbStarted], NULL, worker, ctx)) break;
+        nbStarted++;
+    }
+    worker(ctx);
+    for (t = 0; t < nbStarted; t++) pthread_join(threads[t], NULL);
+#else
+    (void)nbWorkers;
+    worker(ctx);
+#endif
+}
+
+static int LZ4MT_clampWorkers(int nbWorkers, U32 nbBlocks)
+{
+    if (nbWorkers < 1) nbWorkers = 1;
+    if (nbWorkers > LZ4MT_NBWORKERS_MAX) nbWorkers = LZ4MT_NBWORKERS_MAX;
+    if ((U32)nbWorkers > nbBlocks) nbWorkers = nbBlocks ? (int)nbBlocks : 1;
+    return nbWorkers;
+}
+
+
+/*-************************************
+*  Reading and writing into memory
+**************************************/
+static void LZ4MT_writeLE32(void* dst, U32 value)
+{
+    BYTE* const p = (BYTE*)dst;
+    p[0] = (BYTE)value;
+    p[1] = (BYTE)(value >> 8);
+    p[2] = (BYTE)(value >> 16);
+    p[3] = (BYTE)(value >> 24);
+}
+
+static void LZ4MT_writeLE64(void* dst, U64 value)
+{
+    LZ4MT_writeLE32(dst, (U32)value);
+    LZ4MT_writeLE32((BYTE*)dst + 4, (U32)(value >> 32));
+}
+
+static U32 LZ4MT_readLE32(const void* src)
+{
+    const BYTE* const p = (const BYTE*)src;
+    return (U32)p[0] | ((U32)p[1] << 8) | ((U32)p[2] << 16) | ((U32)p[3] << 24);
+}
+
+static U64 LZ4MT_readLE64(const void* src)
+{
+    return (U64)LZ4MT_readLE32(src) | ((U64)LZ4MT_readLE32((const BYTE*)src + 4) << 32);
+}
+
+
+/*-************************************
+*  Common functions
+**************************************/
+#define LZ4MT_FLAG_LINKED 1
+
+static int LZ4MT_blockSize(const LZ4MT_params_t* params)
+{
+    if (params == NULL || params->blockSize <= 0) return LZ4MT_BLOCKSIZE_DEFAULT;
+    return params->blockSize;
+}
+
+static U64 LZ4MT_nbBlocks(U64 contentSize, U32 blockSize)
+{
+    return (contentSize + blockSize - 1) / blockSize;
+}
+
+size_t LZ4MT_compressBound(size_t srcSize, const LZ4MT_params_t* params)
+{
+    int const blockSize = LZ4MT_blockSize(params);
+    if (blockSize > LZ4_MAX_INPUT_SIZE) return 0;
+    return LZ4MT_HEADERSIZE(LZ4MT_nbBlocks(srcSize, (U32)blockSize)) + srcSize;
+}
+
+
+/*-************************************
+*  Compression
+**************************************/
+typedef struct {
+    const BYTE* src;
+    size_t srcSize;
+    BYTE* dst;
+    size_t dstCapacity;
+    U32 blockSize;
+    U32 nbBlocks;
+    int acceleration;
+    int linked;
+
+    LZ4MT_mutex_t mutex;
+    LZ4MT_cond_t  committed;
+    U32 nextJob;        /* next block to compress */
+    U32 nextCommit;     /* next block to be given a place in dst */
+    size_t dstPos;      /* where the next committed block goes */
+    int error;
+} LZ4MT_cctx_t;
+
+/* LZ4MT_compressJob() :
+ * compresses one block into `tmp`, of capacity `blockLen-1`.
+ * @return : compressed size, or `blockLen` if the block must be stored raw */
+static int LZ4MT_compressJob(LZ4MT_cctx_t* cctx, LZ4_stream_t* state, U32 job, char* tmp)
+{
+    size_t const start = (size_t)job * cctx->blockSize;
+    const char* const src = (const char*)cctx->src + start;
+    int const blockLen = (int)((cctx->srcSize - start) < cctx->blockSize ? (cctx->srcSize - start) : cctx->blockSize);
+    int cSize;
+
+    if (cctx->linked) {
+        /* the 64 KB preceding the block are right in front of it : prefix mode */
+        int const dictSize = start < 64 KB ? (int)start : 64 KB;
+        LZ4_resetStream(state);
+        LZ4_loadDict(state, src - dictSize, dictSize);
+        cSize = LZ4_compress_fast_continue(state, src, tmp, blockLen, blockLen-1, cctx->acceleration);
+    } else {
+        cSize = LZ4_compress_fast_extState(state, src, tmp, blockLen, blockLen-1, cctx->acceleration);
+    }
+    return cSize > 0 ? cSize : blockLen;
+}
+
+static void* LZ4MT_compressWorker(void* ctx)
+{
+    LZ4MT_cctx_t* const cctx = (LZ4MT_cctx_t*)ctx;
+    LZ4_stream_t* const state = LZ4_createStream();
+    char* const tmp = (char*)malloc(cctx->srcSize < cctx->blockSize ? cctx->srcSize : cctx->blockSize);
+
+    if (state == NULL || tmp == NULL) {
+        LZ4MT_mutex_lock(&cctx->mutex);
+        cctx->error = 1;
+        LZ4MT_cond_broadcast(&cctx->committed);
+        LZ4MT_mutex_unlock(&cctx->mutex);
+    }
+
+    while (state != NULL && tmp != NULL) {
+        U32 job;
+        int cSize;
+        size_t pos;
+        int error;
+
+        LZ4MT_mutex_lock(&cctx->mutex);
+        if (cctx->error || cctx->nextJob == cctx->nbBlocks) {
+            LZ4MT_mutex_unlock(&cctx->mutex);
+            break;
+        }
+        job = cctx->nextJob++;
+        LZ4MT_mutex_unlock(&cctx->mutex);
+
+        cSize = LZ4MT_compressJob(cctx, state, job, tmp);
+
+        /* blocks are laid out in order : wait for the previous one to take its place,
+         * then take ours. Copies themselves run outside of the lock. */
+        LZ4MT_mutex_lock(&cctx->mutex);
+        while (cctx->nextCommit != job && !cctx->error)
+            LZ4MT_cond_wait(&cctx->committed, &cctx->mutex);
+        pos = cctx->dstPos;
+        if (cctx->error || (size_t)cSize > cctx->dstCapacity - pos) {
+            cctx->error = 1;
+        } else {
+            cctx->dstPos += (size_t)cSize;
+            cctx->nextCommit++;
+        }
+        error = cctx->error;
+        LZ4MT_cond_broadcast(&cctx->committed);
+        LZ4MT_mutex_unlock(&cctx->mutex);
+        if (error) break;
+
+        LZ4MT_writeLE64(cctx->dst + 24 + 8 * (size_t)job, pos);
+        {   size_t const start = (size_t)job * cctx->blockSize;
+            size_t const blockLen = (cctx->srcSize - start) < cctx->blockSize ? (cctx->srcSize - start) : cctx->blockSize;
+            memcpy(cctx->dst + pos, (size_t)cSize == blockLen ? (const char*)cctx->src + start : tmp, (size_t)cSize);
+        }
+    }
+
+    free(tmp);
+    LZ4_freeStream(state);
+    return NULL;
+}
+
+size_t LZ4MT_compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity, const LZ4MT_params_t* params)
+{
+    LZ4MT_cctx_t cctx;
+    int const blockSize = LZ4MT_blockSize(params);
+    U64 nbBlocks;
+    size_t headerSize;
+
+    if (blockSize > LZ4_MAX_INPUT_SIZE) return 0;
+    nbBlocks = LZ4MT_nbBlocks(srcSize, (U32)blockSize);
+    if (nbBlocks > 0xFFFFFFFEU) return 0;
+    headerSize = LZ4MT_HEADERSIZE(nbBlocks);
+    if (dstCapacity < headerSize) return 0;
+
+    memset(&cctx, 0, sizeof(cctx));
+    cctx.src = (const BYTE*)src;
+    cctx.srcSize = srcSize;
+    cctx.dst = (BYTE*)dst;
+    cctx.dstCapacity = dstCapacity;
+    cctx.blockSize = (U32)blockSize;
+    cctx.nbBlocks = (U32)nbBlocks;
+    cctx.acceleration = params ? params->acceleration : 0;
+    cctx.linked = params ? (params->linkedBlocks != 0) : 0;
+    cctx.dstPos = headerSize;
+
+    if (LZ4MT_mutex_init(&cctx.mutex)) return 0;
+    if (LZ4MT_cond_init(&cctx.committed)) {
+        LZ4MT_mutex_destroy(&cctx.mutex);
+        return 0;
+    }
+    if (cctx.nbBlocks)
+        LZ4MT_runWorkers(LZ4MT_compressWorker, &cctx,
+                         LZ4MT_clampWorkers(params ? params->nbWorkers : 1, cctx.nbBlocks));
+    LZ4MT_cond_destroy(&cctx.committed);
+    LZ4MT_mutex_destroy(&cctx.mutex);
+    if (cctx.error || cctx.nextCommit != cctx.nbBlocks) return 0;
+
+    LZ4MT_writeLE32(cctx.dst,      LZ4MT_MAGICNUMBER);
+    LZ4MT_writeLE32(cctx.dst + 4,  cctx.linked ? LZ4MT_FLAG_LINKED : 0);
+    LZ4MT_writeLE32(cctx.dst + 8,  cctx.blockSize);
+    LZ4MT_writeLE32(cctx.dst + 12, cctx.nbBlocks);
+    LZ4MT_writeLE64(cctx.dst + 16, srcSize);
+    LZ4MT_writeLE64(cctx.dst + 24 + 8 * (size_t)cctx.nbBlocks, cctx.dstPos);
+    return cctx.dstPos;
+}
+
+
+/*-************************************
+*  Decompression
+**************************************/
+int LZ4MT_getFrameInfo(LZ4MT_frameInfo_t* info, const void* src, size_t srcSize)
+{
+    const BYTE* const p = (const BYTE*)src;
+    U64 contentSize, prev;
+    U32 blockSize, nbBlocks, n;
+    size_t headerSize;
+
+    if (srcSize < LZ4MT_HEADERSIZE_MIN) return -1;
+    if (LZ4MT_readLE32(p) != LZ4MT_MAGICNUMBER) return -1;
+    if (LZ4MT_readLE32(p + 4) & ~(U32)LZ4MT_FLAG_LINKED) return -1;   /* unknown flags */
+    blockSize = LZ4MT_readLE32(p + 8);
+    nbBlocks = LZ4MT_readLE32(p + 12);
+    contentSize = LZ4MT_readLE64(p + 16);
+    if (blockSize == 0 || blockSize > LZ4_MAX_INPUT_SIZE) return -1;
+    if (nbBlocks != LZ4MT_nbBlocks(contentSize, blockSize)) return -1;
+    headerSize = LZ4MT_HEADERSIZE(nbBlocks);
+    if (srcSize < headerSize) return -1;
+
+    /* offsets must be increasing, and no block may be larger than its content */
+    prev = headerSize;
+    for (n = 0; n <= nbBlocks; n++) {
+        U64 const off = LZ4MT_readLE64(p + 24 + 8 * (size_t)n);
+        if (n == 0 ? off != headerSize : (off < prev || off - prev > blockSize)) return -1;
+        prev = off;
+    }
+    if (prev > srcSize) return -1;
+
+    info->contentSize = contentSize;
+    info->frameSize = (size_t)prev;
+    info->headerSize = headerSize;
+    info->blockSize = blockSize;
+    info->nbBlocks = nbBlocks;
+    info->linkedBlocks = (LZ4MT_readLE32(p + 4) & LZ4MT_FLAG_LINKED) != 0;
+    return 0;
+}
+
+/* LZ4MT_decodeBlock() :
+ * `info` must be valid for `src`. `dictSize` bytes before `dst` are the dictionary (linked blocks).
+ * @return : decompressed size, or <0 on error */
+static int LZ4MT_decodeBlock(const LZ4MT_frameInfo_t* info, const BYTE* src, U32 n,
+                             char* dst, int dstCapacity, const char* dictStart, int dictSize)
+{
+    U64 const start = (U64)n * info->blockSize;
+    int const blockLen = (int)((info->contentSize - start) < info->blockSize ? (info->contentSize - start) : info->blockSize);
+    U64 const off = LZ4MT_readLE64(src + 24 + 8 * (size_t)n);
+    int const cSize = (int)(LZ4MT_readLE64(src + 24 + 8 * (size_t)n + 8) - off);
+
+    if (dstCapacity < blockLen) return -1;
+    if (cSize == blockLen) {
+        memcpy(dst, src + off, (size_t)blockLen);
+        return blockLen;
+    }
+    {   int const r = (info->linkedBlocks && dictSize > 0) ?
+            LZ4_decompress_safe_usingDict((const char*)src + off, dst, cSize, blockLen, dictStart, dictSize) :
+            LZ4_decompress_safe((const char*)src + off, dst, cSize, blockLen);
+        return r == blockLen ? blockLen : -1;
+    }
+}
+
+int LZ4MT_decompressBlock(const void* src, size_t srcSize, unsigned blockIndex,
+                          char* dst, int dstCapacity, const char* dictStart, int dictSize)
+{
+    LZ4MT_frameInfo_t info;
+    if (LZ4MT_getFrameInfo(&info, src, srcSize)) return -1;
+    if (blockIndex >= info.nbBlocks) return -1;
+    if (dictSize < 0 || (dictSize > 0 && dictStart == NULL)) return -1;
+    if (info.linkedBlocks && blockIndex > 0 && dictSize == 0) return -1;   /* missing dictionary */
+    return LZ4MT_decodeBlock(&info, (const BYTE*)src, blockIndex, dst, dstCapacity, dictStart, dictSize);
+}
+
+typedef struct {
+    const LZ4MT_frameInfo_t* info;
+    const BYTE* src;
+    char* dst;
+    LZ4MT_mutex_t mutex;
+    U32 nextJob;
+    int error;
+} LZ4MT_dctx_t;
+
+static void* LZ4MT_decompressWorker(void* ctx)
+{
+    LZ4MT_dctx_t* const dctx = (LZ4MT_dctx_t*)ctx;
+    const LZ4MT_frameInfo_t* const info = dctx->info;
+    while (1) {
+        U32 job;
+        size_t start;
+        LZ4MT_mutex_lock(&dctx->mutex);
+        if (dctx->error || dctx->nextJob == info->nbBlocks) {
+            LZ4MT_mutex_unlock(&dctx->mutex);
+            break;
+        }
+        job = dctx->nextJob++;
+        LZ4MT_mutex_unlock(&dctx->mutex);
+
+        start = (size_t)job * info->blockSize;
+        if (LZ4MT_decodeBlock(info, dctx->src, job, dctx->dst + start, (int)info->blockSize, NULL, 0) < 0) {
+            LZ4MT_mutex_lock(&dctx->mutex);
+            dctx->error = 1;
+            LZ4MT_mutex_unlock(&dctx->mutex);
+        }
+    }
+    return NULL;
+}
+
+long long LZ4MT_decompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity, int nbWorkers)
+{
+    LZ4MT_frameInfo_t info;
+    if (LZ4MT_getFrameInfo(&info, src, srcSize)) return -1;
+    if (info.contentSize > dstCapacity) return -1;
+
+    if (info.linkedBlocks) {
+        /* each block needs the end of the previous one : decode in order */
+        U32 n;
+        for (n = 0; n < info.nbBlocks; n++) {
+            size_t const start = (size_t)n * info.blockSize;
+            int const dictSize = start < 64 KB ? (int)start : 64 KB;
+            char* const blockDst = (char*)dst + start;
+            if (LZ4MT_decodeBlock(&info, (const BYTE*)src, n, blockDst, (int)info.blockSize,
+                                  blockDst - dictSize, dictSize) < 0)
+                return -1;
+        }
+    } else {
+        LZ4MT_dctx_t dctx;
+        memset(&dctx, 0, sizeof(dctx));
+        dctx.info = &info;
+        dctx.src = (const BYTE*)src;
+        dctx.dst = (char*)dst;
+        if (LZ4MT_mutex_init(&dctx.mutex)) return -1;
+        LZ4MT_runWorkers(LZ4MT_decompressWorker, &dctx, LZ4MT_clampWorkers(nbWorkers, info.nbBlocks));
+        LZ4MT_mutex_destroy(&dctx.mutex);
+        if (dctx.error) return -1;
+    }
+    return (long long)info.contentSize;
+}
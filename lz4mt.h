@@ -0,0 +1,115 @@
+/*
+   LZ4mt - block-parallel front-end for LZ4
+   Header File
+   See lz4mt.c.
+*/
+#ifndef LZ4MT_H_98237428734687
+#define LZ4MT_H_98237428734687
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * lz4mt.h splits a large input into blocks of fixed size and compresses
+ * them on several threads, each with its own LZ4_stream_t.
+ * The result is a single frame, which starts with an index of block offsets,
+ * so that blocks can be decompressed in parallel, or one at a time (seek).
+ *
+ * Frame layout (all fields little-endian) :
+ *   magic number     : 4 bytes (LZ4MT_MAGICNUMBER)
+ *   flags            : 4 bytes (bit 0 : linked blocks)
+ *   block size       : 4 bytes
+ *   number of blocks : 4 bytes
+ *   content size     : 8 bytes
+ *   block offsets    : (nbBlocks+1) x 8 bytes, from the start of the frame;
+ *                      the last one is the frame size.
+ *   blocks           : LZ4 raw blocks. A block whose compressed size equals
+ *                      its decompressed size is stored uncompressed.
+ *
+ * Block n holds content bytes [n*blockSize, (n+1)*blockSize).
+ * Blocks are independent by default. Linked blocks reference up to 64 KB
+ * of the content preceding them (see LZ4_loadDict()) : ratio is better,
+ * but decompressing a block requires the end of the previous one.
+ */
+
+#include <stddef.h>   /* size_t */
+
+
+/*-************************************
+*  Constants
+**************************************/
+#define LZ4MT_MAGICNUMBER         0x5A4D344C   /* "L4MZ" */
+#define LZ4MT_HEADERSIZE_MIN      32
+#define LZ4MT_BLOCKSIZE_DEFAULT   (4 << 20)
+#define LZ4MT_NBWORKERS_MAX       256
+
+/*! LZ4MT_HEADERSIZE() :
+ *  Size of frame header and block index for `nbBlocks` blocks. */
+#define LZ4MT_HEADERSIZE(nbBlocks) (24 + 8 * ((size_t)(nbBlocks) + 1))
+
+
+/*-************************************
+*  Compression
+**************************************/
+typedef struct {
+    int blockSize;       /* input bytes per block; 0 = LZ4MT_BLOCKSIZE_DEFAULT */
+    int nbWorkers;       /* compression threads; 0 or 1 = calling thread only */
+    int acceleration;    /* see LZ4_compress_fast(); 0 = default */
+    int linkedBlocks;    /* 1 = blocks may reference the previous 64 KB of content */
+} LZ4MT_params_t;
+
+/*! LZ4MT_compressBound() :
+ *  Maximum frame size for `srcSize` bytes of input.
+ *  Incompressible blocks are stored raw, so this is the input size plus the index.
+ *  `params` may be NULL (default parameters). */
+size_t LZ4MT_compressBound(size_t srcSize, const LZ4MT_params_t* params);
+
+/*! LZ4MT_compress() :
+ *  Compresses `srcSize` bytes from `src` into a frame in `dst`,
+ *  using `params->nbWorkers` threads (the calling thread included).
+ *  Compression is guaranteed to succeed if `dstCapacity >= LZ4MT_compressBound(srcSize, params)`.
+ *  @return : frame size, or 0 if compression fails (argument error, `dst` too small, allocation error) */
+size_t LZ4MT_compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity, const LZ4MT_params_t* params);
+
+
+/*-************************************
+*  Decompression
+**************************************/
+typedef struct {
+    unsigned long long contentSize;
+    size_t   frameSize;
+    size_t   headerSize;
+    unsigned blockSize;
+    unsigned nbBlocks;
+    int      linkedBlocks;
+} LZ4MT_frameInfo_t;
+
+/*! LZ4MT_getFrameInfo() :
+ *  Reads and validates frame header and block index.
+ *  @return : 0 on success, or a negative value if `src` is not a valid frame. */
+int LZ4MT_getFrameInfo(LZ4MT_frameInfo_t* info, const void* src, size_t srcSize);
+
+/*! LZ4MT_decompress() :
+ *  Decompresses a whole frame into `dst`.
+ *  Independent blocks are decoded on `nbWorkers` threads;
+ *  linked blocks depend on each other and are decoded by the calling thread.
+ *  @return : content size, or a negative value if the frame is malformed or `dst` is too small.
+ *  Never writes outside of `dst`. */
+long long LZ4MT_decompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity, int nbWorkers);
+
+/*! LZ4MT_decompressBlock() :
+ *  Decompresses block `blockIndex` alone into `dst`.
+ *  Its content starts at offset `blockIndex * blockSize`.
+ *  For linked blocks, `dictStart` must point to the content just before the block
+ *  (up to 64 KB, `dictSize` bytes), or be NULL for block 0. It is ignored for independent blocks.
+ *  @return : decompressed size of the block, or a negative value on error. */
+int LZ4MT_decompressBlock(const void* src, size_t srcSize, unsigned blockIndex,
+                          char* dst, int dstCapacity, const char* dictStart, int dictSize);
+
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif /* LZ4MT_H_98237428734687 */
@@ -1,13 +1,34 @@
-// build: g++ recursive.cpp -o recursive -std=c++11
+// build: g++ nested_map_recursive.cpp -o nested_map -std=c++11 -O2 -pthread
+//
+//   ./nested_map              numbers the sample catalog and prints it
+//   ./nested_map N [threads] [file]
+//                             numbers a generated catalog of N lessons,
+//                             sequentially, in parallel and flattened, and
+//                             times them; with a file, also saves the flat
+//                             catalog to it and numbers it mapped from there
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <map>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 struct Lesson
 {
   Lesson(std::string name)
-    : name(name) {}
+    : name(std::move(name)) {}
 
   std::string name;
   unsigned int position{0};
@@ -18,7 +39,7 @@ using Lessons = std::vector<Lesson>;
 struct Section
 {
   Section(std::string title, bool reset, Lessons lessons)
-    : title(title), reset_lesson_position(reset), lessons(lessons) {}
+    : title(std::move(title)), reset_lesson_position(reset), lessons(std::move(lessons)) {}
 
   std::string title;
   bool reset_lesson_position;
@@ -28,31 +49,454 @@ struct Section
 
 using Sections = std::vector<Section>;
 
-int calculateLessons(Lessons lessons, unsigned int lesson_position, unsigned int lesson_counter){
-    if (lessons.size() == lesson_position)
-        return lesson_counter;
+// Numbers the lessons in place, starting with lesson_counter.
+// Returns the number of the lesson that would follow.
+unsigned int calculateLessons(Lessons& lessons, unsigned int lesson_counter){
+    for (auto& lesson : lessons)
+        lesson.position = lesson_counter++;
+
+    return lesson_counter;
+}
+
+// Numbers the sections from 1, and the lessons from 1 across all sections,
+// starting over at each section with reset_lesson_position.
+void calculate(Sections& sections){
+    unsigned int lesson_counter = 1;
 
-    lessons[lesson_position].position = lesson_counter;
+    for (std::size_t i = 0; i < sections.size(); i++) {
+        auto& section = sections[i];
+        if (section.reset_lesson_position)
+            lesson_counter = 1;
 
-    return calculateLessons(lessons, lesson_position+1, lesson_counter+1);
+        section.position = static_cast<unsigned int>(i + 1);
+        lesson_counter = calculateLessons(section.lessons, lesson_counter);
+    }
 }
 
-void calculate(Sections sections, unsigned int section_counter, unsigned int lesson_counter){
-    if (sections.size() == section_counter)
+// Same as calculate, on several threads. The lesson numbers are a prefix sum
+// of the lesson counts of the sections, in segments that start at the
+// sections with reset_lesson_position:
+//   1. the sections are split into chunks of about as many lessons each;
+//   2. each thread sums its chunk, from its last reset if it has one;
+//   3. the carry into each chunk follows from the sums of the chunks before;
+//   4. each thread numbers its chunk, starting from its carry.
+void calculateParallel(Sections& sections, unsigned int threads){
+    if (threads < 2 || sections.size() < 2 * threads) {
+        calculate(sections);
         return;
-    
-    if (sections[section_counter].reset_lesson_position)
-        lesson_counter = 1;
-    
-    sections[section_counter].position = section_counter + 1;
+    }
+
+    std::size_t total = 0;
+    for (const auto& section : sections)
+        total += section.lessons.size();
+
+    // Chunk k holds sections [bounds[k], bounds[k+1]).
+    std::vector<std::size_t> bounds{0};
+    std::size_t seen = 0;
+    for (std::size_t i = 0; i < sections.size() && bounds.size() < threads; i++) {
+        seen += sections[i].lessons.size();
+        if (seen * threads >= total * bounds.size())
+            bounds.push_back(i + 1);
+    }
+    if (bounds.back() != sections.size())
+        bounds.push_back(sections.size());
+    std::size_t chunks = bounds.size() - 1;
+
+    struct Carry
+    {
+        unsigned int sum{0};  // lessons after the last reset, or all of them
+        bool reset{false};    // the chunk has a reset section
+    };
+    std::vector<Carry> carries(chunks);
+    std::vector<std::thread> workers;
+
+    for (std::size_t k = 0; k < chunks; k++) {
+        workers.emplace_back([&sections, &bounds, &carries, k]{
+            Carry carry;
+            for (std::size_t i = bounds[k]; i < bounds[k + 1]; i++) {
+                if (sections[i].reset_lesson_position) {
+                    carry.sum = 0;
+                    carry.reset = true;
+                }
+                carry.sum += static_cast<unsigned int>(sections[i].lessons.size());
+            }
+            carries[k] = carry;
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+
+    std::vector<unsigned int> first(chunks);
+    unsigned int lesson_counter = 1;
+    for (std::size_t k = 0; k < chunks; k++) {
+        first[k] = lesson_counter;
+        lesson_counter = carries[k].reset ? 1 + carries[k].sum
+                                          : lesson_counter + carries[k].sum;
+    }
 
-    lesson_counter = calculateLessons(sections[section_counter].lessons, 0, lesson_counter);
+    for (std::size_t k = 0; k < chunks; k++) {
+        workers.emplace_back([&sections, &bounds, &first, k]{
+            unsigned int counter = first[k];
+            for (std::size_t i = bounds[k]; i < bounds[k + 1]; i++) {
+                auto& section = sections[i];
+                if (section.reset_lesson_position)
+                    counter = 1;
 
-    return calculate(sections, section_counter+1, lesson_counter);
+                section.position = static_cast<unsigned int>(i + 1);
+                counter = calculateLessons(section.lessons, counter);
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
 }
 
-int main()
+// The same catalog, flattened into columns of one contiguous image:
+//   header
+//   first_lesson[sections + 1]   lessons of section s are
+//                                [first_lesson[s], first_lesson[s + 1])
+//   title_offset[sections], title_size[sections]
+//   section_position[sections]
+//   reset[sections]
+//   name_offset[lessons], name_size[lessons]
+//   lesson_position[lessons]
+//   arena                        titles and names, each stored once
+// The columns start at multiples of 64 bytes. The image is the same in
+// memory and in a file, so a saved catalog can be mapped and used as is.
+class FlatCatalog
 {
+public:
+  FlatCatalog() = default;
+  FlatCatalog(FlatCatalog&& other) { *this = std::move(other); }
+  FlatCatalog& operator=(FlatCatalog&& other);
+  FlatCatalog(const FlatCatalog&) = delete;
+  FlatCatalog& operator=(const FlatCatalog&) = delete;
+  ~FlatCatalog() { unmap(); }
+
+  static FlatCatalog build(const Sections& sections);
+
+  // Maps a file written by save. The mapping is private, so positions may be
+  // calculated in place without changing the file.
+  static bool map(const char* path, FlatCatalog& catalog);
+  bool save(const char* path) const;
+
+  std::uint32_t sectionCount() const { return header()->sections; }
+  std::uint32_t lessonCount() const { return header()->lessons; }
+
+  std::uint32_t* first_lesson;
+  std::uint32_t* title_offset;
+  std::uint32_t* title_size;
+  std::uint32_t* section_position;
+  std::uint8_t*  reset;
+  std::uint32_t* name_offset;
+  std::uint32_t* name_size;
+  std::uint32_t* lesson_position;
+  char*          arena;
+
+  std::string title(std::uint32_t s) const { return std::string(arena + title_offset[s], title_size[s]); }
+  std::string name(std::uint32_t l) const { return std::string(arena + name_offset[l], name_size[l]); }
+
+private:
+  struct Header
+  {
+    char magic[8];            // "flatcat"
+    std::uint32_t sections;
+    std::uint32_t lessons;
+    std::uint64_t arena_size;
+    std::uint64_t size;       // of the whole image
+  };
+
+  struct Layout
+  {
+    std::uint64_t first_lesson, title_offset, title_size, section_position, reset;
+    std::uint64_t name_offset, name_size, lesson_position, arena, size;
+  };
+
+  static std::uint64_t align(std::uint64_t n) { return (n + 63) / 64 * 64; }
+  static Layout layout(std::uint64_t sections, std::uint64_t lessons, std::uint64_t arena_size);
+
+  const Header* header() const { return reinterpret_cast<const Header*>(base_); }
+  void attach(char* base);
+  void unmap();
+
+  std::vector<std::uint64_t> owned_;  // the image, unless mapped
+  char* base_{nullptr};
+  std::size_t mapped_{0};             // size of the mapping
+};
+
+FlatCatalog::Layout FlatCatalog::layout(std::uint64_t sections, std::uint64_t lessons,
+                                        std::uint64_t arena_size){
+    Layout l;
+    l.first_lesson     = align(sizeof(Header));
+    l.title_offset     = align(l.first_lesson + 4 * (sections + 1));
+    l.title_size       = align(l.title_offset + 4 * sections);
+    l.section_position = align(l.title_size + 4 * sections);
+    l.reset            = align(l.section_position + 4 * sections);
+    l.name_offset      = align(l.reset + sections);
+    l.name_size        = align(l.name_offset + 4 * lessons);
+    l.lesson_position  = align(l.name_size + 4 * lessons);
+    l.arena            = align(l.lesson_position + 4 * lessons);
+    l.size             = align(l.arena + arena_size);
+    return l;
+}
+
+void FlatCatalog::attach(char* base){
+    base_ = base;
+    const Header* h = header();
+    Layout l = layout(h->sections, h->lessons, h->arena_size);
+    first_lesson     = reinterpret_cast<std::uint32_t*>(base + l.first_lesson);
+    title_offset     = reinterpret_cast<std::uint32_t*>(base + l.title_offset);
+    title_size       = reinterpret_cast<std::uint32_t*>(base + l.title_size);
+    section_position = reinterpret_cast<std::uint32_t*>(base + l.section_position);
+    reset            = reinterpret_cast<std::uint8_t*>(base + l.reset);
+    name_offset      = reinterpret_cast<std::uint32_t*>(base + l.name_offset);
+    name_size        = reinterpret_cast<std::uint32_t*>(base + l.name_size);
+    lesson_position  = reinterpret_cast<std::uint32_t*>(base + l.lesson_position);
+    arena            = base + l.arena;
+}
+
+void FlatCatalog::unmap(){
+    if (mapped_)
+        munmap(base_, mapped_);
+    mapped_ = 0;
+    base_ = nullptr;
+}
+
+FlatCatalog& FlatCatalog::operator=(FlatCatalog&& other){
+    if (this != &other) {
+        unmap();
+        owned_ = std::move(other.owned_);
+        mapped_ = other.mapped_;
+        other.mapped_ = 0;
+        if (other.base_)
+            attach(mapped_ ? other.base_ : reinterpret_cast<char*>(owned_.data()));
+        other.base_ = nullptr;
+    }
+    return *this;
+}
+
+FlatCatalog FlatCatalog::build(const Sections& sections){
+    // Intern the strings first, to know the size of the arena.
+    std::string strings;
+    std::unordered_map<std::string, std::uint32_t> interned;
+    auto intern = [&](const std::string& s){
+        auto it = interned.find(s);
+        if (it != interned.end())
+            return it->second;
+        auto offset = static_cast<std::uint32_t>(strings.size());
+        strings += s;
+        interned.emplace(s, offset);
+        return offset;
+    };
+
+    std::vector<std::uint32_t> titles, names;
+    std::size_t lessons = 0;
+    for (const auto& section : sections) {
+        titles.push_back(intern(section.title));
+        for (const auto& lesson : section.lessons)
+            names.push_back(intern(lesson.name));
+        lessons += section.lessons.size();
+    }
+
+    Layout l = layout(sections.size(), lessons, strings.size());
+    FlatCatalog catalog;
+    catalog.owned_.assign(l.size / 8, 0);
+    char* base = reinterpret_cast<char*>(catalog.owned_.data());
+    Header h;
+    std::memcpy(h.magic, "flatcat", 8);
+    h.sections = static_cast<std::uint32_t>(sections.size());
+    h.lessons = static_cast<std::uint32_t>(lessons);
+    h.arena_size = strings.size();
+    h.size = l.size;
+    std::memcpy(base, &h, sizeof(h));
+    catalog.attach(base);
+
+    std::uint32_t lesson = 0;
+    for (std::size_t s = 0; s < sections.size(); s++) {
+        const auto& section = sections[s];
+        catalog.first_lesson[s] = lesson;
+        catalog.title_offset[s] = titles[s];
+        catalog.title_size[s] = static_cast<std::uint32_t>(section.title.size());
+        catalog.section_position[s] = section.position;
+        catalog.reset[s] = section.reset_lesson_position;
+        for (const auto& item : section.lessons) {
+            catalog.name_offset[lesson] = names[lesson];
+            catalog.name_size[lesson] = static_cast<std::uint32_t>(item.name.size());
+            catalog.lesson_position[lesson] = item.position;
+            lesson++;
+        }
+    }
+    catalog.first_lesson[sections.size()] = lesson;
+    std::memcpy(catalog.arena, strings.data(), strings.size());
+    return catalog;
+}
+
+bool FlatCatalog::save(const char* path) const{
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(base_, header()->size, 1, file) == 1;
+    return std::fclose(file) == 0 && ok;
+}
+
+bool FlatCatalog::map(const char* path, FlatCatalog& catalog){
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    // Check that every column fits, and that the lesson ranges and the
+    // strings stay within their columns.
+    const Header* h = static_cast<const Header*>(base);
+    bool ok = std::memcmp(h->magic, "flatcat", 8) == 0 && h->size == size &&
+              h->arena_size <= size &&
+              layout(h->sections, h->lessons, h->arena_size).size == size;
+    FlatCatalog mapped;
+    mapped.mapped_ = size;
+    mapped.attach(static_cast<char*>(base));
+    for (std::uint32_t s = 0; ok && s < h->sections; s++) {
+        ok = mapped.first_lesson[s] <= mapped.first_lesson[s + 1] &&
+             mapped.title_offset[s] <= h->arena_size &&
+             mapped.title_size[s] <= h->arena_size - mapped.title_offset[s];
+    }
+    ok = ok && mapped.first_lesson[0] == 0 && mapped.first_lesson[h->sections] == h->lessons;
+    for (std::uint32_t l = 0; ok && l < h->lessons; l++) {
+        ok = mapped.name_offset[l] <= h->arena_size &&
+             mapped.name_size[l] <= h->arena_size - mapped.name_offset[l];
+    }
+    if (!ok)
+        return false;
+    catalog = std::move(mapped);
+    return true;
+}
+
+// calculate on the flat catalog: one pass over the columns, where the lesson
+// positions of a section are a run of consecutive numbers.
+void calculate(FlatCatalog& catalog){
+    const std::uint32_t sections = catalog.sectionCount();
+    const std::uint32_t* first = catalog.first_lesson;
+    const std::uint8_t* reset = catalog.reset;
+    std::uint32_t* section_position = catalog.section_position;
+    std::uint32_t* lesson_position = catalog.lesson_position;
+    std::uint32_t lesson_counter = 1;
+
+    for (std::uint32_t s = 0; s < sections; s++) {
+        if (reset[s])
+            lesson_counter = 1;
+
+        section_position[s] = s + 1;
+        const std::uint32_t begin = first[s], end = first[s + 1];
+        const std::uint32_t base = lesson_counter - begin;
+        for (std::uint32_t l = begin; l < end; l++)
+            lesson_position[l] = base + l;
+        lesson_counter += end - begin;
+    }
+}
+
+// A catalog of about `lessons` lessons, 10 to a section, with a reset every
+// 100 sections.
+Sections generate(std::size_t lessons){
+    Sections sections;
+    sections.reserve(lessons / 10 + 1);
+
+    for (std::size_t i = 0; i * 10 < lessons; i++) {
+        Lessons section_lessons;
+        section_lessons.reserve(10);
+        for (std::size_t j = 0; j < 10 && i * 10 + j < lessons; j++)
+            section_lessons.emplace_back("Lesson " + std::to_string(i * 10 + j));
+
+        sections.emplace_back("Section " + std::to_string(i), i % 100 == 99,
+                              std::move(section_lessons));
+    }
+    return sections;
+}
+
+bool samePositions(const Sections& a, const Sections& b){
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (a[i].position != b[i].position)
+            return false;
+        for (std::size_t j = 0; j < a[i].lessons.size(); j++) {
+            if (a[i].lessons[j].position != b[i].lessons[j].position)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool samePositions(const Sections& a, const FlatCatalog& b){
+    std::uint32_t lesson = 0;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (a[i].position != b.section_position[i])
+            return false;
+        for (const auto& item : a[i].lessons) {
+            if (item.position != b.lesson_position[lesson++])
+                return false;
+        }
+    }
+    return true;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        std::size_t lessons = std::strtoul(argv[1], nullptr, 10);
+        unsigned int threads = argc > 2 ? std::atoi(argv[2])
+                                        : std::max(2u, std::thread::hardware_concurrency());
+        Sections a = generate(lessons);
+        Sections b = a;
+        FlatCatalog flat = FlatCatalog::build(a);
+
+        auto start = std::chrono::steady_clock::now();
+        calculate(a);
+        double sequential = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        calculateParallel(b, threads);
+        double parallel = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        calculate(flat);
+        double flattened = secondsSince(start);
+
+        bool ok = samePositions(a, b) && samePositions(a, flat);
+        std::printf("lessons=%zu sections=%zu threads=%u sequential=%.2fms parallel=%.2fms"
+                    " flat=%.2fms %s\n",
+                    lessons, a.size(), threads, sequential * 1e3, parallel * 1e3,
+                    flattened * 1e3, ok ? "ok" : "MISMATCH");
+
+        if (argc > 3) {
+            FlatCatalog mapped;
+            if (!FlatCatalog::build(generate(lessons)).save(argv[3]) ||
+                !FlatCatalog::map(argv[3], mapped)) {
+                std::fprintf(stderr, "cannot save or map %s\n", argv[3]);
+                return 1;
+            }
+            start = std::chrono::steady_clock::now();
+            calculate(mapped);
+            double mapped_time = secondsSince(start);
+            bool same = samePositions(a, mapped) &&
+                        (lessons == 0 || mapped.name(mapped.lessonCount() - 1) ==
+                         a.back().lessons.back().name);
+            ok = ok && same;
+            std::printf("mapped=%.2fms %s\n", mapped_time * 1e3, same ? "ok" : "MISMATCH");
+        }
+        return ok ? 0 : 1;
+    }
+
     auto sections = Sections{
     {"Getting started", false,
         {
@@ -74,10 +518,13 @@ int main()
     }
     };
 
-    unsigned int section_counter = 1;
-    unsigned int lesson_counter = 1;
+    calculate(sections);
 
-    calculate(sections, section_counter, lesson_counter);
+    for (const auto& section : sections) {
+        std::printf("%u. %s\n", section.position, section.title.c_str());
+        for (const auto& lesson : section.lessons)
+            std::printf("   %u. %s\n", lesson.position, lesson.name.c_str());
+    }
 
     return 0;
 }
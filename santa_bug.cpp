@@ -1,17 +1,40 @@
 /*
     Compile with:
-      clang++ -std=c++20 -stdlib=libc++ -o santa santa_bug.cpp
+      clang++ -std=c++20 -stdlib=libc++ -O2 -pthread -o santa santa_bug.cpp
     or
-      g++ -std=c++20 -o santa santa_bug.cpp
+      g++ -std=c++20 -O2 -pthread -o santa santa_bug.cpp
+
+    Run:
+      ./santa [pace_ms]                the story; each thread pauses pace_ms
+                                       (default 500, 0 for none) after it logs
+      ./santa bench [elves] [seconds]  rendezvous throughput, no sleeps
+      ./santa logbench [threads] [lines] > /dev/null
+                                       logging throughput
+      ./santa sim [options]            the story as coroutines on a pool of
+                                       worker threads; ./santa sim --help
+                                       lists the options. For instance:
+      ./santa sim --workers 16 --workshops 10000 --reindeer 90000 --elves 1000000
 */
 
 #include <iostream>
 #include <thread>
 #include <semaphore>
 #include <mutex>
+#include <coroutine>
+#include <deque>
+#include <cerrno>
+#include <atomic>
 #include <chrono>
 #include <vector>
 #include <random>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cstdio>
+#include <unistd.h>
 
 //
 // ------------------------------------------------------------
@@ -27,136 +50,429 @@ constexpr int REINDEER_VACATION_ROUNDS = 2;
 
 constexpr double SLOWDOWN_FACTOR = 10.0;
 
+// Default pause after every logged line, taken by the thread that logs
+constexpr int PRINT_PAUSE_MS = 500;
+
+// Log ring: number of records (a power of two) and bytes per record
+constexpr uint32_t LOG_RECORDS     = 4096;
+constexpr uint32_t LOG_RECORD_SIZE = 128;
+constexpr size_t   LOG_BATCH_BYTES = 64 * 1024;
+
+// Benchmark defaults
+constexpr int BENCH_ELVES   = 2000;
+constexpr int BENCH_SECONDS = 2;
+
 //
 // ------------------------------------------------------------
-// Shared State
+// GroupBarrier: a phased group rendezvous
+// ------------------------------------------------------------
+//
+// Threads arrive one at a time and are put into groups of `groupSize`, in
+// arrival order, by an atomic arrival counter. The thread that completes a
+// group is told so, and wakes the leader. The leader serves the groups in
+// order: admit() lets the members of the group in, and dismiss() lets them
+// go, which ends the service of that group.
+//
+// Each group waits on one 32-bit phase cell of a small ring, so that admitting
+// or dismissing a group is a single atomic store and one notify_all (one
+// futex wake) that reaches the members of that group, and not every thread
+// that is blocked on the barrier. A cell is shared by the groups that are
+// `cells` apart, and counts two phases per group.
+//
+// Arrivals never block: a thread that arrives while a group is being served
+// simply joins a later group. Because every member waits for the phase of its
+// own group, a wake-up can't be taken by a thread of another group, no matter
+// how late the member starts waiting.
+//
+// close() wakes every waiter and makes the waits return false, for shutdown.
+class GroupBarrier
+{
+public:
+    struct Ticket
+    {
+        uint64_t group;  // group number, in arrival order
+        bool     last;   // this arrival completed the group
+    };
+
+    explicit GroupBarrier(uint32_t groupSize, uint32_t cells = 256)
+        : groupSize_(groupSize), ncells_(cells),
+          cells_(std::make_unique<std::atomic<uint32_t>[]>(cells))
+    {
+        for (uint32_t i = 0; i < ncells_; i++) {
+            cells_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Join the next group.
+    Ticket arrive()
+    {
+        uint64_t a = arrivals_.fetch_add(1, std::memory_order_acq_rel);
+        return Ticket{a / groupSize_, a % groupSize_ == groupSize_ - 1};
+    }
+
+    // Wait until the leader admits the group.
+    // Returns false if the barrier was closed first.
+    bool awaitAdmission(const Ticket &t) { return await(t.group, 1); }
+
+    // Wait until the leader dismisses the group.
+    // Returns false if the barrier was closed first.
+    bool awaitDismissal(const Ticket &t) { return await(t.group, 2); }
+
+    // Leader side: true if the next group to serve is complete.
+    bool groupReady() const
+    {
+        return arrivals_.load(std::memory_order_acquire) >=
+               (served_.load(std::memory_order_relaxed) + 1) * groupSize_;
+    }
+
+    // Leader side: admit the next group.
+    void admit() { advance(served_.load(std::memory_order_relaxed)); }
+
+    // Leader side: dismiss the admitted group, and move on to the next one.
+    void dismiss()
+    {
+        uint64_t group = served_.load(std::memory_order_relaxed);
+        served_.store(group + 1, std::memory_order_release);
+        advance(group);
+    }
+
+    // Number of arrivals in the group that is not complete yet.
+    uint64_t pending() const
+    {
+        return arrivals_.load(std::memory_order_acquire) % groupSize_;
+    }
+
+    // Wake all waiters, whose waits then return false.
+    void close()
+    {
+        for (uint32_t i = 0; i < ncells_; i++) {
+            cells_[i].fetch_or(CLOSED, std::memory_order_acq_rel);
+            cells_[i].notify_all();
+        }
+    }
+
+private:
+    static constexpr uint32_t CLOSED = 0x80000000u;  // rest is the phase count
+    static constexpr uint32_t PHASE  = 0x7FFFFFFFu;
+
+    // The phase that the cell of the group reaches when it has been admitted
+    // (step 1) or dismissed (step 2).
+    uint32_t target(uint64_t group, uint32_t step) const
+    {
+        return static_cast<uint32_t>((group / ncells_) * 2 + step) & PHASE;
+    }
+
+    static bool reached(uint32_t v, uint32_t target)
+    {
+        // Phases wrap around, so compare their distance.
+        return ((v - target) & PHASE) < (PHASE / 2);
+    }
+
+    bool await(uint64_t group, uint32_t step)
+    {
+        std::atomic<uint32_t> &cell = cells_[group % ncells_];
+        uint32_t t = target(group, step);
+        uint32_t v = cell.load(std::memory_order_acquire);
+        while (!reached(v, t)) {
+            if (v & CLOSED) {
+                return false;
+            }
+            cell.wait(v, std::memory_order_acquire);
+            v = cell.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    void advance(uint64_t group)
+    {
+        std::atomic<uint32_t> &cell = cells_[group % ncells_];
+        uint32_t v = cell.load(std::memory_order_relaxed);
+        // Only the leader advances, but close() may set its bit meanwhile.
+        while (!cell.compare_exchange_weak(v, (v & CLOSED) | ((v + 1) & PHASE),
+                                           std::memory_order_acq_rel)) {
+        }
+        cell.notify_all();
+    }
+
+    const uint32_t groupSize_;
+    const uint32_t ncells_;
+    std::unique_ptr<std::atomic<uint32_t>[]> cells_;
+    alignas(64) std::atomic<uint64_t> arrivals_{0};
+    alignas(64) std::atomic<uint64_t> served_{0};
+};
+
+//
 // ------------------------------------------------------------
+// AsyncLog: lock-free logging with a writer thread
+// ------------------------------------------------------------
+//
+// Producers format a line straight into a record of a bounded ring, and a
+// single writer thread copies the ready records into a batch that it writes
+// to the file descriptor with one write(). Producers never block: claiming a
+// record is one compare-and-swap, and when the ring is full the line is
+// dropped and counted instead of waiting for the writer.
+//
+// Each record has a sequence number that tells whose turn it is: `pos` when
+// it is free for the producer that claims position `pos`, and `pos + 1` once
+// that producer has filled it in. The writer only sleeps when the ring is
+// empty, and producers only wake it when it is sleeping.
+class AsyncLog
+{
+public:
+    explicit AsyncLog(int fd) : fd_(fd), records_(new Record[LOG_RECORDS])
+    {
+        for (uint32_t i = 0; i < LOG_RECORDS; i++) {
+            records_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void start() { writer_ = std::thread(&AsyncLog::run, this); }
+
+    // Write out everything that was logged, and stop the writer.
+    void stop()
+    {
+        if (!writer_.joinable())
+            return;
+        stop_.store(true, std::memory_order_seq_cst);
+        wake();
+        writer_.join();
+    }
+
+    // Format a line (a newline is added) and queue it. Lines longer than a
+    // record are cut. Returns false if the line was dropped.
+    bool vlog(const char *fmt, va_list ap)
+    {
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
+        Record *r;
+        for (;;) {
+            r = &records_[pos & (LOG_RECORDS - 1)];
+            uint64_t seq = r->seq.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // The writer hasn't caught up with this record yet.
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        int n = std::vsnprintf(r->text, LOG_RECORD_SIZE - 1, fmt, ap);
+        if (n < 0)
+            n = 0;
+        if (n > static_cast<int>(LOG_RECORD_SIZE) - 2)
+            n = LOG_RECORD_SIZE - 2;
+        r->text[n] = '\n';
+        r->len = static_cast<uint16_t>(n + 1);
+        // Sequentially consistent, like the writer going to sleep: either the
+        // writer sees the record, or we see that it is asleep.
+        r->seq.store(pos + 1, std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_seq_cst))
+            wake();
+        return true;
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Record
+    {
+        std::atomic<uint64_t> seq;
+        uint16_t len;
+        char text[LOG_RECORD_SIZE];
+    };
+
+    void wake()
+    {
+        wakeups_.fetch_add(1, std::memory_order_release);
+        wakeups_.notify_one();
+    }
 
-// For reindeer
-int reindeerCount = 0;  
-// For elves
-int elfCount = 0;       
+    bool ready() const
+    {
+        const Record &r = records_[head_ & (LOG_RECORDS - 1)];
+        return r.seq.load(std::memory_order_seq_cst) == head_ + 1;
+    }
 
-// Guard both counters with a mutex
-std::mutex mtx;
+    void flush(const char *buf, size_t len)
+    {
+        while (len > 0) {
+            ssize_t n = ::write(fd_, buf, len);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            buf += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
 
+    void run()
+    {
+        std::unique_ptr<char[]> batch(new char[LOG_BATCH_BYTES]);
+        for (;;) {
+            size_t len = 0;
+            while (ready() && len + LOG_RECORD_SIZE <= LOG_BATCH_BYTES) {
+                Record &r = records_[head_ & (LOG_RECORDS - 1)];
+                std::memcpy(batch.get() + len, r.text, r.len);
+                len += r.len;
+                // Hand the record to the producer one lap ahead.
+                r.seq.store(head_ + LOG_RECORDS, std::memory_order_release);
+                head_++;
+            }
+            if (len > 0) {
+                flush(batch.get(), len);
+                continue;
+            }
+            if (stop_.load(std::memory_order_acquire)) {
+                // Nothing is left, unless a producer is halfway through
+                // a record, and nobody logs after stop().
+                if (head_ == tail_.load(std::memory_order_acquire))
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t w = wakeups_.load(std::memory_order_acquire);
+            sleeping_.store(true, std::memory_order_seq_cst);
+            if (!ready() && !stop_.load(std::memory_order_acquire))
+                wakeups_.wait(w, std::memory_order_acquire);
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    const int fd_;
+    std::unique_ptr<Record[]> records_;
+    std::thread writer_;
+    uint64_t head_ = 0;  // writer only
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+    alignas(64) std::atomic<bool> sleeping_{false};
+    std::atomic<uint32_t> wakeups_{0};
+    std::atomic<bool> stop_{false};
+};
+
+//
 // ------------------------------------------------------------
-// Semaphores for synchronization
+// Shared State
 // ------------------------------------------------------------
 
-// Santa sleeps on this until 9 reindeer or 3 elves are ready
-static std::counting_semaphore<9999> santaSem(0);
+// Reindeer come back in groups of all the reindeer, elves in groups of 3
+static GroupBarrier reindeerBarrier(NUM_REINDEER);
+static GroupBarrier elfBarrier(GROUP_SIZE);
 
-// Reindeer wait on this until Santa is ready to harness them
-static std::counting_semaphore<9999> reindeerSem(0);
+// Santa sleeps on this until 9 reindeer or 3 elves are ready.
+// The last arrival of each group releases it once.
+static std::counting_semaphore<> santaSem(0);
 
-// Elves: allow up to 3 “in flight” to form a group
-static std::counting_semaphore<9999> onlyElves(3);
+// Set to make Santa go home
+static std::atomic<bool> stopping{false};
 
-// The 1st and 2nd elves in a group wait on this (the 3rd wakes Santa)
-static std::counting_semaphore<9999> santaSignal(0);
+// Elves that still have work rounds left
+static std::atomic<int> elvesLeft{NUM_ELVES};
 
-// The “problem” semaphore: Santa signals it 3 times when he’s ready
-static std::counting_semaphore<9999> problem(0);
+// All output goes through the log, so that lines don't get jumbled
+static AsyncLog logger(STDOUT_FILENO);
 
-// The “elfDone” semaphore: Santa signals 3 times after he’s answered them
-static std::counting_semaphore<9999> elfDone(0);
+// Pause after every logged line
+static int printPauseMs = PRINT_PAUSE_MS;
 
-// Just needed to prevent output getting jumbled
-static std::mutex printMutex;
+// Benchmark mode: no printing and no sleeping
+static bool benchMode = false;
 
 // ------------------------------------------------------------
 // Utility: safe print
 // ------------------------------------------------------------
-void safePrint(const std::string &msg)
+void safePrint(const char *fmt, ...)
 {
-    std::lock_guard<std::mutex> lock(printMutex);
-    std::cout << msg << std::endl;
+    if (benchMode)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    logger.vlog(fmt, ap);
+    va_end(ap);
 
-    // Add a half-second pause after every printed line:
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // Optional pause after every printed line. It only slows down the
+    // thread that printed:
+    if (printPauseMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(printPauseMs));
 }
 
 // ------------------------------------------------------------
 // Utility: random sleep for demonstration
 // ------------------------------------------------------------
-void randomSleep(int minMs, int maxMs, double scale = 1.0)
+static std::mt19937 &threadRng()
 {
     // Each thread has its own RNG
     static thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+void randomSleep(int minMs, int maxMs, double scale = 1.0)
+{
+    if (benchMode)
+        return;
     std::uniform_int_distribution<> dist(minMs, maxMs);
-    auto ms = static_cast<int>(dist(rng) * scale);
+    auto ms = static_cast<int>(dist(threadRng()) * scale);
     std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
 // ------------------------------------------------------------
 // Santa Thread
 // ------------------------------------------------------------
-void santaThread()
+void santaThread(uint64_t *rendezvous)
 {
     safePrint("[Santa] Ho-ho-ho, I'm here...");
     for (;;)
     {
         // Wait until awakened by either all 9 reindeer or 3 elves
         santaSem.acquire();
+        if (stopping.load(std::memory_order_acquire))
+            break;
 
-        // Check who woke me
-        std::unique_lock<std::mutex> lock(mtx);
-        if (reindeerCount == NUM_REINDEER)
+        // Check who woke me; the reindeer go first
+        if (reindeerBarrier.groupReady())
         {
-            // All reindeer arrived
             safePrint("[Santa] All reindeer have arrived! Preparing the sleigh...");
-            reindeerCount = 0;    // reset the count
 
-            // Let each reindeer proceed
-            for (int i = 0; i < NUM_REINDEER; i++) {
-                reindeerSem.release();
-            }
+            // Let all reindeer proceed with one wake
+            reindeerBarrier.admit();
 
-            lock.unlock();
             // Simulate delivering
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-            lock.lock();
+            if (!benchMode)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
             safePrint("[Santa] Done delivering toys; back to sleep!");
+            reindeerBarrier.dismiss();
         }
-        else if (elfCount == 3)
+        else if (elfBarrier.groupReady())
         {
-            // 3 elves arrived (the 3rd elf woke Santa)
             safePrint("[Santa] 3 elves need help. Letting them in...");
 
-            // Release the first 2 elves that were waiting on santaSignal
-            for (int i = 0; i < (GROUP_SIZE - 1); i++) {
-                santaSignal.release();
-            }
-
-            // Reset the elfCount while locked
-            elfCount = 0;
-
             // Let all 3 elves ask their questions
-            for (int i = 0; i < GROUP_SIZE; i++) {
-                problem.release();
-            }
+            elfBarrier.admit();
 
             // Help them (simulate)
-            lock.unlock();
-            std::this_thread::sleep_for(std::chrono::milliseconds(700));
-            lock.lock();
+            if (!benchMode)
+                std::this_thread::sleep_for(std::chrono::milliseconds(700));
 
             safePrint("[Santa] Done helping these elves!");
 
-            // Let the 3 elves know Santa’s done
-            for (int i = 0; i < GROUP_SIZE; i++) {
-                elfDone.release();
-            }
+            // Let the 3 elves know Santa's done
+            elfBarrier.dismiss();
         }
         else
         {
-            // Possibly a spurious wakeup or partial group
-            safePrint("[Santa] Woke up, but ReindeerCount=" 
-                      + std::to_string(reindeerCount) + ", ElfCount=" + std::to_string(elfCount));
+            // Every release is for a complete group, so this is not expected
+            safePrint("[Santa] Woke up, but nobody is waiting");
+            continue;
         }
+        (*rendezvous)++;
     }
+    safePrint("[Santa] Going home.");
 }
 
 // ------------------------------------------------------------
@@ -168,98 +484,1078 @@ void reindeerThread(int id)
     {
         // Vacation
         randomSleep(500, 1000, SLOWDOWN_FACTOR);
-        {
-            // Lock to safely increment
-            std::unique_lock<std::mutex> lock(mtx);
-            reindeerCount++;
-            safePrint("[Reindeer " + std::to_string(id) + "] Returned. ReindeerCount=" + std::to_string(reindeerCount));
-
-            // If this is the 9th reindeer, wake Santa
-            if (reindeerCount == NUM_REINDEER) {
-                safePrint("[Reindeer " + std::to_string(id) + "] I'm the last! Waking Santa!");
-                santaSem.release();
-            }
+
+        GroupBarrier::Ticket t = reindeerBarrier.arrive();
+        safePrint("[Reindeer %d] Returned.", id);
+
+        // If this is the 9th reindeer, wake Santa
+        if (t.last) {
+            safePrint("[Reindeer %d] I'm the last! Waking Santa!", id);
+            santaSem.release();
         }
-        // Wait until Santa harnesses us
-        reindeerSem.acquire(); // <- Bug right here - what if this is called after santa is releasing the reindeer?
+
+        // Wait until Santa harnesses us. This returns at once if Santa
+        // already has, and can't be taken by a reindeer of the next round.
+        if (!reindeerBarrier.awaitAdmission(t))
+            break;
 
         // Deliver toys
-        safePrint("[Reindeer " + std::to_string(id) + "] Delivering toys...");
+        safePrint("[Reindeer %d] Delivering toys...", id);
         randomSleep(300, 600, SLOWDOWN_FACTOR);
-        safePrint("[Reindeer " + std::to_string(id) + "] Going back on vacation...");
+        safePrint("[Reindeer %d] Going back on vacation...", id);
     }
-    safePrint("[Reindeer " + std::to_string(id) + "] Done, exiting thread.");
+    safePrint("[Reindeer %d] Done, exiting thread.", id);
 }
 
 // ------------------------------------------------------------
 // Elf Thread
 // ------------------------------------------------------------
+bool elfAskSanta(int id)
+{
+    GroupBarrier::Ticket t = elfBarrier.arrive();
+    safePrint("[Elf %d] Has a problem!", id);
+
+    if (t.last) {
+        safePrint("[Elf %d] I'm the 3rd elf, waking Santa!", id);
+        santaSem.release();
+    } else {
+        safePrint("[Elf %d] Waiting outside for group of 3...", id);
+    }
+
+    // Wait for Santa to say "go ahead"
+    if (!elfBarrier.awaitAdmission(t))
+        return false;
+
+    // Now talk to Santa
+    safePrint("[Elf %d] Asking Santa my question...", id);
+    randomSleep(200, 400, SLOWDOWN_FACTOR);
+
+    // Wait until Santa's done helping
+    if (!elfBarrier.awaitDismissal(t))
+        return false;
+
+    safePrint("[Elf %d] Done with Santa. Returning to work.", id);
+    return true;
+}
+
 void elfThread(int id)
 {
+    std::uniform_int_distribution<> percent(0, 99);
     for (int round = 0; round < ELF_WORK_ROUNDS; round++)
     {
         // Simulate working
-        safePrint("[Elf " + std::to_string(id) + "] Making toys...");
+        safePrint("[Elf %d] Making toys...", id);
         randomSleep(300, 600, SLOWDOWN_FACTOR);
 
         // 30% chance something goes wrong
-        bool hasProblem = (rand() % 100 < 30);
+        bool hasProblem = percent(threadRng()) < 30;
         if (!hasProblem)
             continue;
 
-        // Acquire a slot so only up to 3 elves can proceed
-        onlyElves.acquire();
+        if (!elfAskSanta(id))
+            break;
+    }
+    elvesLeft.fetch_sub(1, std::memory_order_acq_rel);
+    safePrint("[Elf %d] Done with all rounds, exiting.", id);
+}
+
+// Benchmark elf: asks Santa for help over and over
+void benchElfThread(int id)
+{
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (!elfAskSanta(id))
+            break;
+    }
+}
+
+// Stop Santa and everyone still waiting on him
+void shutdown(std::thread &santa)
+{
+    stopping.store(true, std::memory_order_release);
+    reindeerBarrier.close();
+    elfBarrier.close();
+    santaSem.release();
+    santa.join();
+}
+
+// ------------------------------------------------------------
+// Benchmark: elf groups served per second
+// ------------------------------------------------------------
+int bench(int nelves, int seconds)
+{
+    benchMode = true;
+    uint64_t rendezvous = 0;
+    std::thread santa(santaThread, &rendezvous);
+
+    std::vector<std::thread> elves;
+    elves.reserve(nelves);
+    for (int i = 1; i <= nelves; i++) {
+        elves.emplace_back(benchElfThread, i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    shutdown(santa);
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for (auto &e : elves) {
+        e.join();
+    }
+
+    std::cout << "elves=" << nelves << " group=" << GROUP_SIZE
+              << " rendezvous=" << rendezvous
+              << " seconds=" << elapsed
+              << " rendezvous/s=" << static_cast<uint64_t>(rendezvous / elapsed)
+              << std::endl;
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Benchmark: lines logged per second
+// ------------------------------------------------------------
+int logBench(int nthreads, int nlines)
+{
+    printPauseMs = 0;
+    logger.start();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads);
+    for (int t = 1; t <= nthreads; t++) {
+        threads.emplace_back([t, nlines] {
+            for (int i = 0; i < nlines; i++) {
+                safePrint("[Elf %d] Making toy %d...", t, i);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    double logged = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    logger.stop();
+    double written = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total = static_cast<uint64_t>(nthreads) * nlines;
+    std::cerr << "threads=" << nthreads << " lines=" << total
+              << " dropped=" << logger.dropped()
+              << " producer_lines/s=" << static_cast<uint64_t>(total / logged)
+              << " written_lines/s="
+              << static_cast<uint64_t>((total - logger.dropped()) / written)
+              << std::endl;
+    return 0;
+}
+
+//
+// ------------------------------------------------------------
+// Simulation engine: actors as coroutines on a work-stealing pool
+// ------------------------------------------------------------
+//
+// `./santa sim` runs the same story with any number of actors, set at run
+// time. Every reindeer, elf and Santa is a coroutine, and a fixed pool of
+// worker threads runs them. A coroutine that waits for its group, or for
+// Santa, suspends and frees its worker, so a million actors need no more
+// threads than there are cores.
+//
+// Each worker owns a Chase-Lev deque of runnable coroutines: it pushes and
+// pops at the bottom, and idle workers steal from the top of a random
+// victim. A worker with nothing to run or steal parks on an atomic wait,
+// and is woken when work is pushed while it sleeps.
+//
+// The actors are split into workshops, each with its own Santa, so that
+// a single Santa doesn't serialize the whole run. The sleeps of the story
+// become a fixed amount of busy work. The time that each actor waits for its
+// group is recorded in per worker latency histograms, one per kind of wait.
+
+struct SimConfig
+{
+    int  workers        = static_cast<int>(std::thread::hardware_concurrency());
+    int  workshops      = 1;                         // one Santa each
+    long reindeer       = NUM_REINDEER;              // split among workshops
+    long elves          = NUM_ELVES;                 // split among workshops
+    int  elfGroup       = GROUP_SIZE;
+    int  reindeerRounds = REINDEER_VACATION_ROUNDS;
+    int  elfRounds      = ELF_WORK_ROUNDS;
+    int  problemPct     = 30;                        // chance an elf needs help
+    int  work           = 1000;                      // spin steps per activity
+};
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Busy work in place of sleeping.
+static void simSpin(int steps)
+{
+    uint64_t x = 88172645463325252ull;
+    for (int i = 0; i < steps; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    volatile uint64_t sink = x;
+    (void)sink;
+}
+
+// Log-linear histogram of nanoseconds: 8 buckets per power of two.
+class LatencyHistogram
+{
+public:
+    void add(int64_t ns)
+    {
+        uint64_t v = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+        counts_[index(v)]++;
+        count_++;
+        sum_ += v;
+        if (v > max_)
+            max_ = v;
+    }
+
+    void merge(const LatencyHistogram &o)
+    {
+        for (int i = 0; i < NBUCKETS; i++)
+            counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        if (o.max_ > max_)
+            max_ = o.max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    // The lower bound of the bucket that holds the quantile q.
+    uint64_t quantile(double q) const
+    {
+        uint64_t rank = static_cast<uint64_t>(q * count_);
+        uint64_t seen = 0;
+        for (int i = 0; i < NBUCKETS; i++) {
+            seen += counts_[i];
+            if (seen > rank)
+                return lowest(i);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int NBUCKETS = 512;
+
+    static int index(uint64_t v)
+    {
+        if (v < 8)
+            return static_cast<int>(v);
+        int k = 63 - __builtin_clzll(v);
+        return (k - 2) * 8 + static_cast<int>((v >> (k - 3)) & 7);
+    }
+
+    static uint64_t lowest(int i)
+    {
+        if (i < 8)
+            return static_cast<uint64_t>(i);
+        int k = i / 8 + 2;
+        return (8ull + static_cast<uint64_t>(i % 8)) << (k - 3);
+    }
+
+    uint64_t counts_[NBUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+enum SimLatency { LAT_REINDEER_WAIT, LAT_ELF_WAIT, LAT_ELF_VISIT, LAT_KINDS };
+static const char *const simLatencyNames[LAT_KINDS] = {
+    "reindeer_wait", "elf_wait", "elf_visit"
+};
+
+// Chase-Lev work-stealing deque of coroutine addresses. Only the owner
+// pushes and pops; anyone may steal. Arrays that are outgrown are kept until
+// the deque is destroyed, since a thief may still be reading them.
+class WorkDeque
+{
+public:
+    WorkDeque() : array_(new Array(256)) {}
+
+    ~WorkDeque()
+    {
+        delete array_.load(std::memory_order_relaxed);
+        for (Array *a : retired_)
+            delete a;
+    }
+
+    void push(void *x)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *a = array_.load(std::memory_order_relaxed);
+        if (b - t > a->mask) {
+            a = grow(a, t, b);
+        }
+        a->put(b, x);
+        // Sequentially consistent, like parking: a worker going to sleep
+        // either sees this push or gets woken for it.
+        bottom_.store(b + 1, std::memory_order_seq_cst);
+    }
+
+    void *pop()
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        void *x = a->get(b);
+        if (t == b) {
+            // The last one: race the thieves for it.
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+                x = nullptr;
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    void *steal()
+    {
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b)
+            return nullptr;
+        Array *a = array_.load(std::memory_order_acquire);
+        void *x = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+            return nullptr;
+        return x;
+    }
+
+    bool empty() const
+    {
+        return bottom_.load(std::memory_order_seq_cst) <=
+               top_.load(std::memory_order_seq_cst);
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(int64_t size)
+            : mask(size - 1), slots(new std::atomic<void *>[size]) {}
+        void put(int64_t i, void *x) { slots[i & mask].store(x, std::memory_order_relaxed); }
+        void *get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+
+        const int64_t mask;
+        std::unique_ptr<std::atomic<void *>[]> slots;
+    };
+
+    Array *grow(Array *a, int64_t t, int64_t b)
+    {
+        Array *bigger = new Array((a->mask + 1) * 2);
+        for (int64_t i = t; i < b; i++)
+            bigger->put(i, a->get(i));
+        retired_.push_back(a);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array *> array_;
+    std::vector<Array *> retired_;  // owner only
+};
+
+class SimEngine
+{
+public:
+    struct Worker
+    {
+        WorkDeque deque;
+        uint64_t rng;
+        uint64_t steps = 0;
+        uint64_t steals = 0;
+        LatencyHistogram latency[LAT_KINDS];
+        std::thread thread;
+    };
+
+    explicit SimEngine(int nworkers)
+    {
+        for (int i = 0; i < nworkers; i++) {
+            workers_.push_back(std::make_unique<Worker>());
+            workers_.back()->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        }
+    }
+
+    // Queue a new actor, before start(). Actors are dealt out to the
+    // workers in turn.
+    void spawn(std::coroutine_handle<> h)
+    {
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        workers_[spawned_++ % workers_.size()]->deque.push(h.address());
+    }
+
+    // Make a suspended coroutine runnable.
+    void schedule(std::coroutine_handle<> h)
+    {
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        push(h.address());
+        wake(false);
+    }
+
+    // Make a group of coroutines runnable, with at most one wake-up. A worker
+    // that steals wakes the next one while there is more to steal.
+    void schedule(const std::vector<std::coroutine_handle<>> &hs)
+    {
+        if (hs.empty())
+            return;
+        queued_.fetch_add(hs.size(), std::memory_order_relaxed);
+        for (auto h : hs)
+            push(h.address());
+        wake(false);
+    }
+
+    void start()
+    {
+        for (auto &w : workers_)
+            w->thread = std::thread(&SimEngine::run, this, w.get());
+    }
+
+    // Wait until no coroutine is runnable or running. Only the caller may
+    // then make one runnable.
+    void waitIdle()
+    {
+        for (;;) {
+            uint32_t e = idle_.load(std::memory_order_acquire);
+            if (queued_.load(std::memory_order_acquire) == 0)
+                return;
+            idle_.wait(e, std::memory_order_acquire);
+        }
+    }
+
+    void stop()
+    {
+        stop_.store(true, std::memory_order_seq_cst);
+        wake(true);
+        for (auto &w : workers_)
+            w->thread.join();
+    }
+
+    // The worker of the calling thread, or null outside of the pool.
+    static Worker *current() { return current_; }
+
+    uint64_t random()
+    {
+        uint64_t &x = current_->rng;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+
+    const std::vector<std::unique_ptr<Worker>> &workers() const { return workers_; }
+
+private:
+    void push(void *x)
+    {
+        if (current_) {
+            current_->deque.push(x);
+        } else {
+            std::lock_guard<std::mutex> lock(injectMutex_);
+            inject_.push_back(x);
+            injected_.store(inject_.size(), std::memory_order_seq_cst);
+        }
+    }
+
+    void *takeInjected()
+    {
+        if (injected_.load(std::memory_order_seq_cst) == 0)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(injectMutex_);
+        if (inject_.empty())
+            return nullptr;
+        void *x = inject_.back();
+        inject_.pop_back();
+        injected_.store(inject_.size(), std::memory_order_seq_cst);
+        return x;
+    }
+
+    void wake(bool all)
+    {
+        if (sleepers_.load(std::memory_order_seq_cst) == 0)
+            return;
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        if (all)
+            epoch_.notify_all();
+        else
+            epoch_.notify_one();
+    }
+
+    bool anyWork() const
+    {
+        for (auto &w : workers_) {
+            if (!w->deque.empty())
+                return true;
+        }
+        return injected_.load(std::memory_order_seq_cst) > 0;
+    }
+
+    void *steal(Worker *self)
+    {
+        size_t n = workers_.size();
+        size_t start = static_cast<size_t>(random() % n);
+        for (size_t i = 0; i < n; i++) {
+            Worker *victim = workers_[(start + i) % n].get();
+            if (victim == self)
+                continue;
+            if (void *x = victim->deque.steal()) {
+                self->steals++;
+                if (!victim->deque.empty())
+                    wake(false);
+                return x;
+            }
+        }
+        return takeInjected();
+    }
+
+    void park()
+    {
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t e = epoch_.load(std::memory_order_seq_cst);
+        if (!anyWork() && !stop_.load(std::memory_order_seq_cst))
+            epoch_.wait(e, std::memory_order_seq_cst);
+        sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void run(Worker *w)
+    {
+        current_ = w;
+        for (;;) {
+            void *x = w->deque.pop();
+            if (!x)
+                x = steal(w);
+            if (x) {
+                std::coroutine_handle<>::from_address(x).resume();
+                w->steps++;
+                if (queued_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    idle_.fetch_add(1, std::memory_order_release);
+                    idle_.notify_all();
+                }
+                continue;
+            }
+            if (stop_.load(std::memory_order_acquire))
+                break;
+            park();
+        }
+        current_ = nullptr;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t spawned_ = 0;
+    std::mutex injectMutex_;
+    std::vector<void *> inject_;
+    std::atomic<size_t> injected_{0};
+    alignas(64) std::atomic<uint64_t> queued_{0};  // runnable or running
+    alignas(64) std::atomic<uint32_t> sleepers_{0};
+    std::atomic<uint32_t> epoch_{0};
+    std::atomic<uint32_t> idle_{0};
+    std::atomic<bool> stop_{false};
+    static thread_local Worker *current_;
+};
+
+thread_local SimEngine::Worker *SimEngine::current_ = nullptr;
+
+static SimEngine *simEngine;
+static std::atomic<int64_t> simLive{0};  // actors that have not returned
+
+static void simRecord(SimLatency kind, int64_t ns)
+{
+    SimEngine::current()->latency[kind].add(ns);
+}
+
+// An actor coroutine. It starts suspended, runs when the engine first picks
+// it, and frees itself when it returns.
+struct SimActor
+{
+    struct promise_type
+    {
+        promise_type() { simLive.fetch_add(1, std::memory_order_relaxed); }
+        ~promise_type() { simLive.fetch_sub(1, std::memory_order_acq_rel); }
+        SimActor get_return_object()
+        {
+            return SimActor{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Let the other actors of this worker run.
+struct SimYield
+{
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) const { simEngine->schedule(h); }
+    void await_resume() const noexcept {}
+};
+
+// Counting semaphore for coroutines. Santa waits on it for a complete group.
+//
+// In the awaiters, nothing may be touched once the lock is released after
+// queueing the coroutine, since it may already be running on another worker.
+class SimSemaphore
+{
+public:
+    struct Acquire
+    {
+        SimSemaphore &sem;
+        std::coroutine_handle<> h;
+        bool ok = true;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> hh)
+        {
+            h = hh;
+            return sem.enqueue(this);
+        }
+        // False if the semaphore was closed.
+        bool await_resume() const noexcept { return ok; }
+    };
+
+    Acquire acquire() { return Acquire{*this, nullptr}; }
+
+    void release()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (waiters_.empty()) {
+            count_++;
+            return;
+        }
+        Acquire *a = waiters_.back();
+        waiters_.pop_back();
+        lock.unlock();
+        simEngine->schedule(a->h);
+    }
+
+    void close()
+    {
+        std::vector<Acquire *> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            waiters.swap(waiters_);
+        }
+        for (Acquire *a : waiters) {
+            a->ok = false;
+            simEngine->schedule(a->h);
+        }
+    }
+
+private:
+    bool enqueue(Acquire *a)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ > 0) {
+            count_--;
+            return false;
+        }
+        if (closed_) {
+            a->ok = false;
+            return false;
+        }
+        waiters_.push_back(a);
+        return true;
+    }
+
+    std::mutex mutex_;
+    uint64_t count_ = 0;
+    bool closed_ = false;
+    std::vector<Acquire *> waiters_;
+};
+
+// A group in a SimGate. It is freed by whoever leaves it last: its members,
+// and the leader while serving it.
+struct SimGroup
+{
+    std::vector<std::coroutine_handle<>> admitWaiters;
+    std::vector<std::coroutine_handle<>> dismissWaiters;
+    int phase = 0;  // 0 forming, 1 admitted, 2 dismissed
+    int refs = 0;
+    bool closed = false;
+};
+
+// GroupBarrier for coroutines: members suspend until the leader admits
+// their group, and optionally until it dismisses them. The last member of a
+// group releases the leader's semaphore.
+class SimGate
+{
+public:
+    struct Ticket
+    {
+        SimGroup *group;
+        bool closed;  // the gate closed before the group was admitted
+    };
+
+    struct Arrive
+    {
+        SimGate &gate;
+        SimGroup *group = nullptr;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) { return gate.join(this, h); }
+        Ticket await_resume() const noexcept
+        {
+            return Ticket{group, group == nullptr || group->closed};
+        }
+    };
+
+    struct Dismissal
+    {
+        SimGate &gate;
+        SimGroup *group;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            std::lock_guard<std::mutex> lock(gate.mutex_);
+            if (group->phase >= 2 || group->closed)
+                return false;
+            group->dismissWaiters.push_back(h);
+            return true;
+        }
+        void await_resume() const { gate.leave(group); }
+    };
+
+    SimGate(uint32_t groupSize, SimSemaphore &leader)
+        : groupSize_(groupSize), leader_(leader) {}
+
+    Arrive arrive() { return Arrive{*this}; }
 
+    // Wait for the group to be dismissed, and leave it.
+    Dismissal dismissal(const Ticket &t) { return Dismissal{*this, t.group}; }
+
+    // Leave the group without waiting for the dismissal.
+    void leave(const Ticket &t)
+    {
+        if (t.group)
+            leave(t.group);
+    }
+
+    // Leader side: the next complete group, or null.
+    SimGroup *takeReady()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ready_.empty())
+            return nullptr;
+        SimGroup *g = ready_.front();
+        ready_.pop_front();
+        g->refs++;
+        return g;
+    }
+
+    // Leader side: let the members in, with one batch of wake-ups.
+    void admit(SimGroup *g)
+    {
+        std::vector<std::coroutine_handle<>> waiters;
         {
-            // Lock to safely increment
-            std::unique_lock<std::mutex> lock(mtx);
-            elfCount++;
-            safePrint("[Elf " + std::to_string(id) + "] Has a problem! ElfCount=" + std::to_string(elfCount));
-
-            if (elfCount == GROUP_SIZE)
-            {
-                safePrint("[Elf " + std::to_string(id) + "] I'm the 3rd elf, waking Santa!");
-                santaSem.release();
+            std::lock_guard<std::mutex> lock(mutex_);
+            g->phase = 1;
+            waiters.swap(g->admitWaiters);
+        }
+        simEngine->schedule(waiters);
+    }
+
+    // Leader side: let the members go, and leave the group.
+    void dismiss(SimGroup *g)
+    {
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            g->phase = 2;
+            waiters.swap(g->dismissWaiters);
+        }
+        simEngine->schedule(waiters);
+        leave(g);
+    }
+
+    // Let the members of the incomplete group go, and refuse new ones.
+    void close()
+    {
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            if (forming_) {
+                forming_->closed = true;
+                waiters.swap(forming_->admitWaiters);
+                forming_ = nullptr;
             }
-            else
-            {
-                // If not 3rd, wait outside
-                safePrint("[Elf " + std::to_string(id) + "] Waiting outside for group of 3...");
+        }
+        simEngine->schedule(waiters);
+    }
+
+private:
+    bool join(Arrive *a, std::coroutine_handle<> h)
+    {
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_)
+                return false;
+            if (!forming_)
+                forming_ = new SimGroup;
+            SimGroup *g = forming_;
+            a->group = g;
+            g->refs++;
+            g->admitWaiters.push_back(h);
+            full = g->admitWaiters.size() == groupSize_;
+            if (full) {
+                ready_.push_back(g);
+                forming_ = nullptr;
             }
         }
+        if (full)
+            leader_.release();
+        return true;
+    }
+
+    void leave(SimGroup *g)
+    {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last = --g->refs == 0;
+        }
+        if (last)
+            delete g;
+    }
+
+    const uint32_t groupSize_;
+    SimSemaphore &leader_;
+    std::mutex mutex_;
+    SimGroup *forming_ = nullptr;
+    std::deque<SimGroup *> ready_;
+    bool closed_ = false;
+};
+
+struct SimWorkshop
+{
+    SimWorkshop(uint32_t nreindeer, uint32_t elfGroup)
+        : reindeer(nreindeer, santa), elves(elfGroup, santa) {}
+
+    SimSemaphore santa;
+    SimGate reindeer;
+    SimGate elves;
+    uint64_t served = 0;  // Santa only
+};
+
+SimActor simSanta(SimWorkshop &ws, const SimConfig &c)
+{
+    while (co_await ws.santa.acquire()) {
+        // The reindeer go first
+        if (SimGroup *g = ws.reindeer.takeReady()) {
+            ws.reindeer.admit(g);
+            simSpin(c.work);  // delivering
+            ws.reindeer.dismiss(g);
+        } else if (SimGroup *g = ws.elves.takeReady()) {
+            ws.elves.admit(g);
+            simSpin(c.work);  // helping
+            ws.elves.dismiss(g);
+        }
+        ws.served++;
+    }
+}
+
+SimActor simReindeer(SimWorkshop &ws, const SimConfig &c)
+{
+    for (int round = 0; round < c.reindeerRounds; round++) {
+        simSpin(c.work);  // vacation
+        co_await SimYield{};
+        int64_t start = nowNs();
+        SimGate::Ticket t = co_await ws.reindeer.arrive();
+        ws.reindeer.leave(t);
+        if (t.closed)
+            break;
+        simRecord(LAT_REINDEER_WAIT, nowNs() - start);
+        simSpin(c.work);  // delivering toys
+    }
+}
+
+SimActor simElf(SimWorkshop &ws, const SimConfig &c)
+{
+    for (int round = 0; round < c.elfRounds; round++) {
+        simSpin(c.work);  // making toys
+        co_await SimYield{};
+        if (static_cast<int>(simEngine->random() % 100) >= c.problemPct)
+            continue;
+        int64_t start = nowNs();
+        SimGate::Ticket t = co_await ws.elves.arrive();
+        if (t.closed) {
+            ws.elves.leave(t);
+            break;
+        }
+        simRecord(LAT_ELF_WAIT, nowNs() - start);
+        simSpin(c.work / 2);  // asking the question
+        co_await ws.elves.dismissal(t);
+        simRecord(LAT_ELF_VISIT, nowNs() - start);
+    }
+}
 
-        // If I'm NOT the 3rd, I block on santaSignal
-        if (elfCount < GROUP_SIZE) {
-            santaSignal.acquire();
+static bool parseSimArgs(int argc, char **argv, SimConfig &c)
+{
+    struct Option { const char *name; long *lvalue; int *ivalue; long min; };
+    const Option options[] = {
+        {"--workers",         nullptr,     &c.workers,        1},
+        {"--workshops",       nullptr,     &c.workshops,      1},
+        {"--reindeer",        &c.reindeer, nullptr,           1},
+        {"--elves",           &c.elves,    nullptr,           0},
+        {"--elf-group",       nullptr,     &c.elfGroup,       1},
+        {"--reindeer-rounds", nullptr,     &c.reindeerRounds, 0},
+        {"--elf-rounds",      nullptr,     &c.elfRounds,      0},
+        {"--problem-pct",     nullptr,     &c.problemPct,     0},
+        {"--work",            nullptr,     &c.work,           0},
+    };
+    for (int i = 0; i < argc; i++) {
+        const Option *opt = nullptr;
+        for (const Option &o : options) {
+            if (std::strcmp(argv[i], o.name) == 0)
+                opt = &o;
         }
+        if (!opt || i + 1 == argc)
+            return false;
+        char *end;
+        long v = std::strtol(argv[++i], &end, 10);
+        if (*end || v < opt->min)
+            return false;
+        if (opt->lvalue)
+            *opt->lvalue = v;
+        else
+            *opt->ivalue = static_cast<int>(v);
+    }
+    if (c.workers < 1)
+        c.workers = 1;
+    return c.reindeer >= c.workshops && c.problemPct <= 100;
+}
 
-        // Wait for Santa to say "go ahead" (problem)
-        problem.acquire();
+// ------------------------------------------------------------
+// Simulation: the story with coroutine actors
+// ------------------------------------------------------------
+int sim(int argc, char **argv)
+{
+    SimConfig c;
+    if (!parseSimArgs(argc, argv, c)) {
+        std::cerr << "usage: santa sim [--workers N] [--workshops N] [--reindeer N]"
+                     " [--elves N]\n"
+                     "       [--elf-group N] [--reindeer-rounds N] [--elf-rounds N]"
+                     " [--problem-pct P] [--work N]\n"
+                     "(the reindeer are split among the workshops, so there must be"
+                     " at least one per workshop)" << std::endl;
+        return 1;
+    }
 
-        // Now talk to Santa
-        safePrint("[Elf " + std::to_string(id) + "] Asking Santa my question...");
-        randomSleep(200, 400, SLOWDOWN_FACTOR);
+    SimEngine engine(c.workers);
+    simEngine = &engine;
 
-        // Wait until Santa's done helping
-        elfDone.acquire();
+    // Each workshop gets its share of the reindeer, all of which make its
+    // reindeer group, and its share of the elves.
+    std::vector<std::unique_ptr<SimWorkshop>> workshops;
+    for (int i = 0; i < c.workshops; i++) {
+        long nreindeer = c.reindeer / c.workshops + (i < c.reindeer % c.workshops);
+        workshops.push_back(std::make_unique<SimWorkshop>(
+            static_cast<uint32_t>(nreindeer), static_cast<uint32_t>(c.elfGroup)));
+        engine.spawn(simSanta(*workshops.back(), c).handle);
+        for (long r = 0; r < nreindeer; r++)
+            engine.spawn(simReindeer(*workshops.back(), c).handle);
+    }
+    for (long e = 0; e < c.elves; e++)
+        engine.spawn(simElf(*workshops[e % c.workshops], c).handle);
+    int64_t actors = simLive.load();
+
+    int64_t start = nowNs();
+    engine.start();
 
-        safePrint("[Elf " + std::to_string(id) + "] Done with Santa. Returning to work.");
+    // When nothing can run, everyone left is a Santa, or an elf in a group
+    // that will never fill up. Close the workshops to let them go.
+    engine.waitIdle();
+    int64_t finished = nowNs();
+    for (auto &ws : workshops) {
+        ws->reindeer.close();
+        ws->elves.close();
+        ws->santa.close();
+    }
+    engine.waitIdle();
+    engine.stop();
+    double elapsed = static_cast<double>(finished - start) / 1e9;
 
-        // Release slot so next elf can form a group
-        onlyElves.release();
+    uint64_t steps = 0, steals = 0, served = 0;
+    LatencyHistogram latency[LAT_KINDS];
+    for (auto &w : engine.workers()) {
+        steps += w->steps;
+        steals += w->steals;
+        for (int k = 0; k < LAT_KINDS; k++)
+            latency[k].merge(w->latency[k]);
     }
-    safePrint("[Elf " + std::to_string(id) + "] Done with all rounds, exiting.");
+    for (auto &ws : workshops)
+        served += ws->served;
+
+    std::printf("sim workers=%d workshops=%d actors=%lld elapsed=%.3fs"
+                " steps=%llu steps/s=%.0f steals=%llu groups=%llu groups/s=%.0f"
+                " leftover=%lld\n",
+                c.workers, c.workshops, static_cast<long long>(actors), elapsed,
+                static_cast<unsigned long long>(steps), steps / elapsed,
+                static_cast<unsigned long long>(steals),
+                static_cast<unsigned long long>(served), served / elapsed,
+                static_cast<long long>(simLive.load()));
+    std::printf("%-14s %10s %10s %10s %10s %10s %10s %10s (us)\n", "latency",
+                "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int k = 0; k < LAT_KINDS; k++) {
+        const LatencyHistogram &h = latency[k];
+        std::printf("%-14s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    simLatencyNames[k], static_cast<unsigned long long>(h.count()),
+                    h.mean() / 1e3, h.quantile(0.5) / 1e3, h.quantile(0.9) / 1e3,
+                    h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3, h.max() / 1e3);
+    }
+    return 0;
 }
 
 // ------------------------------------------------------------
 // main()
 // ------------------------------------------------------------
-int main()
+int main(int argc, char **argv)
 {
-    srand((unsigned int)time(nullptr));
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+        int nelves  = argc > 2 ? std::atoi(argv[2]) : BENCH_ELVES;
+        int seconds = argc > 3 ? std::atoi(argv[3]) : BENCH_SECONDS;
+        if (nelves < GROUP_SIZE || seconds < 1) {
+            std::cerr << "usage: " << argv[0] << " bench [elves] [seconds]" << std::endl;
+            return 1;
+        }
+        return bench(nelves, seconds);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "sim") == 0) {
+        return sim(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "logbench") == 0) {
+        int nthreads = argc > 2 ? std::atoi(argv[2]) : 8;
+        int nlines   = argc > 3 ? std::atoi(argv[3]) : 1000000;
+        if (nthreads < 1 || nlines < 1) {
+            std::cerr << "usage: " << argv[0] << " logbench [threads] [lines]" << std::endl;
+            return 1;
+        }
+        return logBench(nthreads, nlines);
+    }
+    if (argc > 1)
+        printPauseMs = std::atoi(argv[1]);
+    logger.start();
 
     // Start Santa
-    std::thread santa(santaThread);
+    uint64_t rendezvous = 0;
+    std::thread santa(santaThread, &rendezvous);
 
     // Start Reindeer
     std::vector<std::thread> reindeers;
@@ -280,14 +1576,26 @@ int main()
         r.join();
     }
 
+    // The last few elves with a problem may never make a group of 3.
+    // Once every elf still around is waiting in that group, nothing else
+    // can happen, so send Santa home and let them go.
+    while (elvesLeft.load(std::memory_order_acquire) >
+           static_cast<int>(elfBarrier.pending()) || elfBarrier.groupReady()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    shutdown(santa);
+
     // Join elves
     for (auto &e : elves) {
         e.join();
     }
 
-    // Santa runs forever in this demo, so detach or kill:
-    santa.detach();
-
-    safePrint("[Main] All reindeer and elves finished. Santa still dozing.");
+    safePrint("[Main] All reindeer and elves finished, after %llu visits to Santa.",
+              static_cast<unsigned long long>(rendezvous));
+    logger.stop();
+    if (logger.dropped() > 0) {
+        std::fprintf(stderr, "[Main] %llu log lines dropped\n",
+                     static_cast<unsigned long long>(logger.dropped()));
+    }
     return 0;
 }
@@ -1,8 +1,11 @@
 #include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #define MAXBUF (8192)
@@ -11,42 +14,152 @@
 // This program is intended to help you test your web server.
 // You can use it to test that you are correctly having multiple threads
 // handling http requests.
-// 
+//
+// QUERY_STRING is either a number of seconds, as in spin.cgi?2.5, or a list
+// of settings, as in spin.cgi?ms=200&mode=mem&mb=64:
+//      s=, ms=, us=     how long to run (seconds, milliseconds, microseconds)
+//      mode=cpu         burn CPU until the time is up (the default)
+//      mode=mem         stream over a buffer of mb= megabytes (default 64),
+//                       for memory bandwidth rather than CPU
+//      mode=sleep       sleep, using no CPU at all
+// The response reports the time it ran and the CPU time it got.  A CPU time
+// well below the time it ran means the server ran more of these at once
+// than there were cores for.
+//
 
-double get_seconds() {
-    struct timeval t;
-    int rc = gettimeofday(&t, NULL);
+double get_seconds(clockid_t clock) {
+    struct timespec t;
+    int rc = clock_gettime(clock, &t);
     assert(rc == 0);
-    return (double) ((double)t.tv_sec + (double)t.tv_usec / 1e6);
+    return (double) t.tv_sec + (double) t.tv_nsec / 1e9;
+}
+
+// some work that the compiler cannot drop
+static volatile uint64_t sink;
+
+static uint64_t burn(uint64_t x, long iterations) {
+    for (long i = 0; i < iterations; i++)
+	x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    return x;
 }
 
+// Burns CPU until spin_for seconds after t1.  The work between two reads of
+// the clock is kept at about 10us, so that it stops on time but reading the
+// clock is not most of the work.
+static void spin_cpu(double t1, double spin_for) {
+    long iterations = 64;
+    double t, last = t1;
+    while ((t = get_seconds(CLOCK_MONOTONIC)) - t1 < spin_for) {
+	if (t - last < 5e-6 && iterations < (1L << 30))
+	    iterations *= 2;
+	else if (t - last > 2e-5 && iterations > 1)
+	    iterations /= 2;
+	last = t;
+	sink = burn(sink, iterations);
+    }
+}
+
+// Streams over size bytes until spin_for seconds after t1.  Returns the
+// number of bytes read and written.
+static double spin_mem(double t1, double spin_for, size_t size) {
+    if (spin_for <= 0)
+	return 0;
+    size_t n = size / sizeof(uint64_t);
+    uint64_t *a = malloc(n * sizeof(uint64_t));
+    assert(a != NULL);
+    memset(a, 1, n * sizeof(uint64_t));
+
+    double bytes = 0;
+    // a pass is too long to check the clock only between passes
+    size_t chunk = 1 << 16;
+    for (size_t i = 0; (get_seconds(CLOCK_MONOTONIC) - t1) < spin_for; i = (i + chunk) % n) {
+	size_t end = i + chunk < n ? i + chunk : n;
+	for (size_t j = i; j < end; j++)
+	    a[j] += j;
+	bytes += 2.0 * (end - i) * sizeof(uint64_t);
+    }
+    sink = a[n / 2];
+    free(a);
+    return bytes;
+}
+
+static void spin_sleep(double t1, double spin_for) {
+    double left = spin_for - (get_seconds(CLOCK_MONOTONIC) - t1);
+    if (left <= 0)
+	return;
+    struct timespec t;
+    t.tv_sec = (time_t) left;
+    t.tv_nsec = (long) ((left - (double) t.tv_sec) * 1e9);
+    while (nanosleep(&t, &t) == -1 && errno == EINTR)
+	;
+}
+
+// Appends to content, which holds *len bytes, without overflowing it
+static void append(char *content, size_t *len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(content + *len, MAXBUF - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+	*len = *len + n < MAXBUF ? *len + n : MAXBUF - 1;
+}
 
 int main(int argc, char *argv[]) {
     // Extract arguments
     double spin_for = 0.0;
+    const char *mode = "cpu";
+    size_t mb = 64;
     char *buf;
+    char query[MAXBUF] = "";
     if ((buf = getenv("QUERY_STRING")) != NULL) {
-	// just expecting a single number
-	spin_for = (double) atoi(buf);
+	snprintf(query, MAXBUF, "%s", buf);
+	char settings[MAXBUF];
+	snprintf(settings, MAXBUF, "%s", buf);
+	for (char *saved, *s = strtok_r(settings, "&", &saved); s; s = strtok_r(NULL, "&", &saved)) {
+	    if (strncmp(s, "s=", 2) == 0)
+		spin_for = atof(s + 2);
+	    else if (strncmp(s, "ms=", 3) == 0)
+		spin_for = atof(s + 3) / 1e3;
+	    else if (strncmp(s, "us=", 3) == 0)
+		spin_for = atof(s + 3) / 1e6;
+	    else if (strcmp(s, "mode=mem") == 0 || strcmp(s, "mode=sleep") == 0 || strcmp(s, "mode=cpu") == 0)
+		mode = s[5] == 'm' ? "mem" : s[5] == 's' ? "sleep" : "cpu";
+	    else if (strncmp(s, "mb=", 3) == 0 && atoi(s + 3) > 0)
+		mb = atoi(s + 3);
+	    else if (strchr(s, '=') == NULL)
+		// just a number of seconds
+		spin_for = atof(s);
+	}
     }
 
-    double t1 = get_seconds();
-    while ((get_seconds() - t1) < spin_for)
-	sleep(1);
-    double t2 = get_seconds();
-    
+    double bytes = 0;
+    double t1 = get_seconds(CLOCK_MONOTONIC);
+    double c1 = get_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (strcmp(mode, "mem") == 0)
+	bytes = spin_mem(t1, spin_for, mb << 20);
+    else if (strcmp(mode, "sleep") == 0)
+	spin_sleep(t1, spin_for);
+    else
+	spin_cpu(t1, spin_for);
+    double t2 = get_seconds(CLOCK_MONOTONIC);
+    double c2 = get_seconds(CLOCK_PROCESS_CPUTIME_ID);
+
     /* Make the response body */
     char content[MAXBUF];
-    sprintf(content, "<p>Welcome to the CGI program (%s)</p>\r\n", buf);
-    sprintf(content, "%s<p>My only purpose is to waste time on the server!</p>\r\n", content);
-    sprintf(content, "%s<p>I spun for %.2f seconds</p>\r\n", content, t2 - t1);
-    
+    size_t len = 0;
+    content[0] = '\0';
+    append(content, &len, "<p>Welcome to the CGI program (%s)</p>\r\n", query);
+    append(content, &len, "<p>My only purpose is to waste time on the server!</p>\r\n");
+    append(content, &len, "<p>I spun (%s) for %.6f seconds of %.6f asked, using %.6f seconds of CPU</p>\r\n",
+	   mode, t2 - t1, spin_for, c2 - c1);
+    if (bytes > 0)
+	append(content, &len, "<p>I moved %.0f MB, at %.2f GB/s</p>\r\n", bytes / 1e6, bytes / (t2 - t1) / 1e9);
+
     /* Generate the HTTP response */
-    printf("Content-Length: %lu\r\n", strlen(content));
+    printf("Content-Length: %lu\r\n", (unsigned long) len);
     printf("Content-Type: text/html\r\n\r\n");
     printf("%s", content);
     fflush(stdout);
-    
+
     exit(0);
 }
-
@@ -18,9 +18,30 @@
 //
 // When we test your server, we will be using modifications to this client.
 //
+// Load mode:
+//      client -l hostname portnumber urifile threads connections rate seconds
+//
+// Sends requests for the URIs in urifile (one per line, used round robin)
+// at a fixed rate (requests per second) for the given number of seconds.
+// The requests are open loop: each one is due at a fixed time, whether or
+// not earlier ones have been answered, and its latency counts from that
+// time, so a slow server shows up as latency rather than as a lower rate.
+// Each thread runs an epoll loop over its share of the connections, which
+// are kept alive for as long as the server allows.  At the end it prints
+// the throughput and the latency percentiles.
+//
+// build: gcc wclient.c -o wclient -O2 -pthread
+//
 
 #include "io_helper.h"
 
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <time.h>
+
 #define MAXBUF (8192)
 
 //
@@ -66,13 +87,427 @@ void client_print(int fd) {
     }
 }
 
+//
+// Load mode
+//
+
+// Latencies in nanoseconds, in buckets of 1/16 of a power of two
+#define HIST_SUB   (16)
+#define HIST_SLOTS (64 * HIST_SUB)
+
+typedef struct {
+    uint64_t count[HIST_SLOTS];
+    uint64_t total;
+    uint64_t max;
+} hist_t;
+
+static int hist_slot(uint64_t ns) {
+    if (ns < HIST_SUB)
+	return (int) ns;
+    int log = 63 - __builtin_clzll(ns);
+    int sub = (int) ((ns >> (log - 4)) & (HIST_SUB - 1));
+    return (log - 3) * HIST_SUB + sub;
+}
+
+static uint64_t hist_value(int slot) {
+    if (slot < HIST_SUB)
+	return slot;
+    int log = slot / HIST_SUB + 3;
+    uint64_t sub = slot % HIST_SUB;
+    // the upper end of the bucket
+    return ((HIST_SUB + sub + 1) << (log - 4)) - 1;
+}
+
+static void hist_add(hist_t *h, uint64_t ns) {
+    h->count[hist_slot(ns)]++;
+    h->total++;
+    if (ns > h->max)
+	h->max = ns;
+}
+
+static void hist_merge(hist_t *to, hist_t *from) {
+    for (int i = 0; i < HIST_SLOTS; i++)
+	to->count[i] += from->count[i];
+    to->total += from->total;
+    if (from->max > to->max)
+	to->max = from->max;
+}
+
+static uint64_t hist_percentile(hist_t *h, double p) {
+    uint64_t rank = (uint64_t) (p * h->total), seen = 0;
+    for (int i = 0; i < HIST_SLOTS; i++) {
+	seen += h->count[i];
+	if (seen > rank)
+	    return hist_value(i) < h->max ? hist_value(i) : h->max;
+    }
+    return h->max;
+}
+
+static uint64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// what every load thread shares
+typedef struct {
+    char *host;
+    int port;
+    char hostname[MAXBUF];
+    char **uris;
+    int nuris;
+    int threads;
+    int conns;
+    double rate;
+    uint64_t start;
+    uint64_t stop;     // no requests are due from here on
+    uint64_t drain;    // unanswered requests time out here
+} load_t;
+
+typedef struct conn {
+    int fd;
+    int busy;
+    uint64_t due;      // when the request in flight was due
+    char head[MAXBUF]; // the header of the response so far
+    int have;          // bytes in head
+    int header_len;    // 0 until the header is complete
+    long body_left;    // body bytes still to come, -1 until close
+    int keep;          // the server keeps the connection open after this
+    struct conn *next; // in the idle list
+} conn_t;
+
+// one load thread and what it counted
+typedef struct {
+    load_t *load;
+    int id;
+    pthread_t thread;
+    int epfd;
+    conn_t *conns;
+    int nconns;
+    conn_t *idle;
+    int busy;          // connections with a request in flight
+    hist_t hist;
+    uint64_t done, bad, errors, late, unsent, bytes;
+} worker_t;
+
+static char **load_uris(char *path, int *count) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+	perror(path);
+	exit(1);
+    }
+    char **uris = NULL, *line = NULL;
+    size_t cap = 0;
+    int n = 0;
+    while (getline(&line, &cap, f) > 0) {
+	line[strcspn(line, "\r\n")] = '\0';
+	if (line[0] == '\0')
+	    continue;
+	uris = realloc(uris, (n + 1) * sizeof(char *));
+	assert(uris != NULL);
+	uris[n++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    *count = n;
+    return uris;
+}
+
+static void conn_idle(worker_t *w, conn_t *c) {
+    if (c->busy)
+	w->busy--;
+    c->busy = 0;
+    c->next = w->idle;
+    w->idle = c;
+}
+
+static int conn_open(worker_t *w, conn_t *c) {
+    c->fd = open_client_fd(w->load->host, w->load->port);
+    if (c->fd < 0) {
+	c->fd = -1;
+	return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    int rc = epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    assert(rc == 0);
+    return 0;
+}
+
+static void conn_close(conn_t *c) {
+    if (c->fd >= 0)
+	close(c->fd); // also takes it out of the epoll set
+    c->fd = -1;
+}
+
+// Sends the request numbered seq, due at the given time
+static int conn_send(worker_t *w, conn_t *c, uint64_t seq, uint64_t due) {
+    load_t *l = w->load;
+    char buf[MAXBUF];
+
+    if (c->fd < 0 && conn_open(w, c) < 0)
+	return -1;
+    int len = snprintf(buf, MAXBUF, "GET %s HTTP/1.1\r\nhost: %s\r\nconnection: keep-alive\r\n\r\n",
+		       l->uris[seq % l->nuris], l->hostname);
+    if (len >= MAXBUF)
+	len = MAXBUF - 1;
+    // the socket is empty between requests, so a short request goes at once
+    if (write(c->fd, buf, len) != len) {
+	conn_close(c);
+	return -1;
+    }
+    c->busy = 1;
+    w->busy++;
+    c->due = due;
+    c->have = 0;
+    c->header_len = 0;
+    c->body_left = -1;
+    return 0;
+}
+
+// Finds the end of the header, and in it the Content-Length, if any, and
+// whether the server will keep the connection open
+static void conn_parse_header(conn_t *c) {
+    char *end = NULL;
+    for (int i = 0; i + 3 < c->have; i++) {
+	if (memcmp(c->head + i, "\r\n\r\n", 4) == 0) {
+	    end = c->head + i + 4;
+	    break;
+	}
+    }
+    if (end == NULL)
+	return;
+    c->header_len = end - c->head;
+    c->keep = strncmp(c->head, "HTTP/1.0", 8) != 0;
+    for (char *line = c->head; line < end; line = strchr(line, '\n') + 1) {
+	if (strncasecmp(line, "Content-Length:", 15) == 0) {
+	    c->body_left = atol(line + 15);
+	} else if (strncasecmp(line, "Connection:", 11) == 0) {
+	    char *value = line + 11;
+	    while (*value == ' ')
+		value++;
+	    c->keep = strncasecmp(value, "keep-alive", 10) == 0;
+	}
+    }
+    if (c->body_left >= 0)
+	c->body_left -= c->have - c->header_len;
+}
+
+static void conn_finish(worker_t *w, conn_t *c, int keep) {
+    uint64_t now = now_ns();
+    hist_add(&w->hist, now > c->due ? now - c->due : 0);
+    w->done++;
+    if (strncmp(c->head, "HTTP/1.", 7) != 0 || c->head[9] != '2')
+	w->bad++;
+    if (!keep)
+	conn_close(c);
+    conn_idle(w, c);
+}
+
+static void conn_failed(worker_t *w, conn_t *c) {
+    w->errors++;
+    conn_close(c);
+    conn_idle(w, c);
+}
+
+// Reads what has arrived for the request in flight
+static void conn_read(worker_t *w, conn_t *c, char *scratch, size_t size) {
+    ssize_t n;
+    if (!c->busy) {
+	// the server closing an idle connection
+	n = read(c->fd, scratch, size);
+	if (n <= 0)
+	    conn_close(c);
+	return;
+    }
+    if (c->header_len == 0) {
+	n = read(c->fd, c->head + c->have, MAXBUF - 1 - c->have);
+	if (n > 0) {
+	    c->have += n;
+	    c->head[c->have] = '\0';
+	    w->bytes += n;
+	    conn_parse_header(c);
+	    if (c->header_len == 0 && c->have == MAXBUF - 1) {
+		conn_failed(w, c); // header too long
+		return;
+	    }
+	}
+    } else {
+	n = read(c->fd, scratch, size);
+	if (n > 0) {
+	    w->bytes += n;
+	    if (c->body_left >= 0)
+		c->body_left -= n;
+	}
+    }
+    if (n < 0) {
+	conn_failed(w, c);
+    } else if (n == 0) {
+	// closed: that ends a response without a length, else it's cut short
+	if (c->header_len > 0 && c->body_left < 0)
+	    conn_finish(w, c, 0);
+	else
+	    conn_failed(w, c);
+    } else if (c->header_len > 0 && c->body_left == 0) {
+	conn_finish(w, c, c->keep);
+    }
+}
+
+static void *load_worker(void *arg) {
+    worker_t *w = arg;
+    load_t *l = w->load;
+    static __thread char scratch[1 << 16];
+    struct epoll_event events[64];
+    double interval = 1e9 / l->rate;
+    uint64_t seq = w->id; // requests seq, seq + threads, ...
+
+    for (;;) {
+	uint64_t now = now_ns();
+	// send what is due, as far as there are idle connections
+	while (now < l->stop && w->idle != NULL) {
+	    uint64_t due = l->start + (uint64_t) (seq * interval);
+	    if (due >= l->stop || due > now)
+		break;
+	    conn_t *c = w->idle;
+	    w->idle = c->next;
+	    if (due + 1000000 < now)
+		w->late++; // sent more than 1ms late, for want of a connection
+	    if (conn_send(w, c, seq, due) < 0)
+		conn_failed(w, c);
+	    seq += l->threads;
+	}
+	uint64_t due = l->start + (uint64_t) (seq * interval);
+	int stopped = due >= l->stop || now >= l->stop;
+	if (stopped && (w->busy == 0 || now >= l->drain))
+	    break;
+
+	// wait for responses, and for the next request to be due, if there is
+	// a connection for it
+	uint64_t until = due;
+	if (stopped)
+	    until = l->drain;
+	else if (w->idle == NULL)
+	    until = l->stop;
+	int timeout = until > now ? (int) ((until - now + 999999) / 1000000) : 0;
+	int n = epoll_wait(w->epfd, events, 64, timeout);
+	if (n < 0 && errno != EINTR) {
+	    perror("epoll_wait");
+	    exit(1);
+	}
+	for (int i = 0; i < n; i++) {
+	    conn_t *c = events[i].data.ptr;
+	    if (c->fd >= 0)
+		conn_read(w, c, scratch, sizeof(scratch));
+	}
+    }
+    // requests still due were never sent, for want of a connection, and
+    // whatever is still in flight timed out
+    while (l->start + (uint64_t) (seq * interval) < l->stop) {
+	w->unsent++;
+	seq += l->threads;
+    }
+    for (int i = 0; i < w->nconns; i++) {
+	if (w->conns[i].busy)
+	    w->errors++;
+	conn_close(&w->conns[i]);
+    }
+    return NULL;
+}
+
+static void load_run(char *host, int port, char *urifile,
+		     int threads, int conns, double rate, double seconds) {
+    load_t l;
+    if (threads < 1 || conns < threads || rate <= 0 || seconds <= 0) {
+	fprintf(stderr, "load: need 1 <= threads <= connections, and a positive rate and time\n");
+	exit(1);
+    }
+    l.host = host;
+    l.port = port;
+    gethostname_or_die(l.hostname, MAXBUF);
+    l.uris = load_uris(urifile, &l.nuris);
+    if (l.nuris == 0) {
+	fprintf(stderr, "load: no URIs in %s\n", urifile);
+	exit(1);
+    }
+    l.threads = threads;
+    l.conns = conns;
+    l.rate = rate;
+    signal(SIGPIPE, SIG_IGN);
+
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    assert(workers != NULL);
+    for (int t = 0; t < threads; t++) {
+	worker_t *w = &workers[t];
+	w->load = &l;
+	w->id = t;
+	w->epfd = epoll_create1(0);
+	assert(w->epfd >= 0);
+	w->nconns = conns / threads + (t < conns % threads);
+	w->conns = calloc(w->nconns, sizeof(conn_t));
+	assert(w->conns != NULL);
+	for (int i = 0; i < w->nconns; i++) {
+	    conn_t *c = &w->conns[i];
+	    if (conn_open(w, c) < 0) {
+		fprintf(stderr, "load: cannot connect to %s:%d\n", host, port);
+		exit(1);
+	    }
+	    conn_idle(w, c);
+	}
+    }
+
+    l.start = now_ns();
+    l.stop = l.start + (uint64_t) (seconds * 1e9);
+    l.drain = l.stop + 1000000000; // a second for the last answers
+    for (int t = 0; t < threads; t++)
+	pthread_create(&workers[t].thread, NULL, load_worker, &workers[t]);
+
+    hist_t *all = calloc(1, sizeof(hist_t));
+    assert(all != NULL);
+    uint64_t done = 0, bad = 0, errors = 0, late = 0, unsent = 0, bytes = 0;
+    for (int t = 0; t < threads; t++) {
+	worker_t *w = &workers[t];
+	pthread_join(w->thread, NULL);
+	hist_merge(all, &w->hist);
+	done += w->done;
+	bad += w->bad;
+	errors += w->errors;
+	late += w->late;
+	unsent += w->unsent;
+	bytes += w->bytes;
+	close(w->epfd);
+	free(w->conns);
+    }
+    double elapsed = (now_ns() - l.start) / 1e9;
+
+    printf("requests: %lu done, %lu not 2xx, %lu failed, %lu sent late, %lu never sent\n",
+	   (unsigned long) done, (unsigned long) bad, (unsigned long) errors,
+	   (unsigned long) late, (unsigned long) unsent);
+    printf("throughput: %.1f requests/s (%.1f wanted), %.2f MB/s\n",
+	   done / elapsed, rate, bytes / elapsed / 1e6);
+    printf("latency: p50 %.3fms p99 %.3fms p999 %.3fms max %.3fms\n",
+	   hist_percentile(all, 0.5) / 1e6, hist_percentile(all, 0.99) / 1e6,
+	   hist_percentile(all, 0.999) / 1e6, all->max / 1e6);
+
+    free(all);
+    free(workers);
+    for (int i = 0; i < l.nuris; i++)
+	free(l.uris[i]);
+    free(l.uris);
+}
+
 int main(int argc, char *argv[]) {
     char *host, *filename;
     int port;
     int clientfd;
     
+    if (argc == 9 && strcmp(argv[1], "-l") == 0) {
+	load_run(argv[2], atoi(argv[3]), argv[4], atoi(argv[5]), atoi(argv[6]),
+		 atof(argv[7]), atof(argv[8]));
+	exit(0);
+    }
+
     if (argc != 4) {
 	fprintf(stderr, "Usage: %s <host> <port> <filename>\n", argv[0]);
+	fprintf(stderr, "       %s -l <host> <port> <urifile> <threads> <connections> <rate> <seconds>\n", argv[0]);
 	exit(1);
     }
     